@@ -0,0 +1,733 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/aggregator.hh>
+#include <klogger/logger.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// Datagrams are read DATAGRAM_BATCH at a time with recvmmsg(2); larger
+// datagrams than MAX_DATAGRAM are dropped.
+constexpr size_t	DATAGRAM_BATCH = 32;
+constexpr size_t	MAX_DATAGRAM = 65536;
+
+// A worker reads at most READ_ROUNDS times from a socket per wakeup so
+// that one busy client can't starve the rest, and writes its batch out
+// early once it reaches BATCH_LIMIT bytes.
+constexpr int		READ_ROUNDS = 16;
+constexpr size_t	READ_CHUNK = 65536;
+constexpr size_t	BATCH_LIMIT = 1 << 20;
+
+// A connection that sends more than MAX_FRAME bytes without completing
+// a frame is dropped.
+constexpr size_t	MAX_FRAME = 16 << 20;
+
+constexpr int		MAX_EVENTS = 64;
+
+
+namespace {
+
+
+// A Conn is a client connected to the stream socket; seq is the last
+// batch read from it, and acked the last acknowledged.
+struct Conn {
+	std::int64_t	pid;
+	std::string	buf;
+	std::uint64_t	seq;
+	std::uint64_t	acked;
+};
+
+
+} // anonymous namespace
+
+
+// A Worker is one epoll loop and everything it owns. stats is shared
+// with clients(), under lock; pending holds the counts for the batch
+// being built, which are added to stats once it is written.
+struct Aggregator::Worker {
+	Worker() : epfd(-1), runner(), lock(), stats(), pending(), conns(),
+	    batch(), text(), decoder(), records(),
+	    datagrams(DATAGRAM_BATCH * MAX_DATAGRAM) {};
+
+	int					epfd;
+	std::thread				runner;
+	std::mutex				lock;
+	std::map<std::int64_t, ClientStats>	stats;
+	std::map<std::int64_t, ClientStats>	pending;
+	std::map<int, Conn>			conns;
+	std::string				batch;
+	std::string				text;
+	tlv::Decoder				decoder;
+	std::vector<Record>			records;
+	std::vector<char>			datagrams;
+
+	ClientStats&
+	client(std::int64_t pid)
+	{
+		auto	it = this->pending.find(pid);
+
+		if (it == this->pending.end()) {
+			it = this->pending.insert(std::make_pair(pid,
+			    ClientStats{pid, 0, 0, 0})).first;
+		}
+		return it->second;
+	}
+};
+
+
+// count_entries counts the log entries filling buf from off to end,
+// returning false if they don't fill it exactly.
+static bool
+count_entries(const std::string& buf, size_t off, size_t end, size_t& count)
+{
+	count = 0;
+	while (off < end) {
+		std::uint8_t	tag;
+		std::uint64_t	length;
+
+		if (!tlv::read_header(buf, off, tag, length) ||
+		    tlv::TLogEntry != tag || off > end || length > end - off) {
+			return false;
+		}
+		off += static_cast<size_t>(length);
+		count++;
+	}
+	return true;
+}
+
+
+// bind_unix binds a new non-blocking unix socket of the given type at
+// path, replacing anything there.
+static int
+bind_unix(const std::string& path, int type)
+{
+	struct sockaddr_un	addr;
+	int			sock;
+
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+
+	::unlink(path.c_str());
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::memcpy(addr.sun_path, path.data(), path.size());
+
+	sock = ::socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (-1 == sock) {
+		return -1;
+	}
+
+	if (-1 == ::bind(sock, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr))) {
+		::close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+
+Aggregator::Aggregator(const AggregatorConfig& c)
+    : config(c), datagram_fd(-1), listen_fd(-1), wake_fd(-1), workers(),
+      out_lock(), out_fd(-1), out_size(0), err(LogError::HEALTHY)
+{
+}
+
+
+Aggregator::~Aggregator()
+{
+	this->stop();
+}
+
+
+bool
+Aggregator::start(void)
+{
+	struct stat	st;
+	int		on = 1;
+	size_t		nthreads = this->config.threads;
+
+	this->out_fd = open_logfd(this->config.logfile, false);
+	if (-1 == this->out_fd || -1 == ::fstat(this->out_fd, &st)) {
+		this->err.store(LogError::ERR_OPEN);
+		return false;
+	}
+	this->out_size = static_cast<std::uint64_t>(st.st_size);
+
+	this->wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (-1 == this->wake_fd) {
+		return false;
+	}
+
+	if (!this->config.datagram_path.empty()) {
+		this->datagram_fd = bind_unix(this->config.datagram_path,
+		    SOCK_DGRAM);
+		if (-1 == this->datagram_fd) {
+			return false;
+		}
+
+		// Have the kernel attach each sender's credentials.
+		::setsockopt(this->datagram_fd, SOL_SOCKET, SO_PASSCRED, &on,
+		    sizeof(on));
+	}
+
+	if (!this->config.stream_path.empty()) {
+		this->listen_fd = bind_unix(this->config.stream_path,
+		    SOCK_STREAM);
+		if (-1 == this->listen_fd ||
+		    -1 == ::listen(this->listen_fd, SOMAXCONN)) {
+			return false;
+		}
+	}
+
+	if (0 == nthreads) {
+		nthreads = 1;
+	}
+
+	for (size_t i = 0; i < nthreads; i++) {
+		std::unique_ptr<Worker>	w(new Worker());
+		struct epoll_event	ev;
+
+		w->epfd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (-1 == w->epfd) {
+			return false;
+		}
+
+		// Every worker wakes to stop, but only one is woken for
+		// each datagram or new connection.
+		::memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = this->wake_fd;
+		::epoll_ctl(w->epfd, EPOLL_CTL_ADD, this->wake_fd, &ev);
+
+		for (int fd : {this->datagram_fd, this->listen_fd}) {
+			if (-1 == fd) {
+				continue;
+			}
+			ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+			ev.data.fd = fd;
+			::epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+		}
+
+		this->workers.push_back(std::move(w));
+	}
+
+	for (auto& w : this->workers) {
+		Worker	*p = w.get();
+
+		w->runner = std::thread([this, p]() { this->run(*p); });
+	}
+
+	return true;
+}
+
+
+void
+Aggregator::stop(void)
+{
+	if (-1 != this->wake_fd) {
+		std::uint64_t	one = 1;
+
+		(void)::write(this->wake_fd, &one, sizeof(one));
+	}
+
+	for (auto& w : this->workers) {
+		if (w->runner.joinable()) {
+			w->runner.join();
+		}
+		if (-1 != w->epfd) {
+			::close(w->epfd);
+			w->epfd = -1;
+		}
+	}
+
+	if (-1 != this->datagram_fd) {
+		::close(this->datagram_fd);
+		::unlink(this->config.datagram_path.c_str());
+		this->datagram_fd = -1;
+	}
+
+	if (-1 != this->listen_fd) {
+		::close(this->listen_fd);
+		::unlink(this->config.stream_path.c_str());
+		this->listen_fd = -1;
+	}
+
+	if (-1 != this->wake_fd) {
+		::close(this->wake_fd);
+		this->wake_fd = -1;
+	}
+
+	std::lock_guard<std::mutex>	lock(this->out_lock);
+	if (-1 != this->out_fd) {
+		::close(this->out_fd);
+		this->out_fd = -1;
+	}
+}
+
+
+void
+Aggregator::run(Worker& w)
+{
+	struct epoll_event	events[MAX_EVENTS];
+	bool			stopping = false;
+
+	while (!stopping) {
+		int	n = ::epoll_wait(w.epfd, events, MAX_EVENTS, -1);
+
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			int	fd = events[i].data.fd;
+
+			if (fd == this->wake_fd) {
+				stopping = true;
+			}
+			else if (fd == this->datagram_fd) {
+				this->read_datagrams(w);
+			}
+			else if (fd == this->listen_fd) {
+				this->accept_clients(w);
+			}
+			else if (!this->read_stream(w, fd)) {
+				::epoll_ctl(w.epfd, EPOLL_CTL_DEL, fd, nullptr);
+				::close(fd);
+				w.conns.erase(fd);
+			}
+
+			if (w.batch.size() >= BATCH_LIMIT) {
+				this->flush(w);
+			}
+		}
+
+		this->flush(w);
+	}
+
+	// Datagrams already queued when stopping are still written.
+	if (-1 != this->datagram_fd) {
+		this->read_datagrams(w);
+		this->flush(w);
+	}
+
+	for (auto& c : w.conns) {
+		::close(c.first);
+	}
+	w.conns.clear();
+}
+
+
+// sender returns the pid in a datagram's credentials, or zero.
+static std::int64_t
+sender(struct msghdr& msg)
+{
+	for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+	    cm = CMSG_NXTHDR(&msg, cm)) {
+		if (SOL_SOCKET == cm->cmsg_level &&
+		    SCM_CREDENTIALS == cm->cmsg_type) {
+			struct ucred	cred;
+
+			::memcpy(&cred, CMSG_DATA(cm), sizeof(cred));
+			return cred.pid;
+		}
+	}
+	return 0;
+}
+
+
+void
+Aggregator::read_datagrams(Worker& w)
+{
+	struct mmsghdr	msgs[DATAGRAM_BATCH];
+	struct iovec	iov[DATAGRAM_BATCH];
+	char		control[DATAGRAM_BATCH][CMSG_SPACE(sizeof(struct ucred))];
+
+	for (int round = 0; round < READ_ROUNDS; round++) {
+		int	n;
+
+		::memset(msgs, 0, sizeof(msgs));
+		for (size_t i = 0; i < DATAGRAM_BATCH; i++) {
+			iov[i].iov_base = w.datagrams.data() + i * MAX_DATAGRAM;
+			iov[i].iov_len = MAX_DATAGRAM;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_control = control[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+		}
+
+		n = ::recvmmsg(this->datagram_fd, msgs, DATAGRAM_BATCH,
+		    MSG_DONTWAIT, nullptr);
+		if (n <= 0) {
+			return;
+		}
+
+		for (int i = 0; i < n; i++) {
+			ClientStats&	c = w.client(sender(msgs[i].msg_hdr));
+			size_t		start = w.batch.size();
+			size_t		length = msgs[i].msg_len;
+			size_t		count;
+
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				c.dropped++;
+				continue;
+			}
+
+			w.batch.append(static_cast<char *>(iov[i].iov_base),
+			    length);
+			if (!count_entries(w.batch, start, w.batch.size(),
+			    count)) {
+				w.batch.resize(start);
+				c.dropped++;
+				continue;
+			}
+
+			c.records += count;
+			c.bytes += length;
+		}
+
+		if (n < static_cast<int>(DATAGRAM_BATCH)) {
+			return;
+		}
+	}
+}
+
+
+void
+Aggregator::accept_clients(Worker& w)
+{
+	while (true) {
+		struct epoll_event	ev;
+		struct ucred		cred;
+		socklen_t		len = sizeof(cred);
+		int			fd;
+
+		fd = ::accept4(this->listen_fd, nullptr, nullptr,
+		    SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (-1 == fd) {
+			return;
+		}
+
+		if (-1 == ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred,
+		    &len)) {
+			cred.pid = 0;
+		}
+
+		::memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (-1 == ::epoll_ctl(w.epfd, EPOLL_CTL_ADD, fd, &ev)) {
+			::close(fd);
+			continue;
+		}
+
+		w.conns.erase(fd);
+		w.conns.insert(std::make_pair(fd,
+		    Conn{cred.pid, std::string(), 0, 0}));
+	}
+}
+
+
+// read_stream reads what a client has sent and moves its whole entries
+// and batches onto the worker's batch. It returns false once the
+// connection should be closed.
+bool
+Aggregator::read_stream(Worker& w, int fd)
+{
+	auto	it = w.conns.find(fd);
+	bool	open = true;
+
+	if (it == w.conns.end()) {
+		return false;
+	}
+
+	Conn&		conn = it->second;
+	ClientStats&	c = w.client(conn.pid);
+	size_t		off = 0;
+
+	for (int round = 0; round < READ_ROUNDS; round++) {
+		size_t	have = conn.buf.size();
+		ssize_t	n;
+
+		conn.buf.resize(have + READ_CHUNK);
+		n = ::recv(fd, &conn.buf[have], READ_CHUNK, MSG_DONTWAIT);
+		conn.buf.resize(have + static_cast<size_t>(n > 0 ? n : 0));
+
+		if (n < 0 && EINTR == errno) {
+			continue;
+		}
+		if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+			break;
+		}
+		if (n <= 0) {
+			open = false;
+			break;
+		}
+		if (static_cast<size_t>(n) < READ_CHUNK) {
+			break;
+		}
+	}
+
+	while (off < conn.buf.size()) {
+		size_t		pos = off;
+		std::uint8_t	tag;
+		std::uint64_t	length;
+
+		if (!tlv::read_header(conn.buf, pos, tag, length)) {
+			if (conn.buf.size() - off > MAX_FRAME) {
+				c.dropped++;
+				return false;
+			}
+			break;
+		}
+
+		if (tlv::TLogEntry == tag) {
+			size_t	end = pos + static_cast<size_t>(length);
+
+			w.batch.append(conn.buf, off, end - off);
+			c.records++;
+			c.bytes += end - off;
+			off = end;
+			continue;
+		}
+
+		if (tlv::TBatch != tag) {
+			c.dropped++;
+			return false;
+		}
+
+		std::uint64_t	seq;
+		size_t		entries;
+		size_t		count;
+
+		pos = off;
+		if (!tlv::read_batch(conn.buf, pos, seq, entries)) {
+			c.dropped++;
+			return false;
+		}
+
+		if (count_entries(conn.buf, pos, pos + entries, count)) {
+			w.batch.append(conn.buf, pos, entries);
+			c.records += count;
+			c.bytes += entries;
+		}
+		else {
+			c.dropped++;
+		}
+
+		// A malformed batch is acknowledged all the same, since
+		// sending it again won't help.
+		conn.seq = seq;
+		off = pos + entries;
+	}
+
+	conn.buf.erase(0, off);
+	return open;
+}
+
+
+// flush writes the worker's batch to the log, adds its counts to the
+// worker's stats, and acknowledges the batches it held. If the write
+// fails, the batch's records are counted as dropped and nothing is
+// acknowledged, so NetLogger clients send them again.
+void
+Aggregator::flush(Worker& w)
+{
+	LogError	result = LogError::HEALTHY;
+
+	if (w.pending.empty()) {
+		return;
+	}
+
+	if (!w.batch.empty() && this->config.text) {
+		w.records.clear();
+		w.text.clear();
+		w.decoder.decode(w.batch, w.records);
+		for (auto& r : w.records) {
+			format_log(w.text, r.level, r.when, r.actor, r.event,
+			    r.attrs);
+		}
+		result = this->write_out(w.text);
+	}
+	else if (!w.batch.empty()) {
+		result = this->write_out(w.batch);
+	}
+	w.batch.clear();
+
+	{
+		std::lock_guard<std::mutex>	lock(w.lock);
+
+		for (auto& p : w.pending) {
+			auto	it = w.stats.find(p.first);
+
+			if (it == w.stats.end()) {
+				it = w.stats.insert(std::make_pair(p.first,
+				    ClientStats{p.first, 0, 0, 0})).first;
+			}
+
+			if (LogError::HEALTHY == result) {
+				it->second.records += p.second.records;
+				it->second.bytes += p.second.bytes;
+			}
+			else {
+				it->second.dropped += p.second.records;
+			}
+			it->second.dropped += p.second.dropped;
+		}
+	}
+	w.pending.clear();
+
+	if (LogError::HEALTHY != result) {
+		return;
+	}
+
+	for (auto& p : w.conns) {
+		Conn&	conn = p.second;
+		std::string	ack;
+
+		if (conn.seq == conn.acked) {
+			continue;
+		}
+
+		tlv::append_ack(ack, conn.seq);
+		if (::send(p.first, ack.data(), ack.size(),
+		    MSG_DONTWAIT | MSG_NOSIGNAL) ==
+		    static_cast<ssize_t>(ack.size())) {
+			conn.acked = conn.seq;
+		}
+	}
+}
+
+
+// write_out appends buf to the log, rotating it once it is full.
+LogError
+Aggregator::write_out(const std::string& buf)
+{
+	std::lock_guard<std::mutex>	lock(this->out_lock);
+	LogError			result = LogError::ERR_CLOSED;
+
+	if (-1 != this->out_fd) {
+		result = write_fd(this->out_fd, buf.data(), buf.size());
+	}
+	this->err.store(result);
+	if (LogError::HEALTHY != result) {
+		return result;
+	}
+
+	this->out_size += buf.size();
+	if (this->config.rotate_size > 0 &&
+	    this->out_size >= this->config.rotate_size) {
+		this->rotate();
+	}
+	return result;
+}
+
+
+// rotate moves each kept file up by one, dropping the oldest, and
+// starts a new log. The caller must hold out_lock.
+void
+Aggregator::rotate(void)
+{
+	const std::string&	path = this->config.logfile;
+
+	::close(this->out_fd);
+	for (size_t i = this->config.keep; i > 0; i--) {
+		std::string	from = path;
+
+		if (i > 1) {
+			from += "." + std::to_string(i - 1);
+		}
+		::rename(from.c_str(), (path + "." + std::to_string(i)).c_str());
+	}
+
+	this->out_fd = open_logfd(path, true);
+	this->out_size = 0;
+	if (-1 == this->out_fd) {
+		this->err.store(errno_error(errno));
+	}
+}
+
+
+std::vector<ClientStats>
+Aggregator::clients(void)
+{
+	std::map<std::int64_t, ClientStats>	merged;
+	std::vector<ClientStats>		out;
+
+	for (auto& w : this->workers) {
+		std::lock_guard<std::mutex>	lock(w->lock);
+
+		for (auto& p : w->stats) {
+			auto	it = merged.find(p.first);
+
+			if (it == merged.end()) {
+				merged.insert(p);
+				continue;
+			}
+			it->second.records += p.second.records;
+			it->second.bytes += p.second.bytes;
+			it->second.dropped += p.second.dropped;
+		}
+	}
+
+	for (auto& p : merged) {
+		out.push_back(p.second);
+	}
+	return out;
+}
+
+
+bool
+Aggregator::good(void) const
+{
+	return LogError::HEALTHY == this->err.load();
+}
+
+
+} // namespace klog
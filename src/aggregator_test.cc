@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/aggregator.hh>
+#include <klogger/console.hh>
+#include <klogger/netlog.hh>
+#include <klogger/tlv.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	DGRAM = "aggregator_test.dgram";
+static const string	STREAM = "aggregator_test.sock";
+static const string	LOG = "aggregator_test.log";
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static vector<klog::Record>
+read_log(const string& path)
+{
+	klog::tlv::Decoder	decoder;
+	vector<klog::Record>	records;
+
+	decoder.decode(read_file(path), records);
+	return records;
+}
+
+
+static bool
+file_exists(const string& path)
+{
+	struct stat	st;
+
+	return 0 == ::stat(path.c_str(), &st);
+}
+
+
+static klog::AggregatorConfig
+config(bool text, uint64_t rotate_size)
+{
+	return klog::AggregatorConfig{DGRAM, STREAM, LOG, text, rotate_size,
+	    3, 2};
+}
+
+
+// stats returns the counters for pid, waiting up to a couple of
+// seconds for want records to arrive.
+static klog::ClientStats
+stats(klog::Aggregator& agg, int64_t pid, uint64_t want)
+{
+	auto	deadline = chrono::steady_clock::now() + chrono::seconds(2);
+
+	while (true) {
+		for (auto& c : agg.clients()) {
+			if (c.pid == pid && (c.records >= want ||
+			    chrono::steady_clock::now() > deadline)) {
+				return c;
+			}
+		}
+
+		if (chrono::steady_clock::now() > deadline) {
+			return klog::ClientStats{pid, 0, 0, 0};
+		}
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+}
+
+
+static int
+connect_datagram(void)
+{
+	struct sockaddr_un	addr;
+	int			fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::strncpy(addr.sun_path, DGRAM.c_str(), sizeof(addr.sun_path) - 1);
+	if (-1 == ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr))) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+// send_datagrams sends count entries to the datagram socket, per
+// entries to a datagram, pausing between datagrams if pause is set.
+static bool
+send_datagrams(int count, int per, size_t padding, bool pause)
+{
+	int	fd = connect_datagram();
+	string	buf;
+
+	if (-1 == fd) {
+		return false;
+	}
+
+	for (int i = 0; i < count;) {
+		buf.clear();
+		for (int j = 0; j < per && i < count; j++, i++) {
+			klog::tlv::append_tlv_log(buf,
+			    static_cast<uint8_t>(klog::Level::INFO), 0,
+			    "test", "datagram", {{"seq", to_string(i)},
+			    {"padding", string(padding, 'x')}});
+		}
+		if (-1 == ::send(fd, buf.data(), buf.size(), 0)) {
+			::close(fd);
+			return false;
+		}
+		if (pause) {
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+	}
+
+	::close(fd);
+	return true;
+}
+
+
+// send_garbage sends a datagram that isn't a log entry.
+static bool
+send_garbage(void)
+{
+	int	fd = connect_datagram();
+	string	buf = "\x11\x05garbage";
+	bool	ok;
+
+	if (-1 == fd) {
+		return false;
+	}
+	ok = -1 != ::send(fd, buf.data(), buf.size(), 0);
+	::close(fd);
+	return ok;
+}
+
+
+static int
+test_datagrams(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::Aggregator	agg(config(false, 0));
+
+	if (!agg.start()) {
+		console.error("test_datagrams", "failed to start");
+		return 0;
+	}
+
+	pid_t	pid = ::fork();
+	int	status = 0;
+
+	if (0 == pid) {
+		bool	ok = send_datagrams(1000, 10, 0, false) &&
+			    send_garbage();
+
+		::_exit(ok ? 0 : 1);
+	}
+	::waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+		console.error("test_datagrams", "client failed");
+		return 0;
+	}
+
+	auto	c = stats(agg, pid, 1000);
+
+	agg.stop();
+	if (c.records != 1000 || c.dropped != 1 || c.bytes == 0) {
+		console.error("test_datagrams", "bad client counters",
+		    {{"records", to_string(c.records)},
+		     {"dropped", to_string(c.dropped)}});
+		return 0;
+	}
+
+	// The counters survive stopping.
+	if (agg.clients().size() != 1 || agg.clients()[0].pid != pid) {
+		console.error("test_datagrams", "counters lost");
+		return 0;
+	}
+
+	auto	records = read_log(LOG);
+
+	if (records.size() != 1000 || records[999].attrs["seq"] != "999" ||
+	    records[0].event != "datagram") {
+		console.error("test_datagrams", "bad log",
+		    {{"records", to_string(records.size())}});
+		return 0;
+	}
+
+	if (file_exists(DGRAM) || file_exists(STREAM)) {
+		console.error("test_datagrams", "sockets not removed");
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_stream(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::Aggregator	agg(config(false, 0));
+
+	if (!agg.start()) {
+		console.error("test_stream", "failed to start");
+		return 0;
+	}
+
+	// A NetLogger logs to the stream socket directly; it only
+	// closes once every batch has been acknowledged.
+	klog::NetLogger	nlog(STREAM, "");
+
+	for (int i = 0; i < 5000; i++) {
+		nlog.info("test", "stream", {{"seq", to_string(i)}});
+	}
+	nlog.close();
+
+	auto	c = stats(agg, ::getpid(), 5000);
+
+	agg.stop();
+	if (nlog.spilled() != 0 || nlog.dropped()[klog::Level::INFO] != 0 ||
+	    c.records != 5000 || c.dropped != 0) {
+		console.error("test_stream", "records not delivered",
+		    {{"records", to_string(c.records)}});
+		return 0;
+	}
+
+	auto	records = read_log(LOG);
+
+	if (records.size() != 5000) {
+		console.error("test_stream", "records lost");
+		return 0;
+	}
+
+	for (int i = 0; i < 5000; i++) {
+		if (records[i].attrs["seq"] != to_string(i)) {
+			console.error("test_stream", "records out of order");
+			return 0;
+		}
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_rotate(void)
+{
+	vector<string>	paths = {LOG, LOG + ".1", LOG + ".2", LOG + ".3",
+			    LOG + ".4"};
+
+	for (auto& path : paths) {
+		::unlink(path.c_str());
+	}
+
+	klog::Aggregator	agg(config(false, 4096));
+
+	if (!agg.start()) {
+		console.error("test_rotate", "failed to start");
+		return 0;
+	}
+
+	// Pausing between datagrams has each written on its own, so
+	// the records spread over more logs than are kept.
+	if (!send_datagrams(100, 5, 200, true)) {
+		console.error("test_rotate", "failed to send");
+		return 0;
+	}
+	stats(agg, ::getpid(), 100);
+	agg.stop();
+
+	for (size_t i = 1; i <= 3; i++) {
+		if (!file_exists(paths[i]) || read_log(paths[i]).empty()) {
+			console.error("test_rotate", "rotated log missing",
+			    {{"log", paths[i]}});
+			return 0;
+		}
+	}
+
+	if (file_exists(paths[4])) {
+		console.error("test_rotate", "too many logs kept");
+		return 0;
+	}
+
+	// The newest records are in the live log, unless it was
+	// rotated by the last write.
+	auto	records = read_log(LOG);
+
+	if (records.empty()) {
+		records = read_log(paths[1]);
+	}
+	if (records.empty() || records.back().attrs["seq"] != "99") {
+		console.error("test_rotate", "bad live log");
+		return 0;
+	}
+
+	for (auto& path : paths) {
+		::unlink(path.c_str());
+	}
+	return 1;
+}
+
+
+static int
+test_text(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::Aggregator	agg(config(true, 0));
+
+	if (!agg.start()) {
+		console.error("test_text", "failed to start");
+		return 0;
+	}
+
+	klog::NetLogger	nlog(STREAM, "");
+
+	for (int i = 0; i < 10; i++) {
+		nlog.warn("test", "text", {{"seq", to_string(i)}});
+	}
+	nlog.close();
+	stats(agg, ::getpid(), 10);
+	agg.stop();
+
+	string	log = read_file(LOG);
+	size_t	lines = 0;
+
+	for (size_t at = log.find("[WARNING] [actor:test event:text] seq=");
+	    at != string::npos;
+	    at = log.find("[WARNING] [actor:test event:text] seq=", at + 1)) {
+		lines++;
+	}
+
+	if (lines != 10) {
+		console.error("test_text", "bad text log",
+		    {{"lines", to_string(lines)}});
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"datagrams", test_datagrams},
+	{"stream", test_stream},
+	{"rotate", test_rotate},
+	{"text", test_text},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("aggregator_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("aggregator_test", "ok");
+}
@@ -0,0 +1,1029 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+// bench contains the throughput benchmarks for the library. Each
+// benchmark is selected by name on the command line, and reports its
+// results through a ConsoleLogger.
+
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/binlog.hh>
+#include <klogger/console.hh>
+#include <klogger/dedup.hh>
+#include <klogger/deferred.hh>
+#include <klogger/fastlog.hh>
+#include <klogger/filelog.hh>
+#include <klogger/flightrec.hh>
+#include <klogger/format.hh>
+#include <klogger/layout.hh>
+#include <klogger/metrics.hh>
+#include <klogger/netlog.hh>
+#include <klogger/percpu.hh>
+#include <klogger/ratelimit.hh>
+#include <klogger/rfc5424.hh>
+#include <klogger/schema.hh>
+#include <klogger/scope.hh>
+#include <klogger/shmlog.hh>
+#include <klogger/syslog.hh>
+#include <klogger/tee.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+constexpr int	RECORDS_PER_THREAD = 100000;
+constexpr int	MAX_THREADS = 64;
+
+
+// NullLogger discards everything written to it; it stands in for a
+// sink when only the cost of the logger in front of it is of interest.
+class NullLogger : public klog::BasicLogger {
+public:
+	void	write(klog::Level, std::uint64_t, const string&, const string&,
+		      const map<string, string>&) {};
+	int	close(void) { return 0; };
+};
+
+
+static double
+elapsed_since(chrono::steady_clock::time_point start)
+{
+	auto	d = chrono::steady_clock::now() - start;
+
+	return chrono::duration<double>(d).count();
+}
+
+
+static void
+report(const string& bench, int threads, long records, double secs)
+{
+	console.info("bench", bench,
+	    {{"threads", to_string(threads)},
+	     {"records", to_string(records)},
+	     {"seconds", to_string(secs)},
+	     {"records/s", to_string(static_cast<long>(records / secs))},
+	     {"ns/record", to_string(secs * 1e9 / records)}});
+}
+
+
+// run_threads drives logger from 1 to MAX_THREADS threads, each thread
+// writing RECORDS_PER_THREAD records.
+static void
+run_threads(const string& bench, klog::BasicLogger& logger)
+{
+	for (int n = 1; n <= MAX_THREADS; n *= 2) {
+		vector<thread>	workers;
+		auto		start = chrono::steady_clock::now();
+
+		for (int t = 0; t < n; t++) {
+			workers.push_back(thread([&logger, t]() {
+				string	id = to_string(t);
+
+				for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+					logger.info("worker", "request",
+					    {{"thread", id},
+					     {"request", "GET /index.html"}});
+				}
+			}));
+		}
+
+		for (auto& w : workers) {
+			w.join();
+		}
+
+		report(bench, n, static_cast<long>(n) * RECORDS_PER_THREAD,
+		    elapsed_since(start));
+	}
+}
+
+
+// run_single writes count records to logger from the calling thread.
+static void
+run_single(const string& bench, klog::BasicLogger& logger, int count)
+{
+	auto	start = chrono::steady_clock::now();
+
+	for (int i = 0; i < count; i++) {
+		logger.info("worker", "request",
+		    {{"thread", "0"},
+		     {"request", "GET /index.html"}});
+	}
+
+	report(bench, 1, count, elapsed_since(start));
+}
+
+
+static int
+bench_threads(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench threads logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::FileLogger	flog(args[0], true);
+
+	if (!flog.good()) {
+		console.error("bench", "failed to open log file",
+		    {{"path", args[0]}});
+		return EXIT_FAILURE;
+	}
+
+	run_threads("threads", flog);
+	return flog.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_percpu compares a single shared sink against a PerCPULogger in
+// front of it. The sink discards records, so only the cost paid by the
+// logging threads is measured.
+static int
+bench_percpu(const vector<string>&)
+{
+	NullLogger		sink;
+	klog::PerCPULogger	percpu(&sink);
+
+	sink.level(klog::Level::DEBUG);
+	run_threads("percpu", percpu);
+	percpu.close();
+	return EXIT_SUCCESS;
+}
+
+
+// bench_deferred compares the time the logging thread spends in a
+// FileLogger against a DeferredLogger in front of the same file. The
+// queue is large enough that the logging thread never waits.
+static int
+bench_deferred(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench deferred logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::FileLogger	flog(args[0], true);
+	klog::OverflowPolicy	policy = {klog::Overflow::Block,
+				    RECORDS_PER_THREAD,
+				    chrono::milliseconds(1000)};
+
+	if (!flog.good()) {
+		console.error("bench", "failed to open log file",
+		    {{"path", args[0]}});
+		return EXIT_FAILURE;
+	}
+
+	run_single("direct", flog, RECORDS_PER_THREAD);
+
+	klog::DeferredLogger	deferred(&flog, policy);
+	auto			start = chrono::steady_clock::now();
+
+	run_single("deferred", deferred, RECORDS_PER_THREAD);
+	deferred.close();
+	report("deferred+drain", 1, RECORDS_PER_THREAD, elapsed_since(start));
+	return flog.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// run_schema writes the same event as run_single through a Schema.
+static void
+run_schema(const string& bench, klog::BasicLogger& logger, int count)
+{
+	static const klog::Schema<2>	request("worker", "request",
+					    {"request", "thread"});
+	const string			id = "0";
+	const string			path = "GET /index.html";
+	auto				start = chrono::steady_clock::now();
+
+	for (int i = 0; i < count; i++) {
+		request.info(logger, path, id);
+	}
+
+	report(bench, 1, count, elapsed_since(start));
+}
+
+
+// bench_schema compares the generic logging call against a Schema for
+// the same event, for both the text and binary file loggers.
+static int
+bench_schema(const vector<string>& args)
+{
+	if (args.size() < 2) {
+		cerr << "Usage: bench schema logfile binlogfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::FileLogger	flog(args[0], true);
+	klog::BinLogger		blog(args[1], true);
+
+	if (!flog.good() || !blog.good()) {
+		console.error("bench", "failed to open log files",
+		    {{"path", args[0]}, {"binpath", args[1]}});
+		return EXIT_FAILURE;
+	}
+
+	run_single("text/generic", flog, RECORDS_PER_THREAD);
+	run_schema("text/schema", flog, RECORDS_PER_THREAD);
+	run_single("tlv/generic", blog, RECORDS_PER_THREAD);
+	run_schema("tlv/schema", blog, RECORDS_PER_THREAD);
+	return flog.good() && blog.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_fastlog measures the cost of a FastLogger site against the
+// generic call to a BinLogger for an event with two integer arguments,
+// and the cost of the same site from 1 to MAX_THREADS threads.
+static int
+bench_fastlog(const vector<string>& args)
+{
+	if (args.size() < 2) {
+		cerr << "Usage: bench fastlog binlogfile fastlogfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::BinLogger		blog(args[0], true);
+	klog::FastLogger	flog(args[1], true);
+	klog::Site<int, long>	sent(flog, klog::Level::INFO, "worker",
+				    "sent", {"thread", "bytes"});
+	const long		count = 10 * RECORDS_PER_THREAD;
+
+	if (!blog.good() || !flog.good()) {
+		console.error("bench", "failed to open log files",
+		    {{"path", args[0]}, {"fastpath", args[1]}});
+		return EXIT_FAILURE;
+	}
+
+	auto	start = chrono::steady_clock::now();
+
+	for (long i = 0; i < RECORDS_PER_THREAD; i++) {
+		blog.info("worker", "sent",
+		    {{"thread", "0"}, {"bytes", to_string(i)}});
+	}
+	report("binlog", 1, RECORDS_PER_THREAD, elapsed_since(start));
+
+	start = chrono::steady_clock::now();
+	for (long i = 0; i < count; i++) {
+		sent.log(0, i);
+	}
+	report("fastlog", 1, count, elapsed_since(start));
+
+	for (int n = 1; n <= MAX_THREADS; n *= 2) {
+		vector<thread>	workers;
+
+		start = chrono::steady_clock::now();
+		for (int t = 0; t < n; t++) {
+			workers.push_back(thread([&sent, t, count]() {
+				for (long i = 0; i < count; i++) {
+					sent.log(t, i);
+				}
+			}));
+		}
+
+		for (auto& w : workers) {
+			w.join();
+		}
+		report("fastlog", n, n * count, elapsed_since(start));
+	}
+
+	flog.close();
+	return flog.error() == klog::LogError::ERR_CLOSED ?
+	    EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_context compares passing the same four attributes on every
+// call against binding them once to a child logger.
+static int
+bench_context(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench context logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::FileLogger	flog(args[0], true);
+	map<string, string>	context = {{"service", "api"},
+					   {"host", "web-1"},
+					   {"request_id", "8f14e45f"},
+					   {"tenant", "acme"}};
+
+	if (!flog.good()) {
+		console.error("bench", "failed to open log file",
+		    {{"path", args[0]}});
+		return EXIT_FAILURE;
+	}
+
+	auto	start = chrono::steady_clock::now();
+
+	for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+		map<string, string>	attrs(context);
+
+		attrs["path"] = "/index.html";
+		flog.info("worker", "request", attrs);
+	}
+	report("generic", 1, RECORDS_PER_THREAD, elapsed_since(start));
+
+	auto	child = flog.with(context);
+
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+		child->info("worker", "request", {{"path", "/index.html"}});
+	}
+	report("context", 1, RECORDS_PER_THREAD, elapsed_since(start));
+	return flog.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_tee compares calling three file loggers in turn against a
+// TeeLogger in front of them.
+static int
+bench_tee(const vector<string>& args)
+{
+	if (args.size() < 3) {
+		cerr << "Usage: bench tee logfile logfile logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::FileLogger	a(args[0], true);
+	klog::FileLogger	b(args[1], true);
+	klog::BinLogger		c(args[2], true);
+	klog::TeeLogger		tee;
+
+	if (!a.good() || !b.good() || !c.good()) {
+		console.error("bench", "failed to open log files");
+		return EXIT_FAILURE;
+	}
+
+	tee.add(&a, klog::Level::INFO);
+	tee.add(&b, klog::Level::INFO);
+	tee.add(&c, klog::Level::INFO);
+
+	auto	start = chrono::steady_clock::now();
+
+	for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+		map<string, string>	attrs = {{"thread", "0"},
+						 {"request", "GET /index.html"}};
+
+		a.info("worker", "request", attrs);
+		b.info("worker", "request", attrs);
+		c.info("worker", "request", attrs);
+	}
+	report("separate", 1, RECORDS_PER_THREAD, elapsed_since(start));
+
+	run_single("tee", tee, RECORDS_PER_THREAD);
+	return tee.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_layout compares the built-in text format with a layout that
+// reproduces it, and with one using its own time format.
+static int
+bench_layout(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench layout logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	map<string, string>	layouts = {
+		{"layout text", ""},
+		{"layout same", "[%{time}] [%{level}] [actor:%{actor} "
+		    "event:%{event}] %{attrs}"},
+		{"layout custom", "%{time:%H:%M:%S}.%{msec} %{level} "
+		    "%{actor}/%{event} path=%{attr:path} %{attrs}"},
+	};
+
+	for (auto& l : layouts) {
+		klog::FileLogger	flog(args[0], true);
+
+		if (!flog.good()) {
+			console.error("bench", "failed to open log file",
+			    {{"path", args[0]}});
+			return EXIT_FAILURE;
+		}
+
+		if (!l.second.empty() && !flog.layout(klog::Layout(l.second))) {
+			console.error("bench", "bad layout");
+			return EXIT_FAILURE;
+		}
+
+		run_single(l.first, flog, RECORDS_PER_THREAD);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+// bench_levels measures the cost of a filtered call with no level
+// overrides and with a table of overrides for other actors.
+static int
+bench_levels(const vector<string>&)
+{
+	NullLogger	sink;
+	const string	actor = "worker";
+	const string	event = "request";
+	const long	count = 10 * RECORDS_PER_THREAD;
+
+	sink.level(klog::Level::INFO);
+
+	auto	start = chrono::steady_clock::now();
+
+	for (long i = 0; i < count; i++) {
+		sink.debug(actor, event);
+	}
+	report("levels/none", 1, count, elapsed_since(start));
+
+	for (int i = 0; i < 100; i++) {
+		sink.level("actor" + to_string(i), klog::Level::DEBUG);
+		sink.level(actor, "event" + to_string(i), klog::Level::DEBUG);
+	}
+
+	start = chrono::steady_clock::now();
+	for (long i = 0; i < count; i++) {
+		sink.debug(actor, event);
+	}
+	report("levels/200", 1, count, elapsed_since(start));
+	return EXIT_SUCCESS;
+}
+
+
+// bench_metrics measures the counters every logger keeps: counting a
+// write, timing a sampled call, and a NullLogger's log call with both.
+// It then reports the sampled latencies and the cost of a snapshot
+// after every thread count has logged.
+static int
+bench_metrics(const vector<string>&)
+{
+	klog::Metrics	metrics;
+	NullLogger	sink;
+	const long	count = 10 * RECORDS_PER_THREAD;
+
+	auto	start = chrono::steady_clock::now();
+
+	for (long i = 0; i < count; i++) {
+		metrics.wrote(klog::Level::INFO, 100);
+	}
+	report("metrics/wrote", 1, count, elapsed_since(start));
+
+	start = chrono::steady_clock::now();
+	for (long i = 0; i < count; i++) {
+		metrics.finish(metrics.start());
+	}
+	report("metrics/sample", 1, count, elapsed_since(start));
+
+	run_single("metrics/null", sink, RECORDS_PER_THREAD);
+	run_threads("metrics/null", sink);
+
+	start = chrono::steady_clock::now();
+
+	klog::MetricsSnapshot	m = sink.metrics();
+	double			secs = elapsed_since(start);
+
+	console.info("bench", "metrics/snapshot",
+	    {{"seconds", to_string(secs)},
+	     {"samples", to_string(m.samples)},
+	     {"p50 ns", to_string(m.percentile(50))},
+	     {"p99 ns", to_string(m.percentile(99))},
+	     {"p99.9 ns", to_string(m.percentile(99.9))}});
+	return EXIT_SUCCESS;
+}
+
+
+// bench_ratelimit measures a RateLimitLogger that passes everything,
+// one that holds back almost everything, and one sampling a level.
+static int
+bench_ratelimit(const vector<string>&)
+{
+	NullLogger		sink;
+	klog::RateLimitLogger	unlimited(&sink, klog::RateLimit{1e9, 1e9});
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{1, 1});
+	klog::RateLimitLogger	sampled(&sink, klog::NO_RATE_LIMIT);
+
+	sampled.sample(klog::Level::INFO, 0.1);
+
+	run_single("ratelimit/pass", unlimited, RECORDS_PER_THREAD);
+	run_single("ratelimit/limited", limited, RECORDS_PER_THREAD);
+	run_single("ratelimit/sampled", sampled, RECORDS_PER_THREAD);
+	run_threads("ratelimit/limited", limited);
+	return EXIT_SUCCESS;
+}
+
+
+// bench_console compares writing each record to standard output as it
+// is logged with batching them. Standard output is pointed at outfile
+// while the records are written.
+static int
+bench_console(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench console outfile\n";
+		return EXIT_FAILURE;
+	}
+
+	int	fd = ::open(args[0].c_str(),
+		    O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	int	saved = ::dup(STDOUT_FILENO);
+
+	if (-1 == fd) {
+		console.error("bench", "failed to open output file",
+		    {{"path", args[0]}});
+		return EXIT_FAILURE;
+	}
+
+	map<string, klog::ConsoleMode>	modes = {
+		{"console line", klog::ConsoleMode::LINE},
+		{"console batch", klog::ConsoleMode::BATCH},
+	};
+
+	for (auto& mode : modes) {
+		klog::ConsoleLogger	clog(mode.second);
+
+		console.flush();
+		::dup2(fd, STDOUT_FILENO);
+
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+			clog.info("worker", "request",
+			    {{"thread", "0"},
+			     {"request", "GET /index.html"}});
+		}
+		clog.flush();
+
+		double	secs = elapsed_since(start);
+
+		::dup2(saved, STDOUT_FILENO);
+		report(mode.first, 1, RECORDS_PER_THREAD, secs);
+	}
+
+	::close(saved);
+	::close(fd);
+	return EXIT_SUCCESS;
+}
+
+
+// bench_json measures the JSON escaping scan against a byte-at-a-time
+// scan over typical attribute values, then compares a FileLogger
+// writing text with one writing JSON.
+static int
+bench_json(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench json logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	vector<string>	values = {
+		"/api/v2/accounts/1837/orders?page=3&limit=50",
+		"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+		"(KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36",
+		"upstream connect error or disconnect/reset before headers. "
+		"retried and the latest reset reason: connection timeout "
+		"after 5000ms while talking to 10.0.4.17:8443 for "
+		"\"orders-svc\"",
+		"7f3c2a9e-5b1d-4c8a-9f0e-2d6b8a1c4e73",
+	};
+	size_t		bytes = 0;
+
+	for (auto& v : values) {
+		bytes += v.size();
+	}
+
+	map<string, size_t (*)(const char *, size_t)>	scans = {
+		{string("json scan ") + klog::json::scanner(),
+		 klog::json::scan},
+		{"json scan scalar", klog::json::scan_scalar},
+	};
+
+	for (auto& scan : scans) {
+		size_t	found = 0;
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < RECORDS_PER_THREAD * 10; i++) {
+			for (auto& v : values) {
+				found += scan.second(v.data(), v.size());
+			}
+		}
+
+		double	secs = elapsed_since(start);
+
+		console.info("bench", scan.first,
+		    {{"MB/s", to_string(bytes * RECORDS_PER_THREAD * 10 /
+		      secs / 1e6)},
+		     {"found", to_string(found)}});
+	}
+
+	map<string, klog::Format>	formats = {
+		{"json text", klog::Format::TEXT},
+		{"json json", klog::Format::JSON},
+	};
+
+	for (auto& f : formats) {
+		klog::FileLogger	flog(args[0], true);
+
+		if (!flog.good()) {
+			console.error("bench", "failed to open log file",
+			    {{"path", args[0]}});
+			return EXIT_FAILURE;
+		}
+
+		flog.format(f.second);
+
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+			flog.info("http", "request",
+			    {{"path", values[0]},
+			     {"agent", values[1]},
+			     {"error", values[2]},
+			     {"request_id", values[3]}});
+		}
+
+		report(f.first, 1, RECORDS_PER_THREAD, elapsed_since(start));
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+// bench_logfmt measures the logfmt quoting scan against a byte-at-a-time
+// scan, the cost of writing logfmt records, and the rate at which the
+// parser reads them back.
+static int
+bench_logfmt(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench logfmt logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	vector<string>	values = {
+		"/api/v2/accounts/1837/orders",
+		"Mozilla/5.0_(X11;_Linux_x86_64)_AppleWebKit/537.36_"
+		"(KHTML,_like_Gecko)_Chrome/126.0.0.0_Safari/537.36",
+		"upstream connect error or disconnect/reset before headers",
+		"7f3c2a9e-5b1d-4c8a-9f0e-2d6b8a1c4e73",
+	};
+	size_t		bytes = 0;
+
+	for (auto& v : values) {
+		bytes += v.size();
+	}
+
+	map<string, size_t (*)(const char *, size_t)>	scans = {
+		{string("logfmt scan ") + klog::logfmt::scanner(),
+		 klog::logfmt::scan},
+		{"logfmt scan scalar", klog::logfmt::scan_scalar},
+	};
+
+	for (auto& scan : scans) {
+		size_t	found = 0;
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < RECORDS_PER_THREAD * 10; i++) {
+			for (auto& v : values) {
+				found += scan.second(v.data(), v.size());
+			}
+		}
+
+		double	secs = elapsed_since(start);
+
+		console.info("bench", scan.first,
+		    {{"MB/s", to_string(bytes * RECORDS_PER_THREAD * 10 /
+		      secs / 1e6)},
+		     {"found", to_string(found)}});
+	}
+
+	{
+		klog::FileLogger	flog(args[0], true);
+
+		if (!flog.good()) {
+			console.error("bench", "failed to open log file",
+			    {{"path", args[0]}});
+			return EXIT_FAILURE;
+		}
+
+		flog.format(klog::Format::LOGFMT);
+
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+			flog.info("http", "request",
+			    {{"path", values[0]},
+			     {"agent", values[1]},
+			     {"error", values[2]},
+			     {"request_id", values[3]}});
+		}
+
+		report("logfmt write", 1, RECORDS_PER_THREAD,
+		    elapsed_since(start));
+	}
+
+	ifstream		in(args[0], ios::binary);
+	string			log((istreambuf_iterator<char>(in)),
+				    istreambuf_iterator<char>());
+	klog::logfmt::Parser	parser;
+	vector<klog::Record>	records;
+	auto			start = chrono::steady_clock::now();
+
+	for (size_t off = 0; off < log.size(); off += 65536) {
+		parser.feed(log.data() + off, min<size_t>(65536,
+		    log.size() - off), records);
+	}
+	parser.finish(records);
+	report("logfmt parse", 1, static_cast<long>(records.size()),
+	    elapsed_since(start));
+
+	return parser.malformed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// bench_dedup compares queueing a stream of identical records with
+// collapsing them in front of the queue.
+static int
+bench_dedup(const vector<string>&)
+{
+	NullLogger		sink;
+	klog::DeferredLogger	deferred(&sink);
+	klog::DedupLogger	dedup(&deferred);
+
+	run_single("dedup/deferred", deferred, RECORDS_PER_THREAD);
+	deferred.flush();
+	run_single("dedup/dedup", dedup, RECORDS_PER_THREAD);
+	dedup.close();
+	deferred.close();
+	return EXIT_SUCCESS;
+}
+
+
+// bench_flightrec measures recording records that the sink filters
+// out, and the cost of a dump.
+static int
+bench_flightrec(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench flightrec dumpfile\n";
+		return EXIT_FAILURE;
+	}
+
+	NullLogger		sink;
+	klog::FlightRecorder	recorder(&sink, args[0]);
+
+	sink.level(klog::Level::WARN);
+	run_single("flightrec", recorder, RECORDS_PER_THREAD);
+	run_threads("flightrec", recorder);
+
+	auto	start = chrono::steady_clock::now();
+
+	if (!recorder.dump()) {
+		console.error("bench", "dump failed");
+		return EXIT_FAILURE;
+	}
+	report("flightrec/dump", 1, 1, elapsed_since(start));
+	return EXIT_SUCCESS;
+}
+
+
+// bench_scope measures requests of ten DEBUG records that succeed, so
+// their records are discarded, and ones that fail.
+static int
+bench_scope(const vector<string>&)
+{
+	NullLogger	sink;
+	const int	requests = RECORDS_PER_THREAD / 10;
+
+	sink.level(klog::Level::INFO);
+	for (int fail = 0; fail < 2; fail++) {
+		auto	start = chrono::steady_clock::now();
+
+		for (int i = 0; i < requests; i++) {
+			klog::RequestScope	scope(&sink);
+
+			for (int j = 0; j < 10; j++) {
+				scope.debug("worker", "step",
+				    {{"request", "GET /index.html"}});
+			}
+
+			if (fail) {
+				scope.error("worker", "failed");
+			}
+		}
+		report(fail ? "scope/failed" : "scope/succeeded", 1,
+		    requests * 10, elapsed_since(start));
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+// bench_rfc5424 compares Syslogger, which goes through syslog(3) to
+// /dev/log, with a DatagramSyslogger sending to a stand-in daemon that
+// reads and discards every message.
+static int
+bench_rfc5424(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench rfc5424 socket\n";
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_un	addr;
+	int			fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+	atomic<bool>		done(false);
+
+	::unlink(args[0].c_str());
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::strncpy(addr.sun_path, args[0].c_str(), sizeof(addr.sun_path) - 1);
+	if (-1 == ::bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr))) {
+		console.error("bench", "failed to bind socket",
+		    {{"path", args[0]}});
+		return EXIT_FAILURE;
+	}
+
+	thread	daemon([fd, &done]() {
+		char		buf[8192];
+		struct pollfd	pfd = {fd, POLLIN, 0};
+
+		while (!done.load()) {
+			if (::poll(&pfd, 1, 50) > 0) {
+				(void)::recv(fd, buf, sizeof(buf), 0);
+			}
+		}
+	});
+
+	{
+		klog::Syslogger	slog("bench", klog::syslog::Facility::User,
+				    {});
+
+		run_single("rfc5424/syslog(3)", slog, RECORDS_PER_THREAD);
+	}
+
+	klog::DatagramSyslogger	dlog("bench", klog::syslog::Facility::User,
+				     args[0]);
+
+	run_single("rfc5424/datagram", dlog, RECORDS_PER_THREAD);
+	dlog.flush();
+	run_threads("rfc5424/datagram", dlog);
+	dlog.close();
+
+	done.store(true);
+	daemon.join();
+	::close(fd);
+	::unlink(args[0].c_str());
+	return EXIT_SUCCESS;
+}
+
+
+// bench_netlog streams records to a collector listening on a unix
+// socket, such as the reference collector; with none there, it
+// measures the spill path instead.
+static int
+bench_netlog(const vector<string>& args)
+{
+	if (args.size() < 2) {
+		cerr << "Usage: bench netlog socket spillfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::NetLogger	nlog(args[0], args[1]);
+	string		bench = nlog.connected() ? "netlog" : "netlog/spill";
+
+	run_single(bench, nlog, RECORDS_PER_THREAD);
+	nlog.flush();
+	run_threads(bench, nlog);
+
+	auto	start = chrono::steady_clock::now();
+
+	nlog.close();
+	console.info("bench", bench + " close",
+	    {{"seconds", to_string(elapsed_since(start))},
+	     {"spilled", to_string(nlog.spilled())}});
+	return EXIT_SUCCESS;
+}
+
+
+// bench_shmlog writes to a ShmLogger while a collector on another
+// thread drains its ring into logfile, as a collector process would.
+static int
+bench_shmlog(const vector<string>& args)
+{
+	if (args.size() < 1) {
+		cerr << "Usage: bench shmlog logfile\n";
+		return EXIT_FAILURE;
+	}
+
+	klog::ShmLogger		slog("klog_bench");
+	klog::ShmCollector	collector("klog_bench", args[0], false);
+	atomic<bool>		done(false);
+	atomic<long>		collected(0);
+
+	thread	drainer([&collector, &done, &collected]() {
+		while (!done.load()) {
+			size_t	n = collector.drain();
+
+			collected += static_cast<long>(n);
+			if (0 == n) {
+				this_thread::sleep_for(chrono::microseconds(100));
+			}
+		}
+	});
+
+	run_single("shmlog", slog, RECORDS_PER_THREAD);
+	run_threads("shmlog", slog);
+
+	done.store(true);
+	drainer.join();
+	collected += static_cast<long>(collector.drain());
+	slog.close();
+	collector.drain();
+
+	console.info("bench", "shmlog collected",
+	    {{"records", to_string(collected.load())},
+	     {"dropped", to_string(slog.dropped()[klog::Level::INFO])}});
+	return EXIT_SUCCESS;
+}
+
+
+static map<string, function<int(const vector<string>&)>> benches = {
+	{"console", bench_console},
+	{"context", bench_context},
+	{"dedup", bench_dedup},
+	{"deferred", bench_deferred},
+	{"fastlog", bench_fastlog},
+	{"flightrec", bench_flightrec},
+	{"json", bench_json},
+	{"layout", bench_layout},
+	{"levels", bench_levels},
+	{"logfmt", bench_logfmt},
+	{"metrics", bench_metrics},
+	{"netlog", bench_netlog},
+	{"percpu", bench_percpu},
+	{"ratelimit", bench_ratelimit},
+	{"rfc5424", bench_rfc5424},
+	{"schema", bench_schema},
+	{"scope", bench_scope},
+	{"shmlog", bench_shmlog},
+	{"tee", bench_tee},
+	{"threads", bench_threads},
+};
+
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2 || benches.count(argv[1]) == 0) {
+		cerr << "Usage: " << argv[0] << " benchmark [args...]\n";
+		cerr << "Benchmarks:";
+		for (auto it = benches.begin(); it != benches.end(); it++) {
+			cerr << " " << it->first;
+		}
+		cerr << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	vector<string>	args(argv + 2, argv + argc);
+
+	return benches[argv[1]](args);
+}
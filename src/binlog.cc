@@ -21,12 +21,11 @@
  */
 
 
+
 #include <cstdint>
-#include <fstream>
-#include <iostream>
-#include <sstream>
 #include <map>
-#include <unistd.h>
+#include <string>
+#include <vector>
 
 #include <klogger/logger.hh>
 #include <klogger/binlog.hh>
@@ -37,289 +36,107 @@
 namespace klog {
 
 
-constexpr auto	BIN_DEFAULT_FLAGS = std::ofstream::out | std::ofstream::app;
-constexpr auto	BIN_TRUNC_FLAGS = std::ofstream::out | std::ofstream::trunc;
-
-
-static void
-write_tlv_log(std::ostream& outs,
-	      Level level,
-	      const std::string& actor,
-	      const std::string& event,
-	      std::map<std::string, std::string> attrs)
-{
-	auto		lvl = static_cast<std::underlying_type<Level>::type>(level);
-
-	if (tlv::write_tlv_log(outs, lvl, actor, event, attrs)) {
-		outs.flush();
-	}
-}
-
 BinLogger::BinLogger(std::string logfile, bool truncate)
-    : outs(nullptr), errs(nullptr), ilevel(DEFAULT_LEVEL),
-      err(LogError::HEALTHY)
+    : BasicLogger(), files({{LEVELS_ALL, logfile}}, truncate)
 {
-	auto	flags = BIN_DEFAULT_FLAGS;
-
-	if (truncate) {
-		flags = BIN_TRUNC_FLAGS;
-	}
-
-	try {
-		this->outs.open(logfile, flags);
-		this->errs.open(logfile, BIN_DEFAULT_FLAGS);
-	}
-	catch (std::ifstream::failure &e) {
-		this->err = LogError::ERR_OPEN;
-		return;
-	}
-
-	if (!this->outs.good()) {
+	if (!this->files.open_all()) {
 		this->err = LogError::ERR_OPEN;
-		return;
-	}
-	else if (!this->errs.good()) {
-		this->err = LogError::ERR_OPEN;
-		return;
 	}
 }
 
 
 BinLogger::BinLogger(std::string logfile, std::string errfile,
 		       bool truncate)
-    : outs(nullptr), errs(nullptr), ilevel(DEFAULT_LEVEL),
-      err(LogError::HEALTHY)
+    : BasicLogger(),
+      files({{Level::DEBUG | Level::INFO, logfile},
+	     {at_or_above(Level::WARN), errfile}}, truncate)
 {
-	auto	flags = BIN_DEFAULT_FLAGS;
-
-	if (truncate) {
-		flags = BIN_TRUNC_FLAGS;
-	}
-
-	try {
-		this->outs.open(logfile, flags);
-		this->errs.open(errfile, flags);
-	}
-	catch (std::ifstream::failure &e) {
-		this->err = LogError::ERR_OPEN;
-		return;
-	}
-
-
-	if (!this->outs.good()) {
+	if (!this->files.open_all()) {
 		this->err = LogError::ERR_OPEN;
-		return;
-	}
-	else if (!this->errs.good()) {
-		this->err = LogError::ERR_OPEN;
-		return;
 	}
 }
 
-void
-BinLogger::debug(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_tlv_log(this->outs, Level::DEBUG, actor, event, attrs);
-	this->set_err();
-}
-
-
-void
-BinLogger::debug(const std::string& actor,
-		     const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_tlv_log(this->outs, Level::DEBUG, actor, event, {});
-	this->set_err();
-}
-
-
-void
-BinLogger::info(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_tlv_log(this->outs, Level::INFO, actor, event, attrs);
-	this->set_err();
-}
-
-
-void
-BinLogger::info(const std::string& actor,
-		    const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_tlv_log(this->outs, Level::INFO, actor, event, {});
-	this->set_err();
-}
-
 
-void
-BinLogger::warn(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_tlv_log(this->errs, Level::WARN, actor, event, attrs);
-	this->set_err();
-}
-
-
-void
-BinLogger::warn(const std::string& actor,
-		    const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_tlv_log(this->errs, Level::WARN, actor, event, {});
-	this->set_err();
-}
-
-
-void
-BinLogger::error(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_tlv_log(this->errs, Level::ERROR, actor, event, attrs);
-	this->set_err();
-}
-
-
-void
-BinLogger::error(const std::string& actor,
-		     const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_tlv_log(this->errs, Level::ERROR, actor, event, {});
-	this->set_err();
-}
-
-
-void
-BinLogger::critical(const std::string& actor,
-			const std::string& event,
-			std::map<std::string, std::string> attrs) 
-{
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_tlv_log(this->errs, Level::CRITICAL, actor, event, attrs);
-	this->set_err();
-}
-
-
-void
-BinLogger::critical(const std::string& actor,
-			const std::string& event)
+BinLogger::BinLogger(const std::vector<Route>& routes, bool truncate)
+    : BasicLogger(), files(routes, truncate)
 {
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_tlv_log(this->errs, Level::CRITICAL, actor, event, {});
-	this->set_err();
 }
 
 
-void
-BinLogger::fatal(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+BinLogger::~BinLogger()
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, attrs);
-	this->set_err();
-	exit(EXIT_FAILURE);
+	this->close();
 }
 
 
 void
-BinLogger::fatal(const std::string& actor,
-		     const std::string& event)
+BinLogger::write(Level l, std::uint64_t when,
+		 const std::string& actor,
+		 const std::string& event,
+		 const std::map<std::string, std::string>& attrs)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, {});
-	this->set_err();
-	exit(EXIT_FAILURE);
-}
+	if (!this->files.routed(l)) {
+		return;
+	}
 
+	std::string&	buf = thread_buffer();
 
-void
-BinLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, attrs);
-	this->set_err();
-	exit(exitcode);
+	tlv::append_entry(buf, l, when, actor, event, attrs);
+	this->commit(l, buf);
 }
 
 
 void
-BinLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event)
+BinLogger::write_body(Level l, std::uint64_t when, const Body& body)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, {});
-	this->set_err();
-	exit(exitcode);
-}
+	if (!this->files.routed(l)) {
+		return;
+	}
 
+	std::string&	buf = thread_buffer();
 
-void
-BinLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event,
-			    std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, attrs);
-	this->set_err();
+	tlv::append_entry(buf, l, when, body);
+	this->commit(l, buf);
 }
 
 
 void
-BinLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event)
+BinLogger::commit(Level l, const std::string& buf)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_tlv_log(this->errs, Level::FATAL, actor, event, {});
-	this->set_err();
-}
-
+	LogError	result;
 
-void
-BinLogger::level(Level l)
-{
-	this->ilevel = l;
+	result = this->files.write(l, buf.data(), buf.size());
+	if (LogError::HEALTHY != result) {
+		this->fail(result);
+		return;
+	}
+	this->count_write(l, buf.size());
 }
 
 
 bool
-BinLogger::good()
-{
-	return this->err == LogError::HEALTHY;
-}
-
+BinLogger::write_emergency(Level l, std::uint64_t when,
+			   const char *actor, const char *event,
+			   const char *key, long value)
+{
+	EmergencyBuffer	b;
+	LogError	result;
+
+	format_emergency_tlv(b, l, when, actor, event, key, value);
+	result = this->files.write_emergency(l, b.data, b.used);
+	if (LogError::HEALTHY != result) {
+		this->err = result;
+		return false;
+	}
 
-LogError
-BinLogger::error()
-{
-	return this->err;
+	return true;
 }
 
 
 int
 BinLogger::close()
 {
-	if (-1 == ::close(STDOUT_FILENO)) {
-		this->err = LogError::ERR_CLOSEFAIL;
-		return -1;
-	}
-
-	if (-1 == ::close(STDERR_FILENO)) {
+	if (-1 == this->files.close()) {
 		this->err = LogError::ERR_CLOSEFAIL;
 		return -1;
 	}
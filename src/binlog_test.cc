@@ -22,12 +22,50 @@
 
 
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <getopt.h>
 
 #include <klogger/binlog.hh>
+#include <klogger/console.hh>
+#include <klogger/tlv.hh>
+
+
+// read_log decodes a binary log, as written by a BinLogger or a
+// FastLogger, and writes its records to the console.
+static int
+read_log(const char *path)
+{
+	std::ifstream			in(path, std::ios::binary);
+	std::stringstream		contents;
+	std::vector<klog::Record>	records;
+	klog::tlv::Decoder		decoder;
+	klog::ConsoleLogger		console;
+	bool				ok;
+
+	if (!in.good()) {
+		std::cerr << "Failed to open " << path << "\n";
+		return EXIT_FAILURE;
+	}
+
+	contents << in.rdbuf();
+	ok = decoder.decode(contents.str(), records);
+
+	console.level(klog::Level::DEBUG);
+	for (auto& r : records) {
+		console.write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+
+	if (!ok) {
+		std::cerr << path << ": malformed log\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
 
 
 int
@@ -43,8 +81,12 @@ main(int argc, char *argv[])
 	while (-1 != (opt = ::getopt(argc, argv, "r"))) {
 		switch (opt) {
 		case 'r':
-			std::cerr << "Not implemented.\n";
-			exit(1);
+			if (optind >= argc) {
+				std::cerr << "Usage: " << argv[0]
+					  << " -r logfile\n";
+				exit(EXIT_FAILURE);
+			}
+			exit(read_log(argv[optind]));
 		default:
 			::abort();
 		}
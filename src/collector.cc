@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+// collector is a reference collector for NetLogger: it accepts
+// connections on a TCP port or a unix stream socket, writes the entries
+// of each connection's batches to a binary log file of its own in the
+// output directory, and acknowledges every batch once it is written.
+//
+// With -s, it drains the shared memory rings of the ShmLoggers with the
+// given name into one log file instead, in text with -t.
+
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <klogger/console.hh>
+#include <klogger/shmlog.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static atomic<uint64_t>	streams(0);
+
+// With nothing to collect, the ring collector sleeps for IDLE_WAIT.
+constexpr chrono::milliseconds	IDLE_WAIT(10);
+
+
+static void
+usage(const char *prog)
+{
+	cerr << "Usage: " << prog << " [-p port | -u path] [-d dir]\n";
+	cerr << "       " << prog << " -s name -o logfile [-t]\n";
+	exit(EXIT_FAILURE);
+}
+
+
+static int
+listen_tcp(uint16_t port)
+{
+	struct sockaddr_in	addr;
+	int			on = 1;
+	int			sock = ::socket(AF_INET, SOCK_STREAM, 0);
+
+	if (-1 == sock) {
+		return -1;
+	}
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (-1 == ::bind(sock, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr)) || -1 == ::listen(sock, 64)) {
+		::close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+
+static int
+listen_unix(const string& path)
+{
+	struct sockaddr_un	addr;
+	int			sock;
+
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+
+	::unlink(path.c_str());
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::memcpy(addr.sun_path, path.data(), path.size());
+
+	sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == sock) {
+		return -1;
+	}
+
+	if (-1 == ::bind(sock, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr)) || -1 == ::listen(sock, 64)) {
+		::close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+
+// serve reads batches from sock until the sender goes away, appending
+// their entries to the stream's log file and acknowledging them after
+// each read.
+static void
+serve(int sock, string dir)
+{
+	string		path = dir + "/stream-" + to_string(::time(nullptr)) +
+			    "-" + to_string(++streams) + ".bin";
+	int		out = klog::open_logfd(path, false);
+	string		buf;
+	char		chunk[65536];
+	uint64_t	batches = 0;
+	uint64_t	bytes = 0;
+
+	if (-1 == out) {
+		console.error("collector", "failed to open stream log",
+		    {{"path", path}, {"error", ::strerror(errno)}});
+		::close(sock);
+		return;
+	}
+	console.info("collector", "stream opened", {{"path", path}});
+
+	while (true) {
+		ssize_t		n = ::recv(sock, chunk, sizeof(chunk), 0);
+		size_t		off = 0;
+		uint64_t	seq = 0;
+		size_t		length;
+		bool		acked = true;
+		bool		failed = false;
+
+		if (n < 0 && EINTR == errno) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		buf.append(chunk, static_cast<size_t>(n));
+
+		while (klog::tlv::read_batch(buf, off, seq, length)) {
+			if (klog::LogError::HEALTHY != klog::write_fd(out,
+			    buf.data() + off, length)) {
+				console.error("collector", "write failed",
+				    {{"path", path}});
+				failed = true;
+				break;
+			}
+			off += length;
+			bytes += length;
+			batches++;
+			acked = false;
+		}
+
+		if (failed) {
+			break;
+		}
+
+		// Whatever is left must be the start of a batch; a whole
+		// record that read_batch rejected won't become one.
+		size_t		pos = off;
+		uint8_t		tag;
+		uint64_t	value_length;
+
+		if (off < buf.size() &&
+		    (klog::tlv::TBatch != static_cast<uint8_t>(buf[off]) ||
+		    klog::tlv::read_header(buf, pos, tag, value_length))) {
+			console.error("collector", "malformed stream",
+			    {{"path", path}});
+			break;
+		}
+		buf.erase(0, off);
+
+		if (!acked) {
+			string	ack;
+
+			klog::tlv::append_ack(ack, seq);
+			if (klog::LogError::HEALTHY != klog::write_fd(sock,
+			    ack.data(), ack.size())) {
+				break;
+			}
+		}
+	}
+
+	console.info("collector", "stream closed",
+	    {{"path", path},
+	     {"batches", to_string(batches)},
+	     {"bytes", to_string(bytes)}});
+	::close(out);
+	::close(sock);
+}
+
+
+// drain_rings collects the rings named name into logfile until the
+// process is killed.
+static void
+drain_rings(const string& name, const string& logfile, bool text)
+{
+	klog::ShmCollector	collector(name, logfile, text);
+
+	if (!collector.good()) {
+		console.fatal("collector", "failed to open log",
+		    {{"path", logfile}});
+	}
+	console.info("collector", "draining rings",
+	    {{"name", name}, {"path", logfile}});
+
+	while (true) {
+		if (0 == collector.drain()) {
+			this_thread::sleep_for(IDLE_WAIT);
+		}
+	}
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	string	dir = ".";
+	string	path;
+	string	ring;
+	string	logfile;
+	bool	text = false;
+	long	port = 0;
+	int	sock;
+	int	c;
+
+	while (-1 != (c = ::getopt(argc, argv, "d:o:p:s:tu:"))) {
+		switch (c) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'o':
+			logfile = optarg;
+			break;
+		case 'p':
+			port = ::strtol(optarg, nullptr, 10);
+			break;
+		case 's':
+			ring = optarg;
+			break;
+		case 't':
+			text = true;
+			break;
+		case 'u':
+			path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!ring.empty()) {
+		if (logfile.empty()) {
+			usage(argv[0]);
+		}
+		drain_rings(ring, logfile, text);
+	}
+
+	if ((port == 0) == path.empty() || port < 0 || port > 65535) {
+		usage(argv[0]);
+	}
+
+	if (path.empty()) {
+		sock = listen_tcp(static_cast<uint16_t>(port));
+	}
+	else {
+		sock = listen_unix(path);
+	}
+
+	if (-1 == sock) {
+		console.fatal("collector", "failed to listen",
+		    {{"error", ::strerror(errno)}});
+	}
+	console.info("collector", "listening", {{"dir", dir}});
+
+	while (true) {
+		int	conn = ::accept(sock, nullptr, nullptr);
+
+		if (-1 == conn) {
+			if (EINTR == errno || ECONNABORTED == errno) {
+				continue;
+			}
+			console.fatal("collector", "accept failed",
+			    {{"error", ::strerror(errno)}});
+		}
+
+		thread(serve, conn, dir).detach();
+	}
+}
@@ -21,10 +21,18 @@
  */
 
 
-#include <iostream>
-#include <map>
+
+#include <pthread.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include <klogger/logger.hh>
 #include <klogger/console.hh>
 #include <internal.hh>
@@ -33,198 +41,341 @@
 namespace klog {
 
 
-void
-ConsoleLogger::debug(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+constexpr size_t	CONSOLE_BUFFER = 65536;
+constexpr auto		MAX_DELAY = std::chrono::milliseconds(100);
+
+
+namespace {
+
+
+// A ConsoleStream holds the records batched for one standard
+// descriptor, and when the oldest of them was batched.
+struct ConsoleStream {
+	explicit ConsoleStream(int d) : fd(d), pending(), since() {};
+
+	int					fd;
+	std::string				pending;
+	std::chrono::steady_clock::time_point	since;
+};
+
+
+// The standard descriptors are process-wide, so their buffers and the
+// lock guarding them are as well. Appending to one stream first writes
+// out the other, so at most one of them has records pending. err holds
+// a write error from the flusher for the next logger to report.
+struct Console {
+	Console() : lock(), wake(), out(STDOUT_FILENO), errs(STDERR_FILENO),
+	    err(LogError::HEALTHY), flusher(false), exiting(false) {};
+
+	std::mutex		lock;
+	std::condition_variable	wake;
+	ConsoleStream		out;
+	ConsoleStream		errs;
+	LogError		err;
+	bool			flusher;
+	bool			exiting;
+};
+
+
+} // anonymous namespace
+
+
+static Console&	console_state(void);
+
+
+// write_pending writes out s's records, returning false if there were
+// none; the caller holds the lock.
+static bool
+write_pending(Console& c, ConsoleStream& s)
 {
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_log(std::cout, Level::DEBUG, actor, event, attrs);
+	if (s.pending.empty()) {
+		return false;
+	}
+
+	LogError	result = write_fd(s.fd, s.pending.data(),
+			    s.pending.size());
+
+	s.pending.clear();
+	if (LogError::HEALTHY != result) {
+		c.err = result;
+	}
+	return true;
 }
 
 
-void
-ConsoleLogger::debug(const std::string& actor,
-		     const std::string& event)
+// The flusher writes out records that have waited MAX_DELAY, sleeping
+// while there are none. It is detached, as the Console outlives
+// everything else.
+static void
+run_flusher(Console& c)
 {
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_log(std::cout, Level::DEBUG, actor, event, {});
+	std::unique_lock<std::mutex>	lock(c.lock);
+
+	while (c.flusher) {
+		ConsoleStream&	s = c.out.pending.empty() ? c.errs : c.out;
+
+		if (s.pending.empty()) {
+			c.wake.wait(lock);
+			continue;
+		}
+
+		if (s.since + MAX_DELAY <= std::chrono::steady_clock::now()) {
+			write_pending(c, s);
+		}
+		else {
+			c.wake.wait_until(lock, s.since + MAX_DELAY);
+		}
+	}
 }
 
 
-void
-ConsoleLogger::info(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
+// At exit, batched records are written out, and anything logged after
+// that is written directly.
+static void
+flush_at_exit(void)
 {
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_log(std::cout, Level::INFO, actor, event, attrs);
+	Console&			c = console_state();
+	std::lock_guard<std::mutex>	lock(c.lock);
+
+	write_pending(c, c.out);
+	write_pending(c, c.errs);
+	c.exiting = true;
 }
 
 
-void
-ConsoleLogger::info(const std::string& actor,
-		    const std::string& event)
+// A forked child mustn't write its parent's batched records, and has
+// no flusher.
+static void
+lock_for_fork(void)
 {
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_log(std::cout, Level::INFO, actor, event, {});
+	console_state().lock.lock();
 }
 
 
-void
-ConsoleLogger::warn(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
+static void
+unlock_parent(void)
 {
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_log(std::cerr, Level::WARN, actor, event, attrs);
+	console_state().lock.unlock();
 }
 
 
-void
-ConsoleLogger::warn(const std::string& actor,
-		    const std::string& event)
+static void
+unlock_child(void)
 {
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_log(std::cerr, Level::WARN, actor, event, {});
+	Console&	c = console_state();
+
+	c.out.pending.clear();
+	c.errs.pending.clear();
+	c.flusher = false;
+	c.lock.unlock();
 }
 
 
-void
-ConsoleLogger::error(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+// The Console is never destroyed, so loggers may still be used by
+// other objects' destructors.
+static Console&
+console_state(void)
 {
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_log(std::cerr, Level::ERROR, actor, event, attrs);
+	static Console	*c = []() {
+		Console	*state = new Console();
+
+		std::atexit(flush_at_exit);
+		::pthread_atfork(lock_for_fork, unlock_parent, unlock_child);
+		return state;
+	}();
+
+	return *c;
 }
 
 
-void
-ConsoleLogger::error(const std::string& actor,
-		     const std::string& event)
+// resolve_mode returns true if records to fd should be written a line
+// at a time.
+static bool
+resolve_mode(ConsoleMode mode, int fd)
 {
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_log(std::cerr, Level::ERROR, actor, event, {});
+	switch (mode) {
+	case ConsoleMode::LINE:
+		return true;
+	case ConsoleMode::BATCH:
+		return false;
+	default:
+		return 1 == ::isatty(fd);
+	}
 }
 
 
-void
-ConsoleLogger::critical(const std::string& actor,
-			const std::string& event,
-			std::map<std::string, std::string> attrs) 
+ConsoleLogger::ConsoleLogger(void)
+    : BasicLogger(),
+      line_out(resolve_mode(ConsoleMode::AUTO, STDOUT_FILENO)),
+      line_err(resolve_mode(ConsoleMode::AUTO, STDERR_FILENO)),
+      formatter()
 {
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_log(std::cerr, Level::CRITICAL, actor, event, attrs);
 }
 
 
-void
-ConsoleLogger::critical(const std::string& actor,
-			const std::string& event)
+ConsoleLogger::ConsoleLogger(ConsoleMode mode)
+    : BasicLogger(),
+      line_out(resolve_mode(mode, STDOUT_FILENO)),
+      line_err(resolve_mode(mode, STDERR_FILENO)),
+      formatter()
 {
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_log(std::cerr, Level::CRITICAL, actor, event, {});
 }
 
 
 void
-ConsoleLogger::fatal(const std::string& actor,
+ConsoleLogger::write(Level l, std::uint64_t when,
+		     const std::string& actor,
 		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+		     const std::map<std::string, std::string>& attrs)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, attrs);
-	exit(EXIT_FAILURE);
+	if (LogError::ERR_CLOSED == this->err.load()) {
+		return;
+	}
+
+	std::string&	buf = thread_buffer();
+
+	this->formatter.record(buf, l, when, actor, event, attrs);
+	this->commit(l, buf);
 }
 
 
 void
-ConsoleLogger::fatal(const std::string& actor,
-		     const std::string& event)
+ConsoleLogger::write_body(Level l, std::uint64_t when, const Body& body)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, {});
-	exit(EXIT_FAILURE);
+	if (LogError::ERR_CLOSED == this->err.load()) {
+		return;
+	}
+
+	std::string&	buf = thread_buffer();
+
+	this->formatter.body(buf, l, when, body);
+	this->commit(l, buf);
 }
 
 
 void
-ConsoleLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+ConsoleLogger::format(Format f)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, attrs);
-	exit(exitcode);
+	this->formatter.format(f);
 }
 
 
-void
-ConsoleLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event)
+Format
+ConsoleLogger::format(void) const
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, {});
-	exit(exitcode);
+	return this->formatter.format();
 }
 
 
-void
-ConsoleLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event,
-			    std::map<std::string, std::string> attrs)
+bool
+ConsoleLogger::layout(const Layout& l)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, attrs);
+	return this->formatter.layout(l);
 }
 
 
 void
-ConsoleLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event)
+ConsoleLogger::commit(Level l, const std::string& buf)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(std::cerr, Level::FATAL, actor, event, {});
+	Console&	c = console_state();
+	bool		to_err = l > Level::INFO;
+	ConsoleStream&	s = to_err ? c.errs : c.out;
+	bool		line = to_err ? this->line_err : this->line_out;
+
+	std::lock_guard<std::mutex>	lock(c.lock);
+
+	if (write_pending(c, to_err ? c.out : c.errs)) {
+		this->count_flush();
+	}
+	if (s.pending.size() + buf.size() > CONSOLE_BUFFER &&
+	    write_pending(c, s)) {
+		this->count_flush();
+	}
+
+	// A buffered record counts as written; a failed batch write
+	// shows up in the error counts.
+	bool	written = true;
+
+	line = line || c.exiting || l >= Level::CRITICAL;
+	if (line && s.pending.empty()) {
+		LogError	result = write_fd(s.fd, buf.data(), buf.size());
+
+		if (LogError::HEALTHY != result) {
+			c.err = result;
+			written = false;
+		}
+	}
+	else {
+		bool	first = s.pending.empty();
+
+		if (first) {
+			s.since = std::chrono::steady_clock::now();
+		}
+		s.pending += buf;
+
+		if (line || s.pending.size() >= CONSOLE_BUFFER) {
+			write_pending(c, s);
+			this->count_flush();
+		}
+		else if (!c.flusher) {
+			c.flusher = true;
+			std::thread(run_flusher, std::ref(c)).detach();
+		}
+		else if (first) {
+			c.wake.notify_one();
+		}
+	}
+
+	if (written) {
+		this->count_write(l, buf.size());
+	}
+	if (LogError::HEALTHY != c.err) {
+		this->fail(c.err);
+		c.err = LogError::HEALTHY;
+	}
 }
 
 
 void
-ConsoleLogger::level(Level l)
+ConsoleLogger::flush(void)
 {
-	this->ilevel = l;
+	Console&			c = console_state();
+	std::lock_guard<std::mutex>	lock(c.lock);
+
+	if (write_pending(c, c.out)) {
+		this->count_flush();
+	}
+	if (write_pending(c, c.errs)) {
+		this->count_flush();
+	}
+	if (LogError::HEALTHY != c.err) {
+		this->fail(c.err);
+		c.err = LogError::HEALTHY;
+	}
 }
 
 
+// The emergency path skips the console lock, so its record may land in
+// the middle of one being written by another thread.
 bool
-ConsoleLogger::good()
+ConsoleLogger::write_emergency(Level l, std::uint64_t when,
+			       const char *actor, const char *event,
+			       const char *key, long value)
 {
-	return this->err == LogError::HEALTHY;
-}
+	EmergencyBuffer	b;
+	int		fd = (l > Level::INFO) ? STDERR_FILENO : STDOUT_FILENO;
 
-
-LogError
-ConsoleLogger::error()
-{
-	return this->err;
+	format_emergency(b, l, when, actor, event, key, value);
+	return LogError::HEALTHY == write_fd(fd, b.data, b.used);
 }
 
 
+// close leaves the standard descriptors open, as other loggers and the
+// rest of the process share them.
 int
 ConsoleLogger::close()
 {
-	if (-1 == ::close(STDOUT_FILENO)) {
-		this->err = LogError::ERR_CLOSEFAIL;
-		return -1;
-	}
-
-	if (-1 == ::close(STDERR_FILENO)) {
-		this->err = LogError::ERR_CLOSEFAIL;
-		return -1;
-	}
-
+	this->flush();
 	this->err = LogError::ERR_CLOSED;
 	return 0;
 }
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	OUT = "consolebuf_test.out";
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static vector<string>
+read_lines(const string& path)
+{
+	string		log = read_file(path);
+	vector<string>	lines;
+	size_t		start = 0;
+
+	for (size_t end = log.find('\n'); end != string::npos;
+	    end = log.find('\n', start)) {
+		lines.push_back(log.substr(start, end - start));
+		start = end + 1;
+	}
+	return lines;
+}
+
+
+// A Redirect points a standard descriptor at another file for as long
+// as it lives.
+class Redirect {
+public:
+	Redirect(int target, int fd) : std_fd(target), saved(::dup(target))
+	{
+		::dup2(fd, target);
+	}
+
+	~Redirect()
+	{
+		::dup2(this->saved, this->std_fd);
+		::close(this->saved);
+	}
+
+private:
+	int	std_fd;
+	int	saved;
+
+	Redirect(const Redirect&) = delete;
+	Redirect&	operator=(const Redirect&) = delete;
+};
+
+
+static int
+open_out(void)
+{
+	return ::open(OUT.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+	    0644);
+}
+
+
+static int
+test_batch(void)
+{
+	int	fd = open_out();
+
+	{
+		Redirect		r(STDOUT_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::BATCH);
+
+		for (int i = 0; i < 100; i++) {
+			clog.info("test", "batch", {{"seq", to_string(i)}});
+		}
+
+		if (!read_file(OUT).empty()) {
+			console.error("test_batch", "records not batched");
+			return 0;
+		}
+
+		clog.flush();
+	}
+	::close(fd);
+
+	auto	lines = read_lines(OUT);
+
+	if (lines.size() != 100 ||
+	    lines[99].find("[actor:test event:batch] seq=99") ==
+	    string::npos) {
+		console.error("test_batch", "records lost");
+		return 0;
+	}
+
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static int
+test_delay(void)
+{
+	int	fd = open_out();
+
+	{
+		Redirect		r1(STDOUT_FILENO, fd);
+		Redirect		r2(STDERR_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::BATCH);
+
+		// Batched records are written once they have waited a
+		// while, without a flush.
+		clog.info("test", "delay");
+		this_thread::sleep_for(chrono::milliseconds(500));
+		if (read_lines(OUT).size() != 1) {
+			console.error("test_delay", "record not written");
+			return 0;
+		}
+
+		// CRITICAL records are written at once.
+		clog.critical("test", "critical");
+		if (read_lines(OUT).size() != 2) {
+			console.error("test_delay", "critical record batched");
+			return 0;
+		}
+	}
+	::close(fd);
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static int
+test_line(void)
+{
+	int	fd = open_out();
+
+	{
+		Redirect		r(STDOUT_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::LINE);
+
+		for (size_t i = 1; i <= 10; i++) {
+			clog.info("test", "line");
+			if (read_lines(OUT).size() != i) {
+				console.error("test_line", "record batched");
+				return 0;
+			}
+		}
+	}
+	::close(fd);
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static int
+test_order(void)
+{
+	int	fd = open_out();
+
+	{
+		Redirect		r1(STDOUT_FILENO, fd);
+		Redirect		r2(STDERR_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::BATCH);
+
+		for (int i = 0; i < 30; i++) {
+			if (i % 3 == 0) {
+				clog.warn("test", "order",
+				    {{"seq", to_string(i)}});
+			}
+			else {
+				clog.info("test", "order",
+				    {{"seq", to_string(i)}});
+			}
+		}
+		clog.flush();
+	}
+	::close(fd);
+
+	auto	lines = read_lines(OUT);
+
+	if (lines.size() != 30) {
+		console.error("test_order", "records lost");
+		return 0;
+	}
+
+	for (int i = 0; i < 30; i++) {
+		string	seq = "seq=" + to_string(i);
+
+		if (lines[i].size() < seq.size() ||
+		    lines[i].compare(lines[i].size() - seq.size(), seq.size(),
+		    seq) != 0) {
+			console.error("test_order", "records out of order");
+			return 0;
+		}
+	}
+
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static int
+test_whole(void)
+{
+	int		fd = open_out();
+	string		big(200000, 'x');
+	vector<thread>	workers;
+
+	{
+		Redirect		r(STDOUT_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::BATCH);
+
+		for (int t = 0; t < 4; t++) {
+			workers.push_back(thread([&clog, &big, t]() {
+				string	id = to_string(t);
+
+				for (int i = 0; i < 2000; i++) {
+					clog.info("test", "whole",
+					    {{"thread", id},
+					     {"seq", to_string(i)}});
+				}
+				clog.info("test", "whole", {{"big", big}});
+			}));
+		}
+
+		for (auto& w : workers) {
+			w.join();
+		}
+		clog.flush();
+	}
+	::close(fd);
+
+	auto			lines = read_lines(OUT);
+	map<string, int>	next;
+	int			bigs = 0;
+
+	if (lines.size() != 8004) {
+		console.error("test_whole", "records lost",
+		    {{"lines", to_string(lines.size())}});
+		return 0;
+	}
+
+	for (auto& line : lines) {
+		size_t	at = line.find("[actor:test event:whole] ");
+
+		if (at == string::npos) {
+			console.error("test_whole", "record split");
+			return 0;
+		}
+
+		string	rest = line.substr(at + 25);
+
+		if (rest == "big=" + big) {
+			bigs++;
+			continue;
+		}
+
+		size_t	space = rest.find(' ');
+		string	thread = rest.substr(space + 1);
+
+		if (rest.substr(0, space) != "seq=" + to_string(next[thread]++)) {
+			console.error("test_whole", "record split");
+			return 0;
+		}
+	}
+
+	if (bigs != 4) {
+		console.error("test_whole", "large record split");
+		return 0;
+	}
+
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static int
+test_auto(void)
+{
+	int	fd = open_out();
+
+	// A file isn't a terminal, so records are batched.
+	{
+		Redirect		r(STDOUT_FILENO, fd);
+		klog::ConsoleLogger	clog;
+
+		clog.info("test", "auto");
+		if (!read_file(OUT).empty()) {
+			console.error("test_auto", "file not batched");
+			return 0;
+		}
+		clog.flush();
+	}
+	::close(fd);
+	::unlink(OUT.c_str());
+
+	// A terminal gets each record at once.
+	int	master = ::posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (-1 == master || -1 == ::grantpt(master) ||
+	    -1 == ::unlockpt(master)) {
+		console.error("test_auto", "no terminal");
+		return 0;
+	}
+
+	int	slave = ::open(::ptsname(master), O_RDWR | O_NOCTTY);
+	bool	ready;
+
+	{
+		Redirect		r(STDOUT_FILENO, slave);
+		klog::ConsoleLogger	clog;
+		struct pollfd		pfd = {master, POLLIN, 0};
+
+		clog.info("test", "auto");
+		ready = 1 == ::poll(&pfd, 1, 50);
+	}
+
+	::close(slave);
+	::close(master);
+	if (!ready) {
+		console.error("test_auto", "terminal batched");
+		return 0;
+	}
+	return 1;
+}
+
+
+// test_close checks that closing a logger writes out its records and
+// leaves the standard streams open for everyone else.
+static int
+test_close(void)
+{
+	int	fd = open_out();
+
+	{
+		Redirect		r(STDOUT_FILENO, fd);
+		klog::ConsoleLogger	clog(klog::ConsoleMode::BATCH);
+
+		clog.info("test", "before");
+		clog.close();
+		clog.info("test", "after");
+		clog.flush();
+
+		if (-1 == ::fcntl(STDOUT_FILENO, F_GETFD) ||
+		    -1 == ::fcntl(STDERR_FILENO, F_GETFD)) {
+			console.error("test_close", "standard stream closed");
+			return 0;
+		}
+	}
+	::close(fd);
+
+	auto	lines = read_lines(OUT);
+
+	if (lines.size() != 1 ||
+	    lines[0].find("event:before") == string::npos) {
+		console.error("test_close", "wrong records written",
+		    {{"lines", to_string(lines.size())}});
+		return 0;
+	}
+
+	::unlink(OUT.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"auto", test_auto},
+	{"batch", test_batch},
+	{"close", test_close},
+	{"delay", test_delay},
+	{"line", test_line},
+	{"order", test_order},
+	{"whole", test_whole},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("consolebuf_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("consolebuf_test", "ok");
+}
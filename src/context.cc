@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// ContextBody is a record from a ContextLogger: the bound attributes,
+// already rendered, followed by the call's own attributes.
+class ContextBody : public Body {
+public:
+	ContextBody(const std::string& actor, const std::string& event,
+		    const std::map<std::string, std::string>& bound,
+		    const std::string& text, const std::string& tlv,
+		    const std::map<std::string, std::string>& attrs) :
+	    ractor(actor), revent(event), bound_attrs(bound),
+	    bound_text(text), bound_tlv(tlv), call_attrs(attrs) {};
+
+	const std::string&
+	actor() const
+	{
+		return this->ractor;
+	}
+
+	const std::string&
+	event() const
+	{
+		return this->revent;
+	}
+
+	void
+	text(std::string& buf) const
+	{
+		buf += "[actor:";
+		buf += this->ractor;
+		buf += " event:";
+		buf += this->revent;
+		buf += "]";
+		buf += this->bound_text;
+		format_attrs(buf, this->call_attrs);
+	}
+
+	void
+	tlv(std::string& buf) const
+	{
+		tlv::append_string(buf, this->ractor);
+		tlv::append_string(buf, this->revent);
+		buf += this->bound_tlv;
+		for (auto& kv : this->call_attrs) {
+			tlv::append_string(buf, kv.first);
+			tlv::append_string(buf, kv.second);
+		}
+	}
+
+	size_t
+	tlv_length() const
+	{
+		size_t	length = this->bound_tlv.size();
+
+		length += tlv::string_length(this->ractor);
+		length += tlv::string_length(this->revent);
+		for (auto& kv : this->call_attrs) {
+			length += tlv::string_length(kv.first);
+			length += tlv::string_length(kv.second);
+		}
+		return length;
+	}
+
+	void
+	attrs(std::map<std::string, std::string>& out) const
+	{
+		out.insert(this->bound_attrs.begin(), this->bound_attrs.end());
+		for (auto& kv : this->call_attrs) {
+			out[kv.first] = kv.second;
+		}
+	}
+
+private:
+	const std::string&				ractor;
+	const std::string&				revent;
+	const std::map<std::string, std::string>&	bound_attrs;
+	const std::string&				bound_text;
+	const std::string&				bound_tlv;
+	const std::map<std::string, std::string>&	call_attrs;
+
+	ContextBody(const ContextBody&) = delete;
+	ContextBody&	operator=(const ContextBody&) = delete;
+};
+
+
+std::unique_ptr<ContextLogger>
+BasicLogger::with(const std::map<std::string, std::string>& attrs)
+{
+	return std::unique_ptr<ContextLogger>(new ContextLogger(this, attrs));
+}
+
+
+ContextLogger::ContextLogger(BasicLogger *logger,
+			     const std::map<std::string, std::string>& bound)
+    : BasicLogger(), parent(logger), attrs(bound), text(), tlv()
+{
+	format_attrs(this->text, this->attrs);
+	for (auto& kv : this->attrs) {
+		tlv::append_string(this->tlv, kv.first);
+		tlv::append_string(this->tlv, kv.second);
+	}
+
+	// The parent's levels and overrides are applied as each record
+	// is written; the child's own level only narrows them.
+	this->level(Level::DEBUG);
+}
+
+
+void
+ContextLogger::write(Level l, std::uint64_t when,
+		     const std::string& actor,
+		     const std::string& event,
+		     const std::map<std::string, std::string>& call)
+{
+	if (!this->parent->enabled(l, actor, event)) {
+		return;
+	}
+
+	// A call attribute that replaces a bound one can't use the
+	// prepared bytes.
+	for (auto& kv : call) {
+		if (this->attrs.count(kv.first) != 0) {
+			std::map<std::string, std::string>	merged(call);
+
+			merged.insert(this->attrs.begin(), this->attrs.end());
+			this->parent->write(l, when, actor, event, merged);
+			return;
+		}
+	}
+
+	ContextBody	body(actor, event, this->attrs, this->text,
+			     this->tlv, call);
+
+	this->parent->write_body(l, when, body);
+}
+
+
+std::unique_ptr<ContextLogger>
+ContextLogger::with(const std::map<std::string, std::string>& more)
+{
+	std::map<std::string, std::string>	merged(more);
+
+	merged.insert(this->attrs.begin(), this->attrs.end());
+
+	std::unique_ptr<ContextLogger>	child(new ContextLogger(this->parent,
+					    merged));
+
+	child->levels(this->levels());
+	return child;
+}
+
+
+const std::map<std::string, std::string>&
+ContextLogger::bound(void) const
+{
+	return this->attrs;
+}
+
+
+bool
+ContextLogger::good(void)
+{
+	return LogError::HEALTHY == this->error();
+}
+
+
+LogError
+ContextLogger::error(void)
+{
+	LogError	own = this->err.load();
+
+	if (LogError::HEALTHY != own) {
+		return own;
+	}
+	return this->parent->error();
+}
+
+
+int
+ContextLogger::close(void)
+{
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
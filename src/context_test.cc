@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/record.hh>
+#include <klogger/tlv.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const map<string, string>	bound = {{"service", "api"},
+						 {"tenant", "acme"}};
+
+
+// BodyLogger keeps the text and TLV renderings of each body written
+// to it.
+class BodyLogger : public CaptureLogger {
+public:
+	BodyLogger() : CaptureLogger(), texts(), tlvs(), lengths() {};
+
+	void
+	write_body(klog::Level, std::uint64_t, const klog::Body& body)
+	{
+		string	text, tlv;
+
+		body.text(text);
+		body.tlv(tlv);
+		this->texts.push_back(text);
+		this->tlvs.push_back(tlv);
+		this->lengths.push_back(body.tlv_length());
+	}
+
+	vector<string>	texts;
+	vector<string>	tlvs;
+	vector<size_t>	lengths;
+};
+
+
+static int
+test_splice(void)
+{
+	BodyLogger	logger;
+	auto		child = logger.with(bound);
+	string		expected;
+
+	child->info("server", "request", {{"path", "/"}});
+	if (logger.texts.size() != 1) {
+		console.error("test_splice", "record not written");
+		return 0;
+	}
+
+	if (logger.texts[0] != "[actor:server event:request] service=api "
+			       "tenant=acme path=/") {
+		console.error("test_splice", "bad text rendering",
+		    {{"text", logger.texts[0]}});
+		return 0;
+	}
+
+	for (auto s : {"server", "request", "service", "api", "tenant",
+		       "acme", "path", "/"}) {
+		klog::tlv::append_string(expected, s);
+	}
+	if (logger.tlvs[0] != expected || logger.lengths[0] != expected.size()) {
+		console.error("test_splice", "bad TLV rendering");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_merge(void)
+{
+	CaptureLogger	logger;
+	auto		child = logger.with(bound);
+	auto		grandchild = child->with({{"request_id", "42"}});
+
+	child->info("server", "request", {{"path", "/"}});
+	child->info("server", "request", {{"tenant", "other"}});
+	grandchild->info("server", "request");
+
+	if (logger.records.size() != 3) {
+		console.error("test_merge", "records lost");
+		return 0;
+	}
+
+	map<string, string>	first = {{"service", "api"},
+					 {"tenant", "acme"}, {"path", "/"}};
+	map<string, string>	second = {{"service", "api"},
+					  {"tenant", "other"}};
+	map<string, string>	third = {{"service", "api"},
+					 {"tenant", "acme"},
+					 {"request_id", "42"}};
+
+	if (logger.records[0].attrs != first) {
+		console.error("test_merge", "call attributes not merged");
+		return 0;
+	}
+	else if (logger.records[1].attrs != second) {
+		console.error("test_merge", "call attribute didn't override");
+		return 0;
+	}
+	else if (logger.records[2].attrs != third) {
+		console.error("test_merge", "nested attributes not merged");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_level(void)
+{
+	CaptureLogger	logger;
+
+	logger.level(klog::Level::WARN);
+
+	auto	child = logger.with(bound);
+
+	child->info("server", "ignored");
+	child->error("server", "error");
+
+	// Changes to the parent reach existing children.
+	logger.level(klog::Level::DEBUG);
+	child->debug("server", "written");
+	logger.level("server", klog::Level::ERROR);
+	child->info("server", "overridden");
+
+	// The child's own level narrows the parent's.
+	logger.clear_levels();
+	child->level(klog::Level::WARN);
+	child->info("server", "narrowed");
+
+	if (logger.records.size() != 2 ||
+	    logger.records[0].event != "error" ||
+	    logger.records[1].event != "written") {
+		console.error("test_level", "level not honoured");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"splice", test_splice},
+	{"merge", test_merge},
+	{"level", test_level},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("context_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("context_test", "ok");
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <klogger/dedup.hh>
+#include <klogger/logger.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// syslogd reports a run at most every 30 seconds.
+constexpr std::chrono::milliseconds	REPEAT_TIMEOUT(30000);
+
+// The timer never wakes more often than this.
+constexpr std::chrono::milliseconds	MIN_TICK(1);
+
+
+// record_hash hashes everything that makes two records duplicates:
+// the level and the body's TLV encoding, whose length prefixes keep
+// neighbouring strings apart. The timestamp is left out.
+static std::uint64_t
+record_hash(Level l, const Body& body)
+{
+	static thread_local std::string	tlv;
+
+	tlv.clear();
+	body.tlv(tlv);
+	return fnv1a(tlv, FNV_OFFSET + level_index(l));
+}
+
+
+DedupLogger::DedupLogger(BasicLogger *out, std::chrono::milliseconds period)
+    : BasicLogger(), sink(out),
+      timeout(std::chrono::duration_cast<std::chrono::nanoseconds>(
+	  period).count()),
+      lock(), have_last(false), last(0), last_level(Level::DEBUG),
+      last_actor(), last_event(), count(0), started(0), latest(0),
+      total(0), wake(), stopping(false), timer()
+{
+	this->timer = std::thread(&DedupLogger::run, this);
+}
+
+
+DedupLogger::DedupLogger(BasicLogger *out)
+    : DedupLogger(out, REPEAT_TIMEOUT)
+{
+}
+
+
+DedupLogger::~DedupLogger()
+{
+	this->close();
+}
+
+
+// duplicate returns true if the record with the given hash repeats the
+// last one. Otherwise, it ends the current run and starts a new one.
+// Either way, if a run is due to be reported, it fills in r and sets
+// ended. The caller must hold the lock.
+bool
+DedupLogger::duplicate(Level l, std::uint64_t when, std::uint64_t hash,
+		       const std::string& actor, const std::string& event,
+		       Record& r, bool& ended)
+{
+	if (this->have_last && hash == this->last &&
+	    l == this->last_level) {
+		if (0 == this->count) {
+			this->started = when;
+		}
+		this->count++;
+		this->total++;
+		this->latest = when;
+
+		ended = false;
+		if (when > this->started &&
+		    when - this->started >= this->timeout) {
+			ended = this->take(r);
+			this->started = when;
+		}
+		return true;
+	}
+
+	ended = this->take(r);
+	this->have_last = true;
+	this->last = hash;
+	this->last_level = l;
+	this->last_actor = actor;
+	this->last_event = event;
+	return false;
+}
+
+
+// take fills in r with the record reporting the current run and starts
+// counting afresh, returning false if the run has no duplicates. The
+// caller must hold the lock.
+bool
+DedupLogger::take(Record& r)
+{
+	if (0 == this->count) {
+		return false;
+	}
+
+	r = Record{this->last_level, this->latest, "klog",
+	    "last record repeated",
+	    {{"actor", this->last_actor}, {"event", this->last_event},
+	     {"repeated", std::to_string(this->count)}}};
+	this->count = 0;
+	return true;
+}
+
+
+// run reports a run once it has been idle for the timeout.
+void
+DedupLogger::run(void)
+{
+	std::unique_lock<std::mutex>	guard(this->lock);
+	std::chrono::nanoseconds	period = std::max(
+					    std::chrono::nanoseconds(
+					    this->timeout),
+					    std::chrono::nanoseconds(MIN_TICK));
+
+	while (!this->stopping) {
+		this->wake.wait_for(guard, period);
+
+		std::uint64_t	t = now();
+		Record		r{Level::WARN, 0, "", "", {}};
+
+		if (this->count > 0 && t > this->latest &&
+		    t - this->latest >= this->timeout && this->take(r)) {
+			guard.unlock();
+			this->sink->write(r.level, r.when, r.actor, r.event,
+			    r.attrs);
+			guard.lock();
+		}
+	}
+}
+
+
+void
+DedupLogger::write(Level l, std::uint64_t when, const std::string& actor,
+		   const std::string& event,
+		   const std::map<std::string, std::string>& attrs)
+{
+	if (!this->sink->enabled(l, actor, event)) {
+		return;
+	}
+
+	MapBody		body(actor, event, attrs);
+	std::uint64_t	h = record_hash(l, body);
+	Record		r{Level::WARN, 0, "", "", {}};
+	bool		ended;
+	bool		repeat;
+
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		repeat = this->duplicate(l, when, h, actor, event, r, ended);
+	}
+
+	if (ended) {
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+	if (!repeat) {
+		this->sink->write(l, when, actor, event, attrs);
+	}
+}
+
+
+void
+DedupLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	if (!this->sink->enabled(l, body.actor(), body.event())) {
+		return;
+	}
+
+	std::uint64_t	h = record_hash(l, body);
+	Record		r{Level::WARN, 0, "", "", {}};
+	bool		ended;
+	bool		repeat;
+
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		repeat = this->duplicate(l, when, h, body.actor(),
+		    body.event(), r, ended);
+	}
+
+	if (ended) {
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+	if (!repeat) {
+		this->sink->write_body(l, when, body);
+	}
+}
+
+
+std::uint64_t
+DedupLogger::repeated(void) const
+{
+	return this->total.load();
+}
+
+
+void
+DedupLogger::flush(void)
+{
+	Record	r{Level::WARN, 0, "", "", {}};
+	bool	ended;
+
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		ended = this->take(r);
+	}
+
+	if (ended) {
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+}
+
+
+int
+DedupLogger::close(void)
+{
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+	if (this->timer.joinable()) {
+		this->timer.join();
+	}
+
+	this->flush();
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
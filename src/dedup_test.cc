@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/dedup.hh>
+#include <klogger/deferred.hh>
+#include <klogger/record.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static int
+test_runs(void)
+{
+	CaptureLogger		sink;
+	klog::DedupLogger	dedup(&sink);
+
+	for (int i = 0; i < 10; i++) {
+		dedup.info("test", "same", {{"k", "v"}});
+	}
+	dedup.info("test", "same", {{"k", "w"}});
+	dedup.warn("test", "same", {{"k", "w"}});
+	dedup.warn("test", "same", {{"k", "w"}});
+	dedup.close();
+
+	// same, repeated 9, k=w, warn, repeated 1.
+	if (sink.records.size() != 5 || dedup.repeated() != 10) {
+		console.error("test_runs", "runs not collapsed",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	auto&	r = sink.records[1];
+	if (r.level != klog::Level::INFO || r.actor != "klog" ||
+	    r.event != "last record repeated" ||
+	    r.attrs["actor"] != "test" || r.attrs["event"] != "same" ||
+	    r.attrs["repeated"] != "9") {
+		console.error("test_runs", "bad repeat record",
+		    {{"repeated", r.attrs["repeated"]}});
+		return 0;
+	}
+
+	if (sink.records[2].attrs["k"] != "w" ||
+	    sink.records[3].level != klog::Level::WARN ||
+	    sink.records[4].attrs["repeated"] != "1") {
+		console.error("test_runs", "run boundaries wrong");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_timeout(void)
+{
+	CaptureLogger		sink;
+	klog::DedupLogger	dedup(&sink, chrono::milliseconds(1000));
+	std::uint64_t		start = klog::now();
+
+	for (int i = 0; i < 5; i++) {
+		dedup.write(klog::Level::INFO, start + i * 400000000ULL,
+		    "test", "slow", {});
+	}
+
+	// The record at 1.6s is over a second after the run started.
+	if (sink.records.size() != 2 ||
+	    sink.records[1].attrs["repeated"] != "4") {
+		console.error("test_timeout", "run not reported on timeout",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	dedup.flush();
+	if (sink.records.size() != 2) {
+		console.error("test_timeout", "empty run reported");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// test_empty_actor checks that records without an actor collapse too.
+static int
+test_empty_actor(void)
+{
+	CaptureLogger		sink;
+	klog::DedupLogger	dedup(&sink);
+
+	for (int i = 0; i < 3; i++) {
+		dedup.info("", "anonymous");
+	}
+	dedup.close();
+
+	if (sink.records.size() != 2 ||
+	    sink.records[1].attrs["repeated"] != "2") {
+		console.error("test_empty_actor", "run not collapsed",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// test_idle checks that a run that goes quiet is reported without
+// another record or a flush.
+static int
+test_idle(void)
+{
+	CaptureLogger		sink;
+	klog::DedupLogger	dedup(&sink, chrono::milliseconds(20));
+
+	for (int i = 0; i < 5; i++) {
+		dedup.info("test", "idle");
+	}
+
+	for (int i = 0; i < 100; i++) {
+		this_thread::sleep_for(chrono::milliseconds(10));
+
+		lock_guard<mutex>	guard(sink.lock);
+
+		if (sink.records.size() == 2) {
+			break;
+		}
+	}
+
+	if (sink.records.size() != 2 ||
+	    sink.records[1].attrs["repeated"] != "4") {
+		console.error("test_idle", "idle run not reported",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_deferred(void)
+{
+	CaptureLogger		sink;
+	klog::DeferredLogger	deferred(&sink);
+	klog::DedupLogger	dedup(&deferred);
+
+	for (int i = 0; i < 1000; i++) {
+		dedup.info("test", "queued", {{"n", to_string(i / 100)}});
+	}
+	dedup.close();
+	deferred.close();
+
+	// Ten distinct records, each followed by a repeat record.
+	if (sink.records.size() != 20) {
+		console.error("test_deferred", "duplicates reached the queue",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	for (size_t i = 0; i < sink.records.size(); i += 2) {
+		if (sink.records[i].attrs["n"] != to_string(i / 2) ||
+		    sink.records[i + 1].attrs["repeated"] != "99") {
+			console.error("test_deferred", "records out of order");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"runs", test_runs},
+	{"timeout", test_timeout},
+	{"deferred", test_deferred},
+	{"empty_actor", test_empty_actor},
+	{"idle", test_idle},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("dedup_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("dedup_test", "ok");
+}
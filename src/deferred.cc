@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/deferred.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The worker wakes at least this often to notice a close.
+constexpr std::chrono::milliseconds	WORKER_WAIT(100);
+
+
+DeferredLogger::DeferredLogger(BasicLogger *out, OverflowPolicy policy)
+    : BasicLogger(), sink(out), drops(), queue(policy, &this->drops),
+      collect(), stopping(false), worker()
+{
+	this->worker = std::thread(&DeferredLogger::run, this);
+}
+
+
+DeferredLogger::DeferredLogger(BasicLogger *out)
+    : DeferredLogger(out, DEFAULT_OVERFLOW)
+{
+}
+
+
+DeferredLogger::~DeferredLogger()
+{
+	this->close();
+}
+
+
+void
+DeferredLogger::write(Level l, std::uint64_t when,
+		      const std::string& actor,
+		      const std::string& event,
+		      const std::map<std::string, std::string>& attrs)
+{
+	PackedRecord	p{l, std::string()};
+
+	pack_record(p, l, when, actor, event, attrs);
+	this->queue.push(std::move(p));
+
+	// Nothing drains the queue once it has been closed.
+	if (Level::FATAL == l || this->stopping.load()) {
+		this->flush();
+	}
+}
+
+
+void
+DeferredLogger::flush()
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+	std::vector<PackedRecord>	batch;
+	Record				r{Level::DEBUG, 0, "", "", {}};
+
+	this->queue.drain(batch);
+	for (auto& p : batch) {
+		if (!unpack_record(p, r)) {
+			this->err = LogError::ERR_UNKNOWN;
+			continue;
+		}
+		else if (!this->sink->enabled(r.level, r.actor, r.event)) {
+			continue;
+		}
+
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+
+	// The queue has been emptied, so any pressure has cleared.
+	if (this->drops.report(r)) {
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+
+	if (!this->sink->good()) {
+		this->err = this->sink->error();
+	}
+}
+
+
+void
+DeferredLogger::run()
+{
+	while (!this->stopping.load()) {
+		if (this->queue.wait(WORKER_WAIT)) {
+			this->flush();
+		}
+	}
+}
+
+
+int
+DeferredLogger::close()
+{
+	this->stopping.store(true);
+	this->queue.close();
+
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+
+	this->flush();
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+std::map<Level, std::uint64_t>
+DeferredLogger::dropped() const
+{
+	return this->drops.totals();
+}
+
+
+} // namespace klog
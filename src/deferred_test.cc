@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/deferred.hh>
+#include <klogger/record.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+constexpr int	THREADS = 4;
+constexpr int	RECORDS = 10000;
+
+
+static int
+test_pack(void)
+{
+	map<string, string>	attrs = {{"k", "v"}, {"empty", ""},
+					 {"nul", string("a\0b", 3)}};
+	klog::PackedRecord	p{klog::Level::INFO, ""};
+	klog::Record		r{klog::Level::DEBUG, 0, "", "", {}};
+
+	klog::pack_record(p, klog::Level::ERROR, 1234567890123, "actor",
+	    "event", attrs);
+	if (!klog::unpack_record(p, r)) {
+		console.error("test_pack", "unpack failed");
+		return 0;
+	}
+
+	if (r.level != klog::Level::ERROR || r.when != 1234567890123 ||
+	    r.actor != "actor" || r.event != "event" || r.attrs != attrs) {
+		console.error("test_pack", "record changed in packing");
+		return 0;
+	}
+
+	// A truncated record must be rejected.
+	p.data.resize(p.data.size() - 1);
+	if (klog::unpack_record(p, r)) {
+		console.error("test_pack", "truncated record unpacked");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_deferred(void)
+{
+	CaptureLogger		sink;
+	klog::DeferredLogger	deferred(&sink);
+	vector<thread>		workers;
+	map<string, int>	next;
+	int			fails = 0;
+
+	sink.level(klog::Level::DEBUG);
+	deferred.level(klog::Level::DEBUG);
+
+	for (int t = 0; t < THREADS; t++) {
+		workers.push_back(thread([&deferred, t]() {
+			for (int i = 0; i < RECORDS; i++) {
+				deferred.debug(to_string(t), "record",
+				    {{"seq", to_string(i)}});
+			}
+		}));
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+	deferred.close();
+
+	if (sink.records.size() != THREADS * RECORDS) {
+		console.error("test_deferred", "records lost",
+		    {{"expected", to_string(THREADS * RECORDS)},
+		     {"actual", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	for (auto& r : sink.records) {
+		if (stoi(r.attrs["seq"]) != next[r.actor]++) {
+			console.error("test_deferred", "record out of order",
+			    {{"thread", r.actor}});
+			fails++;
+			break;
+		}
+		else if (0 == r.when) {
+			console.error("test_deferred", "timestamp lost");
+			fails++;
+			break;
+		}
+	}
+
+	return fails == 0;
+}
+
+
+int
+main(void)
+{
+	if (!test_pack()) {
+		console.fatal("deferred_test", "test fail", {{"test", "pack"}});
+	}
+
+	if (!test_deferred()) {
+		console.fatal("deferred_test", "test fail",
+		    {{"test", "deferred"}});
+	}
+
+	console.info("deferred_test", "ok");
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <type_traits>
+
+#include <klogger/logger.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+// Everything here may run in a signal handler: it must not allocate,
+// lock, or call anything that isn't async-signal-safe, and that
+// includes the string and map helpers used by the other formatters.
+
+
+namespace klog {
+
+
+// The level names, indexed by level_index; they match level_string.
+static const char	*emergency_levels[LEVEL_COUNT] = {
+	"DEBUG", "INFO", "WARNING", "ERROR", "CRITICAL", "FATAL",
+};
+
+
+static size_t
+clamped_length(const char *s)
+{
+	size_t	n = 0;
+
+	while (n < EmergencyBuffer::STRING && '\0' != s[n]) {
+		n++;
+	}
+	return n;
+}
+
+
+static void
+put(EmergencyBuffer& b, const char *s, size_t n)
+{
+	for (size_t i = 0; i < n && b.used < EmergencyBuffer::SIZE; i++) {
+		b.data[b.used++] = s[i];
+	}
+}
+
+
+static void
+put(EmergencyBuffer& b, char c)
+{
+	put(b, &c, 1);
+}
+
+
+static void
+put(EmergencyBuffer& b, const char *s)
+{
+	put(b, s, clamped_length(s));
+}
+
+
+// put_digits writes v in decimal, zero-padded to at least width digits.
+static void
+put_digits(EmergencyBuffer& b, std::uint64_t v, int width)
+{
+	char	digits[20];
+	int	n = 0;
+
+	do {
+		digits[n++] = static_cast<char>('0' + v % 10);
+		v /= 10;
+	} while (v > 0 || n < width);
+
+	while (n > 0) {
+		put(b, digits[--n]);
+	}
+}
+
+
+// format_long writes value in decimal to out, which must hold 21
+// bytes, and returns its length.
+static size_t
+format_long(char *out, long value)
+{
+	EmergencyBuffer	b;
+	std::uint64_t	v = static_cast<std::uint64_t>(value);
+
+	b.used = 0;
+	if (value < 0) {
+		put(b, '-');
+		v = ~v + 1;
+	}
+	put_digits(b, v, 1);
+
+	for (size_t i = 0; i < b.used; i++) {
+		out[i] = b.data[i];
+	}
+	return b.used;
+}
+
+
+// put_timestamp writes when as a UTC timestamp in the same layout as
+// the text loggers use, computing the civil date from the day count.
+static void
+put_timestamp(EmergencyBuffer& b, std::uint64_t when)
+{
+	std::int64_t	secs = static_cast<std::int64_t>(when / 1000000000);
+	std::int64_t	days = secs / 86400;
+	std::int64_t	rem = secs % 86400;
+
+	// See Howard Hinnant's civil_from_days.
+	days += 719468;
+
+	std::int64_t	era = days / 146097;
+	std::int64_t	doe = days - era * 146097;
+	std::int64_t	yoe = (doe - doe / 1460 + doe / 36524 -
+			       doe / 146096) / 365;
+	std::int64_t	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	std::int64_t	mp = (5 * doy + 2) / 153;
+	std::int64_t	day = doy - (153 * mp + 2) / 5 + 1;
+	std::int64_t	month = mp < 10 ? mp + 3 : mp - 9;
+	std::int64_t	year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+	put_digits(b, static_cast<std::uint64_t>(year), 4);
+	put(b, '-');
+	put_digits(b, static_cast<std::uint64_t>(month), 2);
+	put(b, '-');
+	put_digits(b, static_cast<std::uint64_t>(day), 2);
+	put(b, 'T');
+	put_digits(b, static_cast<std::uint64_t>(rem / 3600), 2);
+	put(b, ':');
+	put_digits(b, static_cast<std::uint64_t>(rem / 60 % 60), 2);
+	put(b, ':');
+	put_digits(b, static_cast<std::uint64_t>(rem % 60), 2);
+	put(b, "+0000");
+}
+
+
+void
+format_emergency(EmergencyBuffer& b, Level l, std::uint64_t when,
+		 const char *actor, const char *event, const char *key,
+		 long value)
+{
+	b.used = 0;
+	put(b, '[');
+	put_timestamp(b, when);
+	put(b, "] [");
+	put(b, emergency_levels[level_index(l)]);
+	put(b, "] [actor:");
+	put(b, actor);
+	put(b, " event:");
+	put(b, event);
+	put(b, ']');
+
+	if (nullptr != key) {
+		char	digits[24];
+
+		put(b, ' ');
+		put(b, key);
+		put(b, '=');
+		put(b, digits, format_long(digits, value));
+	}
+
+	// Always end the record, even if it was cut short.
+	if (b.used == EmergencyBuffer::SIZE) {
+		b.used--;
+	}
+	put(b, '\n');
+}
+
+
+static void
+put_tlv_length(EmergencyBuffer& b, size_t length)
+{
+	if (length <= 0x7F) {
+		put(b, static_cast<char>(length));
+		return;
+	}
+
+	size_t	octets = 0;
+
+	for (size_t v = length; v > 0; v >>= 8) {
+		octets++;
+	}
+
+	put(b, static_cast<char>(0x80 + octets));
+	for (size_t i = octets; i > 0; i--) {
+		put(b, static_cast<char>((length >> ((i - 1) * 8)) & 0xFF));
+	}
+}
+
+
+static void
+put_tlv_string(EmergencyBuffer& b, const char *s, size_t n)
+{
+	put(b, static_cast<char>(tlv::TString));
+	put_tlv_length(b, n);
+	put(b, s, n);
+}
+
+
+// format_emergency_tlv writes the same entry as
+// tlv::append_tlv_log. The strings are clamped so that a whole entry
+// always fits in the buffer.
+void
+format_emergency_tlv(EmergencyBuffer& b, Level l, std::uint64_t when,
+		     const char *actor, const char *event, const char *key,
+		     long value)
+{
+	static_assert(3 * (EmergencyBuffer::STRING + 2) + 64 <
+		      EmergencyBuffer::SIZE, "emergency entries must fit");
+
+	size_t		actor_length = clamped_length(actor);
+	size_t		event_length = clamped_length(event);
+	size_t		key_length = 0;
+	size_t		value_length = 0;
+	size_t		length = tlv::TIMESTAMP_LENGTH + tlv::LEVEL_LENGTH;
+	char		digits[24];
+	std::uint64_t	secs = when / 1000000000;
+
+	// Every string is under 128 bytes, so its header is two bytes.
+	length += 2 + actor_length + 2 + event_length;
+	if (nullptr != key) {
+		key_length = clamped_length(key);
+		value_length = format_long(digits, value);
+		length += 2 + key_length + 2 + value_length;
+	}
+
+	b.used = 0;
+	put(b, static_cast<char>(tlv::TLogEntry));
+	put_tlv_length(b, length);
+
+	put(b, static_cast<char>(tlv::TTimestamp));
+	put_tlv_length(b, sizeof(secs));
+	for (size_t i = sizeof(secs); i > 0; i--) {
+		put(b, static_cast<char>((secs >> ((i - 1) * 8)) & 0xFF));
+	}
+
+	put(b, static_cast<char>(tlv::TLevel));
+	put_tlv_length(b, 1);
+	put(b, static_cast<char>(
+	    static_cast<std::underlying_type<Level>::type>(l)));
+
+	put_tlv_string(b, actor, actor_length);
+	put_tlv_string(b, event, event_length);
+	if (nullptr != key) {
+		put_tlv_string(b, key, key_length);
+		put_tlv_string(b, digits, value_length);
+	}
+}
+
+
+bool
+BasicLogger::emergency(Level l, const char *actor, const char *event)
+{
+	return this->emergency(l, actor, event, nullptr, 0);
+}
+
+
+bool
+BasicLogger::emergency(Level l, const char *actor, const char *event,
+		       const char *key, long value)
+{
+	if (!this->enabled(l)) {
+		return false;
+	}
+
+	return this->write_emergency(l, now(), actor, event, key, value);
+}
+
+
+bool
+BasicLogger::write_emergency(Level, std::uint64_t, const char *,
+			     const char *, const char *, long)
+{
+	return false;
+}
+
+
+} // namespace klog
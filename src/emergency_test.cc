@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <klogger/binlog.hh>
+#include <klogger/console.hh>
+#include <klogger/filelog.hh>
+#include <klogger/record.hh>
+#include <klogger/tlv.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOGFILE = "emergency_test.log";
+static const string	BINFILE = "emergency_test.bin";
+
+static klog::BasicLogger	*handler_logger = nullptr;
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+	stringstream	contents;
+
+	contents << in.rdbuf();
+	::unlink(path.c_str());
+	return contents.str();
+}
+
+
+static void
+on_signal(int signo)
+{
+	handler_logger->emergency(klog::Level::CRITICAL, "handler",
+	    "caught signal", "signal", signo);
+}
+
+
+static int
+test_text(void)
+{
+	string		line;
+	string		expected = "] [CRITICAL] [actor:handler "
+				   "event:caught signal] signal=10\n";
+	char		date[16];
+	time_t		t = time(nullptr);
+	struct tm	tm;
+
+	{
+		klog::FileLogger	flog(LOGFILE, true);
+
+		handler_logger = &flog;
+		::signal(SIGUSR1, on_signal);
+		::raise(SIGUSR1);
+		::signal(SIGUSR1, SIG_DFL);
+		handler_logger = nullptr;
+
+		flog.level(klog::Level::ERROR);
+		if (flog.emergency(klog::Level::INFO, "test", "filtered")) {
+			console.error("test_text", "level not honoured");
+			return 0;
+		}
+	}
+
+	line = read_file(LOGFILE);
+	gmtime_r(&t, &tm);
+	strftime(date, sizeof(date), "[%Y-%m-%dT", &tm);
+
+	if (line.size() < 26 || line.compare(0, 12, date) != 0 ||
+	    line.compare(20, 5, "+0000") != 0 ||
+	    line.compare(25, string::npos, expected) != 0) {
+		console.error("test_text", "bad record", {{"record", line}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_binary(void)
+{
+	vector<klog::Record>	records;
+	klog::tlv::Decoder	decoder;
+	string			actor(1000, 'a');
+
+	{
+		klog::BinLogger	blog(BINFILE, true);
+
+		if (!blog.emergency(klog::Level::FATAL, "main", "abort",
+		    "code", -42) ||
+		    !blog.emergency(klog::Level::ERROR, actor.c_str(), "long")) {
+			console.error("test_binary", "emergency write failed");
+			return 0;
+		}
+	}
+
+	if (!decoder.decode(read_file(BINFILE), records) ||
+	    records.size() != 2) {
+		console.error("test_binary", "log failed to decode");
+		return 0;
+	}
+
+	if (records[0].level != klog::Level::FATAL ||
+	    records[0].actor != "main" || records[0].event != "abort" ||
+	    records[0].attrs["code"] != "-42") {
+		console.error("test_binary", "bad record");
+		return 0;
+	}
+
+	if (records[1].actor != string(127, 'a') ||
+	    !records[1].attrs.empty()) {
+		console.error("test_binary", "long string not truncated",
+		    {{"length", to_string(records[1].actor.size())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_unsupported(void)
+{
+	klog::ConsoleLogger	out;
+
+	if (!out.emergency(klog::Level::INFO, "emergency_test",
+	    "console", "n", 1)) {
+		console.error("test_unsupported", "console write failed");
+		return 0;
+	}
+
+	// A logger without an emergency path reports it.
+	klog::ContextLogger	*child = out.with({{"k", "v"}}).release();
+	bool			written = child->emergency(klog::Level::FATAL,
+				    "test", "context");
+
+	delete child;
+	if (written) {
+		console.error("test_unsupported", "no emergency path");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"text", test_text},
+	{"binary", test_binary},
+	{"unsupported", test_unsupported},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("emergency_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("emergency_test", "ok");
+}
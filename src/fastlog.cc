@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <klogger/fastlog.hh>
+#include <klogger/logger.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+FastLogger::FastLogger(std::string logfile, bool truncate)
+    : BasicLogger(), fd(-1), lock(), buffers(), next_site(0)
+{
+	this->fd.store(open_logfd(logfile, truncate));
+	if (-1 == this->fd.load()) {
+		this->err = LogError::ERR_OPEN;
+		return;
+	}
+
+	this->write_anchor();
+}
+
+
+FastLogger::~FastLogger()
+{
+	this->close();
+}
+
+
+void
+FastLogger::write(Level l, std::uint64_t when,
+		  const std::string& actor,
+		  const std::string& event,
+		  const std::map<std::string, std::string>& attrs)
+{
+	std::string&	buf = thread_buffer();
+	FastBuffer&	b = this->buffer();
+	char		*p;
+
+	tlv::append_entry(buf, l, when, actor, event, attrs);
+
+	b.acquire();
+	if (buf.size() <= FastBuffer::CAPACITY - b.used) {
+		p = b.data + b.used;
+	}
+	else {
+		p = this->make_room(b, buf.size());
+	}
+	::memcpy(p, buf.data(), buf.size());
+	this->commit(b, l, buf.size());
+	b.release();
+
+	if (Level::FATAL == l) {
+		this->flush();
+	}
+}
+
+
+std::uint32_t
+FastLogger::register_site(Level l, const std::string& actor,
+			  const std::string& event,
+			  const std::string& types,
+			  const std::vector<std::string>& keys)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+	std::uint32_t			id = this->next_site++;
+	std::string			value;
+	std::string			buf;
+	LogError			result;
+
+	value.append(reinterpret_cast<const char *>(&id), sizeof(id));
+	tlv::append_loglevel(value, tlv::level_value(l));
+	tlv::append_string(value, actor);
+	tlv::append_string(value, event);
+	tlv::append_string(value, types);
+	for (auto& k : keys) {
+		tlv::append_string(value, k);
+	}
+
+	tlv::append_header(buf, tlv::TSite, value.size());
+	buf += value;
+	result = write_fd(this->fd.load(), buf.data(), buf.size());
+	if (LogError::HEALTHY != result) {
+		this->fail(result);
+	}
+
+	return id;
+}
+
+
+char *
+FastLogger::make_room(FastBuffer& b, size_t length)
+{
+	this->write_out(b);
+	if (length <= FastBuffer::CAPACITY) {
+		return b.data;
+	}
+
+	b.spill.assign(length, '\0');
+	return &b.spill[0];
+}
+
+
+// write_out and write_spill are called with b held, so close can't
+// close the log file under them; once it is closed, they discard b.
+void
+FastLogger::write_out(FastBuffer& b)
+{
+	int		out = this->fd.load();
+	LogError	result;
+
+	if (0 == b.used) {
+		return;
+	}
+	if (-1 == out) {
+		b.used = 0;
+		return;
+	}
+
+	result = write_fd(out, b.data, b.used);
+	if (LogError::HEALTHY != result) {
+		this->fail(result);
+	}
+	b.used = 0;
+	this->count_flush();
+	this->write_anchor();
+}
+
+
+void
+FastLogger::write_spill(FastBuffer& b)
+{
+	int		out = this->fd.load();
+	LogError	result;
+
+	if (-1 != out) {
+		result = write_fd(out, b.spill.data(), b.spill.size());
+		if (LogError::HEALTHY != result) {
+			this->fail(result);
+		}
+	}
+	std::string().swap(b.spill);
+}
+
+
+// write_anchor records the cycle counter against the wall clock.
+void
+FastLogger::write_anchor(void)
+{
+	std::uint64_t	counter = cycles();
+	std::uint64_t	ns = now();
+	int		out = this->fd.load();
+	std::string	buf;
+	LogError	result;
+
+	if (-1 == out) {
+		return;
+	}
+
+	tlv::append_header(buf, tlv::TClock, sizeof(counter) + sizeof(ns));
+	buf.append(reinterpret_cast<const char *>(&counter), sizeof(counter));
+	buf.append(reinterpret_cast<const char *>(&ns), sizeof(ns));
+	result = write_fd(out, buf.data(), buf.size());
+	if (LogError::HEALTHY != result) {
+		this->fail(result);
+	}
+}
+
+
+void
+FastLogger::flush(void)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	this->buffers.each([this](FastBuffer& b) {
+		b.acquire();
+		this->write_out(b);
+		b.release();
+	});
+}
+
+
+// close takes the log file away from writers before closing it, then
+// waits for each buffer to be let go, so that a writer that picked up
+// the old descriptor has finished with it.
+int
+FastLogger::close(void)
+{
+	if (-1 == this->fd.load()) {
+		return 0;
+	}
+
+	this->flush();
+	this->write_anchor();
+
+	std::lock_guard<std::mutex>	guard(this->lock);
+	int				out = this->fd.exchange(-1);
+
+	if (-1 == out) {
+		return 0;
+	}
+
+	this->buffers.each([](FastBuffer& b) {
+		b.acquire();
+		b.release();
+	});
+
+	if (-1 == ::close(out)) {
+		this->err = LogError::ERR_CLOSEFAIL;
+		return -1;
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <klogger/console.hh>
+#include <klogger/fastlog.hh>
+#include <klogger/record.hh>
+#include <klogger/tlv.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+constexpr int		THREADS = 2;
+constexpr int		RECORDS = 20000;
+static const string	LOGFILE = "fastlog_test.bin";
+
+
+static bool
+read_log(const string& path, vector<klog::Record>& records)
+{
+	ifstream		in(path, ios::binary);
+	stringstream		contents;
+	klog::tlv::Decoder	decoder;
+
+	contents << in.rdbuf();
+	return decoder.decode(contents.str(), records);
+}
+
+
+static int
+test_sites(void)
+{
+	uint64_t		start = klog::now();
+	vector<thread>		workers;
+	vector<klog::Record>	records;
+	map<string, int>	next;
+	string			big(2 * klog::FastBuffer::CAPACITY, 'x');
+	int			fails = 0;
+
+	{
+		klog::FastLogger	flog(LOGFILE, true);
+		klog::Site<int, uint64_t, double, string> sent(flog,
+		    klog::Level::INFO, "worker", "sent",
+		    {"seq", "bytes", "ratio", "thread"});
+		klog::Site<string>	debug(flog, klog::Level::DEBUG,
+					    "worker", "debug", {"msg"});
+
+		if (!flog.good()) {
+			console.error("test_sites", "failed to open log");
+			return 0;
+		}
+
+		for (int t = 0; t < THREADS; t++) {
+			workers.push_back(thread([&sent, t]() {
+				string	id = to_string(t);
+
+				for (int i = 0; i < RECORDS; i++) {
+					sent.log(i, 1024, 0.5, id);
+				}
+			}));
+		}
+		for (auto& w : workers) {
+			w.join();
+		}
+
+		// Filtered by level, so never written.
+		debug.log("hidden");
+		flog.info("main", "generic", {{"big", big}});
+		flog.close();
+	}
+
+	uint64_t	end = klog::now();
+
+	if (!read_log(LOGFILE, records)) {
+		console.error("test_sites", "log failed to decode");
+		return 0;
+	}
+	::unlink(LOGFILE.c_str());
+
+	if (records.size() != THREADS * RECORDS + 1) {
+		console.error("test_sites", "wrong number of records",
+		    {{"expected", to_string(THREADS * RECORDS + 1)},
+		     {"actual", to_string(records.size())}});
+		return 0;
+	}
+
+	for (auto& r : records) {
+		if (r.event == "generic") {
+			if (r.actor != "main" || r.attrs["big"] != big) {
+				console.error("test_sites", "bad generic record");
+				fails++;
+			}
+			continue;
+		}
+
+		const string&	id = r.attrs["thread"];
+
+		if (r.level != klog::Level::INFO || r.actor != "worker" ||
+		    r.attrs["bytes"] != "1024" ||
+		    r.attrs["ratio"] != "0.500000") {
+			console.error("test_sites", "bad site record");
+			fails++;
+			break;
+		}
+
+		if (stoi(r.attrs["seq"]) != next[id]++) {
+			console.error("test_sites", "record out of order",
+			    {{"thread", id}});
+			fails++;
+			break;
+		}
+
+		// The decoder interpolates the cycle counter; allow a
+		// second either side.
+		if (r.when + 1000000000 < start || r.when > end + 1000000000) {
+			console.error("test_sites", "bad timestamp",
+			    {{"when", to_string(r.when)}});
+			fails++;
+			break;
+		}
+	}
+
+	return fails == 0;
+}
+
+
+// Closing while other threads are still logging leaves a log that
+// decodes, and later records are discarded.
+static int
+test_close(void)
+{
+	vector<thread>		workers;
+	vector<klog::Record>	records;
+	atomic<bool>		stop(false);
+
+	{
+		klog::FastLogger	flog(LOGFILE, true);
+		klog::Site<int>		sent(flog, klog::Level::INFO,
+					    "worker", "sent", {"seq"});
+
+		for (int t = 0; t < THREADS; t++) {
+			workers.push_back(thread([&sent, &stop]() {
+				for (int i = 0; !stop.load(); i++) {
+					sent.log(i);
+				}
+			}));
+		}
+
+		this_thread::sleep_for(chrono::milliseconds(50));
+		flog.close();
+		this_thread::sleep_for(chrono::milliseconds(10));
+		stop.store(true);
+		for (auto& w : workers) {
+			w.join();
+		}
+	}
+
+	if (!read_log(LOGFILE, records) || records.empty()) {
+		console.error("test_close", "log failed to decode");
+		return 0;
+	}
+	::unlink(LOGFILE.c_str());
+	return 1;
+}
+
+
+static int
+test_malformed(void)
+{
+	vector<klog::Record>	records;
+	klog::tlv::Decoder	decoder;
+	string			buf;
+
+	// A site entry for a site that was never registered.
+	klog::tlv::append_header(buf, klog::tlv::TSiteEntry, 12);
+	buf.append(12, '\0');
+	if (decoder.decode(buf, records)) {
+		console.error("test_malformed", "unknown site decoded");
+		return 0;
+	}
+
+	return records.empty();
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"sites", test_sites},
+	{"close", test_close},
+	{"malformed", test_malformed},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("fastlog_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("fastlog_test", "ok");
+}
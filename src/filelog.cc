@@ -21,9 +21,11 @@
  */
 
 
-#include <fstream>
+
+#include <cerrno>
 #include <map>
-#include <unistd.h>
+#include <string>
+#include <vector>
 
 #include <klogger/logger.hh>
 #include <klogger/filelog.hh>
@@ -33,259 +35,130 @@
 namespace klog {
 
 
-constexpr auto	DEFAULT_FLAGS = std::ofstream::out | std::ofstream::app;
-constexpr auto	TRUNC_FLAGS = std::ofstream::out | std::ofstream::trunc;
-
-
 FileLogger::FileLogger(std::string logfile, bool truncate)
-    : outs(nullptr), errs(nullptr), ilevel(DEFAULT_LEVEL),
-      err(LogError::HEALTHY)
+    : BasicLogger(), files({{LEVELS_ALL, logfile}}, truncate),
+      formatter()
 {
-	auto	flags = DEFAULT_FLAGS;
-
-	if (truncate) {
-		flags = TRUNC_FLAGS;
-	}
-
-	try {
-		this->outs.open(logfile, flags);
-		this->errs.open(logfile, DEFAULT_FLAGS);
-	}
-	catch (std::ifstream::failure &e) {
-		this->err = LogError::ERR_OPEN;
-		return;
-	}
-
-	if (!this->outs.good()) {
+	if (!this->files.open_all()) {
 		this->err = LogError::ERR_OPEN;
-		return;
-	}
-	else if (!this->errs.good()) {
-		this->err = LogError::ERR_OPEN;
-		return;
 	}
 }
 
 
 FileLogger::FileLogger(std::string logfile, std::string errfile,
 		       bool truncate)
-    : outs(nullptr), errs(nullptr), ilevel(DEFAULT_LEVEL),
-      err(LogError::HEALTHY)
+    : BasicLogger(),
+      files({{Level::DEBUG | Level::INFO, logfile},
+	     {at_or_above(Level::WARN), errfile}}, truncate),
+      formatter()
 {
-	auto	flags = DEFAULT_FLAGS;
-
-	if (truncate) {
-		flags = TRUNC_FLAGS;
-	}
-
-	try {
-		this->outs.open(logfile, flags);
-		this->errs.open(errfile, flags);
-	}
-	catch (std::ifstream::failure &e) {
-		this->err = LogError::ERR_OPEN;
-		return;
-	}
-
-
-	if (!this->outs.good()) {
-		this->err = LogError::ERR_OPEN;
-		return;
-	}
-	else if (!this->errs.good()) {
+	if (!this->files.open_all()) {
 		this->err = LogError::ERR_OPEN;
-		return;
 	}
 }
 
-void
-FileLogger::debug(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_log(this->outs, Level::DEBUG, actor, event, attrs);
-}
-
-
-void
-FileLogger::debug(const std::string& actor,
-		     const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-	write_log(this->outs, Level::DEBUG, actor, event, {});
-}
-
 
-void
-FileLogger::info(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
+FileLogger::FileLogger(const std::vector<Route>& routes, bool truncate)
+    : BasicLogger(), files(routes, truncate), formatter()
 {
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_log(this->outs, Level::INFO, actor, event, attrs);
 }
 
 
-void
-FileLogger::info(const std::string& actor,
-		    const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-	write_log(this->outs, Level::INFO, actor, event, {});
-}
-
-
-void
-FileLogger::warn(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs)
+FileLogger::~FileLogger()
 {
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_log(this->errs, Level::WARN, actor, event, attrs);
+	this->close();
 }
 
 
 void
-FileLogger::warn(const std::string& actor,
-		    const std::string& event)
+FileLogger::write(Level l, std::uint64_t when,
+		  const std::string& actor,
+		  const std::string& event,
+		  const std::map<std::string, std::string>& attrs)
 {
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-	write_log(this->errs, Level::WARN, actor, event, {});
-}
-
-
-void
-FileLogger::error(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_log(this->errs, Level::ERROR, actor, event, attrs);
-}
-
-
-void
-FileLogger::error(const std::string& actor,
-		     const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-	write_log(this->errs, Level::ERROR, actor, event, {});
-}
-
-
-void
-FileLogger::critical(const std::string& actor,
-			const std::string& event,
-			std::map<std::string, std::string> attrs) 
-{
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_log(this->errs, Level::CRITICAL, actor, event, attrs);
-}
+	if (!this->files.routed(l)) {
+		return;
+	}
 
+	std::string&	buf = thread_buffer();
 
-void
-FileLogger::critical(const std::string& actor,
-			const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-	write_log(this->errs, Level::CRITICAL, actor, event, {});
+	this->formatter.record(buf, l, when, actor, event, attrs);
+	this->commit(l, buf);
 }
 
 
 void
-FileLogger::fatal(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+FileLogger::write_body(Level l, std::uint64_t when, const Body& body)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, attrs);
-	exit(EXIT_FAILURE);
-}
+	if (!this->files.routed(l)) {
+		return;
+	}
 
+	std::string&	buf = thread_buffer();
 
-void
-FileLogger::fatal(const std::string& actor,
-		     const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, {});
-	exit(EXIT_FAILURE);
+	this->formatter.body(buf, l, when, body);
+	this->commit(l, buf);
 }
 
 
 void
-FileLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
+FileLogger::format(Format f)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, attrs);
-	exit(exitcode);
+	this->formatter.format(f);
 }
 
 
-void
-FileLogger::fatal(int exitcode,
-		     const std::string& actor,
-		     const std::string& event)
+Format
+FileLogger::format(void) const
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, {});
-	exit(exitcode);
+	return this->formatter.format();
 }
 
 
-void
-FileLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event,
-			    std::map<std::string, std::string> attrs)
+bool
+FileLogger::layout(const Layout& l)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, attrs);
+	return this->formatter.layout(l);
 }
 
 
 void
-FileLogger::fatal_noexit(const std::string& actor,
-			    const std::string& event)
+FileLogger::commit(Level l, const std::string& buf)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-	write_log(this->errs, Level::FATAL, actor, event, {});
-}
-
+	LogError	result;
 
-void
-FileLogger::level(Level l)
-{
-	this->ilevel = l;
+	result = this->files.write(l, buf.data(), buf.size());
+	if (LogError::HEALTHY != result) {
+		this->fail(result);
+		return;
+	}
+	this->count_write(l, buf.size());
 }
 
 
 bool
-FileLogger::good()
-{
-	return this->err == LogError::HEALTHY;
-}
-
+FileLogger::write_emergency(Level l, std::uint64_t when,
+			    const char *actor, const char *event,
+			    const char *key, long value)
+{
+	EmergencyBuffer	b;
+	LogError	result;
+
+	format_emergency(b, l, when, actor, event, key, value);
+	result = this->files.write_emergency(l, b.data, b.used);
+	if (LogError::HEALTHY != result) {
+		this->err = result;
+		return false;
+	}
 
-LogError
-FileLogger::error()
-{
-	return this->err;
+	return true;
 }
 
 
 int
 FileLogger::close()
 {
-	if (-1 == ::close(STDOUT_FILENO)) {
-		this->err = LogError::ERR_CLOSEFAIL;
-		return -1;
-	}
-
-	if (-1 == ::close(STDERR_FILENO)) {
+	if (-1 == this->files.close()) {
 		this->err = LogError::ERR_CLOSEFAIL;
 		return -1;
 	}
@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <klogger/flightrec.hh>
+#include <klogger/logger.hh>
+#include <klogger/slots.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+constexpr size_t	RING_CAPACITY = 65536;
+
+// Entries in a ring are aligned to ENTRY_ALIGN bytes, so that an entry
+// header always fits before the end of the ring.
+constexpr size_t	ENTRY_ALIGN = 16;
+
+// A PADDING entry fills the end of the ring when the next entry
+// doesn't fit there.
+constexpr std::uint32_t	PADDING = UINT32_MAX;
+
+// The fields of an entry are either RAW_FIELDS, each a 4-byte length
+// followed by the bytes, or TLV_FIELDS, the string records a Body
+// appends.
+constexpr std::uint16_t	RAW_FIELDS = 0;
+constexpr std::uint16_t	TLV_FIELDS = 1;
+
+// The dump is written out through a buffer of DUMP_BUFFER bytes.
+constexpr size_t	DUMP_BUFFER = 4096;
+
+// Each recording thread gets an alternate signal stack of CRASH_STACK
+// bytes, so that a crash caused by overflowing its own stack can still
+// be dumped.
+constexpr size_t	CRASH_STACK = 65536;
+
+static std::atomic<FlightRecorder *>	crash_recorder(nullptr);
+
+// The signals handle_crashes catches, and the actions they had before.
+static const int		crash_signals[] = {SIGSEGV, SIGABRT};
+static struct sigaction		crash_previous[2];
+
+
+static inline size_t
+entry_align(size_t n)
+{
+	return (n + ENTRY_ALIGN - 1) & ~(ENTRY_ALIGN - 1);
+}
+
+
+static inline size_t
+field_length(const std::string& s)
+{
+	return sizeof(std::uint32_t) + s.size();
+}
+
+
+static inline char *
+put_field(char *p, const std::string& s)
+{
+	std::uint32_t	length = static_cast<std::uint32_t>(s.size());
+
+	::memcpy(p, &length, sizeof(length));
+	::memcpy(p + sizeof(length), s.data(), s.size());
+	return p + sizeof(length) + s.size();
+}
+
+
+// encode_length writes a TLV length to p, returning the number of
+// bytes written; it matches tlv::append_length.
+static size_t
+encode_length(char *p, std::uint64_t length)
+{
+	size_t	loct = 0;
+
+	if (length <= 0x7F) {
+		p[0] = static_cast<char>(length);
+		return 1;
+	}
+
+	for (std::uint64_t v = length; v > 0; v >>= 8) {
+		loct++;
+	}
+
+	p[0] = static_cast<char>(0x80 + loct);
+	for (size_t i = loct; i > 0; i--) {
+		p[loct - i + 1] = static_cast<char>(
+		    (length >> ((i - 1) * 8)) & 0xFF);
+	}
+	return loct + 1;
+}
+
+
+// Each entry in a ring is an EntryHeader followed by length bytes of
+// fields; the wall-clock time orders entries across rings.
+struct EntryHeader {
+	std::uint32_t	length;
+	std::uint16_t	level;
+	std::uint16_t	kind;
+	std::uint64_t	when;
+};
+
+static_assert(sizeof(EntryHeader) == ENTRY_ALIGN,
+	      "entry headers must fill an alignment unit");
+
+
+// A Ring holds one thread's recent entries. Positions count the bytes
+// ever written, so head - tail is the number of bytes held; only the
+// owning thread moves them.
+struct FlightRecorder::Ring {
+	explicit Ring(size_t size)
+	    : capacity(size), head(0), tail(0), claimed(0),
+	      data(new char[size]())
+	{
+	}
+
+	// entry returns the header of the entry at pos.
+	const EntryHeader *
+	entry(std::uint64_t pos) const
+	{
+		return reinterpret_cast<const EntryHeader *>(
+		    this->data.get() + pos % this->capacity);
+	}
+
+	// next returns the position of the entry after the one at pos.
+	std::uint64_t
+	next(std::uint64_t pos) const
+	{
+		const EntryHeader	*e = this->entry(pos);
+
+		if (PADDING == e->length) {
+			return pos + this->capacity - pos % this->capacity;
+		}
+		return pos + entry_align(sizeof(EntryHeader) + e->length);
+	}
+
+	// reserve drops the oldest entries until the ring can hold head
+	// bytes from the tail.
+	void
+	reserve(std::uint64_t end)
+	{
+		std::uint64_t	pos = this->tail.load(std::memory_order_relaxed);
+
+		while (end - pos > this->capacity) {
+			pos = this->next(pos);
+			this->tail.store(pos, std::memory_order_release);
+		}
+	}
+
+	// claim makes room for an entry with length bytes of fields and
+	// returns where to copy them, or nullptr if the entry can't fit
+	// in the ring.
+	char *
+	claim(size_t length)
+	{
+		size_t		size = entry_align(sizeof(EntryHeader) +
+				    length);
+		std::uint64_t	pos = this->head.load(
+				    std::memory_order_relaxed);
+		size_t		off = pos % this->capacity;
+		size_t		pad = 0;
+
+		if (size > this->capacity) {
+			return nullptr;
+		}
+
+		if (this->capacity - off < size) {
+			pad = this->capacity - off;
+		}
+		this->reserve(pos + pad + size);
+
+		if (pad > 0) {
+			EntryHeader	padding{PADDING, 0, 0, 0};
+
+			::memcpy(this->data.get() + off, &padding,
+			    sizeof(padding));
+			pos += pad;
+			off = 0;
+		}
+
+		this->claimed = pos;
+		return this->data.get() + off + sizeof(EntryHeader);
+	}
+
+	// commit writes the header of the claimed entry and makes it
+	// visible to dump.
+	void
+	commit(const EntryHeader& h)
+	{
+		::memcpy(this->data.get() + this->claimed % this->capacity,
+		    &h, sizeof(h));
+		this->head.store(this->claimed +
+		    entry_align(sizeof(EntryHeader) + h.length),
+		    std::memory_order_release);
+	}
+
+	const size_t			capacity;
+	std::atomic<std::uint64_t>	head;
+	std::atomic<std::uint64_t>	tail;
+	std::uint64_t			claimed;
+	std::unique_ptr<char[]>		data;
+
+	Ring(const Ring&) = delete;
+	Ring&	operator=(const Ring&) = delete;
+};
+
+
+// An AltStack gives the thread that creates it an alternate signal
+// stack, unless it already has one, and removes it when the thread
+// exits.
+class AltStack {
+public:
+	AltStack() : stack()
+	{
+		stack_t	ss;
+
+		if (0 == ::sigaltstack(nullptr, &ss) &&
+		    0 == (ss.ss_flags & SS_DISABLE)) {
+			return;
+		}
+
+		this->stack.reset(new char[CRASH_STACK]);
+		ss.ss_sp = this->stack.get();
+		ss.ss_size = CRASH_STACK;
+		ss.ss_flags = 0;
+		if (0 != ::sigaltstack(&ss, nullptr)) {
+			this->stack.reset();
+		}
+	}
+
+	~AltStack()
+	{
+		stack_t	ss;
+
+		if (!this->stack) {
+			return;
+		}
+
+		::memset(&ss, 0, sizeof(ss));
+		ss.ss_flags = SS_DISABLE;
+		::sigaltstack(&ss, nullptr);
+	}
+
+private:
+	std::unique_ptr<char[]>	stack;
+};
+
+
+static void
+use_alt_stack(void)
+{
+	static thread_local AltStack	alt;
+
+	(void)alt;
+}
+
+
+// A DumpWriter buffers the encoded entries of a dump on the stack.
+struct DumpWriter {
+	explicit DumpWriter(int out)
+	    : fd(out), used(0), ok(true), buf()
+	{
+	}
+
+	void
+	flush(void)
+	{
+		if (this->ok && this->used > 0) {
+			this->ok = LogError::HEALTHY == write_fd(this->fd,
+			    this->buf, this->used);
+		}
+		this->used = 0;
+	}
+
+	void
+	put(const char *p, size_t length)
+	{
+		if (length > DUMP_BUFFER - this->used) {
+			this->flush();
+		}
+
+		if (length > DUMP_BUFFER) {
+			this->ok = this->ok && LogError::HEALTHY ==
+			    write_fd(this->fd, p, length);
+			return;
+		}
+
+		::memcpy(this->buf + this->used, p, length);
+		this->used += length;
+	}
+
+	void
+	header(std::uint8_t tag, std::uint64_t length)
+	{
+		char	h[10];
+
+		h[0] = static_cast<char>(tag);
+		this->put(h, 1 + encode_length(h + 1, length));
+	}
+
+	void
+	timestamp(std::uint64_t t)
+	{
+		char	v[8];
+
+		for (size_t i = 0; i < sizeof(v); i++) {
+			v[i] = static_cast<char>(
+			    (t >> ((sizeof(v) - i - 1) * 8)) & 0xFF);
+		}
+		this->header(tlv::TTimestamp, sizeof(v));
+		this->put(v, sizeof(v));
+	}
+
+	void
+	level(std::uint8_t lvl)
+	{
+		this->header(tlv::TLevel, sizeof(lvl));
+		this->put(reinterpret_cast<const char *>(&lvl), sizeof(lvl));
+	}
+
+	int	fd;
+	size_t	used;
+	bool	ok;
+	char	buf[DUMP_BUFFER];
+};
+
+
+// raw_length returns the length of the string records for the raw
+// fields p of e, or false if they are malformed.
+static bool
+raw_length(const EntryHeader& e, const char *p, std::uint64_t& length)
+{
+	size_t		 off = 0;
+	std::uint32_t	 n;
+	char		 scratch[10];
+
+	length = 0;
+	while (off < e.length) {
+		if (e.length - off < sizeof(n)) {
+			return false;
+		}
+		::memcpy(&n, p + off, sizeof(n));
+		off += sizeof(n);
+		if (e.length - off < n) {
+			return false;
+		}
+		off += n;
+		length += 1 + encode_length(scratch, n) + n;
+	}
+	return true;
+}
+
+
+// dump_entry writes the entry e, with fields p, as a BinLogger entry.
+static void
+dump_entry(DumpWriter& out, const EntryHeader& e, const char *p)
+{
+	std::uint64_t	 length = e.length;
+	std::uint32_t	 n;
+
+	if (RAW_FIELDS == e.kind && !raw_length(e, p, length)) {
+		return;
+	}
+
+	out.header(tlv::TLogEntry,
+	    tlv::TIMESTAMP_LENGTH + tlv::LEVEL_LENGTH + length);
+	out.timestamp(tlv::seconds(e.when));
+	out.level(static_cast<std::uint8_t>(e.level));
+
+	if (TLV_FIELDS == e.kind) {
+		out.put(p, e.length);
+		return;
+	}
+
+	for (size_t off = 0; off < e.length; off += n) {
+		::memcpy(&n, p + off, sizeof(n));
+		off += sizeof(n);
+		out.header(tlv::TString, n);
+		out.put(p + off, n);
+	}
+}
+
+
+FlightRecorder::FlightRecorder(BasicLogger *out, std::string path,
+			       size_t size)
+    : BasicLogger(), sink(out), dumpfile(path),
+      capacity(entry_align(size)), keys(), rings(), dumping(false)
+{
+	for (size_t i = 0; i < MAX_RINGS; i++) {
+		this->keys[i].store(0);
+		this->rings[i].store(nullptr);
+	}
+	this->level(Level::DEBUG);
+}
+
+
+FlightRecorder::FlightRecorder(BasicLogger *out, std::string path)
+    : FlightRecorder(out, path, RING_CAPACITY)
+{
+}
+
+
+FlightRecorder::~FlightRecorder()
+{
+	FlightRecorder	*self = this;
+
+	crash_recorder.compare_exchange_strong(self, nullptr);
+	for (auto& r : this->rings) {
+		delete r.load();
+	}
+}
+
+
+// ring finds the calling thread's ring as a SlotTable finds its
+// entries, probing from the thread's home slot and claiming an empty
+// one the first time, so that it never locks. It returns nullptr once
+// every slot is taken. A thread can take over an exited thread's ring
+// with its key, so each sets up its own alternate stack.
+FlightRecorder::Ring *
+FlightRecorder::ring(void)
+{
+	std::uint64_t	key = thread_key();
+	size_t		home = key % MAX_RINGS;
+
+	use_alt_stack();
+
+	for (size_t n = 0; n < MAX_RINGS; n++) {
+		size_t		i = (home + n) % MAX_RINGS;
+		std::uint64_t	found = this->keys[i].load(
+				    std::memory_order_acquire);
+
+		if (found == key) {
+			return this->rings[i].load(std::memory_order_relaxed);
+		}
+
+		if (found == 0 && this->keys[i].compare_exchange_strong(found,
+		    key, std::memory_order_acq_rel)) {
+			Ring	*r = new Ring(this->capacity);
+
+			this->rings[i].store(r, std::memory_order_release);
+			return r;
+		}
+	}
+
+	return nullptr;
+}
+
+
+void
+FlightRecorder::write(Level l, std::uint64_t when, const std::string& actor,
+		      const std::string& event,
+		      const std::map<std::string, std::string>& attrs)
+{
+	Ring	*r = this->ring();
+	size_t	 length = field_length(actor) + field_length(event);
+	char	*p;
+
+	for (auto& attr : attrs) {
+		length += field_length(attr.first) + field_length(attr.second);
+	}
+
+	if (nullptr != r && nullptr != (p = r->claim(length))) {
+		p = put_field(p, actor);
+		p = put_field(p, event);
+		for (auto& attr : attrs) {
+			p = put_field(p, attr.first);
+			p = put_field(p, attr.second);
+		}
+		r->commit(EntryHeader{static_cast<std::uint32_t>(length),
+		    tlv::level_value(l), RAW_FIELDS, when});
+	}
+
+	if (this->sink->enabled(l, actor, event)) {
+		this->sink->write(l, when, actor, event, attrs);
+	}
+
+	if (Level::FATAL == l) {
+		this->dump();
+	}
+}
+
+
+void
+FlightRecorder::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	Ring	*r = this->ring();
+	char	*p;
+
+	// A Body only gives up its fields as string records, so those
+	// are what is kept.
+	if (nullptr != r) {
+		std::string&	buf = thread_buffer();
+
+		body.tlv(buf);
+		if (nullptr != (p = r->claim(buf.size()))) {
+			::memcpy(p, buf.data(), buf.size());
+			r->commit(EntryHeader{
+			    static_cast<std::uint32_t>(buf.size()),
+			    tlv::level_value(l), TLV_FIELDS, when});
+		}
+	}
+
+	if (this->sink->enabled(l, body.actor(), body.event())) {
+		this->sink->write_body(l, when, body);
+	}
+
+	if (Level::FATAL == l) {
+		this->dump();
+	}
+}
+
+
+// dump merges the rings by timestamp, encoding each entry as it goes.
+// It may run in a signal handler, so it only uses the stack, atomics
+// and async-signal-safe calls.
+bool
+FlightRecorder::dump(void)
+{
+	Ring		*held[MAX_RINGS];
+	std::uint64_t	 pos[MAX_RINGS];
+	std::uint64_t	 end[MAX_RINGS];
+	bool		 ok;
+	int		 fd;
+
+	if (this->dumping.exchange(true)) {
+		return false;
+	}
+
+	fd = ::open(this->dumpfile.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (-1 == fd) {
+		this->dumping.store(false);
+		return false;
+	}
+
+	DumpWriter	out(fd);
+
+	for (size_t i = 0; i < MAX_RINGS; i++) {
+		held[i] = this->rings[i].load(std::memory_order_acquire);
+		if (nullptr == held[i]) {
+			pos[i] = end[i] = 0;
+			continue;
+		}
+
+		end[i] = held[i]->head.load(std::memory_order_acquire);
+		pos[i] = held[i]->tail.load(std::memory_order_acquire);
+	}
+
+	while (out.ok) {
+		EntryHeader	 oldest{0, 0, 0, 0};
+		const char	*fields = nullptr;
+		size_t		 which = 0;
+
+		for (size_t i = 0; i < MAX_RINGS; i++) {
+			Ring	*r = held[i];
+
+			if (nullptr == r) {
+				continue;
+			}
+
+			// Skip anything the owner has overwritten since.
+			std::uint64_t	tail = r->tail.load(
+					    std::memory_order_acquire);
+			if (pos[i] < tail) {
+				pos[i] = tail;
+			}
+
+			while (pos[i] < end[i] &&
+			    PADDING == r->entry(pos[i])->length) {
+				pos[i] = r->next(pos[i]);
+			}
+
+			if (pos[i] >= end[i]) {
+				continue;
+			}
+
+			// The header is copied, so that the owner can't
+			// change its length once it has been checked; an
+			// entry overwritten mid-dump may claim more than
+			// the ring holds past it.
+			EntryHeader	e;
+
+			::memcpy(&e, r->entry(pos[i]), sizeof(e));
+			if (pos[i] % r->capacity + sizeof(EntryHeader) +
+			    e.length > r->capacity) {
+				pos[i] = end[i];
+				continue;
+			}
+
+			if (nullptr == fields || e.when < oldest.when) {
+				oldest = e;
+				fields = reinterpret_cast<const char *>(
+				    r->entry(pos[i]) + 1);
+				which = i;
+			}
+		}
+
+		if (nullptr == fields) {
+			break;
+		}
+
+		pos[which] += entry_align(sizeof(EntryHeader) + oldest.length);
+		dump_entry(out, oldest, fields);
+	}
+
+	out.flush();
+	ok = (0 == ::close(fd)) && out.ok;
+	this->dumping.store(false);
+	return ok;
+}
+
+
+// dump_on_crash dumps the crash recorder, then passes the signal on to
+// the handler that was installed before, or restores the previous
+// action and raises the signal again; it is blocked until this
+// returns, so the action is taken then.
+static void
+dump_on_crash(int signo, siginfo_t *info, void *context)
+{
+	FlightRecorder		*recorder = crash_recorder.load();
+	const struct sigaction	*previous = &crash_previous[0];
+
+	if (nullptr != recorder) {
+		recorder->dump();
+	}
+
+	for (size_t i = 0; i < sizeof(crash_signals) / sizeof(int); i++) {
+		if (crash_signals[i] == signo) {
+			previous = &crash_previous[i];
+		}
+	}
+
+	if (previous->sa_flags & SA_SIGINFO) {
+		previous->sa_sigaction(signo, info, context);
+		return;
+	}
+
+	if (SIG_DFL != previous->sa_handler &&
+	    SIG_IGN != previous->sa_handler) {
+		previous->sa_handler(signo);
+		return;
+	}
+
+	::sigaction(signo, previous, nullptr);
+	::raise(signo);
+}
+
+
+static void
+install_crash_handlers(void)
+{
+	struct sigaction	sa;
+
+	::memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = dump_on_crash;
+	sa.sa_flags = SA_SIGINFO|SA_ONSTACK;
+	::sigemptyset(&sa.sa_mask);
+
+	for (size_t i = 0; i < sizeof(crash_signals) / sizeof(int); i++) {
+		::sigaction(crash_signals[i], &sa, &crash_previous[i]);
+	}
+}
+
+
+void
+FlightRecorder::handle_crashes(void)
+{
+	static std::once_flag	installed;
+
+	use_alt_stack();
+	crash_recorder.store(this);
+	std::call_once(installed, install_crash_handlers);
+}
+
+
+int
+FlightRecorder::close(void)
+{
+	FlightRecorder	*self = this;
+
+	crash_recorder.compare_exchange_strong(self, nullptr);
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
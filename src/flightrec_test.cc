@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/flightrec.hh>
+#include <klogger/record.hh>
+#include <klogger/tlv.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	DUMPFILE = "flightrec_test.bin";
+
+
+static bool
+read_dump(vector<klog::Record>& records)
+{
+	ifstream		in(DUMPFILE, ios::binary);
+	stringstream		contents;
+	klog::tlv::Decoder	decoder;
+
+	if (!in) {
+		return false;
+	}
+
+	contents << in.rdbuf();
+	::unlink(DUMPFILE.c_str());
+	return decoder.decode(contents.str(), records);
+}
+
+
+static int
+test_forward(void)
+{
+	CaptureLogger		sink;
+	klog::FlightRecorder	recorder(&sink, DUMPFILE);
+	vector<klog::Record>	records;
+
+	sink.level(klog::Level::INFO);
+	for (int i = 0; i < 10; i++) {
+		recorder.debug("test", "debug", {{"seq", to_string(i)}});
+	}
+	recorder.info("test", "info");
+
+	if (sink.records.size() != 1 || sink.records[0].event != "info") {
+		console.error("test_forward", "sink level not honoured",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	if (!recorder.dump() || !read_dump(records)) {
+		console.error("test_forward", "dump failed");
+		return 0;
+	}
+
+	if (records.size() != 11 || records[3].level != klog::Level::DEBUG ||
+	    records[3].attrs["seq"] != "3" || records[10].event != "info") {
+		console.error("test_forward", "dump doesn't match",
+		    {{"records", to_string(records.size())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_wrap(void)
+{
+	CaptureLogger		sink;
+	klog::FlightRecorder	recorder(&sink, DUMPFILE, 1024);
+	vector<klog::Record>	records;
+	string			big(2048, 'x');
+
+	recorder.info("test", "too big", {{"big", big}});
+	for (int i = 0; i < 1000; i++) {
+		recorder.debug("test", "debug", {{"seq", to_string(i)}});
+	}
+
+	if (!recorder.dump() || !read_dump(records)) {
+		console.error("test_wrap", "dump failed");
+		return 0;
+	}
+
+	// Only the newest records fit, and they must be whole and in
+	// order.
+	if (records.empty() || records.size() > 30) {
+		console.error("test_wrap", "wrong number of records",
+		    {{"records", to_string(records.size())}});
+		return 0;
+	}
+
+	int	seq = 1000 - static_cast<int>(records.size());
+
+	for (auto& r : records) {
+		if (r.attrs["seq"] != to_string(seq++)) {
+			console.error("test_wrap", "records out of order",
+			    {{"seq", r.attrs["seq"]}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_threads(void)
+{
+	CaptureLogger		sink;
+	klog::FlightRecorder	recorder(&sink, DUMPFILE);
+	vector<thread>		threads;
+	vector<klog::Record>	records;
+	map<string, int>	next;
+
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(thread([&recorder, t]() {
+			for (int i = 0; i < 100; i++) {
+				recorder.debug("thread", to_string(t),
+				    {{"seq", to_string(i)}});
+			}
+		}));
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	recorder.fatal_noexit("test", "fatal");
+	if (!read_dump(records)) {
+		console.error("test_threads", "FATAL didn't dump");
+		return 0;
+	}
+
+	if (records.size() != 401 || records.back().event != "fatal") {
+		console.error("test_threads", "records lost",
+		    {{"records", to_string(records.size())}});
+		return 0;
+	}
+
+	for (auto& r : records) {
+		if (r.actor == "thread" &&
+		    r.attrs["seq"] != to_string(next[r.event]++)) {
+			console.error("test_threads", "thread's records out "
+			    "of order");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_crash(void)
+{
+	vector<klog::Record>	records;
+	int			status;
+	pid_t			pid = ::fork();
+
+	if (-1 == pid) {
+		console.error("test_crash", "fork failed");
+		return 0;
+	}
+
+	if (0 == pid) {
+		CaptureLogger		sink;
+		klog::FlightRecorder	recorder(&sink, DUMPFILE);
+
+		recorder.handle_crashes();
+		recorder.debug("child", "before crash");
+		::abort();
+	}
+
+	if (-1 == ::waitpid(pid, &status, 0) || !WIFSIGNALED(status) ||
+	    WTERMSIG(status) != SIGABRT) {
+		console.error("test_crash", "child didn't abort");
+		return 0;
+	}
+
+	if (!read_dump(records) || records.size() != 1 ||
+	    records[0].event != "before crash") {
+		console.error("test_crash", "no dump on SIGABRT");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// overflow recurses until the stack runs out.
+static size_t
+overflow(size_t depth)
+{
+	volatile char	frame[4096];
+
+	frame[0] = static_cast<char>(depth);
+	if (SIZE_MAX == depth) {
+		return 0;
+	}
+	return overflow(depth + 1) + static_cast<size_t>(frame[0]);
+}
+
+
+static int
+test_overflow(void)
+{
+	vector<klog::Record>	records;
+	int			status;
+	pid_t			pid = ::fork();
+
+	if (-1 == pid) {
+		console.error("test_overflow", "fork failed");
+		return 0;
+	}
+
+	if (0 == pid) {
+		CaptureLogger		sink;
+		klog::FlightRecorder	recorder(&sink, DUMPFILE);
+
+		recorder.handle_crashes();
+		recorder.debug("child", "before overflow");
+		::_exit(static_cast<int>(overflow(0)));
+	}
+
+	if (-1 == ::waitpid(pid, &status, 0) || !WIFSIGNALED(status) ||
+	    WTERMSIG(status) != SIGSEGV) {
+		console.error("test_overflow", "child didn't crash");
+		return 0;
+	}
+
+	if (!read_dump(records) || records.size() != 1 ||
+	    records[0].event != "before overflow") {
+		console.error("test_overflow", "no dump on stack overflow");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static void
+exit_on_abort(int)
+{
+	::_exit(7);
+}
+
+
+static int
+test_chain(void)
+{
+	vector<klog::Record>	records;
+	int			status;
+	pid_t			pid = ::fork();
+
+	if (-1 == pid) {
+		console.error("test_chain", "fork failed");
+		return 0;
+	}
+
+	if (0 == pid) {
+		CaptureLogger		sink;
+		klog::FlightRecorder	recorder(&sink, DUMPFILE);
+
+		::signal(SIGABRT, exit_on_abort);
+		recorder.handle_crashes();
+		recorder.debug("child", "before crash");
+		::abort();
+	}
+
+	if (-1 == ::waitpid(pid, &status, 0) || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 7) {
+		console.error("test_chain", "previous handler didn't run");
+		return 0;
+	}
+
+	if (!read_dump(records) || records.size() != 1) {
+		console.error("test_chain", "no dump before chaining");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"forward", test_forward},
+	{"wrap", test_wrap},
+	{"threads", test_threads},
+	{"crash", test_crash},
+	{"overflow", test_overflow},
+	{"chain", test_chain},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("flightrec_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("flightrec_test", "ok");
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <klogger/format.hh>
+#include <klogger/layout.hh>
+#include <klogger/logger.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+void
+Formatter::format(Format f)
+{
+	if (Format::LAYOUT != f) {
+		this->fmt.store(f);
+	}
+}
+
+
+Format
+Formatter::format(void) const
+{
+	return this->fmt.load();
+}
+
+
+bool
+Formatter::layout(const Layout& l)
+{
+	if (!l.good()) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	this->layouts.publish(std::unique_ptr<const Layout>(new Layout(l)));
+	this->fmt.store(Format::LAYOUT);
+	return true;
+}
+
+
+void
+Formatter::record(std::string& buf, Level level, std::uint64_t when,
+		  const std::string& actor, const std::string& event,
+		  const std::map<std::string, std::string>& attrs) const
+{
+	Format	f = this->fmt.load();
+
+	if (Format::LAYOUT == f) {
+		Published<Layout>::Reader	layout(this->layouts);
+
+		layout.get()->format(buf, level, when, actor, event, attrs);
+		return;
+	}
+
+	format_record(buf, f, level, when, actor, event, attrs);
+}
+
+
+void
+Formatter::body(std::string& buf, Level level, std::uint64_t when,
+		const Body& b) const
+{
+	Format	f = this->fmt.load();
+
+	if (Format::LAYOUT == f) {
+		std::map<std::string, std::string>	attrs;
+
+		b.attrs(attrs);
+
+		Published<Layout>::Reader	layout(this->layouts);
+
+		layout.get()->format(buf, level, when, b.actor(), b.event(),
+		    attrs);
+		return;
+	}
+
+	format_record_body(buf, f, level, when, b);
+}
+
+
+} // namespace klog
@@ -25,37 +25,187 @@
 #define __KLOGGER_INTERNAL_HH__
 
 
+#include <cstdint>
 #include <map>
 #include <ostream>
+#include <string>
 
+#include <klogger/format.hh>
 #include <klogger/logger.hh>
 
 
-// Determine whether to write the log message based on the current
-// level. l is the logger's current minimum logging level, and c is the
-// log level for the current method. For example,
+// Determine whether to write the log message based on the enabled
+// levels. m is the logger's set of enabled levels, and c is the log
+// level for the current method. For example,
 //   void
 //   Logger::info(std::string actor, std::string event)
 //   {
-//           LEVEL_CHECK(this->ilevel, Level::DEBUG);
+//           LEVEL_CHECK(this->ilevels, Level::INFO);
 //           // do the actual logging
 //   }
-#define LEVEL_CHECK(l, c) if ((l) > (c)) { return; }
+#define LEVEL_CHECK(m, c) if (0 == ((m) & level_bit(c))) { return; }
 
 namespace klog {
 
 constexpr auto	date_format = "%FT%T%z";
 
-static std::map<Level, std::string> level_strings = {
-	{Level::DEBUG,    "DEBUG"},
-	{Level::INFO,     "INFO"},
-	{Level::WARN,     "WARNING"},
-	{Level::ERROR,    "ERROR"},
-	{Level::CRITICAL, "CRITICAL"},
-	{Level::FATAL,    "FATAL"}
-};
+// level_string returns the name used for a level in text logs.
+const std::string&	level_string(Level level);
 
 std::string	timestamp(void);
+std::string	timestamp(std::uint64_t when);
+
+// thread_buffer returns a per-thread scratch buffer, emptied, that a
+// backend can assemble a record in before committing it with a single
+// write. The buffer must not be held across a call into another
+// logger.
+std::string&	thread_buffer(void);
+
+// format_header appends the "[timestamp] [LEVEL] " that starts a text
+// record to buf; format_header_nt omits the timestamp. format_body
+// appends the "[actor:A event:E] k=v ..." that follows it, and
+// format_attrs appends just the " k=v ..." part.
+void		format_header(std::string& buf, Level level,
+			      std::uint64_t when);
+void		format_header_nt(std::string& buf, Level level);
+void		format_body(std::string& buf,
+			    const std::string& actor,
+			    const std::string& event,
+			    const std::map<std::string, std::string>& attrs);
+void		format_attrs(std::string& buf,
+			     const std::map<std::string, std::string>& attrs);
+
+// format_log appends the text form of a record, including the trailing
+// newline, to buf. format_log_nt omits the timestamp.
+void		format_log(std::string& buf,
+			   Level level,
+			   std::uint64_t when,
+			   const std::string& actor,
+			   const std::string& event,
+			   const std::map<std::string, std::string>& attrs);
+void		format_log_nt(std::string& buf,
+			      Level level,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+// format_timestamp appends the text form of when to buf.
+void		format_timestamp(std::string& buf, std::uint64_t when);
+
+// format_record appends a record in format f, including the trailing
+// newline, to buf; format_record_body does the same for a record with
+// a prepared body.
+void		format_record(std::string& buf, Format f, Level level,
+			      std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+void		format_record_body(std::string& buf, Format f, Level level,
+				   std::uint64_t when, const Body& body);
+
+// fnv1a extends the FNV-1a hash h with the bytes of s; it is the hash
+// used by the tables keyed on actors and events. fnv1a_pair hashes an
+// actor and an event together.
+constexpr std::uint64_t	FNV_OFFSET = 14695981039346656037ULL;
+constexpr std::uint64_t	FNV_PRIME = 1099511628211ULL;
+
+inline std::uint64_t
+fnv1a(const std::string& s, std::uint64_t h = FNV_OFFSET)
+{
+	for (auto c : s) {
+		h ^= static_cast<unsigned char>(c);
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+inline std::uint64_t
+fnv1a_pair(std::uint64_t actor_hash, const std::string& event)
+{
+	// Separate the actor from the event with a NUL byte.
+	return fnv1a(event, actor_hash * FNV_PRIME);
+}
+
+
+// A MapBody is the Body of a record passed as an attribute map, for
+// loggers that hand records on to other loggers as bodies.
+class MapBody : public Body {
+public:
+	MapBody(const std::string& actor, const std::string& event,
+		const std::map<std::string, std::string>& attrs) :
+	    ractor(actor), revent(event), rattrs(attrs) {};
+
+	const std::string&	actor(void) const { return this->ractor; };
+	const std::string&	event(void) const { return this->revent; };
+	void			text(std::string& buf) const;
+	void			tlv(std::string& buf) const;
+	size_t			tlv_length(void) const;
+	void			attrs(std::map<std::string,
+				      std::string>& out) const;
+
+private:
+	const std::string&				ractor;
+	const std::string&				revent;
+	const std::map<std::string, std::string>&	rattrs;
+
+	MapBody(const MapBody&) = delete;
+	MapBody&	operator=(const MapBody&) = delete;
+};
+
+// open_logfd opens path for appending, creating it if needed; it
+// returns -1 on failure with errno set.
+int		open_logfd(const std::string& path, bool truncate);
+
+// write_fd writes all of buf to fd, returning the error condition that
+// resulted. Writes to an O_APPEND descriptor are appended atomically,
+// so concurrent writers need no further locking.
+LogError	write_fd(int fd, const char *buf, size_t length);
+
+// errno_error maps an errno value to the nearest LogError.
+LogError	errno_error(int errnum);
+
+// syslog_priority maps a level to its syslog(3) severity.
+int		syslog_priority(Level l);
+
+// connect_unix and connect_tcp open a stream connection to a unix
+// socket or a TCP host and port, returning -1 on failure.
+int		connect_unix(const std::string& path);
+int		connect_tcp(const std::string& host, std::uint16_t port);
+
+// format_rfc5424 appends an RFC 5424 syslog message for a record to
+// buf: the header, the attributes as STRUCTURED-DATA, and the text
+// body as the MSG. facility is a syslog(3) facility, already shifted.
+void		format_rfc5424(std::string& buf, int facility, Level l,
+			       std::uint64_t when, const std::string& host,
+			       const std::string& app,
+			       const std::string& procid,
+			       const std::string& actor,
+			       const std::string& event,
+			       const std::map<std::string, std::string>& attrs,
+			       const std::string& text);
+
+// An EmergencyBuffer is the fixed-size buffer the emergency path
+// formats a record into; it lives on the stack of the caller. Appends
+// that don't fit are dropped. format_emergency fills it with a text
+// record, and format_emergency_tlv with a BinLogger entry; both only
+// use integer arithmetic, and truncate each string to
+// EmergencyBuffer::STRING bytes. key may be null.
+struct EmergencyBuffer {
+	static constexpr size_t	SIZE = 512;
+	static constexpr size_t	STRING = 127;
+
+	size_t	used;
+	char	data[SIZE];
+};
+
+void		format_emergency(EmergencyBuffer& b, Level l,
+				 std::uint64_t when, const char *actor,
+				 const char *event, const char *key,
+				 long value);
+void		format_emergency_tlv(EmergencyBuffer& b, Level l,
+				     std::uint64_t when, const char *actor,
+				     const char *event, const char *key,
+				     long value);
 
 // Standard functions for writing out log messages and building
 // strings. The _nt variants do not log timestamps, expecting that
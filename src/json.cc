@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/format.hh>
+#include <internal.hh>
+#include <scan.hh>
+
+
+namespace klog {
+namespace json {
+
+
+// Escaped is the class of bytes that can't appear as themselves in a
+// JSON string: control bytes, quotes and backslashes.
+struct Escaped {
+	static constexpr char		first = '"';
+	static constexpr char		second = '\\';
+	static constexpr unsigned char	last = 0x1f;
+};
+
+
+size_t
+scan_scalar(const char *s, size_t length)
+{
+	return scan_bytes<Escaped>(s, length);
+}
+
+
+size_t
+scan(const char *s, size_t length)
+{
+	return pick_scanner<Escaped>().scan(s, length);
+}
+
+
+const char *
+scanner(void)
+{
+	return pick_scanner<Escaped>().name;
+}
+
+
+static void
+append_escape(std::string& buf, unsigned char c)
+{
+	static const char	hex[] = "0123456789abcdef";
+
+	switch (c) {
+	case '"':
+		buf += "\\\"";
+		break;
+	case '\\':
+		buf += "\\\\";
+		break;
+	case '\n':
+		buf += "\\n";
+		break;
+	case '\r':
+		buf += "\\r";
+		break;
+	case '\t':
+		buf += "\\t";
+		break;
+	case '\b':
+		buf += "\\b";
+		break;
+	case '\f':
+		buf += "\\f";
+		break;
+	default:
+		buf += "\\u00";
+		buf += hex[c >> 4];
+		buf += hex[c & 0xf];
+	}
+}
+
+
+void
+append_string(std::string& buf, const std::string& s)
+{
+	scan_func	find = pick_scanner<Escaped>().scan;
+	const char	*p = s.data();
+	size_t		left = s.size();
+
+	buf += '"';
+	while (left > 0) {
+		size_t	clean = find(p, left);
+
+		buf.append(p, clean);
+		if (clean == left) {
+			break;
+		}
+
+		append_escape(buf, static_cast<unsigned char>(p[clean]));
+		p += clean + 1;
+		left -= clean + 1;
+	}
+	buf += '"';
+}
+
+
+void
+format_log(std::string& buf, Level level, std::uint64_t when,
+	   const std::string& actor, const std::string& event,
+	   const std::map<std::string, std::string>& attrs)
+{
+	bool	first = true;
+
+	buf += "{\"time\":\"";
+	format_timestamp(buf, when);
+	buf += "\",\"level\":\"";
+	buf += level_string(level);
+	buf += "\",\"actor\":";
+	append_string(buf, actor);
+	buf += ",\"event\":";
+	append_string(buf, event);
+	buf += ",\"attrs\":{";
+	for (auto& kv : attrs) {
+		if (!first) {
+			buf += ',';
+		}
+		first = false;
+		append_string(buf, kv.first);
+		buf += ':';
+		append_string(buf, kv.second);
+	}
+	buf += "}}\n";
+}
+
+
+} // namespace json
+} // namespace klog
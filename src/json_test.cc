@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/filelog.hh>
+#include <klogger/format.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOG = "json_test.log";
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static int
+test_scan(void)
+{
+	const string	hits = string("\"\\\n\x1f", 4) + string(1, '\0');
+	const string	misses = " /\x7f\x80\xff~";
+
+	// Every offset in and around the 16- and 32-byte blocks.
+	for (size_t length = 0; length < 100; length++) {
+		string	clean(length, 'a');
+
+		for (size_t i = 0; i < length; i++) {
+			clean[i] = misses[i % misses.size()];
+		}
+
+		if (klog::json::scan(clean.data(), length) != length) {
+			console.error("test_scan", "false hit",
+			    {{"length", to_string(length)}});
+			return 0;
+		}
+
+		for (size_t at = 0; at < length; at++) {
+			for (auto c : hits) {
+				string	s = clean;
+
+				s[at] = c;
+				if (klog::json::scan(s.data(), length) != at ||
+				    klog::json::scan_scalar(s.data(),
+				    length) != at) {
+					console.error("test_scan", "missed byte",
+					    {{"length", to_string(length)},
+					     {"at", to_string(at)},
+					     {"scanner",
+					      klog::json::scanner()}});
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_escape(void)
+{
+	map<string, string>	cases = {
+		{"", "\"\""},
+		{"plain text", "\"plain text\""},
+		{"say \"hi\"", "\"say \\\"hi\\\"\""},
+		{"C:\\path", "\"C:\\\\path\""},
+		{"a\nb\tc\rd", "\"a\\nb\\tc\\rd\""},
+		{"\b\f", "\"\\b\\f\""},
+		{string("\x01\x1f", 2), "\"\\u0001\\u001f\""},
+		{string("nul\0byte", 8), "\"nul\\u0000byte\""},
+		{"caf\xc3\xa9", "\"caf\xc3\xa9\""},
+		{string(40, 'x') + "\"" + string(40, 'y'),
+		 "\"" + string(40, 'x') + "\\\"" + string(40, 'y') + "\""},
+	};
+
+	for (auto& c : cases) {
+		string	buf;
+
+		klog::json::append_string(buf, c.first);
+		if (buf != c.second) {
+			console.error("test_escape", "bad escape",
+			    {{"got", buf}, {"want", c.second}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+// strip_time removes the timestamp from a JSON record, which tests
+// can't predict.
+static string
+strip_time(const string& line)
+{
+	const string	prefix = "{\"time\":\"";
+	size_t		end;
+
+	if (line.compare(0, prefix.size(), prefix) != 0) {
+		return "";
+	}
+
+	end = line.find('"', prefix.size());
+	return line.substr(end + 1);
+}
+
+
+static int
+test_filelog(void)
+{
+	klog::FileLogger	flog(LOG, true);
+
+	flog.format(klog::Format::JSON);
+	flog.info("http", "request", {{"path", "/a\"b"},
+	    {"agent", "curl/8.0\n"}});
+	flog.warn("http", "slow");
+
+	// Records with prepared bodies are written as JSON too.
+	auto	clog = flog.with({{"request_id", "42"}});
+
+	clog->error("http", "failed", {{"status", "500"}});
+
+	flog.format(klog::Format::TEXT);
+	flog.info("http", "text");
+	flog.close();
+
+	string	log = read_file(LOG);
+	vector<string>	lines;
+	size_t		start = 0;
+
+	for (size_t end = log.find('\n'); end != string::npos;
+	    end = log.find('\n', start)) {
+		lines.push_back(log.substr(start, end - start));
+		start = end + 1;
+	}
+
+	vector<string>	want = {
+		",\"level\":\"INFO\",\"actor\":\"http\",\"event\":\"request\","
+		"\"attrs\":{\"agent\":\"curl/8.0\\n\",\"path\":\"/a\\\"b\"}}",
+		",\"level\":\"WARNING\",\"actor\":\"http\",\"event\":\"slow\","
+		"\"attrs\":{}}",
+		",\"level\":\"ERROR\",\"actor\":\"http\",\"event\":\"failed\","
+		"\"attrs\":{\"request_id\":\"42\",\"status\":\"500\"}}",
+	};
+
+	if (lines.size() != 4) {
+		console.error("test_filelog", "wrong number of records");
+		return 0;
+	}
+
+	for (size_t i = 0; i < want.size(); i++) {
+		if (strip_time(lines[i]) != want[i]) {
+			console.error("test_filelog", "bad record",
+			    {{"got", lines[i]}, {"want", want[i]}});
+			return 0;
+		}
+	}
+
+	if (lines[3].find("[INFO] [actor:http event:text]") == string::npos) {
+		console.error("test_filelog", "format not switched back");
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"scan", test_scan},
+	{"escape", test_escape},
+	{"filelog", test_filelog},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("json_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("json_test", "ok", {{"scanner", klog::json::scanner()}});
+}
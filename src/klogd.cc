@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+// klogd collects binary log entries from local processes over unix
+// sockets and writes them to one log; see Aggregator. It reports each
+// client's counters every interval, on SIGUSR1, and when it exits on
+// SIGINT or SIGTERM.
+
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include <klogger/aggregator.hh>
+#include <klogger/console.hh>
+
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static void
+usage(const char *prog)
+{
+	cerr << "Usage: " << prog << " [-d dgram_path] [-u stream_path] "
+	     << "-o logfile [-t]\n"
+	     << "       [-r rotate_bytes] [-k keep] [-j threads] "
+	     << "[-s stats_seconds]\n";
+	exit(EXIT_FAILURE);
+}
+
+
+// report logs each client's counters, with its record rate since the
+// last report.
+static void
+report(klog::Aggregator& agg, map<int64_t, uint64_t>& last, double secs)
+{
+	for (auto& c : agg.clients()) {
+		uint64_t	before = last[c.pid];
+		double		rate = secs > 0 ? (c.records - before) / secs : 0;
+
+		console.info("klogd", "client",
+		    {{"pid", to_string(c.pid)},
+		     {"records", to_string(c.records)},
+		     {"bytes", to_string(c.bytes)},
+		     {"dropped", to_string(c.dropped)},
+		     {"records/s", to_string(static_cast<uint64_t>(rate))}});
+		last[c.pid] = c.records;
+	}
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	klog::AggregatorConfig	config{"", "", "", false, 0, 5,
+				    thread::hardware_concurrency()};
+	long			interval = 60;
+	map<int64_t, uint64_t>	last;
+	sigset_t		signals;
+	int			c;
+
+	while (-1 != (c = ::getopt(argc, argv, "d:j:k:o:r:s:tu:"))) {
+		switch (c) {
+		case 'd':
+			config.datagram_path = optarg;
+			break;
+		case 'j':
+			config.threads = ::strtoul(optarg, nullptr, 10);
+			break;
+		case 'k':
+			config.keep = ::strtoul(optarg, nullptr, 10);
+			break;
+		case 'o':
+			config.logfile = optarg;
+			break;
+		case 'r':
+			config.rotate_size = ::strtoull(optarg, nullptr, 10);
+			break;
+		case 's':
+			interval = ::strtol(optarg, nullptr, 10);
+			break;
+		case 't':
+			config.text = true;
+			break;
+		case 'u':
+			config.stream_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (config.logfile.empty() || interval <= 0 ||
+	    (config.datagram_path.empty() && config.stream_path.empty())) {
+		usage(argv[0]);
+	}
+
+	// The workers inherit the mask, leaving the signals to sigwait.
+	::sigemptyset(&signals);
+	::sigaddset(&signals, SIGINT);
+	::sigaddset(&signals, SIGTERM);
+	::sigaddset(&signals, SIGUSR1);
+	::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	klog::Aggregator	agg(config);
+
+	if (!agg.start()) {
+		console.fatal("klogd", "failed to start",
+		    {{"logfile", config.logfile}});
+	}
+	console.info("klogd", "started",
+	    {{"logfile", config.logfile},
+	     {"threads", to_string(config.threads)}});
+
+	struct timespec	wait = {interval, 0};
+	time_t		since = ::time(nullptr);
+
+	while (true) {
+		int	sig = ::sigtimedwait(&signals, nullptr, &wait);
+
+		if (SIGINT == sig || SIGTERM == sig) {
+			break;
+		}
+		if (-1 == sig && EINTR == errno) {
+			continue;
+		}
+
+		report(agg, last, static_cast<double>(::time(nullptr) - since));
+		since = ::time(nullptr);
+	}
+
+	agg.stop();
+	report(agg, last, static_cast<double>(::time(nullptr) - since));
+	console.info("klogd", "stopped");
+	return agg.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+// klogd_load generates load for klogd: it forks a number of clients
+// that each send records as fast as they can, either in datagrams of
+// several entries each, or through a NetLogger, and reports the
+// overall rate.
+
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/netlog.hh>
+#include <klogger/tlv.hh>
+
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static void
+usage(const char *prog)
+{
+	cerr << "Usage: " << prog << " (-d dgram_path | -u stream_path) "
+	     << "[-c clients] [-n records] [-b batch]\n";
+	exit(EXIT_FAILURE);
+}
+
+
+// send_datagrams sends count records to the datagram socket at path,
+// batch entries to a datagram.
+static bool
+send_datagrams(const string& path, int client, long count, long batch)
+{
+	struct sockaddr_un	addr;
+	int			fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+	string			id = to_string(client);
+	string			buf;
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	if (-1 == ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr))) {
+		return false;
+	}
+
+	for (long i = 0; i < count;) {
+		buf.clear();
+		for (long j = 0; j < batch && i < count; j++, i++) {
+			klog::tlv::append_tlv_log(buf,
+			    static_cast<uint8_t>(klog::Level::INFO),
+			    static_cast<uint64_t>(::time(nullptr)), "load",
+			    "record", {{"client", id},
+			    {"seq", to_string(i)}});
+		}
+
+		while (-1 == ::send(fd, buf.data(), buf.size(), 0)) {
+			if (EINTR != errno && ENOBUFS != errno) {
+				return false;
+			}
+		}
+	}
+
+	::close(fd);
+	return true;
+}
+
+
+// send_stream logs count records through a NetLogger connected to the
+// stream socket at path.
+static bool
+send_stream(const string& path, int client, long count)
+{
+	klog::NetLogger	nlog(path, "");
+	string		id = to_string(client);
+
+	if (!nlog.connected()) {
+		return false;
+	}
+
+	for (long i = 0; i < count; i++) {
+		nlog.info("load", "record", {{"client", id},
+		    {"seq", to_string(i)}});
+	}
+	nlog.close();
+	return nlog.dropped()[klog::Level::INFO] == 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	string		dgram;
+	string		stream;
+	long		clients = 4;
+	long		count = 250000;
+	long		batch = 32;
+	vector<pid_t>	children;
+	int		failed = 0;
+	int		c;
+
+	while (-1 != (c = ::getopt(argc, argv, "b:c:d:n:u:"))) {
+		switch (c) {
+		case 'b':
+			batch = ::strtol(optarg, nullptr, 10);
+			break;
+		case 'c':
+			clients = ::strtol(optarg, nullptr, 10);
+			break;
+		case 'd':
+			dgram = optarg;
+			break;
+		case 'n':
+			count = ::strtol(optarg, nullptr, 10);
+			break;
+		case 'u':
+			stream = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (dgram.empty() == stream.empty() || clients < 1 || count < 1 ||
+	    batch < 1) {
+		usage(argv[0]);
+	}
+
+	auto	start = chrono::steady_clock::now();
+
+	for (int i = 0; i < clients; i++) {
+		pid_t	pid = ::fork();
+
+		if (0 == pid) {
+			bool	ok = dgram.empty() ?
+				    send_stream(stream, i, count) :
+				    send_datagrams(dgram, i, count, batch);
+
+			::_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		children.push_back(pid);
+	}
+
+	for (auto pid : children) {
+		int	status = 0;
+
+		::waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || EXIT_SUCCESS != WEXITSTATUS(status)) {
+			failed++;
+		}
+	}
+
+	double	secs = chrono::duration<double>(
+		    chrono::steady_clock::now() - start).count();
+	long	records = clients * count;
+
+	console.info("klogd_load", "done",
+	    {{"clients", to_string(clients)},
+	     {"failed", to_string(failed)},
+	     {"records", to_string(records)},
+	     {"seconds", to_string(secs)},
+	     {"records/s", to_string(static_cast<long>(records / secs))}});
+	return 0 == failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_AGGREGATOR_HH__
+#define __KLOGGER_AGGREGATOR_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// An AggregatorConfig describes the sockets an Aggregator listens on
+// and the log it writes. Either socket path may be empty. The log is a
+// binary log, or a text log like a FileLogger's if text is set; once
+// it grows past rotate_size bytes, it is renamed to logfile.1, the
+// older files move up by one, and only keep of them are kept. A
+// rotate_size of zero never rotates.
+struct AggregatorConfig {
+	std::string	datagram_path;
+	std::string	stream_path;
+	std::string	logfile;
+	bool		text;
+	std::uint64_t	rotate_size;
+	size_t		keep;
+	size_t		threads;
+};
+
+
+// ClientStats counts what an Aggregator has had from one process:
+// the records and bytes written to the log, and the records dropped
+// because they were malformed or couldn't be written.
+struct ClientStats {
+	std::int64_t	pid;
+	std::uint64_t	records;
+	std::uint64_t	bytes;
+	std::uint64_t	dropped;
+};
+
+
+// Aggregator is the core of klogd: it collects binary log entries from
+// local processes and writes them to one log. Datagrams on the
+// datagram socket carry one or more whole entries each. Connections to
+// the stream socket carry entries either bare or in a NetLogger's
+// batches, which are acknowledged once written, so a NetLogger can log
+// to it directly.
+//
+// Each of the worker threads runs its own epoll loop, taking its share
+// of datagrams and connections. A worker gathers everything it read in
+// one pass into a batch, writes it with one write, and then
+// acknowledges the batches in it. Clients are told apart by the pid in
+// their socket credentials.
+class Aggregator {
+public:
+	explicit Aggregator(const AggregatorConfig& config);
+	~Aggregator();
+
+	// start opens the log, binds the sockets and starts the
+	// workers, returning false if any of that failed.
+	bool		start(void);
+
+	// stop stops the workers and closes the sockets and the log.
+	// The counters are kept.
+	void		stop(void);
+
+	// clients returns the counters for every client seen so far,
+	// ordered by pid.
+	std::vector<ClientStats>	clients(void);
+
+	// good returns true if the last write to the log succeeded.
+	bool		good(void) const;
+
+private:
+	struct Worker;
+
+	AggregatorConfig			config;
+	int					datagram_fd;
+	int					listen_fd;
+	int					wake_fd;
+	std::vector<std::unique_ptr<Worker>>	workers;
+	std::mutex				out_lock;
+	int					out_fd;
+	std::uint64_t				out_size;
+	std::atomic<LogError>			err;
+
+	void		run(Worker& w);
+	void		read_datagrams(Worker& w);
+	void		accept_clients(Worker& w);
+	bool		read_stream(Worker& w, int fd);
+	void		flush(Worker& w);
+	LogError	write_out(const std::string& buf);
+	void		rotate(void);
+
+	Aggregator(const Aggregator&) = delete;
+	Aggregator&	operator=(const Aggregator&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_AGGREGATOR_HH__
@@ -25,16 +25,21 @@
 #define __KLOGGER_BINLOG_HH__
 
 
-#include <fstream>
 #include <map>
+#include <string>
+#include <vector>
 
 #include <klogger/logger.hh>
+#include <klogger/route.hh>
 
 
 namespace klog {
 
-// BinLogger writes logs to disk in a binary format.
-class BinLogger : Logger {
+// BinLogger writes logs to disk in a binary format. As with the
+// FileLogger, each record is encoded in a per-thread buffer and
+// appended with a single write(2), so a BinLogger may be shared
+// between threads without locking.
+class BinLogger : public BasicLogger {
 public:
 	// Create a new file logger where all messages are written
 	// to logfile. If truncate is true, the logfile will be
@@ -49,100 +54,40 @@ public:
 	// they will be created.
 	BinLogger(std::string logfile, std::string errfile, bool truncate);
 
-	~BinLogger() {};
-
-	// debug writes a log message with the DEBUG level.
-	void debug(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void debug(const std::string& actor,
-		   const std::string& event);
-
-	// info writes a log message with the INFO level.
-	void info(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void info(const std::string& actor,
-		  const std::string& event);
-
-	// warn writes a log message with the WARN level.
-	void warn(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void warn(const std::string& actor,
-		  const std::string& event);
-
-	// error writes a log message with the ERROR level.
-	void error(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void error(const std::string& actor,
-		   const std::string& event);
-
-	// critical writes a log message with the CRITICAL level.
-	void critical(const std::string& actor,
-		      const std::string& event,
-		      std::map<std::string, std::string> attrs);
-	void critical(const std::string& actor,
-		      const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exit code EXIT_FAILURE.
-	void fatal(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(const std::string& actor,
-		   const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exitcode.
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event);
-
-	// fatal_noexit writes a log message with the FATAL level but
-	// does not exit; the caller is expected to handle exiting the
-	// process after any cleanup.
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event,
-			  std::map<std::string, std::string> attrs);
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event);
-
-	// level sets the minimum logging level.
-	void            level(Level);
-
-	// good returns true if the logger is healthy.
-	bool            good(void);
-
-	// error returns the current error condition for a logger.
-	LogError        error(void);
+	// Create a new file logger that writes each level to the file
+	// given by routes; levels without a route are discarded. Each
+	// file is opened, and truncated if truncate is true, the first
+	// time a record is written to it.
+	BinLogger(const std::vector<Route>& routes, bool truncate);
+
+	~BinLogger();
+
+	// write emits a single record to the log file for its level.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// write_body emits a single record with a prepared body.
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// write_emergency writes a record without allocating or
+	// locking; see BasicLogger::emergency.
+	bool		write_emergency(Level l, std::uint64_t when,
+					const char *actor, const char *event,
+					const char *key, long value);
 
 	// close provides a mechanism for shutting down a logger.
 	int		close(void);
 
 private:
-	std::ofstream	outs;
-	std::ofstream	errs;
-	Level		ilevel;
-	LogError	err;
-
-	inline void	set_err(void) {
-		if (this->outs.good() && this->errs.good()) {
-			this->err = LogError::HEALTHY;
-		}
-		else if (this->outs.bad() || this->errs.bad()) {
-			this->err = LogError::ERR_DISK;
-			return;
-		}
-		else if (this->outs.fail() || this->errs.fail()) {
-			this->err = LogError::ERR_DISK;
-		}
-	}
+	LevelFiles	files;
+
+	void		commit(Level l, const std::string& buf);
+
+	BinLogger(const BinLogger&) = delete;
+	BinLogger&	operator=(const BinLogger&) = delete;
 };
 
 
@@ -25,101 +25,85 @@
 #define __KLOGGER_CONSOLE_HH__
 
 
+#include <cstdint>
 #include <map>
 
+#include <klogger/format.hh>
 #include <klogger/logger.hh>
 
 
 namespace klog {
 
 
-class ConsoleLogger : Logger {
+// A ConsoleMode selects how a ConsoleLogger writes to a stream. In LINE
+// mode, every record is written as soon as it is formatted. In BATCH
+// mode, records are gathered in a buffer and written together. AUTO
+// picks LINE mode for a terminal and BATCH mode for anything else, such
+// as the pipe a container runtime reads.
+enum class ConsoleMode : std::uint8_t {
+	AUTO,
+	LINE,
+	BATCH,
+};
+
+
+// ConsoleLogger writes DEBUG and INFO messages to standard output, and
+// all other messages to standard error. It writes to the descriptors
+// directly, through buffers that every ConsoleLogger in a process
+// shares under one lock, so records from different threads and
+// different loggers are never interleaved or split, and records keep
+// their order across the two streams.
+//
+// Batched records are written when the buffer fills, when a CRITICAL or
+// FATAL record is logged, once they have waited 100ms, on flush and
+// close, and when the process exits. Output written to the standard
+// streams by other means isn't ordered with them.
+class ConsoleLogger : public BasicLogger {
 public:
-	ConsoleLogger(void) :
-		err(LogError::HEALTHY), ilevel(DEFAULT_LEVEL) {};
+	ConsoleLogger(void);
+	explicit ConsoleLogger(ConsoleMode mode);
 	~ConsoleLogger(void) {};
 
-	// debug writes a log message with the DEBUG level.
-	void debug(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void debug(const std::string& actor,
-	    const std::string& event);
-
-	// info writes a log message with the INFO level.
-	void info(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void info(const std::string& actor,
-		  const std::string& event);
-
-	// warn writes a log message with the WARN level.
-	void warn(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void warn(const std::string& actor,
-	    const std::string& event);
-
-	// error writes a log message with the ERROR level.
-	void error(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void error(const std::string& actor,
-	    const std::string& event);
-
-	// critical writes a log message with the CRITICAL level.
-	void critical(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void critical(const std::string& actor,
-	    const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exit code EXIT_FAILURE.
-	void fatal(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void fatal(const std::string& actor,
-	    const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exitcode.
-	void fatal(int exitcode,
-	    const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void fatal(int exitcode,
-	    const std::string& actor,
-	    const std::string& event);
-   
-	// fatal_noexit writes a log message with the FATAL level but
-	// does not exit; the caller is expected to handle exiting the
-	// process after any cleanup.
-	void fatal_noexit(const std::string& actor,
-	    const std::string& event,
-	    std::map<std::string, std::string> attrs);
-	void fatal_noexit(const std::string& actor,
-	    const std::string& event);
-   
-	// level sets the minimum logging level.
-	void            level(Level);
-
-	// good returns true if the logger is healthy.
-	bool            good(void);
-
-	// error returns the current error condition for a logger.
-	LogError        error(void);
-
-	// close provides a mechanism for shutting down a logger.
+	// write emits a single record to the console.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// write_body emits a single record with a prepared body.
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// write_emergency writes a record without allocating or
+	// locking; see BasicLogger::emergency.
+	bool		write_emergency(Level l, std::uint64_t when,
+					const char *actor, const char *event,
+					const char *key, long value);
+
+	// flush writes out every batched record.
+	void		flush(void);
+
+	// format sets the format of the records written from now on;
+	// without an argument, it returns the current one. The default
+	// is Format::TEXT. layout switches to a user-defined Layout,
+	// returning false if it isn't good. Emergency records are always
+	// written as text.
+	void		format(Format f);
+	Format		format(void) const;
+	bool		layout(const Layout& l);
+
+	// close writes out the batched records; the logger writes
+	// nothing afterwards. Standard output and standard error are
+	// left open.
 	int		close(void);
 
 private:
-	LogError	err;
-	Level		ilevel;
-};
-
-
+	bool			line_out;
+	bool			line_err;
+	Formatter		formatter;
 
+	void		commit(Level l, const std::string& buf);
+};
 
 
 } // namespace klog
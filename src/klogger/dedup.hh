@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_DEDUP_HH__
+#define __KLOGGER_DEDUP_HH__
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <klogger/logger.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// DedupLogger collapses runs of identical records, in the manner of
+// syslog's "last message repeated N times". Records are compared by a
+// 64-bit hash of their level and TLV encoding, so a duplicate costs one
+// encoding and one hash, and never reaches the sink. When the run
+// ends, or a record of it arrives more than timeout after the run
+// started or was last reported, the sink is written a record at the
+// run's level from the actor "klog" with the event "last record
+// repeated", naming the record in the "actor" and "event" attributes
+// and counting the duplicates in "repeated". A run that goes quiet is
+// reported by a timer thread once it has been idle for timeout, rather
+// than waiting for the next record. The sink is written to without the
+// DedupLogger's lock held, so a slow sink holds up only its caller.
+//
+// Placed in front of a DeferredLogger or PerCPULogger, duplicates are
+// dropped before they are queued. The sink isn't owned by the
+// DedupLogger and must outlive it.
+class DedupLogger : public BasicLogger {
+public:
+	DedupLogger(BasicLogger *sink, std::chrono::milliseconds timeout);
+	DedupLogger(BasicLogger *sink);
+	~DedupLogger();
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// repeated returns the number of duplicates suppressed so far.
+	std::uint64_t	repeated(void) const;
+
+	// flush reports the current run, if it has any duplicates.
+	void		flush(void);
+
+	// close reports the current run and stops the timer; the sink
+	// is left open.
+	int		close(void);
+
+private:
+	BasicLogger			*sink;
+	std::uint64_t			 timeout;
+	std::mutex			 lock;
+	bool				 have_last;
+	std::uint64_t			 last;
+	Level				 last_level;
+	std::string			 last_actor;
+	std::string			 last_event;
+	std::uint64_t			 count;
+	std::uint64_t			 started;
+	std::uint64_t			 latest;
+	std::atomic<std::uint64_t>	 total;
+	std::condition_variable		 wake;
+	bool				 stopping;
+	std::thread			 timer;
+
+	bool		duplicate(Level l, std::uint64_t when,
+				  std::uint64_t hash,
+				  const std::string& actor,
+				  const std::string& event,
+				  Record& r, bool& ended);
+	bool		take(Record& r);
+	void		run(void);
+
+	DedupLogger(const DedupLogger&) = delete;
+	DedupLogger&	operator=(const DedupLogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_DEDUP_HH__
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_DEFERRED_HH__
+#define __KLOGGER_DEFERRED_HH__
+
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// DeferredLogger moves the cost of rendering records off the logging
+// threads. The logging thread only packs the level, the raw timestamp,
+// the actor, the event and the attribute bytes into a PackedRecord and
+// queues it; a worker thread unpacks each record and writes it to the
+// sink, so all of the formatting (the timestamp, the level name and
+// the attributes) is done on the worker.
+//
+// The queue enforces an OverflowPolicy, and a WARN record counting any
+// dropped records is written to the sink once the queue has drained.
+// The sink isn't owned by the DeferredLogger and must outlive it.
+class DeferredLogger : public BasicLogger {
+public:
+	DeferredLogger(BasicLogger *sink, OverflowPolicy policy);
+	DeferredLogger(BasicLogger *sink);
+	~DeferredLogger();
+
+	// write packs and queues a record. FATAL records are flushed
+	// through to the sink immediately, as the process is about to
+	// exit, as is every record written after close.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// flush writes every record queued so far to the sink.
+	void		flush(void);
+
+	// close flushes the queue and stops the worker. The sink is left
+	// open.
+	int		close(void);
+
+	// dropped returns the number of records dropped at each level.
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+private:
+	BasicLogger			*sink;
+	DropCounter			 drops;
+	BoundedQueue<PackedRecord>	 queue;
+	std::mutex			 collect;
+	std::atomic<bool>		 stopping;
+	std::thread			 worker;
+
+	void		run(void);
+
+	DeferredLogger(const DeferredLogger&) = delete;
+	DeferredLogger&	operator=(const DeferredLogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_DEFERRED_HH__
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_FASTLOG_HH__
+#define __KLOGGER_FASTLOG_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <klogger/logger.hh>
+#include <klogger/slots.hh>
+#include <klogger/tlv.hh>
+
+
+namespace klog {
+
+
+// cycles returns the cycle counter used to timestamp site entries. On
+// x86 this is the TSC; elsewhere it is the wall clock in nanoseconds.
+// The FastLogger writes clock anchors pairing the counter with the wall
+// clock, from which the decoder recovers the time of each entry.
+inline std::uint64_t
+cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return now();
+#endif
+}
+
+
+// A FastBuffer is one thread's pending output in a FastLogger. Only its
+// owning thread appends to it; the busy flag keeps a flush or close
+// from another thread out while it does so.
+struct FastBuffer {
+	static constexpr size_t	CAPACITY = 65536;
+
+	FastBuffer() : busy(false), used(0), spill(), data() {};
+
+	void
+	acquire(void)
+	{
+		while (this->busy.exchange(true, std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+
+	void
+	release(void)
+	{
+		this->busy.store(false, std::memory_order_release);
+	}
+
+	std::atomic<bool>	busy;
+	size_t			used;
+	std::string		spill;
+	char			data[CAPACITY];
+};
+
+
+// FastLogger writes a NanoLog-style binary log. Each static log site is
+// registered once, as a Site, with its level, actor, event and keys;
+// after that, a record is only the site's ID, a cycle counter and the
+// raw bytes of its arguments, appended to a buffer owned by the logging
+// thread. Buffers are written out when they fill, on flush and on close.
+// Records have to be decoded offline with a tlv::Decoder.
+//
+// The FastLogger is also a BasicLogger: ordinary calls are written as
+// BinLogger entries through the same buffers. FATAL records flush every
+// buffer.
+class FastLogger : public BasicLogger {
+public:
+	// Create a new fast logger writing to logfile. If truncate is
+	// true, the logfile will be truncated at initialisation.
+	FastLogger(std::string logfile, bool truncate);
+	~FastLogger();
+
+	// write appends a BinLogger entry to the calling thread's buffer.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// register_site writes a site registration to the log and
+	// returns the site's ID. types holds the type code of each
+	// argument: 'i', 'u', 'f' or 's'.
+	std::uint32_t	register_site(Level l, const std::string& actor,
+				      const std::string& event,
+				      const std::string& types,
+				      const std::vector<std::string>& keys);
+
+	// buffer returns the calling thread's buffer.
+	FastBuffer&	buffer(void) { return this->buffers.get(); };
+
+	// make_room writes out b, which the caller holds, and returns
+	// where a record of length bytes should be encoded. Records
+	// larger than a buffer are encoded into b.spill, and written by
+	// commit.
+	char		*make_room(FastBuffer& b, size_t length);
+
+	// commit completes a record at level l of length bytes encoded
+	// at the pointer returned by make_room or at the end of b.
+	void
+	commit(FastBuffer& b, Level l, size_t length)
+	{
+		this->count_write(l, length);
+		if (!b.spill.empty()) {
+			this->write_spill(b);
+			return;
+		}
+		b.used += length;
+	}
+
+	// flush writes out every thread's buffer.
+	void		flush(void);
+
+	// close flushes the buffers and closes the log file.
+	int		close(void);
+
+private:
+	std::atomic<int>		 fd;
+	std::mutex			 lock;
+	SlotTable<FastBuffer>		 buffers;
+	std::uint32_t			 next_site;
+
+	void		 write_out(FastBuffer& b);
+	void		 write_spill(FastBuffer& b);
+	void		 write_anchor(void);
+
+	FastLogger(const FastLogger&) = delete;
+	FastLogger&	operator=(const FastLogger&) = delete;
+};
+
+
+namespace fastlog {
+
+
+// Arg describes how a Site argument of type T is encoded: its type code
+// for the decoder, its encoded size, and put, which copies its raw
+// bytes to p and returns the end of them. Integers are widened to
+// 64 bits and floating-point values to double; strings are a 4-byte
+// length followed by their bytes. Everything is in native byte order.
+template <typename T, typename Enable = void>
+struct Arg;
+
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_integral<T>::value &&
+				      std::is_signed<T>::value>::type> {
+	static constexpr char	type = 'i';
+	static size_t	size(T) { return 8; }
+
+	static char *
+	put(char *p, T v)
+	{
+		std::int64_t	x = v;
+
+		std::memcpy(p, &x, sizeof(x));
+		return p + sizeof(x);
+	}
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_integral<T>::value &&
+				      std::is_unsigned<T>::value>::type> {
+	static constexpr char	type = 'u';
+	static size_t	size(T) { return 8; }
+
+	static char *
+	put(char *p, T v)
+	{
+		std::uint64_t	x = v;
+
+		std::memcpy(p, &x, sizeof(x));
+		return p + sizeof(x);
+	}
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<
+    std::is_floating_point<T>::value>::type> {
+	static constexpr char	type = 'f';
+	static size_t	size(T) { return 8; }
+
+	static char *
+	put(char *p, T v)
+	{
+		double	x = v;
+
+		std::memcpy(p, &x, sizeof(x));
+		return p + sizeof(x);
+	}
+};
+
+template <>
+struct Arg<std::string> {
+	static constexpr char	type = 's';
+
+	static size_t
+	size(const std::string& v)
+	{
+		return 4 + v.size();
+	}
+
+	static char *
+	put(char *p, const std::string& v)
+	{
+		std::uint32_t	n = static_cast<std::uint32_t>(v.size());
+
+		std::memcpy(p, &n, sizeof(n));
+		std::memcpy(p + sizeof(n), v.data(), v.size());
+		return p + sizeof(n) + v.size();
+	}
+};
+
+
+inline size_t
+args_size(void)
+{
+	return 0;
+}
+
+template <typename T, typename... Rest>
+inline size_t
+args_size(const T& v, const Rest&... rest)
+{
+	return Arg<T>::size(v) + args_size(rest...);
+}
+
+
+inline char *
+put_args(char *p)
+{
+	return p;
+}
+
+template <typename T, typename... Rest>
+inline char *
+put_args(char *p, const T& v, const Rest&... rest)
+{
+	return put_args(Arg<T>::put(p, v), rest...);
+}
+
+
+// length_size returns the size of the TLV length field for length,
+// and put_length writes it, as tlv::append_length does.
+inline size_t
+length_size(size_t length)
+{
+	size_t	n = 1;
+
+	if (length <= 0x7F) {
+		return n;
+	}
+	for (size_t l = length; l != 0; l >>= 8) {
+		n++;
+	}
+	return n;
+}
+
+inline char *
+put_length(char *p, size_t length)
+{
+	size_t	n = length_size(length) - 1;
+
+	if (0 == n) {
+		*p = static_cast<char>(length);
+		return p + 1;
+	}
+
+	*p++ = static_cast<char>(0x80 + n);
+	for (size_t i = n; i > 0; i--) {
+		*p++ = static_cast<char>((length >> ((i - 1) * 8)) & 0xFF);
+	}
+	return p;
+}
+
+
+} // namespace fastlog
+
+
+// A Site is a static log site for a FastLogger, such as
+//
+//   static const klog::Site<std::uint64_t, std::string> sent(
+//       flog, klog::Level::INFO, "server", "sent", {"bytes", "peer"});
+//   sent.log(n, peer);
+//
+// The site is registered with the logger when it is constructed. Each
+// argument type must be an integer, a floating-point type or a
+// std::string, and each call takes one value per key.
+template <typename... Args>
+class Site {
+public:
+	Site(FastLogger& out, Level l, const std::string& actor_name,
+	     const std::string& event_name,
+	     const std::string (&keys)[sizeof...(Args)]) :
+	    logger(out), level(l), actor(actor_name), event(event_name),
+	    id(0)
+	{
+		const char	types[] = {fastlog::Arg<Args>::type..., '\0'};
+
+		this->id = this->logger.register_site(l, actor_name,
+		    event_name, types, std::vector<std::string>(keys,
+		    keys + sizeof...(Args)));
+	}
+
+	void
+	log(const Args&... args) const
+	{
+		if (!this->logger.enabled(this->level, this->actor,
+		    this->event)) {
+			return;
+		}
+
+		std::uint64_t	started = this->logger.start_call();
+		std::uint64_t	t = cycles();
+		size_t		vlen = sizeof(this->id) + sizeof(t) +
+				       fastlog::args_size(args...);
+		size_t		length = 1 + fastlog::length_size(vlen) + vlen;
+		FastBuffer&	b = this->logger.buffer();
+		char		*p;
+
+		b.acquire();
+		if (length <= FastBuffer::CAPACITY - b.used) {
+			p = b.data + b.used;
+		}
+		else {
+			p = this->logger.make_room(b, length);
+		}
+
+		*p = static_cast<char>(tlv::TSiteEntry);
+		p = fastlog::put_length(p + 1, vlen);
+		std::memcpy(p, &this->id, sizeof(this->id));
+		std::memcpy(p + sizeof(this->id), &t, sizeof(t));
+		fastlog::put_args(p + sizeof(this->id) + sizeof(t), args...);
+		this->logger.commit(b, this->level, length);
+		b.release();
+
+		if (Level::FATAL == this->level) {
+			this->logger.flush();
+		}
+		this->logger.finish_call(started);
+	}
+
+private:
+	FastLogger&	logger;
+	Level		level;
+	std::string	actor;
+	std::string	event;
+	std::uint32_t	id;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_FASTLOG_HH__
@@ -25,16 +25,21 @@
 #define __KLOGGER_FILELOG_HH__
 
 
-#include <fstream>
 #include <map>
+#include <string>
+#include <vector>
 
+#include <klogger/format.hh>
 #include <klogger/logger.hh>
+#include <klogger/route.hh>
 
 
 namespace klog {
 
-// FileLogger writes logs to disk.
-class FileLogger : Logger {
+// FileLogger writes logs to disk. Each record is assembled in a
+// per-thread buffer and appended to its file with a single write(2),
+// so a FileLogger may be shared between threads without locking.
+class FileLogger : public BasicLogger {
 public:
 	// Create a new file logger where all messages are written
 	// to logfile. If truncate is true, the logfile will be
@@ -49,87 +54,50 @@ public:
 	// they will be created.
 	FileLogger(std::string logfile, std::string errfile, bool truncate);
 
-	~FileLogger() {};
-
-	// debug writes a log message with the DEBUG level.
-	void debug(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void debug(const std::string& actor,
-		   const std::string& event);
-
-	// info writes a log message with the INFO level.
-	void info(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void info(const std::string& actor,
-		  const std::string& event);
-
-	// warn writes a log message with the WARN level.
-	void warn(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void warn(const std::string& actor,
-		  const std::string& event);
-
-	// error writes a log message with the ERROR level.
-	void error(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void error(const std::string& actor,
-		   const std::string& event);
-
-	// critical writes a log message with the CRITICAL level.
-	void critical(const std::string& actor,
-		      const std::string& event,
-		      std::map<std::string, std::string> attrs);
-	void critical(const std::string& actor,
-		      const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exit code EXIT_FAILURE.
-	void fatal(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(const std::string& actor,
-		   const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exitcode.
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event);
-   
-	// fatal_noexit writes a log message with the FATAL level but
-	// does not exit; the caller is expected to handle exiting the
-	// process after any cleanup.
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event,
-			  std::map<std::string, std::string> attrs);
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event);
-   
-	// level sets the minimum logging level.
-	void            level(Level);
-
-	// good returns true if the logger is healthy.
-	bool            good(void);
-
-	// error returns the current error condition for a logger.
-	LogError        error(void);
+	// Create a new file logger that writes each level to the file
+	// given by routes; levels without a route are discarded. Each
+	// file is opened, and truncated if truncate is true, the first
+	// time a record is written to it.
+	FileLogger(const std::vector<Route>& routes, bool truncate);
+
+	~FileLogger();
+
+	// write emits a single record to the log file for its level.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// write_body emits a single record with a prepared body.
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// write_emergency writes a record without allocating or
+	// locking; see BasicLogger::emergency.
+	bool		write_emergency(Level l, std::uint64_t when,
+					const char *actor, const char *event,
+					const char *key, long value);
+
+	// format sets the format of the records written from now on;
+	// without an argument, it returns the current one. The default
+	// is Format::TEXT. layout switches to a user-defined Layout,
+	// returning false if it isn't good. Emergency records are always
+	// written as text.
+	void		format(Format f);
+	Format		format(void) const;
+	bool		layout(const Layout& l);
 
 	// close provides a mechanism for shutting down a logger.
 	int		close(void);
 
 private:
-	std::ofstream	outs;
-	std::ofstream	errs;
-	Level		ilevel;
-	LogError	err;
+	LevelFiles		files;
+	Formatter		formatter;
+
+	void		commit(Level l, const std::string& buf);
+
+	FileLogger(const FileLogger&) = delete;
+	FileLogger&	operator=(const FileLogger&) = delete;
 };
 
 
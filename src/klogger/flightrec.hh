@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_FLIGHTREC_HH__
+#define __KLOGGER_FLIGHTREC_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// FlightRecorder keeps the recent history of a process, so that the
+// DEBUG records leading up to a failure are available even when only
+// INFO and above are normally logged. The fields of every record are
+// copied into a fixed-size ring owned by the logging thread; the
+// oldest records are overwritten as the ring fills. Records the sink's level allows are also passed on to it, so
+// the recorder's own level decides what is recorded (everything, by
+// default) and the sink's what is written.
+//
+// dump encodes the records held in every ring, oldest first, as a
+// binary log that a tlv::Decoder can read, and writes it to the dump
+// file. It is called on a
+// FATAL record, and, once handle_crashes has been called, on SIGSEGV
+// and SIGABRT; it doesn't allocate or lock, so it is safe to call from
+// a signal handler. Records being written by other threads during a
+// dump may be lost. The sink isn't owned by the recorder and must
+// outlive it.
+class FlightRecorder : public BasicLogger {
+public:
+	// capacity is the size of each thread's ring in bytes.
+	FlightRecorder(BasicLogger *sink, std::string dumpfile,
+		       size_t capacity);
+	FlightRecorder(BasicLogger *sink, std::string dumpfile);
+	~FlightRecorder();
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// dump writes the contents of the rings to the dump file,
+	// replacing it, and returns false if it couldn't.
+	bool		dump(void);
+
+	// handle_crashes installs handlers for SIGSEGV and SIGABRT that
+	// dump this recorder and then pass the signal on to the handlers
+	// installed before them, or take its default action. The calling
+	// thread and every recording thread get an alternate signal
+	// stack, so that a stack overflow is dumped too. Only one
+	// recorder handles crashes at a time.
+	void		handle_crashes(void);
+
+	// close stops handling crashes; the sink is left open.
+	int		close(void);
+
+	// MAX_RINGS is the number of threads whose records can be
+	// recorded; threads beyond it are only passed on to the sink.
+	static constexpr size_t	MAX_RINGS = 256;
+
+private:
+	struct Ring;
+
+	BasicLogger			*sink;
+	std::string			 dumpfile;
+	size_t				 capacity;
+	std::atomic<std::uint64_t>	 keys[MAX_RINGS];
+	std::atomic<Ring *>		 rings[MAX_RINGS];
+	std::atomic<bool>		 dumping;
+
+	Ring		*ring(void);
+
+	FlightRecorder(const FlightRecorder&) = delete;
+	FlightRecorder&	operator=(const FlightRecorder&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_FLIGHTREC_HH__
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_FORMAT_HH__
+#define __KLOGGER_FORMAT_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <klogger/layout.hh>
+#include <klogger/logger.hh>
+#include <klogger/published.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// A Format selects how a text backend lays out its records. TEXT is
+// the "[timestamp] [LEVEL] [actor:A event:E] k=v" form written by
+// write_log. JSON writes one object per line:
+//
+//   {"time":"...","level":"INFO","actor":"A","event":"E","attrs":{"k":"v"}}
+//
+// LOGFMT writes logfmt, quoting only the values that need it:
+//
+//   time=... level=INFO actor=A event=E k=v msg="two words"
+//
+// LAYOUT writes records with a user-defined Layout.
+enum class Format : std::uint8_t {
+	TEXT,
+	JSON,
+	LOGFMT,
+	LAYOUT,
+};
+
+
+// A Formatter holds a text backend's format, and its layout if it has
+// one, and formats records with them. Either may be changed while
+// other threads format records. A replaced layout is freed once no
+// thread can still be using it.
+class Formatter {
+public:
+	Formatter() : fmt(Format::TEXT), lock(), layouts() {};
+
+	// format sets the format; without an argument, it returns it.
+	// Format::LAYOUT is only set by layout.
+	void		format(Format f);
+	Format		format(void) const;
+
+	// layout switches to Format::LAYOUT with a copy of l. It
+	// returns false, changing nothing, if l isn't good.
+	bool		layout(const Layout& l);
+
+	// record appends a record, including its trailing newline, to
+	// buf; body formats a record with a prepared body.
+	void		record(std::string& buf, Level level,
+			       std::uint64_t when, const std::string& actor,
+			       const std::string& event,
+			       const std::map<std::string,
+			       std::string>& attrs) const;
+	void		body(std::string& buf, Level level,
+			     std::uint64_t when, const Body& b) const;
+
+private:
+	std::atomic<Format>	fmt;
+	std::mutex		lock;
+	Published<Layout>	layouts;
+
+	Formatter(const Formatter&) = delete;
+	Formatter&	operator=(const Formatter&) = delete;
+};
+
+
+namespace json {
+
+
+// scan returns the offset of the first byte in s that has to be
+// escaped in a JSON string (a quote, a backslash or a control byte),
+// or length if there is none. It checks 32 bytes at a time with AVX2
+// where the CPU has it, 16 at a time with SSE2 on other x86 CPUs, and
+// a byte at a time elsewhere; scan_scalar always does the latter.
+size_t		scan(const char *s, size_t length);
+size_t		scan_scalar(const char *s, size_t length);
+
+// scanner names the implementation scan uses: "avx2", "sse2" or
+// "scalar".
+const char	*scanner(void);
+
+// append_string appends s to buf as a quoted JSON string. Runs of
+// bytes that need no escaping are copied whole. Bytes above 0x7f are
+// copied as they are, so s should be UTF-8.
+void		append_string(std::string& buf, const std::string& s);
+
+// format_log appends a record as a line of JSON to buf.
+void		format_log(std::string& buf, Level level, std::uint64_t when,
+			   const std::string& actor, const std::string& event,
+			   const std::map<std::string, std::string>& attrs);
+
+
+} // namespace json
+
+
+namespace logfmt {
+
+
+// scan returns the offset of the first byte in s that means a logfmt
+// value has to be quoted (a space or other control byte, '=' or a
+// quote), or length if there is none. It is vectorised
+// like json::scan; scan_scalar always checks a byte at a time.
+size_t		scan(const char *s, size_t length);
+size_t		scan_scalar(const char *s, size_t length);
+
+// scanner names the implementation scan uses: "avx2", "sse2" or
+// "scalar".
+const char	*scanner(void);
+
+// append_key appends k to buf as a logfmt key, replacing each byte
+// that can't appear in one with '_'. append_value appends v as it is
+// if it needs no quoting, or quoted and escaped as a JSON string.
+void		append_key(std::string& buf, const std::string& k);
+void		append_value(std::string& buf, const std::string& v);
+
+// format_log appends a record as a line of logfmt to buf.
+void		format_log(std::string& buf, Level level, std::uint64_t when,
+			   const std::string& actor, const std::string& event,
+			   const std::map<std::string, std::string>& attrs);
+
+// parse_line splits one line of logfmt, without its newline, into its
+// key/value pairs, appending them to pairs. A key without a value gets
+// an empty one. It returns false if the line is malformed.
+bool		parse_line(const char *s, size_t length,
+			   std::vector<std::pair<std::string,
+			   std::string>>& pairs);
+
+
+// A Parser reads records back from a stream of logfmt, such as a log
+// being tailed, in chunks of any size. The first time, level, actor
+// and event keys fill in those fields of a Record, and the rest, even
+// a repeat of one of those, become its attributes. Malformed lines are
+// skipped and counted.
+class Parser {
+public:
+	Parser() : partial(), pairs(), bad(0) {};
+
+	// feed parses the whole lines in data, appending their records
+	// to out. A line that isn't finished is kept until the rest of
+	// it arrives.
+	void		feed(const char *data, size_t length,
+			     std::vector<Record>& out);
+	void		feed(const std::string& data, std::vector<Record>& out);
+
+	// finish parses a last line that had no newline.
+	void		finish(std::vector<Record>& out);
+
+	// malformed returns the number of lines skipped so far.
+	std::uint64_t	malformed(void) const;
+
+private:
+	std::string	partial;
+	std::vector<std::pair<std::string, std::string>>	pairs;
+	std::uint64_t	bad;
+
+	void		parse(const char *line, size_t length,
+			      std::vector<Record>& out);
+};
+
+
+} // namespace logfmt
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_FORMAT_HH__
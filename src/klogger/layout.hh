@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_LAYOUT_HH__
+#define __KLOGGER_LAYOUT_HH__
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// A Layout is a user-defined record layout, given as a pattern of
+// literal text and fields such as
+//
+//   "%{time:%H:%M:%S}.%{msec} %{level} %{actor}/%{event}: %{attrs}"
+//
+// The fields are:
+//
+//   %{time}        the timestamp, as in a text log
+//   %{time:FMT}    the timestamp formatted by strftime(3) with FMT
+//   %{epoch}       seconds since the Unix epoch
+//   %{msec}        the milliseconds within the second, as 3 digits
+//   %{usec}        the microseconds within the second, as 6 digits
+//   %{level}       the level's name
+//   %{actor}       the actor
+//   %{event}       the event
+//   %{attrs}       every attribute, as logfmt key=value pairs
+//   %{attr:KEY}    the value of attribute KEY, or nothing
+//
+// and "%%" is a literal percent sign. Each record ends with a newline.
+//
+// The pattern is compiled once, when the Layout is created, into a
+// program of steps: runs of literal text become a single copy from a
+// string holding all of them, and every field a step of its own.
+// Formatting a record only runs the program.
+class Layout {
+public:
+	explicit Layout(const std::string& pattern);
+
+	// good returns true if the pattern compiled; error describes
+	// what is wrong with it otherwise.
+	bool			good(void) const;
+	const std::string&	error(void) const;
+
+	// format appends a record to buf.
+	void	format(std::string& buf, Level level, std::uint64_t when,
+		       const std::string& actor, const std::string& event,
+		       const std::map<std::string, std::string>& attrs) const;
+
+private:
+	enum class Op : std::uint8_t {
+		LITERAL,
+		TIME,
+		STRFTIME,
+		EPOCH,
+		MSEC,
+		USEC,
+		LEVEL,
+		ACTOR,
+		EVENT,
+		ATTRS,
+		ATTR,
+	};
+
+	// A Step is one op of the program. A LITERAL's text and a
+	// STRFTIME's format are length bytes at offset in chunks; an
+	// ATTR's key is names[offset].
+	struct Step {
+		Op		op;
+		std::uint32_t	offset;
+		std::uint32_t	length;
+	};
+
+	std::vector<Step>		program;
+	std::string			chunks;
+	std::vector<std::string>	names;
+	std::string			err;
+	std::uint64_t			serial;
+
+	bool		compile(const std::string& pattern);
+	bool		compile_field(const std::string& field);
+	void		literal(const char *s, size_t length);
+	void		format_time(std::string& buf, size_t step,
+				    std::uint64_t when) const;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_LAYOUT_HH__
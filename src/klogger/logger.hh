@@ -25,7 +25,16 @@
 #define __KLOGGER_LOGGER_HH__
 
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <klogger/published.hh>
 
 
 namespace klog {
@@ -78,6 +87,44 @@ enum class Level : int {
 
 constexpr Level	DEFAULT_LEVEL = Level::INFO;
 
+// LEVEL_COUNT is the number of levels; level_index maps a level to its
+// bit position, from 0 for DEBUG to 5 for FATAL, for use as an index
+// into per-level tables.
+constexpr size_t	LEVEL_COUNT = 6;
+size_t			level_index(Level l);
+
+// A LevelSet is an arbitrary set of levels, each level being the bit
+// given by its value, so that levels may be combined with |, as in
+// Level::DEBUG | Level::ERROR. at_or_above returns the set of levels
+// from l up to FATAL.
+typedef std::uint32_t	LevelSet;
+constexpr LevelSet	LEVELS_NONE = 0;
+constexpr LevelSet	LEVELS_ALL = 0x3F;
+
+constexpr LevelSet
+level_bit(Level l)
+{
+	return static_cast<LevelSet>(l);
+}
+
+constexpr LevelSet
+at_or_above(Level l)
+{
+	return LEVELS_ALL & ~(level_bit(l) - 1);
+}
+
+constexpr LevelSet
+operator|(Level a, Level b)
+{
+	return level_bit(a) | level_bit(b);
+}
+
+constexpr LevelSet
+operator|(LevelSet a, Level b)
+{
+	return a | level_bit(b);
+}
+
 
 // A LogError describes an error condition for a logger. This error
 // indicates the reason that the logger cannot write log messages.
@@ -217,6 +264,283 @@ public:
 };
 
 
+// A Body is the actor, event and attributes of a record, prepared ahead
+// of time so that backends can copy it straight into their output
+// rather than formatting it for every record. Each method appends one
+// encoding of the body to buf.
+class Body {
+public:
+	virtual
+	~Body() {};
+
+	// actor and event return the record's actor and event.
+	virtual
+	const std::string&	actor(void) const = 0;
+	virtual
+	const std::string&	event(void) const = 0;
+
+	// text appends the text form, "[actor:A event:E] k=v ...".
+	virtual
+	void		text(std::string& buf) const = 0;
+
+	// tlv appends the TLV string records for the actor, the event
+	// and each attribute key and value; tlv_length returns the
+	// number of bytes tlv will append.
+	virtual
+	void		tlv(std::string& buf) const = 0;
+	virtual
+	size_t		tlv_length(void) const = 0;
+
+	// attrs fills in the record's attributes.
+	virtual
+	void		attrs(std::map<std::string, std::string>& out) const = 0;
+};
+
+
+class ContextLogger;
+class LevelTable;
+class Metrics;
+struct MetricsSnapshot;
+
+
+// A BasicLogger implements the level methods of a Logger in terms of a
+// single write method, and holds the state that every backend shares:
+// the minimum level, any per-actor level overrides and the current
+// error condition. All of these may be read and updated concurrently,
+// so a BasicLogger may be shared between threads; implementations must
+// make write safe to call concurrently.
+class BasicLogger : public Logger {
+public:
+	BasicLogger(void);
+	virtual
+	~BasicLogger();
+
+	void debug(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs);
+	void debug(const std::string& actor,
+		   const std::string& event);
+	void info(const std::string& actor,
+		  const std::string& event,
+		  std::map<std::string, std::string> attrs);
+	void info(const std::string& actor,
+		  const std::string& event);
+	void warn(const std::string& actor,
+		  const std::string& event,
+		  std::map<std::string, std::string> attrs);
+	void warn(const std::string& actor,
+		  const std::string& event);
+	void error(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs);
+	void error(const std::string& actor,
+		   const std::string& event);
+	void critical(const std::string& actor,
+		      const std::string& event,
+		      std::map<std::string, std::string> attrs);
+	void critical(const std::string& actor,
+		      const std::string& event);
+	void fatal(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs);
+	void fatal(const std::string& actor,
+		   const std::string& event);
+	void fatal(int exitcode,
+		   const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs);
+	void fatal(int exitcode,
+		   const std::string& actor,
+		   const std::string& event);
+	void fatal_noexit(const std::string& actor,
+			  const std::string& event,
+			  std::map<std::string, std::string> attrs);
+	void fatal_noexit(const std::string& actor,
+			  const std::string& event);
+
+	// emergency writes a record from a signal handler, or anywhere
+	// else allocating and locking are unsafe. The record is
+	// formatted into a fixed-size buffer on the stack, with long
+	// strings truncated, and written straight to the backend's file
+	// descriptor; key and value add a single integer attribute, such
+	// as a signal number. Only the logger's level is checked, not
+	// any overrides. It returns false if the record wasn't written,
+	// or if the backend has no emergency path.
+	bool		emergency(Level l, const char *actor,
+				  const char *event);
+	bool		emergency(Level l, const char *actor,
+				  const char *event, const char *key,
+				  long value);
+
+	// level sets the minimum logging level, enabling every level
+	// from it up to FATAL; without an argument, it returns the
+	// lowest enabled level.
+	void            level(Level);
+	Level		level(void) const;
+
+	// levels enables exactly the levels in set, which needn't be
+	// contiguous; without an argument, it returns the enabled set.
+	void		levels(LevelSet set);
+	LevelSet	levels(void) const;
+
+	// good returns true if the logger is healthy.
+	bool            good(void);
+
+	// error returns the current error condition for a logger.
+	LogError        error(void);
+
+	// level with an actor, or with an actor and an event, overrides
+	// the minimum level for that actor's records or for that event;
+	// an event override takes precedence over an actor override.
+	// clear_levels removes every override.
+	void		level(const std::string& actor, Level l);
+	void		level(const std::string& actor,
+			      const std::string& event, Level l);
+	void		clear_levels(void);
+
+	// enabled returns true if a message at the given level would be
+	// written by this logger. Given an actor and an event, it also
+	// applies any overrides for them.
+	bool		enabled(Level);
+	bool		enabled(Level l, const std::string& actor,
+				const std::string& event);
+
+	// log writes a message at the given level, provided the logger's
+	// level permits it.
+	void		log(Level l,
+			    const std::string& actor,
+			    const std::string& event,
+			    const std::map<std::string, std::string>& attrs);
+
+	// write emits a single record regardless of the logger's level;
+	// when is the time the record was created, in nanoseconds since
+	// the Unix epoch. Loggers that hold on to records before passing
+	// them on (such as buffering loggers) use this to preserve the
+	// original timestamp.
+	virtual
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs) = 0;
+
+	// write_body emits a single record with a prepared body,
+	// regardless of the logger's level. The default unpacks the body
+	// and calls write; backends override it to copy the prepared
+	// encoding into their output directly.
+	virtual
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// write_emergency is the async-signal-safe write behind
+	// emergency; key may be null. The default writes nothing and
+	// returns false.
+	virtual
+	bool		write_emergency(Level l, std::uint64_t when,
+					const char *actor, const char *event,
+					const char *key, long value);
+
+	// with returns a child logger that adds attrs to every record
+	// it writes to this logger; see ContextLogger.
+	virtual
+	std::unique_ptr<ContextLogger>
+			with(const std::map<std::string, std::string>& attrs);
+
+	// metrics returns the logger's counters: the records and bytes
+	// it has written and dropped at each level, its write errors and
+	// flushes, and the latency of a sample of log calls.
+	MetricsSnapshot	metrics(void);
+
+	// start_call and finish_call time a sample of the calls that
+	// write records: start_call returns 0 for a call that isn't
+	// sampled, and finish_call takes what it returned. The level
+	// methods use them, as do schemas and FastLogger sites.
+	std::uint64_t	start_call(void);
+	void		finish_call(std::uint64_t started);
+
+	// dropped returns the number of records dropped at each level;
+	// loggers that never drop records return an empty map.
+	virtual
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+protected:
+	std::atomic<Level>	ilevel;
+	std::atomic<LevelSet>	ilevels;
+	std::atomic<LogError>	err;
+
+	// Backends report what they write through these: count_write
+	// for each record written, count_flush for each write of
+	// buffered records, and fail to set and count a write error.
+	void		count_write(Level l, size_t bytes);
+	void		count_flush(void);
+	void		fail(LogError e);
+
+private:
+	// Overrides are looked up in an immutable LevelTable, replaced
+	// as a whole on each update. Readers never lock; a replaced
+	// table is freed once no reader can still be using it.
+	Published<LevelTable>		overrides;
+	std::mutex			override_lock;
+	std::unique_ptr<Metrics>	stats;
+
+	void		publish(const std::string& actor,
+				const std::string& event, bool pair,
+				Level l);
+};
+
+
+// A ContextLogger is a child logger, returned by BasicLogger::with, that
+// adds a fixed set of bound attributes to every record it passes to its
+// parent. The bound attributes are rendered once, in text and TLV form,
+// and backends splice the prepared bytes into each record. The
+// attributes of each call follow them; a call attribute with the same
+// key as a bound one replaces it. Records must pass the parent's level
+// and overrides, checked as each is written; the child's own level,
+// DEBUG to begin with, can only narrow them. The parent must outlive
+// the child, and closing the child leaves the parent open.
+class ContextLogger : public BasicLogger {
+public:
+	ContextLogger(BasicLogger *parent,
+		      const std::map<std::string, std::string>& attrs);
+
+	// write passes the record, with the bound attributes, to the
+	// parent if the parent's levels allow it.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// with returns a child of the parent with both this logger's
+	// bound attributes and attrs.
+	std::unique_ptr<ContextLogger>
+			with(const std::map<std::string, std::string>& attrs);
+
+	// bound returns the attributes bound to this logger.
+	const std::map<std::string, std::string>&	bound(void) const;
+
+	using BasicLogger::error;
+
+	// good and error report the parent's condition.
+	bool		good(void);
+	LogError	error(void);
+
+	// close detaches the child; the parent is left open.
+	int		close(void);
+
+private:
+	BasicLogger				*parent;
+	std::map<std::string, std::string>	 attrs;
+	std::string				 text;
+	std::string				 tlv;
+
+	ContextLogger(const ContextLogger&) = delete;
+	ContextLogger&	operator=(const ContextLogger&) = delete;
+};
+
+
+// now returns the current time in nanoseconds since the Unix epoch.
+std::uint64_t	now(void);
+
+
 } // namespace klog
 
 
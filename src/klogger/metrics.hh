@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_METRICS_HH__
+#define __KLOGGER_METRICS_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/slots.hh>
+
+
+namespace klog {
+
+
+// LOG_ERROR_COUNT is the number of LogError values.
+constexpr size_t	LOG_ERROR_COUNT = 8;
+
+// Call latency is kept in a log-linear histogram: every power of two
+// is split into LATENCY_SUB_BUCKETS linear buckets, which bounds the
+// error of any reading to 1/LATENCY_SUB_BUCKETS of its value.
+constexpr size_t	LATENCY_SUB_BITS = 3;
+constexpr size_t	LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+constexpr size_t	LATENCY_BUCKETS =
+    (64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+// LATENCY_SAMPLE is how often a thread times a log call: one call in
+// every LATENCY_SAMPLE; it must be a power of two.
+constexpr std::uint32_t	LATENCY_SAMPLE = 8;
+
+// A MetricShard holds one thread's counters for one logger. Only that
+// thread updates it, so updates are plain relaxed loads and stores;
+// readers sum the shards of every thread.
+struct MetricShard {
+	MetricShard();
+
+	std::atomic<std::uint64_t>	records[LEVEL_COUNT];
+	std::atomic<std::uint64_t>	bytes[LEVEL_COUNT];
+	std::atomic<std::uint64_t>	errors[LOG_ERROR_COUNT];
+	std::atomic<std::uint64_t>	flushes;
+	std::atomic<std::uint64_t>	latency[LATENCY_BUCKETS];
+	std::atomic<std::uint64_t>	latency_sum;
+};
+
+
+// A MetricsSnapshot is a logger's counters at one moment, summed over
+// every thread. Latencies are in nanoseconds; latency lists the
+// non-empty histogram buckets in order, each as its exclusive upper
+// bound and its count.
+struct MetricsSnapshot {
+	MetricsSnapshot();
+
+	std::map<Level, std::uint64_t>		records;
+	std::map<Level, std::uint64_t>		bytes;
+	std::map<Level, std::uint64_t>		dropped;
+	std::map<LogError, std::uint64_t>	errors;
+	std::uint64_t				flushes;
+	std::uint64_t				samples;
+	std::uint64_t				latency_sum;
+	std::vector<std::pair<std::uint64_t, std::uint64_t>>	latency;
+
+	// percentile returns the upper bound of the bucket holding the
+	// pth percentile of the sampled latencies, with p between 0 and
+	// 100, or 0 if nothing has been sampled.
+	std::uint64_t	percentile(double p) const;
+
+	// text returns the snapshot in the Prometheus text exposition
+	// format, with every series labelled with the logger's name.
+	std::string	text(const std::string& name) const;
+};
+
+
+// Metrics counts what a logger writes. Counters live in per-thread
+// shards, so counting costs a handful of uncontended stores; the
+// shards are only summed when a snapshot is taken. Call latency is
+// read from the timestamp counter where there is one.
+//
+// Shards are kept in a SlotTable, so neither finding nor adding one
+// takes a lock, and an exited thread's shard is taken over, counts
+// and all, by the next new thread.
+class Metrics {
+public:
+	Metrics();
+
+	// wrote counts a record of the given size written at level l.
+	void		wrote(Level l, size_t bytes);
+
+	// failed counts a write error.
+	void		failed(LogError e);
+
+	// flushed counts a write of buffered records.
+	void		flushed(void);
+
+	// start begins timing a log call, returning 0 if this call
+	// isn't sampled; finish records the call's latency.
+	std::uint64_t	start(void);
+	void		finish(std::uint64_t started);
+
+	// snapshot sums every thread's counters. Drops aren't counted
+	// here; the logger fills them in.
+	MetricsSnapshot	snapshot(void);
+
+private:
+	SlotTable<MetricShard>		shards;
+
+	Metrics(const Metrics&) = delete;
+	Metrics&	operator=(const Metrics&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_METRICS_HH__
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_NETLOG_HH__
+#define __KLOGGER_NETLOG_HH__
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+
+
+namespace klog {
+
+
+// A NetRecord is a record already encoded as a binary log entry.
+struct NetRecord {
+	Level		level;
+	std::string	data;
+};
+
+inline Level
+record_level(const NetRecord& r)
+{
+	return r.level;
+}
+
+
+// NET_BATCH is the most entries, in bytes, a NetLogger puts in one
+// batch, and NET_WINDOW the most batches it has unacknowledged at once.
+constexpr size_t	NET_BATCH = 65536;
+constexpr size_t	NET_WINDOW = 8;
+
+
+// NetLogger streams records in the BinLogger's format to a collector
+// over TCP or a unix stream socket. Records are encoded on the calling
+// thread; a worker makes the connection, so logging threads never wait
+// on it, and sends them in batches of up to NET_BATCH bytes, each
+// framed as a tlv::TBatch carrying a sequence number, and the collector
+// acknowledges them with tlv::TAck. Once NET_WINDOW batches are
+// unacknowledged, records wait in the queue, so a slow collector is
+// handled by the overflow policy; a collector that acknowledges
+// nothing for ten seconds is treated as unreachable.
+//
+// While the collector is unreachable, batches are appended to the
+// spill file, if one was given, and sent ahead of newer records once a
+// connection is made; reconnection backs off from 100ms up to 30s.
+// Anything undelivered at close is left in the spill file for the next
+// NetLogger using it. Unacknowledged batches are sent again on a new
+// connection, so a collector may see a few twice.
+class NetLogger : public BasicLogger {
+public:
+	// These connect to host and port over TCP.
+	NetLogger(std::string host, std::uint16_t port, std::string spillfile,
+		  OverflowPolicy policy);
+	NetLogger(std::string host, std::uint16_t port, std::string spillfile);
+
+	// These connect to the unix stream socket at path.
+	NetLogger(std::string path, std::string spillfile,
+		  OverflowPolicy policy);
+	NetLogger(std::string path, std::string spillfile);
+	~NetLogger();
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// flush sends the queued records if the window allows, or spills
+	// them if the collector isn't connected. It doesn't connect or
+	// wait for acknowledgements.
+	void		flush(void);
+
+	// close waits up to a couple of seconds for the collector to
+	// acknowledge everything, spills whatever it didn't, and closes
+	// the connection.
+	int		close(void);
+
+	// connected returns true if the collector is connected.
+	bool		connected(void);
+
+	// spilled returns the number of bytes waiting in the spill file.
+	std::uint64_t	spilled(void);
+
+	// dropped returns the number of records dropped at each level,
+	// because the queue was full or the spill file couldn't take
+	// them.
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+private:
+	// A Batch is a batch awaiting acknowledgement; spilled is set if
+	// it was read back from the spill file.
+	struct Batch {
+		std::uint64_t	seq;
+		std::string	entries;
+		bool		spilled;
+	};
+
+	std::string			host;
+	std::uint16_t			port;
+	std::string			path;
+	std::string			spill_path;
+	DropCounter			drops;
+	BoundedQueue<NetRecord>		queue;
+	size_t				limit;
+	int				fd;
+	int				spill_fd;
+	std::uint64_t			spill_read;
+	std::uint64_t			spill_size;
+	std::uint64_t			next_seq;
+	std::vector<NetRecord>		backlog;
+	std::deque<Batch>		unacked;
+	std::string			acks;
+	std::chrono::milliseconds	backoff;
+	std::chrono::steady_clock::time_point	next_attempt;
+	std::chrono::steady_clock::time_point	last_ack;
+	std::mutex			sending;	// guards delivery
+	std::mutex			collect;	// guards the connection
+	std::atomic<bool>		stopping;
+	std::thread			worker;
+
+	void		enqueue(Level l, std::string& buf);
+	void		open_spill(void);
+	bool		connect(bool last);
+	void		disconnect(void);
+	bool		send(Batch& batch);
+	bool		submit(std::string& entries, bool spilled);
+	void		read_acks(void);
+	void		replay(void);
+	void		send_backlog(void);
+	void		spill_backlog(void);
+	bool		spill_entries(const std::string& entries);
+	void		persist(void);
+	bool		pump(void);
+	void		count_sent(size_t start, size_t end);
+	bool		idle(void);
+	bool		wait_acks(int timeout);
+	void		run(void);
+
+	NetLogger(const NetLogger&) = delete;
+	NetLogger&	operator=(const NetLogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_NETLOG_HH__
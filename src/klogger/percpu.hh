@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_PERCPU_HH__
+#define __KLOGGER_PERCPU_HH__
+
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// PerCPULogger buffers records in one buffer per CPU, so that threads
+// running on different CPUs never touch the same cache lines. A
+// collector thread periodically drains the buffers, merges them by
+// timestamp and hands the records to the sink. Records written by a
+// single thread always reach the sink in the order they were written.
+//
+// Each buffer holds at most the policy's capacity; when one fills, the
+// collector is woken early and the overflow policy decides what to do
+// with the new record. Once the buffers have been drained, a WARN
+// record counting the dropped records is written to the sink.
+//
+// The sink is typically a FileLogger or BinLogger; it isn't owned by
+// the PerCPULogger and must outlive it.
+class PerCPULogger : public BasicLogger {
+public:
+	// Create a new per-CPU logger in front of sink. The collector
+	// drains the buffers every interval.
+	PerCPULogger(BasicLogger *sink, std::chrono::milliseconds interval,
+		     OverflowPolicy policy);
+	PerCPULogger(BasicLogger *sink, std::chrono::milliseconds interval);
+	PerCPULogger(BasicLogger *sink);
+	~PerCPULogger();
+
+	// write buffers a record on the current CPU. FATAL records are
+	// flushed through to the sink immediately, as the process is
+	// about to exit.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// flush hands every record buffered so far to the sink.
+	void		flush(void);
+
+	// close flushes the buffers and stops the collector. The sink
+	// is left open.
+	int		close(void);
+
+	// dropped returns the number of records dropped at each level.
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+private:
+	struct Entry {
+		Record		record;
+		std::uint64_t	thread;
+		std::uint64_t	seq;
+
+		friend Level
+		record_level(const Entry& e)
+		{
+			return e.record.level;
+		}
+	};
+
+	typedef BoundedQueue<Entry>	Shard;
+
+	BasicLogger				*sink;
+	std::chrono::milliseconds		 interval;
+	DropCounter				 drops;
+	std::vector<std::unique_ptr<Shard>>	 shards;
+	std::mutex				 collect;
+	std::mutex			 wait;
+	std::condition_variable		 wake;
+	bool				 stopping;
+	std::thread			 collector;
+
+	void		run(void);
+	void		drain(void);
+
+	PerCPULogger(const PerCPULogger&) = delete;
+	PerCPULogger&	operator=(const PerCPULogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_PERCPU_HH__
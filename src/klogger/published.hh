@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_PUBLISHED_HH__
+#define __KLOGGER_PUBLISHED_HH__
+
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+namespace klog {
+
+
+// Readers are counted in PUBLISHED_STRIPES counters, each on its own
+// cache line, so that threads reading at once seldom share one.
+constexpr size_t	PUBLISHED_STRIPES = 16;
+
+// A writer waits for each stripe's readers to leave for at most
+// PUBLISHED_SPINS yields before leaving old objects to be freed by the
+// next publish.
+constexpr int		PUBLISHED_SPINS = 1000;
+
+
+// published_stripe returns the calling thread's reader stripe.
+inline size_t
+published_stripe(void)
+{
+	static std::atomic<size_t>	next(0);
+	static thread_local size_t	stripe =
+	    next.fetch_add(1, std::memory_order_relaxed) % PUBLISHED_STRIPES;
+
+	return stripe;
+}
+
+
+// A Published holds an immutable object that readers use without
+// locking while writers replace it as a whole. A reader holds a
+// Reader for as long as it uses the object; a replaced object is freed
+// once every reader that might have seen it has left. Writers must be
+// serialised by the caller.
+template <typename T>
+class Published {
+public:
+	Published() : current(nullptr), retired(), readers() {};
+
+	~Published()
+	{
+		delete this->current.load();
+	}
+
+	// A Reader pins the object published when it was created.
+	class Reader {
+	public:
+		explicit Reader(const Published& p) :
+		    owner(p), stripe(published_stripe()), object(nullptr)
+		{
+			this->owner.readers[this->stripe].count.fetch_add(1);
+			this->object = this->owner.current.load();
+		}
+
+		~Reader()
+		{
+			this->owner.readers[this->stripe].count.fetch_sub(1,
+			    std::memory_order_release);
+		}
+
+		const T		*get(void) const { return this->object; };
+
+	private:
+		const Published	&owner;
+		size_t		 stripe;
+		const T		*object;
+
+		Reader(const Reader&) = delete;
+		Reader&	operator=(const Reader&) = delete;
+	};
+
+	// empty returns true if nothing is published; it needs no
+	// Reader, as nothing is dereferenced.
+	bool
+	empty(void) const
+	{
+		return nullptr == this->current.load(std::memory_order_acquire);
+	}
+
+	// latest returns the published object to a writer.
+	const T *
+	latest(void) const
+	{
+		return this->current.load(std::memory_order_relaxed);
+	}
+
+	// publish replaces the object with next, which may be null, and
+	// frees the objects no reader can still be using.
+	void
+	publish(std::unique_ptr<const T> next)
+	{
+		const T	*old = this->current.exchange(next.release());
+
+		if (old != nullptr) {
+			this->retired.emplace_back(old);
+		}
+		this->reclaim();
+	}
+
+private:
+	// Stripes are padded rather than aligned, as C++11 operator new
+	// doesn't honour extended alignment.
+	struct Stripe {
+		Stripe() : count(0), pad() {};
+
+		mutable std::atomic<size_t>	count;
+		char			pad[64 - sizeof(std::atomic<size_t>)];
+	};
+
+	std::atomic<const T *>				current;
+	std::vector<std::unique_ptr<const T>>		retired;
+	Stripe						readers[PUBLISHED_STRIPES];
+
+	// reclaim frees the retired objects once each stripe has been
+	// seen empty. A reader that arrives afterwards loads the new
+	// object, as its count is raised before it loads.
+	void
+	reclaim(void)
+	{
+		if (this->retired.empty()) {
+			return;
+		}
+
+		for (auto& s : this->readers) {
+			int	spins = 0;
+
+			while (s.count.load() != 0) {
+				if (++spins > PUBLISHED_SPINS) {
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+		this->retired.clear();
+	}
+
+	Published(const Published&) = delete;
+	Published&	operator=(const Published&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_PUBLISHED_HH__
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_QUEUE_HH__
+#define __KLOGGER_QUEUE_HH__
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// Overflow selects what a buffering logger does with a new record when
+// its buffer is full.
+enum class Overflow {
+	// Block waits up to the policy's timeout for room in the buffer,
+	// then drops the new record.
+	Block,
+
+	// DropNewest drops the new record.
+	DropNewest,
+
+	// DropOldest drops the oldest buffered record to make room.
+	DropOldest,
+
+	// DropLowest drops the oldest buffered record of the lowest level
+	// present, so that DEBUG and INFO records are dropped before
+	// ERROR and FATAL. If the new record's level is no higher than
+	// any buffered record's, the new record is dropped instead.
+	DropLowest,
+};
+
+
+// An OverflowPolicy describes how a buffering logger handles back
+// pressure: capacity is the maximum number of buffered records, and
+// timeout is how long Block waits for room.
+struct OverflowPolicy {
+	Overflow			mode;
+	size_t				capacity;
+	std::chrono::milliseconds	timeout;
+};
+
+constexpr OverflowPolicy	DEFAULT_OVERFLOW = {
+	Overflow::Block, 65536, std::chrono::milliseconds(1000)
+};
+
+
+// DropCounter counts dropped records per level. It keeps running
+// totals, and separately the drops that haven't yet been reported.
+class DropCounter {
+public:
+	DropCounter();
+
+	// add counts one dropped record at level l.
+	void		add(Level l);
+
+	// totals returns the number of records dropped at each level
+	// over the lifetime of the counter.
+	std::map<Level, std::uint64_t>	totals(void) const;
+
+	// report fills in r with a synthetic WARN record describing the
+	// drops since the last report, returning false if there were
+	// none.
+	bool		report(Record& r);
+
+private:
+	std::atomic<std::uint64_t>	total[LEVEL_COUNT];
+	std::atomic<std::uint64_t>	pending[LEVEL_COUNT];
+};
+
+
+// A BoundedQueue is a multi-producer queue of records that enforces an
+// OverflowPolicy. T must be movable, and record_level(const T&) must
+// return the item's level.
+template <typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(OverflowPolicy p, DropCounter *counter) :
+	    policy(p), drops(counter), lock(), not_full(), not_empty(),
+	    items(), levels(), closed(false), pressure() {};
+
+	// on_pressure registers a function that is called, without the
+	// queue's lock held, whenever a push finds the queue full; a
+	// consumer that drains on a timer uses this to drain early.
+	void
+	on_pressure(std::function<void(void)> f)
+	{
+		this->pressure = f;
+	}
+
+	// push adds item to the queue, applying the overflow policy if
+	// the queue is full. It returns false if item was dropped.
+	bool
+	push(T&& item)
+	{
+		Level				l = record_level(item);
+		std::unique_lock<std::mutex>	guard(this->lock);
+
+		if (!this->closed && this->items.size() >= this->policy.capacity) {
+			if (!this->make_room(guard, l)) {
+				this->drops->add(l);
+				return false;
+			}
+		}
+
+		this->levels[level_index(l)]++;
+		this->items.push_back(std::move(item));
+		guard.unlock();
+		this->not_empty.notify_one();
+		return true;
+	}
+
+	// drain moves every queued item onto the end of out, in the
+	// order they were queued, and wakes any blocked producers.
+	void
+	drain(std::vector<T>& out)
+	{
+		{
+			std::lock_guard<std::mutex>	guard(this->lock);
+
+			for (auto& item : this->items) {
+				out.push_back(std::move(item));
+			}
+			this->items.clear();
+			for (size_t i = 0; i < LEVEL_COUNT; i++) {
+				this->levels[i] = 0;
+			}
+		}
+		this->not_full.notify_all();
+	}
+
+	// drain moves at most max queued items onto the end of out, oldest
+	// first, and wakes any blocked producers; whatever is left stays
+	// subject to the overflow policy.
+	void
+	drain(std::vector<T>& out, size_t max)
+	{
+		{
+			std::lock_guard<std::mutex>	guard(this->lock);
+
+			while (max > 0 && !this->items.empty()) {
+				T&	item = this->items.front();
+
+				this->levels[level_index(record_level(item))]--;
+				out.push_back(std::move(item));
+				this->items.pop_front();
+				max--;
+			}
+		}
+		this->not_full.notify_all();
+	}
+
+	// drain_all drains every queue in queues onto the end of out,
+	// holding all of their locks until the last has been drained.
+	// An item pushed to one queue after another was drained can then
+	// never be taken ahead of an item that producer pushed earlier.
+	static void
+	drain_all(const std::vector<std::unique_ptr<BoundedQueue>>& queues,
+		  std::vector<T>& out)
+	{
+		std::vector<std::unique_lock<std::mutex>>	guards;
+
+		for (auto& q : queues) {
+			guards.emplace_back(q->lock);
+		}
+
+		for (auto& q : queues) {
+			for (auto& item : q->items) {
+				out.push_back(std::move(item));
+			}
+			q->items.clear();
+			for (size_t i = 0; i < LEVEL_COUNT; i++) {
+				q->levels[i] = 0;
+			}
+		}
+
+		guards.clear();
+		for (auto& q : queues) {
+			q->not_full.notify_all();
+		}
+	}
+
+	// wait blocks until the queue has items, the queue is closed, or
+	// timeout passes. It returns true if there are items.
+	bool
+	wait(std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex>	guard(this->lock);
+
+		this->not_empty.wait_for(guard, timeout, [this]() {
+			return this->closed || !this->items.empty();
+		});
+		return !this->items.empty();
+	}
+
+	// size returns the number of queued items.
+	size_t
+	size(void)
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		return this->items.size();
+	}
+
+	// close wakes every waiting producer and consumer. Blocked
+	// producers add their records regardless of the capacity, so
+	// that nothing is lost while the consumer shuts down.
+	void
+	close(void)
+	{
+		{
+			std::lock_guard<std::mutex>	guard(this->lock);
+
+			this->closed = true;
+		}
+		this->not_full.notify_all();
+		this->not_empty.notify_all();
+	}
+
+private:
+	OverflowPolicy			policy;
+	DropCounter			*drops;
+	std::mutex			lock;
+	std::condition_variable		not_full;
+	std::condition_variable		not_empty;
+	std::deque<T>			items;
+	size_t				levels[LEVEL_COUNT];
+	bool				closed;
+	std::function<void(void)>	pressure;
+
+	// make_room applies the overflow policy to a full queue on
+	// behalf of a new record at level l. It returns false if the new
+	// record should be dropped.
+	bool
+	make_room(std::unique_lock<std::mutex>& guard, Level l)
+	{
+		if (this->pressure) {
+			guard.unlock();
+			this->pressure();
+			guard.lock();
+			if (this->items.size() < this->policy.capacity) {
+				return true;
+			}
+		}
+
+		switch (this->policy.mode) {
+		case Overflow::Block:
+			return this->not_full.wait_for(guard,
+			    this->policy.timeout, [this]() {
+				return this->closed ||
+				    this->items.size() < this->policy.capacity;
+			});
+		case Overflow::DropNewest:
+			return false;
+		case Overflow::DropOldest:
+			this->evict(this->items.begin());
+			return true;
+		case Overflow::DropLowest:
+			break;
+		}
+
+		size_t	lowest = 0;
+
+		while (lowest < LEVEL_COUNT && 0 == this->levels[lowest]) {
+			lowest++;
+		}
+
+		if (lowest >= level_index(l)) {
+			return false;
+		}
+
+		for (auto it = this->items.begin(); it != this->items.end(); it++) {
+			if (level_index(record_level(*it)) == lowest) {
+				this->evict(it);
+				break;
+			}
+		}
+		return true;
+	}
+
+	void
+	evict(typename std::deque<T>::iterator it)
+	{
+		Level	l = record_level(*it);
+
+		this->levels[level_index(l)]--;
+		this->drops->add(l);
+		this->items.erase(it);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue&	operator=(const BoundedQueue&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_QUEUE_HH__
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_RATELIMIT_HH__
+#define __KLOGGER_RATELIMIT_HH__
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+
+
+namespace klog {
+
+
+// A RateLimit is a token bucket: records are let through at up to rate
+// per second on average, with bursts of up to burst records. A rate of
+// zero means no limit.
+struct RateLimit {
+	double	rate;
+	double	burst;
+};
+
+constexpr RateLimit	NO_RATE_LIMIT = {0, 0};
+
+
+// RateLimitLogger sits in front of another logger and limits what
+// reaches it. Each (actor, event) pair has its own token bucket, and
+// each level may be sampled, so that only a given fraction of its
+// records are kept. FATAL records are never limited or sampled.
+//
+// Records that are held back are counted, and at most once an interval
+// (and on flush and close) the sink is written a WARN record from the
+// actor "klog" for each limited pair, with the event "suppressed
+// records" and the count in "suppressed", and one with the event
+// "sampled records" counting the records dropped by sampling at each
+// level. The summary is written by the next record once it is due, or
+// by a timer thread if the records stop. The buckets are kept in a sharded hash map, so threads logging
+// different events rarely contend. A bucket that has been idle long
+// enough to refill, with nothing left to report, is removed when its
+// shard is next swept: at most once an interval, and on each summary.
+// The sink isn't owned by the RateLimitLogger and must outlive it.
+class RateLimitLogger : public BasicLogger {
+public:
+	RateLimitLogger(BasicLogger *sink, RateLimit limit,
+			std::chrono::milliseconds interval);
+	RateLimitLogger(BasicLogger *sink, RateLimit limit);
+	~RateLimitLogger();
+
+	// sample keeps each record at level l with the given
+	// probability, from 0 to 1.
+	void		sample(Level l, double probability);
+
+	// write passes a record to the sink if its sampling and its
+	// bucket allow.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// suppressed returns the number of records held back so far,
+	// by rate limiting or by sampling.
+	std::uint64_t	suppressed(void) const;
+
+	// buckets returns the number of token buckets held.
+	size_t		buckets(void);
+
+	// flush writes the summary records now.
+	void		flush(void);
+
+	// close stops the timer and writes the summary records; the
+	// sink is left open.
+	int		close(void);
+
+private:
+	static constexpr size_t	SHARDS = 64;
+
+	struct Bucket {
+		std::string	actor;
+		std::string	event;
+		double		tokens;
+		std::uint64_t	last;
+		std::uint64_t	suppressed;
+	};
+
+	typedef std::unordered_multimap<std::uint64_t, Bucket>	BucketMap;
+
+	// Buckets are keyed by the hash of their actor and event;
+	// pairs with the same hash have a bucket each. Shards are
+	// padded to whole cache lines rather than aligned, as C++11
+	// operator new doesn't honour extended alignment.
+	struct Shard {
+		Shard() : lock(), buckets(), last_sweep(0), pad() {};
+
+		std::mutex		lock;
+		BucketMap		buckets;
+		std::uint64_t		last_sweep;
+		char			pad[64 - (sizeof(std::mutex) +
+					    sizeof(BucketMap) +
+					    sizeof(std::uint64_t)) % 64];
+	};
+
+	BasicLogger			*sink;
+	RateLimit			 limit;
+	std::uint64_t			 interval;
+	std::uint64_t			 idle;
+	Shard				 shards[SHARDS];
+	std::atomic<std::uint64_t>	 sampling[LEVEL_COUNT];
+	DropCounter			 sampled;
+	std::atomic<std::uint64_t>	 total;
+	std::atomic<bool>		 pending;
+	std::atomic<std::uint64_t>	 last_summary;
+	std::mutex			 summary;
+	std::mutex			 tick;
+	std::condition_variable		 wake;
+	bool				 stopping;
+	std::thread			 timer;
+
+	bool		allow(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event);
+	Bucket&		bucket(Shard& shard, std::uint64_t h,
+			       std::uint64_t when, const std::string& actor,
+			       const std::string& event);
+	void		sweep(Shard& shard, std::uint64_t when);
+	bool		due(std::uint64_t when) const;
+	void		summarise(std::uint64_t when);
+	void		run(void);
+
+	RateLimitLogger(const RateLimitLogger&) = delete;
+	RateLimitLogger&	operator=(const RateLimitLogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_RATELIMIT_HH__
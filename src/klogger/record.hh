@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_RECORD_HH__
+#define __KLOGGER_RECORD_HH__
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// A Record is a log message held by a logger that doesn't write it out
+// immediately, such as a buffering logger. The timestamp is kept so
+// that the record is written with the time it was logged rather than
+// the time it reached its sink.
+struct Record {
+	Level		level;
+	std::uint64_t	when;
+	std::string	actor;
+	std::string	event;
+	std::map<std::string, std::string>	attrs;
+};
+
+
+// A PackedRecord is a compact binary copy of a record: the timestamp,
+// then the actor, event and attributes as length-prefixed strings, all
+// in one allocation. It is cheap to build on the logging thread and
+// is unpacked only when the record is rendered.
+struct PackedRecord {
+	Level		level;
+	std::string	data;
+};
+
+
+// pack_record packs a record into p.
+void	pack_record(PackedRecord& p, Level l, std::uint64_t when,
+		    const std::string& actor, const std::string& event,
+		    const std::map<std::string, std::string>& attrs);
+
+// unpack_record unpacks p into r, returning false if p is malformed.
+bool	unpack_record(const PackedRecord& p, Record& r);
+
+
+// record_level returns the level of a queued item; queues find it by
+// argument-dependent lookup, so other record types provide their own.
+inline Level
+record_level(const Record& r)
+{
+	return r.level;
+}
+
+inline Level
+record_level(const PackedRecord& p)
+{
+	return p.level;
+}
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_RECORD_HH__
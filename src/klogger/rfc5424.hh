@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_RFC5424_HH__
+#define __KLOGGER_RFC5424_HH__
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/syslog.hh>
+
+
+namespace klog {
+
+
+// A SyslogMessage is a record already formatted for the wire.
+struct SyslogMessage {
+	Level		level;
+	std::string	data;
+};
+
+inline Level
+record_level(const SyslogMessage& m)
+{
+	return m.level;
+}
+
+
+// SYSLOG_OVERFLOW is the default policy for the syslog transports: a
+// slow daemon costs new records rather than stalling the caller.
+constexpr OverflowPolicy	SYSLOG_OVERFLOW = {
+	Overflow::DropNewest, 65536, std::chrono::milliseconds(0)
+};
+
+
+// RFC5424Logger is the part shared by the syslog transports that speak
+// RFC 5424 themselves rather than going through syslog(3). Each
+// message is
+//
+//	<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - [klog@32473 ...] MSG
+//
+// with a UTC timestamp to the microsecond, the actor, event and
+// attributes as the parameters of the klog@32473 STRUCTURED-DATA
+// element, and the usual text body as the MSG. Parameter names are cut
+// to 32 characters, and characters RFC 5424 doesn't allow in them are
+// replaced with '_'.
+//
+// Records are formatted on the calling thread and queued for the
+// transport's worker; FATAL records are flushed before write returns.
+// There is no process-wide state, so any number of these loggers may
+// be used alongside each other and syslog(3).
+class RFC5424Logger : public BasicLogger {
+public:
+	RFC5424Logger(std::string ident, syslog::Facility facility,
+		      OverflowPolicy policy);
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// flush sends every queued message that the transport can.
+	virtual
+	void		flush(void) = 0;
+
+	// dropped returns the number of records dropped at each level,
+	// because the queue was full or they couldn't be delivered.
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+protected:
+	DropCounter			drops;
+	BoundedQueue<SyslogMessage>	queue;
+
+	// format formats a record as a message.
+	void		format(SyslogMessage& m, Level l, std::uint64_t when,
+			       const std::string& actor,
+			       const std::string& event,
+			       const std::map<std::string, std::string>& attrs,
+			       const std::string& text);
+
+	// report appends a message reporting any drops to batch.
+	void		report(std::vector<SyslogMessage>& batch);
+
+private:
+	std::string	ident;
+	int		facility;
+	std::string	host;
+	std::string	procid;
+
+	void		enqueue(Level l, std::uint64_t when,
+				const std::string& actor,
+				const std::string& event,
+				const std::map<std::string, std::string>& attrs,
+				const std::string& text);
+};
+
+
+// DatagramSyslogger sends messages to the local syslog daemon's unix
+// datagram socket, /dev/log by default. A worker sends them in batches
+// with sendmmsg(2), without blocking on the socket; if the daemon
+// can't keep up for long, the rest of the batch is dropped.
+class DatagramSyslogger : public RFC5424Logger {
+public:
+	DatagramSyslogger(std::string ident, syslog::Facility facility,
+			  std::string path, OverflowPolicy policy);
+	DatagramSyslogger(std::string ident, syslog::Facility facility,
+			  std::string path);
+	DatagramSyslogger(std::string ident, syslog::Facility facility);
+	~DatagramSyslogger();
+
+	void		flush(void);
+
+	// close sends the queued messages and closes the socket.
+	int		close(void);
+
+private:
+	std::string			path;
+	std::mutex			sock_lock;
+	int				fd;
+	std::mutex			collect;
+	std::atomic<bool>		stopping;
+	std::thread			worker;
+
+	bool		connect(void);
+	void		send(std::vector<SyslogMessage>& batch);
+	void		run(void);
+
+	DatagramSyslogger(const DatagramSyslogger&) = delete;
+	DatagramSyslogger&	operator=(const DatagramSyslogger&) = delete;
+};
+
+
+// StreamSyslogger sends messages to a syslog collector over TCP or a
+// unix stream socket, framed with RFC 6587 octet counting ("LEN SP
+// MSG"). A worker makes the connection, so that logging threads never
+// wait on it, and writes messages out in large batches. When the
+// connection fails, messages are kept in memory, up to the policy's
+// capacity with the oldest dropped beyond it, while the worker
+// reconnects with exponential backoff from 100ms up to 30s. Messages
+// that were being written when a connection failed are sent again on
+// the next one, so a collector may see a few twice.
+class StreamSyslogger : public RFC5424Logger {
+public:
+	// These connect to host and port over TCP.
+	StreamSyslogger(std::string ident, syslog::Facility facility,
+			std::string host, std::uint16_t port,
+			OverflowPolicy policy);
+	StreamSyslogger(std::string ident, syslog::Facility facility,
+			std::string host, std::uint16_t port);
+
+	// These connect to the unix stream socket at path.
+	StreamSyslogger(std::string ident, syslog::Facility facility,
+			std::string path, OverflowPolicy policy);
+	StreamSyslogger(std::string ident, syslog::Facility facility,
+			std::string path);
+	~StreamSyslogger();
+
+	// flush writes the queued messages if the collector is
+	// connected; it never connects itself.
+	void		flush(void);
+
+	// close makes a last attempt to deliver the queued messages,
+	// counts any left over as dropped, and closes the connection.
+	int		close(void);
+
+	// connected returns true if the collector is connected.
+	bool		connected(void);
+
+private:
+	std::string			host;
+	std::uint16_t			port;
+	std::string			path;
+	int				fd;
+	std::vector<SyslogMessage>	backlog;
+	size_t				limit;
+	std::chrono::milliseconds	backoff;
+	std::chrono::steady_clock::time_point	next_attempt;
+	std::mutex			sending;	// guards backlog
+	std::mutex			collect;	// guards the connection
+	std::atomic<bool>		stopping;
+	std::thread			worker;
+
+	bool		connect(bool last);
+	void		disconnect(void);
+	void		pump(bool last);
+	void		write_out(int sock);
+	void		run(void);
+
+	StreamSyslogger(const StreamSyslogger&) = delete;
+	StreamSyslogger&	operator=(const StreamSyslogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_RFC5424_HH__
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_ROUTE_HH__
+#define __KLOGGER_ROUTE_HH__
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// A Route sends every level in a set to the file at path.
+struct Route {
+	LevelSet	levels;
+	std::string	path;
+};
+
+
+// LevelFiles is the dispatch table used by the file loggers: it maps
+// each level to the file its records are written to, so finding the
+// file for a record is a single array index. Each file is opened the
+// first time a record is written to it, so the files for levels that
+// are never logged are never created. Levels without a route are
+// discarded.
+class LevelFiles {
+public:
+	LevelFiles(const std::vector<Route>& routes, bool truncate);
+	~LevelFiles();
+
+	// open_all opens every routed file now, returning false if any
+	// could not be opened.
+	bool		open_all(void);
+
+	// routed returns true if level l has a file; records at other
+	// levels are discarded.
+	bool		routed(Level l) const;
+
+	// write appends buf to the file for level l, opening it if
+	// needed, and returns the resulting error condition.
+	LogError	write(Level l, const char *buf, size_t length);
+
+	// write_emergency is write without locking, for the emergency
+	// path; an unopened file is opened without the lock.
+	LogError	write_emergency(Level l, const char *buf,
+					size_t length);
+
+	// close closes every open file, once the writes already under
+	// way have finished; no file is reopened after. It returns -1
+	// if any close failed.
+	int		close(void);
+
+private:
+	struct File {
+		std::string		path;
+		std::atomic<int>	fd;
+	};
+
+	std::vector<std::unique_ptr<File>>	files;
+	File					*table[LEVEL_COUNT];
+	bool					truncate;
+	std::mutex				open_lock;
+	std::atomic<size_t>			writers;
+
+	int		open(File& f);
+	int		install(File& f);
+	LogError	write_file(File& f, const char *buf, size_t length,
+				   bool emergency);
+
+	LevelFiles(const LevelFiles&) = delete;
+	LevelFiles&	operator=(const LevelFiles&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_ROUTE_HH__
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_SCHEMA_HH__
+#define __KLOGGER_SCHEMA_HH__
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+
+
+namespace klog {
+
+
+// SchemaBase holds the encodings of an event schema that don't change
+// from one record to the next: the text prefix, the text and TLV forms
+// of each key, and the size of the fixed part of the TLV body. It is
+// the untyped half of Schema, which should be used instead.
+class SchemaBase {
+public:
+	SchemaBase(const std::string& actor, const std::string& event,
+		   const std::string *names, size_t count);
+
+	// log writes a record with the given values, one per key in
+	// the order they were declared, to logger if its level permits.
+	void	log(BasicLogger& logger, Level l,
+		    const std::string *const *values) const;
+
+private:
+	std::string			sactor;
+	std::string			sevent;
+	std::vector<std::string>	keys;
+	std::string			text_prefix;
+	std::vector<std::string>	text_keys;
+	std::string			tlv_prefix;
+	std::vector<std::string>	tlv_keys;
+	size_t				tlv_fixed;
+
+	friend class SchemaBody;
+};
+
+
+// A Schema describes an event whose actor, event and attribute keys are
+// fixed at the log site, such as
+//
+//   static const klog::Schema<2> request("server", "request",
+//                                        {"client", "size"});
+//   request.info(log, client, size);
+//
+// Everything but the values is encoded once when the schema is
+// created, so a log call only copies the values into the backend's
+// output. The number of keys is part of the type, and a call with the
+// wrong number of values doesn't compile. Attributes are written in the
+// order the keys were declared.
+template <size_t N>
+class Schema : public SchemaBase {
+public:
+	Schema(const std::string& actor, const std::string& event,
+	       const std::string (&names)[N]) :
+	    SchemaBase(actor, event, names, N) {};
+
+	// log writes a record at level l; each value is a std::string.
+	template <typename... Args>
+	void
+	log(BasicLogger& logger, Level l, const Args&... values) const
+	{
+		static_assert(sizeof...(Args) == N,
+		    "a schema event takes one value per key");
+		const std::string	*v[N + 1] = {&values..., nullptr};
+
+		SchemaBase::log(logger, l, v);
+	}
+
+	template <typename... Args>
+	void
+	debug(BasicLogger& logger, const Args&... values) const
+	{
+		this->log(logger, Level::DEBUG, values...);
+	}
+
+	template <typename... Args>
+	void
+	info(BasicLogger& logger, const Args&... values) const
+	{
+		this->log(logger, Level::INFO, values...);
+	}
+
+	template <typename... Args>
+	void
+	warn(BasicLogger& logger, const Args&... values) const
+	{
+		this->log(logger, Level::WARN, values...);
+	}
+
+	template <typename... Args>
+	void
+	error(BasicLogger& logger, const Args&... values) const
+	{
+		this->log(logger, Level::ERROR, values...);
+	}
+
+	template <typename... Args>
+	void
+	critical(BasicLogger& logger, const Args&... values) const
+	{
+		this->log(logger, Level::CRITICAL, values...);
+	}
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_SCHEMA_HH__
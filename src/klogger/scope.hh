@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __KLOGGER_SCOPE_HH__
+#define __KLOGGER_SCOPE_HH__
+
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+// A RequestScope collects the DEBUG and INFO records logged while
+// handling one request, and writes them to the sink only if the request
+// fails. It is meant to live on the stack for the length of the
+// request:
+//
+//	klog::RequestScope	log(&service_log);
+//
+//	log.debug("handler", "parsed", {{"path", path}});
+//	...
+//
+// Records below the trigger level (ERROR, by default) are packed into
+// an arena. Records at or above it first write out the arena in order,
+// and from then on every record the sink's level allows goes straight
+// to it. When the scope is destroyed or closed without having been
+// triggered, the buffered WARN records the sink's level allows are
+// passed on, in order, and the rest of the arena is discarded.
+//
+// Buffered records are written to the sink regardless of its level,
+// so a failed request carries its DEBUG context. The arena holds up to
+// ARENA_LIMIT bytes; records past that are dropped and counted in a
+// WARN record written after the rest. Arenas are reused by later
+// scopes on the same thread, so a scope usually doesn't allocate.
+class RequestScope : public BasicLogger {
+public:
+	RequestScope(BasicLogger *sink, Level trigger);
+	explicit RequestScope(BasicLogger *sink);
+	~RequestScope();
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// triggered returns true once the buffered records have been
+	// written out.
+	bool		triggered(void);
+
+	// flush writes out the buffered records, as a record at the
+	// trigger level would.
+	void		flush(void);
+
+	// close passes on the buffered WARN records and discards the
+	// rest; the sink is left open.
+	int		close(void);
+
+	static constexpr size_t	ARENA_LIMIT = 65536;
+
+private:
+	BasicLogger	*sink;
+	Level		 trigger;
+	std::mutex	 lock;
+	bool		 failed;
+	std::string	 arena;
+	PackedRecord	 packed;
+	DropCounter	 drops;
+
+	void		write_out(void);
+	void		release(void);
+
+	RequestScope(const RequestScope&) = delete;
+	RequestScope&	operator=(const RequestScope&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_SCOPE_HH__
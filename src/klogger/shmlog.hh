@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_SHMLOG_HH__
+#define __KLOGGER_SHMLOG_HH__
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/tlv.hh>
+
+
+namespace klog {
+namespace shm {
+
+
+// The layout of a ring shared between a ShmLogger and a ShmCollector.
+// The segment is named "/NAME.PID.N", where N numbers the process's
+// loggers, and holds a RingHeader followed by
+// size bytes of slots. head and tail are byte positions that only
+// grow; a position's offset in the ring is position % size.
+//
+// A producer reserves space by moving head forward, writes the slot's
+// length and marks it RESERVED, copies in a BinLogger entry, and marks
+// it COMMITTED. A record that wouldn't fit before the end of the ring
+// is preceded by a PADDING slot filling the rest of it. The collector
+// reads committed slots from tail, zeroes them, and moves tail past
+// them.
+constexpr std::uint32_t	MAGIC = 0x6b6c6772;
+constexpr std::uint32_t	RING_VERSION = 1;
+
+constexpr std::uint32_t	SLOT_EMPTY = 0;
+constexpr std::uint32_t	SLOT_RESERVED = 1;
+constexpr std::uint32_t	SLOT_COMMITTED = 2;
+constexpr std::uint32_t	SLOT_PADDING = 3;
+
+// Slots are aligned to SLOT_ALIGN bytes; RING_SIZE is the default ring
+// size, which must be a power of two.
+constexpr size_t	SLOT_ALIGN = 8;
+constexpr size_t	RING_SIZE = 1 << 20;
+
+struct Slot {
+	std::atomic<std::uint32_t>	state;
+	std::uint32_t			length;
+};
+
+// magic is stored last, once the rest of the header is valid. closed
+// is set when the producer closes the ring, and dropped counts the
+// records the producer dropped because the ring was full.
+struct RingHeader {
+	RingHeader() : magic(0), version(RING_VERSION), size(0), pid(0),
+	    closed(0), head(0), tail(0), dropped(0) {};
+
+	std::atomic<std::uint32_t>	magic;
+	std::uint32_t			version;
+	std::uint64_t			size;
+	std::int64_t			pid;
+	std::atomic<std::uint32_t>	closed;
+	alignas(64) std::atomic<std::uint64_t>	head;
+	alignas(64) std::atomic<std::uint64_t>	tail;
+	alignas(64) std::atomic<std::uint64_t>	dropped;
+};
+
+// slot_length returns the space taken by a slot holding length bytes.
+inline size_t
+slot_length(size_t length)
+{
+	return (sizeof(Slot) + length + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+}
+
+
+} // namespace shm
+
+
+// ShmLogger writes records into a ring in shared memory for a
+// ShmCollector in another process to write out, so that the process
+// itself does no I/O. Records are encoded as BinLogger entries on the
+// calling thread and copied straight into the ring; any number of
+// threads may write at once. A record that doesn't fit in the ring is
+// dropped, and counted both here and in the ring for the collector to
+// report. The ring belongs to the creating process, so a process that
+// forks should create its loggers afterwards.
+class ShmLogger : public BasicLogger {
+public:
+	// name is the name the collector is given; size is the ring
+	// size, a power of two.
+	ShmLogger(std::string name, size_t size);
+	explicit ShmLogger(std::string name);
+	~ShmLogger();
+
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	// close waits for writes in progress, marks the ring closed and
+	// unmaps it. The collector removes it once it is drained; if it
+	// already is, close removes it itself.
+	int		close(void);
+
+	// segment returns the name of the shared memory segment.
+	const std::string&	segment(void) const;
+
+	// dropped returns the number of records dropped at each level.
+	std::map<Level, std::uint64_t>	dropped(void) const;
+
+private:
+	std::string			path;
+	size_t				size;
+	std::atomic<shm::RingHeader *>	header;
+	char				*ring;
+	std::atomic<size_t>		writers;
+	DropCounter			drops;
+
+	void		push(Level l, const std::string& entry);
+	void		push(shm::RingHeader *h, Level l,
+			     const std::string& entry);
+
+	ShmLogger(const ShmLogger&) = delete;
+	ShmLogger&	operator=(const ShmLogger&) = delete;
+};
+
+
+// ShmCollector drains the rings of every ShmLogger with a given name,
+// from any number of processes, into one log file: a binary log by
+// default, or a text log like a FileLogger's. Each drain writes
+// everything it collected in one write.
+//
+// New rings are found by scanning /dev/shm at most once a second.
+// When a ring's producer has exited, or closed the ring, and the ring
+// is drained, the collector removes it. If the producer died partway
+// through writing a record, the record is skipped and counted as torn;
+// the records after it are kept when its length was already written,
+// and otherwise the rest of the ring is discarded. Drops reported by
+// the producers are written to the log as WARN records.
+class ShmCollector {
+public:
+	ShmCollector(std::string name, std::string logfile, bool text);
+	~ShmCollector();
+
+	// drain collects the records waiting in every ring, writes them
+	// out, and returns the number of records written.
+	size_t		drain(void);
+
+	// rings returns the number of rings being collected, and torn
+	// the number of records lost to producers dying.
+	size_t		rings(void) const;
+	std::uint64_t	torn(void) const;
+
+	// good returns true if the log file is open and the last write
+	// succeeded.
+	bool		good(void) const;
+
+private:
+	struct Ring;
+
+	std::string				name;
+	bool					text;
+	int					fd;
+	LogError				err;
+	std::map<std::string, std::unique_ptr<Ring>>	open_rings;
+	std::uint64_t				last_scan;
+	std::uint64_t				torn_records;
+	std::string				batch;
+	std::string				entries;
+	tlv::Decoder				decoder;
+	std::vector<Record>			records;
+
+	void		scan(void);
+	size_t		collect(Ring& r);
+	void		emit(const std::string& data);
+
+	ShmCollector(const ShmCollector&) = delete;
+	ShmCollector&	operator=(const ShmCollector&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_SHMLOG_HH__
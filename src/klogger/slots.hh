@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_SLOTS_HH__
+#define __KLOGGER_SLOTS_HH__
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace klog {
+
+
+// THREAD_SLOTS is the number of threads a SlotTable serves without
+// taking a lock.
+constexpr size_t	THREAD_SLOTS = 64;
+
+
+// ThreadKeys hands out the numbers thread_key returns. A thread's
+// number is taken back when it exits and given to the next new
+// thread, so that the numbers stay as few as the live threads, and a
+// new thread takes over the slots an exited one held.
+class ThreadKeys {
+public:
+	ThreadKeys() : lock(), unused(), next(1) {};
+
+	std::uint64_t
+	take(void)
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		if (this->unused.empty()) {
+			return this->next++;
+		}
+
+		std::uint64_t	key = this->unused.back();
+
+		this->unused.pop_back();
+		return key;
+	}
+
+	void
+	give(std::uint64_t key)
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		this->unused.push_back(key);
+	}
+
+	// keys returns the process's ThreadKeys, which is never freed, as
+	// threads may exit after static destructors have run.
+	static ThreadKeys&
+	keys(void)
+	{
+		static ThreadKeys	*k = new ThreadKeys();
+
+		return *k;
+	}
+
+private:
+	std::mutex			lock;
+	std::vector<std::uint64_t>	unused;
+	std::uint64_t			next;
+};
+
+
+// A ThreadKey holds the calling thread's number until it exits.
+struct ThreadKey {
+	ThreadKey() : key(ThreadKeys::keys().take()) {};
+	~ThreadKey() { ThreadKeys::keys().give(this->key); };
+
+	const std::uint64_t	key;
+
+	ThreadKey(const ThreadKey&) = delete;
+	ThreadKey&	operator=(const ThreadKey&) = delete;
+};
+
+
+// thread_key returns a number identifying the calling thread among
+// the live threads; it is never zero.
+inline std::uint64_t
+thread_key(void)
+{
+	static thread_local ThreadKey	k;
+
+	return k.key;
+}
+
+
+// A SlotTable holds one T for each thread that asks for one. A thread
+// finds its T in an open-addressed table keyed by its thread_key,
+// claiming an empty slot the first time, so neither finding nor adding
+// one takes a lock. Threads beyond THREAD_SLOTS share a locked map
+// instead. A T lives as long as the table, and passes with a thread's
+// key to the next thread to be given it. Keys are only ever as many as
+// the most threads live at once, so a table serves any number of
+// threads over time without a lock unless that exceeds THREAD_SLOTS.
+template <typename T>
+class SlotTable {
+public:
+	SlotTable() : keys(), slots(), lock(), overflow()
+	{
+		for (size_t i = 0; i < THREAD_SLOTS; i++) {
+			this->keys[i].store(0);
+			this->slots[i].store(nullptr);
+		}
+	}
+
+	~SlotTable()
+	{
+		for (auto& s : this->slots) {
+			delete s.load();
+		}
+	}
+
+	// get returns the calling thread's T, creating it if needed. It
+	// probes from the thread's home slot. Only the thread itself
+	// stores its key, so a slot holding another key is skipped and
+	// an empty one is claimed; a claimed slot's T is published after
+	// the key, and each skips slots without one yet.
+	T&
+	get(void)
+	{
+		std::uint64_t	key = thread_key();
+		size_t		home = key % THREAD_SLOTS;
+
+		for (size_t n = 0; n < THREAD_SLOTS; n++) {
+			size_t		i = (home + n) % THREAD_SLOTS;
+			std::uint64_t	found = this->keys[i].load(
+					    std::memory_order_acquire);
+
+			if (found == key) {
+				return *this->slots[i].load(
+				    std::memory_order_acquire);
+			}
+
+			if (found == 0 &&
+			    this->keys[i].compare_exchange_strong(found, key,
+			    std::memory_order_acq_rel)) {
+				T	*t = new T();
+
+				this->slots[i].store(t,
+				    std::memory_order_release);
+				return *t;
+			}
+		}
+
+		std::lock_guard<std::mutex>	guard(this->lock);
+		auto&				t = this->overflow[key];
+
+		if (!t) {
+			t.reset(new T());
+		}
+		return *t;
+	}
+
+	// each calls f on every thread's T.
+	void
+	each(std::function<void(T&)> f)
+	{
+		for (auto& s : this->slots) {
+			T	*t = s.load(std::memory_order_acquire);
+
+			if (t != nullptr) {
+				f(*t);
+			}
+		}
+
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		for (auto& kv : this->overflow) {
+			f(*kv.second);
+		}
+	}
+
+private:
+	std::atomic<std::uint64_t>			keys[THREAD_SLOTS];
+	std::atomic<T *>				slots[THREAD_SLOTS];
+	std::mutex					lock;
+	std::map<std::uint64_t, std::unique_ptr<T>>	overflow;
+
+	SlotTable(const SlotTable&) = delete;
+	SlotTable&	operator=(const SlotTable&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_SLOTS_HH__
@@ -81,7 +81,10 @@ namespace syslog {
 // outside of this logger in the program will be affected by this
 // program (e.g. if a call is made to openlog("some other name")).
 // The use of Syslogger with calls to syslog(3) is not recommended.
-class Syslogger : Logger {
+//
+// syslog(3) serialises its callers internally, so a Syslogger may be
+// shared between threads.
+class Syslogger : public BasicLogger {
 public:
 	// The construct takes an identity string that is used to
 	// identify the logs in syslog. Facility is one of the
@@ -92,84 +95,21 @@ public:
 		  std::initializer_list<syslog::Option>);
 	~Syslogger() {};
 
-	// debug writes a log message with the DEBUG level.
-	void debug(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void debug(const std::string& actor,
-		   const std::string& event);
-
-	// info writes a log message with the INFO level.
-	void info(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void info(const std::string& actor,
-		  const std::string& event);
-
-	// warn writes a log message with the WARN level.
-	void warn(const std::string& actor,
-		  const std::string& event,
-		  std::map<std::string, std::string> attrs);
-	void warn(const std::string& actor,
-		  const std::string& event);
-
-	// error writes a log message with the ERROR level.
-	void error(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void error(const std::string& actor,
-		   const std::string& event);
-
-	// critical writes a log message with the CRITICAL level.
-	void critical(const std::string& actor,
-		      const std::string& event,
-		      std::map<std::string, std::string> attrs);
-	void critical(const std::string& actor,
-		      const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exit code EXIT_FAILURE.
-	void fatal(const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(const std::string& actor,
-		   const std::string& event);
-
-	// fatal writes a log message with the FATAL level. The process
-	// will exit with exitcode.
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event,
-		   std::map<std::string, std::string> attrs);
-	void fatal(int exitcode,
-		   const std::string& actor,
-		   const std::string& event);
-   
-	// fatal_noexit writes a log message with the FATAL level but
-	// does not exit; the caller is expected to handle exiting the
-	// process after any cleanup.
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event,
-			  std::map<std::string, std::string> attrs);
-	void fatal_noexit(const std::string& actor,
-			  const std::string& event);
-   
-	// level sets the minimum logging level.
-	void            level(Level);
-
-	// good returns true if the logger is healthy.
-	bool            good(void);
-
-	// error returns the current error condition for a logger.
-	LogError        error(void);
+	// write emits a single record to syslog.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+
+	// write_body emits a single record with a prepared body.
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
 
 	// close provides a mechanism for shutting down a logger.
 	int		close(void);
 
 private:
 	std::string	ident;
-	LogError	err;
-	Level		ilevel;
 };
 
 } // namespace klog
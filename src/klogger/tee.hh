@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __KLOGGER_TEE_HH__
+#define __KLOGGER_TEE_HH__
+
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <klogger/deferred.hh>
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+
+
+namespace klog {
+
+
+// TeeLogger writes each record to several sinks, each with its own
+// minimum level; a record must also pass the sink's own level and
+// overrides. The text and TLV encodings of a record's attributes are
+// rendered at most once and shared by the sinks that copy them through
+// write_body; each sink still writes its own header, and the other
+// sinks unpack the attributes into a map. A slow sink can be put
+// behind its own queue, written by a worker thread, so that it doesn't
+// hold up the others; queued sinks always get a map. Sinks should be added before the
+// TeeLogger is shared between threads; they aren't owned by it and must
+// outlive it.
+class TeeLogger : public BasicLogger {
+public:
+	TeeLogger();
+	~TeeLogger();
+
+	// add adds a sink that is written records at or above min.
+	void		add(BasicLogger *sink, Level min);
+
+	// add_queued adds a sink behind a DeferredLogger with the given
+	// overflow policy.
+	void		add_queued(BasicLogger *sink, Level min,
+				   OverflowPolicy policy);
+	void		add_queued(BasicLogger *sink, Level min);
+
+	// write passes a record to each sink whose level permits it.
+	void		write(Level l, std::uint64_t when,
+			      const std::string& actor,
+			      const std::string& event,
+			      const std::map<std::string, std::string>& attrs);
+	void		write_body(Level l, std::uint64_t when,
+				   const Body& body);
+
+	using BasicLogger::error;
+
+	// good and error report the first sink in an error condition,
+	// if any.
+	bool		good(void);
+	LogError	error(void);
+
+	// flush writes out the records held by queued sinks.
+	void		flush(void);
+
+	// close writes out and stops the queues; the sinks are left
+	// open, and records written afterwards go straight to them.
+	int		close(void);
+
+private:
+	// A queued sink's logger is its DeferredLogger; target is the
+	// sink itself, whose levels decide what is written.
+	struct Sink {
+		BasicLogger			*logger;
+		BasicLogger			*target;
+		Level				 min;
+		std::unique_ptr<DeferredLogger>	 queue;
+	};
+
+	std::vector<Sink>	sinks;
+
+	TeeLogger(const TeeLogger&) = delete;
+	TeeLogger&	operator=(const TeeLogger&) = delete;
+};
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_TEE_HH__
@@ -29,6 +29,10 @@
 #include <map>
 #include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <klogger/record.hh>
 
 
 namespace klog {
@@ -41,6 +45,25 @@ constexpr std::uint8_t	TTimestamp =	0x02;
 constexpr std::uint8_t	TLevel =	0x04;
 constexpr std::uint8_t	TString =	0x08;
 
+// Tags used by the FastLogger: a site registration, a site entry, and a
+// clock anchor pairing the cycle counter with the wall clock.
+constexpr std::uint8_t	TSite =		0x10;
+constexpr std::uint8_t	TSiteEntry =	0x20;
+constexpr std::uint8_t	TClock =	0x40;
+
+// Tags used by the NetLogger transport: a batch of log entries, and a
+// collector's acknowledgement of the batches up to a sequence number.
+// Both values start with an 8-byte big-endian sequence number.
+constexpr std::uint8_t	TBatch =	0x80;
+constexpr std::uint8_t	TAck =		0x81;
+constexpr size_t	SEQUENCE_LENGTH = 8;
+
+// The encoded lengths of the fixed-size records in a log entry: a
+// timestamp is a tag, a length and an 8-byte value; a level is a tag, a
+// length and a 1-byte value.
+constexpr size_t	TIMESTAMP_LENGTH = 10;
+constexpr size_t	LEVEL_LENGTH = 3;
+
 // Utility functions.
 std::string	hex_encode(const std::string&);
 std::string	hex_encode(const char *, size_t);
@@ -55,6 +78,95 @@ bool	write_tlv_log(std::ostream& outs, std::uint8_t lvl,
 		      std::string actor, std::string event,
 		      std::map<std::string, std::string> attrs);
 
+// Buffer serialisation support: these append the same encodings as the
+// stream functions above to a string, so that a record can be built up
+// in memory and written out in one piece. string_length returns the
+// number of bytes append_string will append for s.
+void	append_length(std::string& buf, size_t length);
+void	append_header(std::string& buf, std::uint8_t tag, std::uint64_t length);
+void	append_timestamp(std::string& buf, std::uint64_t t);
+void	append_loglevel(std::string& buf, std::uint8_t lvl);
+void	append_string(std::string& buf, const std::string& s);
+size_t	string_length(const std::string& s);
+void	append_tlv_log(std::string& buf, std::uint8_t lvl, std::uint64_t t,
+		       const std::string& actor, const std::string& event,
+		       const std::map<std::string, std::string>& attrs);
+
+// append_entry appends the log entry for a record at level l logged at
+// when, in nanoseconds since the epoch; the second form takes the
+// fields from a Body. Every backend writing the binary format encodes
+// its entries with these. level_value returns the byte a level is
+// recorded as, and seconds the recorded form of a time.
+void		append_entry(std::string& buf, Level l, std::uint64_t when,
+			     const std::string& actor, const std::string& event,
+			     const std::map<std::string, std::string>& attrs);
+void		append_entry(std::string& buf, Level l, std::uint64_t when,
+			     const Body& body);
+std::uint8_t	level_value(Level l);
+std::uint64_t	seconds(std::uint64_t when);
+
+// append_batch_header appends the header of a batch carrying length
+// bytes of log entries, which the caller appends after it. append_ack
+// appends an acknowledgement.
+void	append_batch_header(std::string& buf, std::uint64_t seq,
+			    size_t length);
+void	append_ack(std::string& buf, std::uint64_t seq);
+
+
+// TLV deserialisation support: each function decodes one record from
+// buf at off and advances off past it. They return false if the record
+// is truncated or has the wrong tag.
+bool	read_length(const std::string& buf, size_t& off, std::uint64_t& length);
+bool	read_header(const std::string& buf, size_t& off, std::uint8_t& tag,
+		    std::uint64_t& length);
+bool	read_timestamp(const std::string& buf, size_t& off, std::uint64_t& t);
+bool	read_loglevel(const std::string& buf, size_t& off, std::uint8_t& lvl);
+bool	read_string(const std::string& buf, size_t& off, std::string& s);
+
+// read_batch reads the header of a whole batch, leaving off at its
+// entries and length set to their size; read_ack reads an
+// acknowledgement.
+bool	read_batch(const std::string& buf, size_t& off, std::uint64_t& seq,
+		   size_t& length);
+bool	read_ack(const std::string& buf, size_t& off, std::uint64_t& seq);
+
+
+// A Decoder rebuilds records from a binary log. It understands the
+// entries written by a BinLogger and those written by a FastLogger,
+// which it resolves against the sites registered earlier in the log
+// and timestamps using the log's clock anchors. Entries with unknown
+// tags are skipped.
+class Decoder {
+public:
+	Decoder() : sites(), anchors() {};
+
+	// decode appends the records in buf, which holds whole entries
+	// from a binary log, to out. It returns false if buf is
+	// malformed; the records before the error are still appended.
+	bool	decode(const std::string& buf, std::vector<Record>& out);
+
+private:
+	struct Site {
+		Level				level;
+		std::string			actor;
+		std::string			event;
+		std::string			types;
+		std::vector<std::string>	keys;
+	};
+
+	std::map<std::uint32_t, Site>		sites;
+	std::vector<std::pair<std::uint64_t, std::uint64_t>>	anchors;
+
+	bool		decode_entry(const std::string& buf, size_t& off,
+				     size_t end, Record& r);
+	bool		decode_site(const std::string& buf, size_t& off,
+				    size_t end);
+	bool		decode_site_entry(const std::string& buf, size_t& off,
+					  size_t end, Record& r,
+					  std::uint64_t& counter);
+	std::uint64_t	wall_time(std::uint64_t counter) const;
+};
+
 
 } // namespace tlv
 } // namespace klog
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+
+#include <klogger/format.hh>
+#include <klogger/layout.hh>
+#include <klogger/logger.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+constexpr std::uint64_t	NSEC = 1000000000;
+constexpr size_t	STRFTIME_SIZE = 256;
+constexpr size_t	TIME_CACHES = 4;
+
+
+// Serials tell layouts apart in the per-thread time caches; unlike
+// addresses, they aren't reused.
+static std::atomic<std::uint64_t>	next_serial(1);
+
+
+Layout::Layout(const std::string& pattern)
+    : program(), chunks(), names(), err(), serial(next_serial++)
+{
+	if (!this->compile(pattern)) {
+		this->program.clear();
+	}
+}
+
+
+bool
+Layout::good(void) const
+{
+	return this->err.empty();
+}
+
+
+const std::string&
+Layout::error(void) const
+{
+	return this->err;
+}
+
+
+// literal adds text to the program, extending the previous step if it
+// was a literal too.
+void
+Layout::literal(const char *s, size_t length)
+{
+	if (0 == length) {
+		return;
+	}
+
+	if (this->program.empty() ||
+	    Op::LITERAL != this->program.back().op) {
+		this->program.push_back(Step{Op::LITERAL,
+		    static_cast<std::uint32_t>(this->chunks.size()), 0});
+	}
+
+	this->chunks.append(s, length);
+	this->program.back().length += static_cast<std::uint32_t>(length);
+}
+
+
+bool
+Layout::compile(const std::string& pattern)
+{
+	size_t	i = 0;
+
+	while (i < pattern.size()) {
+		size_t	pct = pattern.find('%', i);
+
+		if (std::string::npos == pct) {
+			this->literal(pattern.data() + i, pattern.size() - i);
+			break;
+		}
+
+		this->literal(pattern.data() + i, pct - i);
+		if (pct + 1 < pattern.size() && '%' == pattern[pct + 1]) {
+			this->literal("%", 1);
+			i = pct + 2;
+			continue;
+		}
+
+		if (pct + 1 >= pattern.size() || '{' != pattern[pct + 1]) {
+			this->err = "stray % at offset " + std::to_string(pct);
+			return false;
+		}
+
+		size_t	close = pattern.find('}', pct + 2);
+
+		if (std::string::npos == close) {
+			this->err = "unterminated field at offset " +
+			    std::to_string(pct);
+			return false;
+		}
+
+		if (!this->compile_field(pattern.substr(pct + 2,
+		    close - pct - 2))) {
+			this->err += " at offset " + std::to_string(pct);
+			return false;
+		}
+		i = close + 1;
+	}
+
+	this->literal("\n", 1);
+	return true;
+}
+
+
+bool
+Layout::compile_field(const std::string& field)
+{
+	static const std::map<std::string, Op>	plain = {
+		{"time", Op::TIME},
+		{"epoch", Op::EPOCH},
+		{"msec", Op::MSEC},
+		{"usec", Op::USEC},
+		{"level", Op::LEVEL},
+		{"actor", Op::ACTOR},
+		{"event", Op::EVENT},
+		{"attrs", Op::ATTRS},
+	};
+	size_t	colon = field.find(':');
+	auto	it = plain.find(field);
+
+	if (plain.end() != it) {
+		this->program.push_back(Step{it->second, 0, 0});
+		return true;
+	}
+
+	if (std::string::npos != colon && colon + 1 < field.size()) {
+		std::string	name = field.substr(0, colon);
+		std::string	arg = field.substr(colon + 1);
+
+		// The strftime format is kept NUL-terminated.
+		if ("time" == name) {
+			this->program.push_back(Step{Op::STRFTIME,
+			    static_cast<std::uint32_t>(this->chunks.size()),
+			    static_cast<std::uint32_t>(arg.size())});
+			this->chunks += arg;
+			this->chunks += '\0';
+			return true;
+		}
+
+		if ("attr" == name) {
+			this->program.push_back(Step{Op::ATTR,
+			    static_cast<std::uint32_t>(this->names.size()), 0});
+			this->names.push_back(arg);
+			return true;
+		}
+	}
+
+	this->err = "unknown field \"" + field + "\"";
+	return false;
+}
+
+
+// Rendering a time with strftime is as costly as for the text format,
+// so each thread keeps the last second rendered for a few STRFTIME
+// steps, keyed by layout and step.
+void
+Layout::format_time(std::string& buf, size_t step, std::uint64_t when) const
+{
+	struct cache {
+		cache() : serial(0), step(0), t(0), text() {};
+
+		std::uint64_t	serial;
+		size_t		step;
+		std::time_t	t;
+		std::string	text;
+	};
+	static thread_local cache	caches[TIME_CACHES];
+	cache&				c = caches[(this->serial + step) %
+					    TIME_CACHES];
+	std::time_t			t = static_cast<std::time_t>(
+					    when / NSEC);
+	const Step&			s = this->program[step];
+	std::tm				tm;
+	char				out[STRFTIME_SIZE];
+	size_t				length = 0;
+
+	if (c.serial != this->serial || c.step != step || c.t != t) {
+		if (nullptr != ::localtime_r(&t, &tm)) {
+			length = std::strftime(out, STRFTIME_SIZE,
+			    this->chunks.data() + s.offset, &tm);
+		}
+
+		c.serial = this->serial;
+		c.step = step;
+		c.t = t;
+		c.text.assign(out, length);
+	}
+
+	buf += c.text;
+}
+
+
+// append_digits appends n as exactly width decimal digits.
+static void
+append_digits(std::string& buf, std::uint64_t n, size_t width)
+{
+	char	digits[20];
+
+	for (size_t i = width; i > 0; i--) {
+		digits[i - 1] = static_cast<char>('0' + n % 10);
+		n /= 10;
+	}
+	buf.append(digits, width);
+}
+
+
+void
+Layout::format(std::string& buf, Level level, std::uint64_t when,
+	       const std::string& actor, const std::string& event,
+	       const std::map<std::string, std::string>& attrs) const
+{
+	for (size_t i = 0; i < this->program.size(); i++) {
+		const Step&	s = this->program[i];
+
+		switch (s.op) {
+		case Op::LITERAL:
+			buf.append(this->chunks, s.offset, s.length);
+			break;
+		case Op::TIME:
+			format_timestamp(buf, when);
+			break;
+		case Op::STRFTIME:
+			this->format_time(buf, i, when);
+			break;
+		case Op::EPOCH:
+			buf += std::to_string(when / NSEC);
+			break;
+		case Op::MSEC:
+			append_digits(buf, (when / 1000000) % 1000, 3);
+			break;
+		case Op::USEC:
+			append_digits(buf, (when / 1000) % 1000000, 6);
+			break;
+		case Op::LEVEL:
+			buf += level_string(level);
+			break;
+		case Op::ACTOR:
+			buf += actor;
+			break;
+		case Op::EVENT:
+			buf += event;
+			break;
+		case Op::ATTRS:
+			for (auto it = attrs.begin(); it != attrs.end(); it++) {
+				if (it != attrs.begin()) {
+					buf += ' ';
+				}
+				logfmt::append_key(buf, it->first);
+				buf += '=';
+				logfmt::append_value(buf, it->second);
+			}
+			break;
+		case Op::ATTR: {
+			auto	it = attrs.find(this->names[s.offset]);
+
+			if (attrs.end() != it) {
+				buf += it->second;
+			}
+			break;
+		}
+		}
+	}
+}
+
+
+} // namespace klog
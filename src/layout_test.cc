@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/filelog.hh>
+#include <klogger/layout.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOG = "layout_test.log";
+
+// 2024-05-01T12:34:56.789012345Z
+static const uint64_t	WHEN = 1714566896789012345ULL;
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static string
+render(const klog::Layout& layout, const map<string, string>& attrs)
+{
+	string	buf;
+
+	layout.format(buf, klog::Level::WARN, WHEN, "http", "request", attrs);
+	return buf;
+}
+
+
+static int
+test_fields(void)
+{
+	map<string, string>	attrs = {{"path", "/a b"}, {"status", "404"}};
+	map<string, string>	cases = {
+		{"", "\n"},
+		{"plain text", "plain text\n"},
+		{"%{level} %{actor}/%{event}", "WARNING http/request\n"},
+		{"%{epoch}.%{msec} %{usec}", "1714566896.789 789012\n"},
+		{"%{attrs}", "path=\"/a b\" status=404\n"},
+		{"[%{attr:status}] [%{attr:missing}]", "[404] []\n"},
+		{"100%% %{level}%%", "100% WARNING%\n"},
+		{"%{time:%Y}", "2024\n"},
+	};
+
+	for (auto& c : cases) {
+		klog::Layout	layout(c.first);
+		string		got;
+
+		if (!layout.good()) {
+			console.error("test_fields", "pattern rejected",
+			    {{"pattern", c.first}, {"error", layout.error()}});
+			return 0;
+		}
+
+		got = render(layout, attrs);
+		if (got != c.second) {
+			console.error("test_fields", "bad record",
+			    {{"pattern", c.first}, {"got", got},
+			     {"want", c.second}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_time(void)
+{
+	// %{time} matches the text format's timestamp, and %{time:...}
+	// agrees with strftime in local time.
+	klog::Layout	layout("%{time}|%{time:%H:%M:%S}|%{time:%j}");
+	time_t		t = static_cast<time_t>(WHEN / 1000000000ULL);
+	tm		tm;
+	char		want[64];
+
+	::localtime_r(&t, &tm);
+	::strftime(want, sizeof(want), "%FT%T%z|%H:%M:%S|%j\n", &tm);
+
+	// Twice, to exercise the cached rendering.
+	for (int i = 0; i < 2; i++) {
+		if (render(layout, {}) != want) {
+			console.error("test_time", "bad time",
+			    {{"got", render(layout, {})}, {"want", want}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_errors(void)
+{
+	vector<string>	bad = {
+		"%{nope}",
+		"%{level",
+		"50% off",
+		"trailing %",
+		"%{attr:}",
+		"%{time:}",
+	};
+
+	for (auto& pattern : bad) {
+		klog::Layout	layout(pattern);
+
+		if (layout.good() || layout.error().empty()) {
+			console.error("test_errors", "accepted bad pattern",
+			    {{"pattern", pattern}});
+			return 0;
+		}
+	}
+
+	klog::Layout	layout("ok %{oops} here");
+
+	if (layout.error() != "unknown field \"oops\" at offset 3") {
+		console.error("test_errors", "bad error",
+		    {{"error", layout.error()}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_filelog(void)
+{
+	klog::FileLogger	flog(LOG, true);
+
+	if (flog.layout(klog::Layout("%{bad"))) {
+		console.error("test_filelog", "bad layout accepted");
+		return 0;
+	}
+
+	if (!flog.layout(klog::Layout("%{level} %{event} %{attrs}")) ||
+	    flog.format() != klog::Format::LAYOUT) {
+		console.error("test_filelog", "layout not set");
+		return 0;
+	}
+
+	flog.info("test", "one", {{"k", "v"}});
+
+	// Records with prepared bodies use the layout too.
+	auto	clog = flog.with({{"bound", "yes"}});
+
+	clog->warn("test", "two", {{"k", "v v"}});
+
+	// Layouts may be replaced while other threads log.
+	vector<thread>	workers;
+
+	for (int t = 0; t < 2; t++) {
+		workers.push_back(thread([&flog]() {
+			for (int i = 0; i < 1000; i++) {
+				flog.info("test", "thread");
+			}
+		}));
+	}
+	for (int i = 0; i < 10; i++) {
+		flog.layout(klog::Layout("%{level} %{event}"));
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	flog.format(klog::Format::TEXT);
+	flog.info("test", "three");
+	flog.close();
+
+	string	log = read_file(LOG);
+	string	want = "INFO one k=v\nWARNING two bound=yes k=\"v v\"\n";
+
+	if (log.compare(0, want.size(), want) != 0 ||
+	    log.find("[INFO] [actor:test event:three]") == string::npos) {
+		console.error("test_filelog", "bad log");
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"fields", test_fields},
+	{"time", test_time},
+	{"errors", test_errors},
+	{"filelog", test_filelog},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("layout_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("layout_test", "ok");
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/metrics.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// A LevelTable is an immutable open-addressed hash table of level
+// overrides, keyed by actor or by actor and event. A lookup hashes the
+// actor (and event) in place, so it allocates nothing.
+class LevelTable {
+public:
+	struct Entry {
+		std::string	actor;
+		std::string	event;
+		bool		pair;
+		Level		level;
+	};
+
+	explicit LevelTable(const std::vector<Entry>& overrides);
+
+	// find returns the override that applies to a record, or
+	// nullptr if there is none.
+	const Level	*find(const std::string& actor,
+			      const std::string& event) const;
+
+	std::vector<Entry>	entries;
+
+private:
+	struct Slot {
+		std::uint64_t	 hash;
+		const Entry	*entry;
+	};
+
+	std::vector<Slot>	slots;
+	size_t			mask;
+	bool			have_actors;
+	bool			have_pairs;
+
+	const Entry	*probe(std::uint64_t hash, bool pair,
+			       const std::string& actor,
+			       const std::string& event) const;
+};
+
+
+LevelTable::LevelTable(const std::vector<Entry>& overrides)
+    : entries(overrides), slots(), mask(0), have_actors(false),
+      have_pairs(false)
+{
+	size_t	size = 8;
+
+	// Keep the table at most half full so that probes stay short.
+	while (size < 2 * this->entries.size()) {
+		size <<= 1;
+	}
+	this->slots.assign(size, Slot{0, nullptr});
+	this->mask = size - 1;
+
+	for (auto& e : this->entries) {
+		std::uint64_t	h = fnv1a(e.actor);
+
+		if (e.pair) {
+			h = fnv1a_pair(h, e.event);
+			this->have_pairs = true;
+		}
+		else {
+			this->have_actors = true;
+		}
+
+		size_t	i = h & this->mask;
+
+		while (this->slots[i].entry != nullptr) {
+			i = (i + 1) & this->mask;
+		}
+		this->slots[i] = Slot{h, &e};
+	}
+}
+
+
+const LevelTable::Entry *
+LevelTable::probe(std::uint64_t hash, bool pair, const std::string& actor,
+		  const std::string& event) const
+{
+	for (size_t i = hash & this->mask; this->slots[i].entry != nullptr;
+	     i = (i + 1) & this->mask) {
+		const Slot&	s = this->slots[i];
+
+		if (s.hash == hash && s.entry->pair == pair &&
+		    s.entry->actor == actor &&
+		    (!pair || s.entry->event == event)) {
+			return s.entry;
+		}
+	}
+
+	return nullptr;
+}
+
+
+const Level *
+LevelTable::find(const std::string& actor, const std::string& event) const
+{
+	std::uint64_t	h = fnv1a(actor);
+	const Entry	*e = nullptr;
+
+	if (this->have_pairs) {
+		e = this->probe(fnv1a_pair(h, event), true, actor, event);
+	}
+	if (nullptr == e && this->have_actors) {
+		e = this->probe(h, false, actor, event);
+	}
+
+	return nullptr == e ? nullptr : &e->level;
+}
+
+
+BasicLogger::BasicLogger(void)
+    : ilevel(DEFAULT_LEVEL), ilevels(at_or_above(DEFAULT_LEVEL)),
+      err(LogError::HEALTHY), overrides(), override_lock(),
+      stats(new Metrics())
+{
+}
+
+
+BasicLogger::~BasicLogger()
+{
+}
+
+
+void
+BasicLogger::level(const std::string& actor, Level l)
+{
+	this->publish(actor, "", false, l);
+}
+
+
+void
+BasicLogger::level(const std::string& actor, const std::string& event,
+		   Level l)
+{
+	this->publish(actor, event, true, l);
+}
+
+
+void
+BasicLogger::clear_levels(void)
+{
+	std::lock_guard<std::mutex>	guard(this->override_lock);
+
+	this->overrides.publish(nullptr);
+}
+
+
+// publish builds a new table with the given override added or replaced
+// and swaps it in.
+void
+BasicLogger::publish(const std::string& actor, const std::string& event,
+		     bool pair, Level l)
+{
+	std::lock_guard<std::mutex>	guard(this->override_lock);
+	const LevelTable		*current;
+	std::vector<LevelTable::Entry>	entries;
+	bool				found = false;
+
+	current = this->overrides.latest();
+	if (current != nullptr) {
+		entries = current->entries;
+	}
+
+	for (auto& e : entries) {
+		if (e.pair == pair && e.actor == actor &&
+		    (!pair || e.event == event)) {
+			e.level = l;
+			found = true;
+		}
+	}
+	if (!found) {
+		entries.push_back(LevelTable::Entry{actor, event, pair, l});
+	}
+
+	this->overrides.publish(std::unique_ptr<const LevelTable>(
+	    new LevelTable(entries)));
+}
+
+
+bool
+BasicLogger::enabled(Level l, const std::string& actor,
+		     const std::string& event)
+{
+	if (!this->overrides.empty()) {
+		Published<LevelTable>::Reader	table(this->overrides);
+
+		if (table.get() != nullptr) {
+			const Level	*o = table.get()->find(actor, event);
+
+			if (o != nullptr) {
+				return !(*o > l);
+			}
+		}
+	}
+
+	return this->enabled(l);
+}
+
+
+} // namespace klog
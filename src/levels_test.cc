@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/record.hh>
+#include <klogger/schema.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static int
+test_overrides(void)
+{
+	CaptureLogger	logger;
+
+	logger.level(klog::Level::WARN);
+	logger.level("db", klog::Level::DEBUG);
+	logger.level("db", "query", klog::Level::ERROR);
+	logger.level("http", "request", klog::Level::INFO);
+
+	logger.debug("db", "connect");		// actor override: written
+	logger.warn("db", "query");		// event override: dropped
+	logger.info("http", "request");		// event override: written
+	logger.info("http", "response");	// global level: dropped
+	logger.info("other", "event");		// global level: dropped
+	logger.error("db", "query");		// written
+
+	vector<string>	expected = {"connect", "request", "query"};
+
+	if (logger.records.size() != expected.size()) {
+		console.error("test_overrides", "wrong records written",
+		    {{"count", to_string(logger.records.size())}});
+		return 0;
+	}
+
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (logger.records[i].event != expected[i]) {
+			console.error("test_overrides", "wrong record",
+			    {{"expected", expected[i]},
+			     {"actual", logger.records[i].event}});
+			return 0;
+		}
+	}
+
+	// Replacing and clearing overrides.
+	logger.level("db", klog::Level::ERROR);
+	logger.debug("db", "connect");
+	logger.clear_levels();
+	logger.error("db", "query");
+	logger.info("http", "request");
+
+	if (logger.records.size() != 4 || logger.records[3].event != "query") {
+		console.error("test_overrides", "override not replaced");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_schema(void)
+{
+	CaptureLogger			logger;
+	static const klog::Schema<1>	query("db", "query", {"sql"});
+	string				sql = "SELECT 1";
+
+	logger.level("db", klog::Level::DEBUG);
+	query.debug(logger, sql);
+
+	return logger.records.size() == 1;
+}
+
+
+// Overrides may be changed while other threads are logging.
+static int
+test_concurrent(void)
+{
+	CaptureLogger	logger;
+	atomic<bool>	done(false);
+	vector<thread>	workers;
+
+	logger.level(klog::Level::ERROR);
+	for (int t = 0; t < 4; t++) {
+		workers.push_back(thread([&logger, &done, t]() {
+			string	actor = "actor" + to_string(t);
+
+			while (!done.load()) {
+				logger.debug(actor, "event");
+			}
+		}));
+	}
+
+	for (int i = 0; i < 1000; i++) {
+		logger.level("actor" + to_string(i % 8), klog::Level::ERROR);
+	}
+	done.store(true);
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	size_t	written = logger.records.size();
+
+	logger.debug("actor0", "event");
+	logger.level("actor0", "event", klog::Level::DEBUG);
+	logger.debug("actor0", "event");
+	return logger.records.size() == written + 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"overrides", test_overrides},
+	{"schema", test_schema},
+	{"concurrent", test_concurrent},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("levels_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("levels_test", "ok");
+}
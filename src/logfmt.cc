@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/format.hh>
+#include <klogger/record.hh>
+#include <internal.hh>
+#include <scan.hh>
+
+
+namespace klog {
+namespace logfmt {
+
+
+constexpr std::uint64_t	NSEC = 1000000000;
+
+
+// Quoted is the class of bytes that end a bare key or value: spaces
+// and other control bytes, equals signs and quotes.
+struct Quoted {
+	static constexpr char		first = '=';
+	static constexpr char		second = '"';
+	static constexpr unsigned char	last = ' ';
+};
+
+
+size_t
+scan_scalar(const char *s, size_t length)
+{
+	return scan_bytes<Quoted>(s, length);
+}
+
+
+size_t
+scan(const char *s, size_t length)
+{
+	return pick_scanner<Quoted>().scan(s, length);
+}
+
+
+const char *
+scanner(void)
+{
+	return pick_scanner<Quoted>().name;
+}
+
+
+void
+append_key(std::string& buf, const std::string& k)
+{
+	size_t	start = buf.size();
+
+	if (k.empty()) {
+		buf += '_';
+		return;
+	}
+
+	buf += k;
+	if (scan(k.data(), k.size()) == k.size()) {
+		return;
+	}
+
+	for (size_t i = start; i < buf.size(); i++) {
+		if (in_class<Quoted>(static_cast<unsigned char>(buf[i]))) {
+			buf[i] = '_';
+		}
+	}
+}
+
+
+void
+append_value(std::string& buf, const std::string& v)
+{
+	if (!v.empty() && scan(v.data(), v.size()) == v.size()) {
+		buf += v;
+		return;
+	}
+
+	json::append_string(buf, v);
+}
+
+
+void
+format_log(std::string& buf, Level level, std::uint64_t when,
+	   const std::string& actor, const std::string& event,
+	   const std::map<std::string, std::string>& attrs)
+{
+	buf += "time=";
+	format_timestamp(buf, when);
+	buf += " level=";
+	buf += level_string(level);
+	buf += " actor=";
+	append_value(buf, actor);
+	buf += " event=";
+	append_value(buf, event);
+	for (auto& kv : attrs) {
+		buf += ' ';
+		append_key(buf, kv.first);
+		buf += '=';
+		append_value(buf, kv.second);
+	}
+	buf += '\n';
+}
+
+
+static int
+hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+
+// append_utf8 appends the code point cp, which is below 0x10000.
+static void
+append_utf8(std::string& out, unsigned cp)
+{
+	if (cp < 0x80) {
+		out += static_cast<char>(cp);
+	}
+	else if (cp < 0x800) {
+		out += static_cast<char>(0xc0 | (cp >> 6));
+		out += static_cast<char>(0x80 | (cp & 0x3f));
+	}
+	else {
+		out += static_cast<char>(0xe0 | (cp >> 12));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (cp & 0x3f));
+	}
+}
+
+
+// read_escape decodes the escape after the backslash at s[i - 1],
+// leaving i after it.
+static bool
+read_escape(const char *s, size_t length, size_t& i, std::string& out)
+{
+	unsigned	cp = 0;
+
+	if (i >= length) {
+		return false;
+	}
+
+	switch (s[i++]) {
+	case '"':
+		out += '"';
+		return true;
+	case '\\':
+		out += '\\';
+		return true;
+	case '/':
+		out += '/';
+		return true;
+	case 'n':
+		out += '\n';
+		return true;
+	case 'r':
+		out += '\r';
+		return true;
+	case 't':
+		out += '\t';
+		return true;
+	case 'b':
+		out += '\b';
+		return true;
+	case 'f':
+		out += '\f';
+		return true;
+	case 'u':
+		if (i + 4 > length) {
+			return false;
+		}
+		for (size_t j = 0; j < 4; j++) {
+			int	d = hex_digit(s[i++]);
+
+			if (d < 0) {
+				return false;
+			}
+			cp = (cp << 4) | static_cast<unsigned>(d);
+		}
+		append_utf8(out, cp);
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// read_quoted reads the quoted string starting at s[i], leaving i after
+// its closing quote. Runs without escapes are found with json::scan,
+// which stops at quotes, backslashes and control bytes.
+static bool
+read_quoted(const char *s, size_t length, size_t& i, std::string& out)
+{
+	i++;
+	while (i < length) {
+		size_t	clean = json::scan(s + i, length - i);
+
+		out.append(s + i, clean);
+		i += clean;
+		if (i == length) {
+			return false;
+		}
+
+		switch (s[i]) {
+		case '"':
+			i++;
+			return true;
+		case '\\':
+			i++;
+			if (!read_escape(s, length, i, out)) {
+				return false;
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+	return false;
+}
+
+
+static inline bool
+is_space(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+
+bool
+parse_line(const char *s, size_t length,
+	   std::vector<std::pair<std::string, std::string>>& pairs)
+{
+	scan_func	find = pick_scanner<Quoted>().scan;
+	size_t		i = 0;
+
+	while (true) {
+		while (i < length && is_space(s[i])) {
+			i++;
+		}
+		if (i == length) {
+			return true;
+		}
+
+		size_t	key = find(s + i, length - i);
+
+		if (0 == key) {
+			return false;
+		}
+		pairs.emplace_back(std::string(s + i, key), std::string());
+		i += key;
+
+		if (i == length || is_space(s[i])) {
+			continue;
+		}
+		if (s[i] != '=') {
+			return false;
+		}
+		i++;
+
+		std::string&	value = pairs.back().second;
+
+		if (i < length && s[i] == '"') {
+			if (!read_quoted(s, length, i, value)) {
+				return false;
+			}
+		}
+		else {
+			size_t	bare = find(s + i, length - i);
+
+			value.assign(s + i, bare);
+			i += bare;
+		}
+
+		if (i < length && !is_space(s[i])) {
+			return false;
+		}
+	}
+}
+
+
+// days_from_civil returns the number of days from 1970-01-01 to the
+// given date in the proleptic Gregorian calendar.
+static std::int64_t
+days_from_civil(std::int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+
+	std::int64_t	era = (y >= 0 ? y : y - 399) / 400;
+	unsigned	yoe = static_cast<unsigned>(y - era * 400);
+	unsigned	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+
+// parse_number reads count digits from s at i.
+static bool
+parse_number(const std::string& s, size_t& i, size_t count, int& n)
+{
+	n = 0;
+	for (size_t j = 0; j < count; j++, i++) {
+		if (i >= s.size() || s[i] < '0' || s[i] > '9') {
+			return false;
+		}
+		n = n * 10 + (s[i] - '0');
+	}
+	return true;
+}
+
+
+// parse_time reads a timestamp written as "%FT%T%z".
+static bool
+parse_time(const std::string& s, std::uint64_t& when)
+{
+	int	year, month, day, hour, minute, second, zh, zm;
+	size_t	i = 0;
+
+	if (!parse_number(s, i, 4, year) || s[i++] != '-' ||
+	    !parse_number(s, i, 2, month) || s[i++] != '-' ||
+	    !parse_number(s, i, 2, day) || s[i++] != 'T' ||
+	    !parse_number(s, i, 2, hour) || s[i++] != ':' ||
+	    !parse_number(s, i, 2, minute) || s[i++] != ':' ||
+	    !parse_number(s, i, 2, second) || i >= s.size()) {
+		return false;
+	}
+
+	char	sign = s[i++];
+
+	if ((sign != '+' && sign != '-') || !parse_number(s, i, 2, zh) ||
+	    !parse_number(s, i, 2, zm) || i != s.size() ||
+	    month < 1 || month > 12 || day < 1 || day > 31) {
+		return false;
+	}
+
+	std::int64_t	t = days_from_civil(year, static_cast<unsigned>(month),
+			    static_cast<unsigned>(day)) * 86400 +
+			    hour * 3600 + minute * 60 + second;
+	std::int64_t	offset = zh * 3600 + zm * 60;
+
+	t -= (sign == '+') ? offset : -offset;
+	if (t < 0) {
+		return false;
+	}
+
+	when = static_cast<std::uint64_t>(t) * NSEC;
+	return true;
+}
+
+
+static bool
+parse_level(const std::string& s, Level& l)
+{
+	for (auto candidate : {Level::DEBUG, Level::INFO, Level::WARN,
+	    Level::ERROR, Level::CRITICAL, Level::FATAL}) {
+		if (level_string(candidate) == s) {
+			l = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void
+Parser::feed(const char *data, size_t length, std::vector<Record>& out)
+{
+	const char	*end = data + length;
+
+	while (data < end) {
+		auto	nl = static_cast<const char *>(
+			    std::memchr(data, '\n', static_cast<size_t>(end - data)));
+
+		if (nullptr == nl) {
+			this->partial.append(data, static_cast<size_t>(end - data));
+			return;
+		}
+
+		if (this->partial.empty()) {
+			this->parse(data, static_cast<size_t>(nl - data), out);
+		}
+		else {
+			this->partial.append(data, static_cast<size_t>(nl - data));
+			this->parse(this->partial.data(), this->partial.size(),
+			    out);
+			this->partial.clear();
+		}
+		data = nl + 1;
+	}
+}
+
+
+void
+Parser::feed(const std::string& data, std::vector<Record>& out)
+{
+	this->feed(data.data(), data.size(), out);
+}
+
+
+void
+Parser::finish(std::vector<Record>& out)
+{
+	if (!this->partial.empty()) {
+		this->parse(this->partial.data(), this->partial.size(), out);
+		this->partial.clear();
+	}
+}
+
+
+std::uint64_t
+Parser::malformed(void) const
+{
+	return this->bad;
+}
+
+
+void
+Parser::parse(const char *line, size_t length, std::vector<Record>& out)
+{
+	Record	r{Level::INFO, 0, "", "", {}};
+
+	this->pairs.clear();
+	if (!parse_line(line, length, this->pairs)) {
+		this->bad++;
+		return;
+	}
+
+	if (this->pairs.empty()) {
+		return;
+	}
+
+	// format_log writes the header first, so only the first of each
+	// header key is taken; later ones are attributes of the same name.
+	bool	time = false, level = false, actor = false, event = false;
+
+	for (auto& kv : this->pairs) {
+		if (!time && kv.first == "time") {
+			if (!parse_time(kv.second, r.when)) {
+				this->bad++;
+				return;
+			}
+			time = true;
+		}
+		else if (!level && kv.first == "level") {
+			if (!parse_level(kv.second, r.level)) {
+				this->bad++;
+				return;
+			}
+			level = true;
+		}
+		else if (!actor && kv.first == "actor") {
+			r.actor = std::move(kv.second);
+			actor = true;
+		}
+		else if (!event && kv.first == "event") {
+			r.event = std::move(kv.second);
+			event = true;
+		}
+		else {
+			r.attrs[kv.first] = std::move(kv.second);
+		}
+	}
+
+	out.push_back(std::move(r));
+}
+
+
+} // namespace logfmt
+} // namespace klog
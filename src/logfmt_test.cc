@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/filelog.hh>
+#include <klogger/format.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOG = "logfmt_test.log";
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static int
+test_scan(void)
+{
+	const string	hits = string(" =\"\t\n\x01", 6) + string(1, '\0');
+	const string	misses = "a]/\\\x7f\x80\xff[";
+
+	for (size_t length = 0; length < 100; length++) {
+		string	clean(length, 'a');
+
+		for (size_t i = 0; i < length; i++) {
+			clean[i] = misses[i % misses.size()];
+		}
+
+		if (klog::logfmt::scan(clean.data(), length) != length) {
+			console.error("test_scan", "false hit",
+			    {{"length", to_string(length)}});
+			return 0;
+		}
+
+		for (size_t at = 0; at < length; at++) {
+			for (auto c : hits) {
+				string	s = clean;
+
+				s[at] = c;
+				if (klog::logfmt::scan(s.data(), length) != at ||
+				    klog::logfmt::scan_scalar(s.data(),
+				    length) != at) {
+					console.error("test_scan", "missed byte",
+					    {{"length", to_string(length)},
+					     {"at", to_string(at)},
+					     {"scanner",
+					      klog::logfmt::scanner()}});
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_quote(void)
+{
+	map<string, string>	values = {
+		{"", "\"\""},
+		{"plain", "plain"},
+		{"/api/v1?x[0]=1", "\"/api/v1?x[0]=1\""},
+		{"bracket]", "bracket]"},
+		{"C:\\path", "C:\\path"},
+		{"two words", "\"two words\""},
+		{"say \"hi\"", "\"say \\\"hi\\\"\""},
+		{"line\nbreak", "\"line\\nbreak\""},
+	};
+	map<string, string>	keys = {
+		{"", "_"},
+		{"key", "key"},
+		{"bad key", "bad_key"},
+		{"a=b\"c", "a_b_c"},
+	};
+
+	for (auto& v : values) {
+		string	buf;
+
+		klog::logfmt::append_value(buf, v.first);
+		if (buf != v.second) {
+			console.error("test_quote", "bad value",
+			    {{"got", buf}, {"want", v.second}});
+			return 0;
+		}
+	}
+
+	for (auto& k : keys) {
+		string	buf;
+
+		klog::logfmt::append_key(buf, k.first);
+		if (buf != k.second) {
+			console.error("test_quote", "bad key",
+			    {{"got", buf}, {"want", k.second}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_parse_line(void)
+{
+	vector<pair<string, string>>	pairs;
+	vector<pair<string, string>>	want = {
+		{"a", "1"}, {"flag", ""}, {"msg", "x y\n\"z\" \xc3\xa9"},
+		{"path", "C:\\tmp"}, {"empty", ""},
+	};
+
+	string	line = "a=1  flag msg=\"x y\\n\\\"z\\\" \\u00e9\" "
+		    "path=C:\\tmp empty=";
+
+	if (!klog::logfmt::parse_line(line.data(), line.size(), pairs) ||
+	    pairs != want) {
+		console.error("test_parse_line", "bad pairs");
+		return 0;
+	}
+
+	vector<string>	bad = {
+		"a=\"unterminated",
+		"=value",
+		"a=b\"c",
+		"a=\"x\"y",
+		"a=b=c",
+		"a=\"bad \\q escape\"",
+		string("a=ctl\x01", 6),
+	};
+
+	for (auto& b : bad) {
+		pairs.clear();
+		if (klog::logfmt::parse_line(b.data(), b.size(), pairs)) {
+			console.error("test_parse_line", "accepted bad line",
+			    {{"line", b}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_roundtrip(void)
+{
+	klog::FileLogger		flog(LOG, true);
+	vector<map<string, string>>	attrs = {
+		{},
+		{{"path", "/index.html"}, {"status", "200"}},
+		{{"msg", "value with spaces"}, {"eq", "a=b"},
+		 {"quote", "say \"hi\""}, {"nl", "one\ntwo"},
+		 {"tab", "a\tb"}, {"empty", ""}, {"bracket", "x]"},
+		 {"utf8", "caf\xc3\xa9"}, {"ctl", string("\x01\x7f", 2)},
+		 {"long", string(100, 'z') + " " + string(100, 'z')}},
+		{{"time", "noon"}, {"level", "high"}, {"actor", "impostor"},
+		 {"event", "other"}},
+	};
+	vector<klog::Level>	levels = {klog::Level::DEBUG,
+				    klog::Level::WARN, klog::Level::CRITICAL,
+				    klog::Level::ERROR};
+
+	flog.format(klog::Format::LOGFMT);
+	flog.level(klog::Level::DEBUG);
+	for (size_t i = 0; i < attrs.size(); i++) {
+		flog.log(levels[i], "test actor", "round=trip", attrs[i]);
+	}
+	flog.close();
+
+	// Feed the log in small pieces, splitting lines and escapes.
+	string			log = read_file(LOG);
+	klog::logfmt::Parser	parser;
+	vector<klog::Record>	records;
+
+	for (size_t off = 0; off < log.size(); off += 7) {
+		parser.feed(log.data() + off, min<size_t>(7, log.size() - off),
+		    records);
+	}
+	parser.finish(records);
+
+	if (records.size() != attrs.size() || parser.malformed() != 0) {
+		console.error("test_roundtrip", "records lost",
+		    {{"records", to_string(records.size())}});
+		return 0;
+	}
+
+	uint64_t	now = klog::now();
+
+	for (size_t i = 0; i < attrs.size(); i++) {
+		auto&	r = records[i];
+
+		if (r.level != levels[i] || r.actor != "test actor" ||
+		    r.event != "round=trip" || r.attrs != attrs[i] ||
+		    r.when > now || now - r.when > 60000000000ULL) {
+			console.error("test_roundtrip", "bad record",
+			    {{"record", to_string(i)}});
+			return 0;
+		}
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_malformed(void)
+{
+	klog::logfmt::Parser	parser;
+	vector<klog::Record>	records;
+
+	parser.feed("level=INFO actor=a event=e\n"
+	    "level=LOUD actor=a event=e\n"
+	    "time=yesterday actor=a event=e\n"
+	    "actor=a event=\"unterminated\n"
+	    "\n"
+	    "level=ERROR actor=b event=e k=v", records);
+	if (records.size() != 1) {
+		console.error("test_malformed", "partial line parsed");
+		return 0;
+	}
+
+	parser.finish(records);
+	if (records.size() != 2 || parser.malformed() != 3 ||
+	    records[1].level != klog::Level::ERROR ||
+	    records[1].attrs["k"] != "v") {
+		console.error("test_malformed", "bad records",
+		    {{"records", to_string(records.size())},
+		     {"malformed", to_string(parser.malformed())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"scan", test_scan},
+	{"quote", test_quote},
+	{"parse_line", test_parse_line},
+	{"roundtrip", test_roundtrip},
+	{"malformed", test_malformed},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("logfmt_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("logfmt_test", "ok",
+	    {{"scanner", klog::logfmt::scanner()}});
+}
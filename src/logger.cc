@@ -21,14 +21,21 @@
  */
 
 
-#include <iomanip>
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
 #include <map>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <klogger/logger.hh>
+#include <klogger/metrics.hh>
+#include <klogger/tlv.hh>
 #include <internal.hh>
 
 
@@ -37,27 +44,343 @@ namespace klog {
 
 constexpr size_t	TIMESTAMP_BUF_SIZE = 32;
 constexpr size_t	TIMESTAMP_SIZE = 24;
+constexpr std::uint64_t	NSEC = 1000000000;
+
+
+std::uint64_t
+now()
+{
+	struct timespec	ts;
+
+	::clock_gettime(CLOCK_REALTIME, &ts);
+	return (static_cast<std::uint64_t>(ts.tv_sec) * NSEC) +
+	    static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+
+size_t
+level_index(Level l)
+{
+	return static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(l)));
+}
+
+
+const std::string&
+level_string(Level level)
+{
+	static const std::string	debug = "DEBUG";
+	static const std::string	info = "INFO";
+	static const std::string	warn = "WARNING";
+	static const std::string	error = "ERROR";
+	static const std::string	critical = "CRITICAL";
+	static const std::string	fatal = "FATAL";
+
+	switch (level) {
+	case Level::DEBUG:
+		return debug;
+	case Level::INFO:
+		return info;
+	case Level::WARN:
+		return warn;
+	case Level::ERROR:
+		return error;
+	case Level::CRITICAL:
+		return critical;
+	default:
+		return fatal;
+	}
+}
 
 
 std::string
 timestamp()
 {
-	std::time_t		t = std::time(nullptr);
-        std::tm			tm = *std::localtime(&t);
-	std::stringstream	ss;
-	char			buf[TIMESTAMP_BUF_SIZE];
+	return timestamp(now());
+}
+
 
-	if (TIMESTAMP_SIZE != std::strftime(buf, TIMESTAMP_BUF_SIZE,
+// Rendering a timestamp means a trip through the time zone rules, so
+// each thread keeps the last second it rendered. The returned reference
+// is valid until the thread's next call.
+static const std::string&
+cached_timestamp(std::uint64_t when)
+{
+	static thread_local std::time_t	cached_t = -1;
+	static thread_local std::string	cached;
+	std::time_t			t = static_cast<std::time_t>(when / NSEC);
+	std::tm				tm;
+	char				buf[TIMESTAMP_BUF_SIZE];
+
+	if (t == cached_t) {
+		return cached;
+	}
+
+	cached_t = t;
+
+	// localtime(3) shares its result between threads.
+	if (nullptr == ::localtime_r(&t, &tm)) {
+		cached = std::to_string(t);
+	}
+	else if (TIMESTAMP_SIZE != std::strftime(buf, TIMESTAMP_BUF_SIZE,
 		    date_format, (const std::tm *)&tm)) {
-		return std::to_string(t);
+		cached = std::to_string(t);
 	}
 	else {
-		ss << buf;
-		return ss.str();
+		cached.assign(buf, TIMESTAMP_SIZE);
+	}
+
+	return cached;
+}
+
+
+std::string
+timestamp(std::uint64_t when)
+{
+	return cached_timestamp(when);
+}
+
+
+std::string&
+thread_buffer()
+{
+	static thread_local std::string	buf;
+
+	buf.clear();
+	return buf;
+}
+
+
+void
+format_timestamp(std::string& buf, std::uint64_t when)
+{
+	buf += cached_timestamp(when);
+}
+
+
+void
+format_header(std::string& buf, Level level, std::uint64_t when)
+{
+	buf += "[";
+	buf += cached_timestamp(when);
+	buf += "] ";
+	format_header_nt(buf, level);
+}
+
+
+void
+format_header_nt(std::string& buf, Level level)
+{
+	buf += "[";
+	buf += level_string(level);
+	buf += "] ";
+}
+
+
+void
+format_body(std::string& buf,
+	    const std::string& actor,
+	    const std::string& event,
+	    const std::map<std::string, std::string>& attrs)
+{
+	buf += "[actor:";
+	buf += actor;
+	buf += " event:";
+	buf += event;
+	buf += "]";
+	format_attrs(buf, attrs);
+}
+
+
+void
+format_attrs(std::string& buf, const std::map<std::string, std::string>& attrs)
+{
+	for (auto it = attrs.begin(); it != attrs.end(); it++) {
+		buf += " ";
+		buf += it->first;
+		buf += "=";
+		buf += it->second;
+	}
+}
+
+
+void
+MapBody::text(std::string& buf) const
+{
+	format_body(buf, this->ractor, this->revent, this->rattrs);
+}
+
+
+void
+MapBody::tlv(std::string& buf) const
+{
+	tlv::append_string(buf, this->ractor);
+	tlv::append_string(buf, this->revent);
+	for (auto& kv : this->rattrs) {
+		tlv::append_string(buf, kv.first);
+		tlv::append_string(buf, kv.second);
 	}
 }
 
 
+size_t
+MapBody::tlv_length() const
+{
+	size_t	length = 0;
+
+	length += tlv::string_length(this->ractor);
+	length += tlv::string_length(this->revent);
+	for (auto& kv : this->rattrs) {
+		length += tlv::string_length(kv.first);
+		length += tlv::string_length(kv.second);
+	}
+	return length;
+}
+
+
+void
+MapBody::attrs(std::map<std::string, std::string>& out) const
+{
+	out.insert(this->rattrs.begin(), this->rattrs.end());
+}
+
+
+void
+format_log(std::string& buf,
+	   Level level,
+	   std::uint64_t when,
+	   const std::string& actor,
+	   const std::string& event,
+	   const std::map<std::string, std::string>& attrs)
+{
+	format_header(buf, level, when);
+	format_body(buf, actor, event, attrs);
+	buf += "\n";
+}
+
+
+void
+format_log_nt(std::string& buf,
+	      Level level,
+	      const std::string& actor,
+	      const std::string& event,
+	      const std::map<std::string, std::string>& attrs)
+{
+	format_header_nt(buf, level);
+	format_body(buf, actor, event, attrs);
+	buf += "\n";
+}
+
+
+void
+format_record(std::string& buf, Format f, Level level, std::uint64_t when,
+	      const std::string& actor,
+	      const std::string& event,
+	      const std::map<std::string, std::string>& attrs)
+{
+	switch (f) {
+	case Format::JSON:
+		json::format_log(buf, level, when, actor, event, attrs);
+		break;
+	case Format::LOGFMT:
+		logfmt::format_log(buf, level, when, actor, event, attrs);
+		break;
+	default:
+		format_log(buf, level, when, actor, event, attrs);
+	}
+}
+
+
+void
+format_record_body(std::string& buf, Format f, Level level,
+		   std::uint64_t when, const Body& body)
+{
+	std::map<std::string, std::string>	attrs;
+
+	switch (f) {
+	case Format::JSON:
+		body.attrs(attrs);
+		json::format_log(buf, level, when, body.actor(), body.event(),
+		    attrs);
+		break;
+	case Format::LOGFMT:
+		body.attrs(attrs);
+		logfmt::format_log(buf, level, when, body.actor(), body.event(),
+		    attrs);
+		break;
+	default:
+		format_header(buf, level, when);
+		body.text(buf);
+		buf += "\n";
+	}
+}
+
+
+int
+open_logfd(const std::string& path, bool truncate)
+{
+	int	flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+	if (truncate) {
+		flags |= O_TRUNC;
+	}
+
+	return ::open(path.c_str(), flags, 0644);
+}
+
+
+LogError
+errno_error(int errnum)
+{
+	switch (errnum) {
+	case EACCES:
+	case EPERM:
+	case EROFS:
+		return LogError::ERR_NOPERM;
+	case ENOSPC:
+	case EDQUOT:
+	case EFBIG:
+	case EIO:
+		return LogError::ERR_DISK;
+	case EBADF:
+		return LogError::ERR_CLOSED;
+	case EPIPE:
+	case EAGAIN:
+	case ENXIO:
+	case ECONNREFUSED:
+	case ECONNRESET:
+	case ENOTCONN:
+		return LogError::ERR_UNAVAILABLE;
+	case ENOENT:
+	case ENOTDIR:
+	case EISDIR:
+		return LogError::ERR_OPEN;
+	default:
+		return LogError::ERR_UNKNOWN;
+	}
+}
+
+
+LogError
+write_fd(int fd, const char *buf, size_t length)
+{
+	while (length > 0) {
+		ssize_t	n = ::write(fd, buf, length);
+
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return errno_error(errno);
+		}
+
+		buf += n;
+		length -= static_cast<size_t>(n);
+	}
+
+	return LogError::HEALTHY;
+}
+
+
 std::ostream&
 write_log(std::ostream& outs, 
 	  Level level,
@@ -65,16 +388,11 @@ write_log(std::ostream& outs,
 	  std::string event,
 	  std::map<std::string, std::string> attrs)
 {
-	auto	t = timestamp();
-	outs << "[" << t << "] ";
-	outs << "[" << level_strings[level] << "] ";
-	outs << "[" << "actor:" << actor << " event:" << event << "]";
+	std::string&	buf = thread_buffer();
 
-	for (auto it = attrs.begin(); it != attrs.end(); it++) {
-		outs << " " << it->first << "=" << it->second;
-	}
-
-	outs << std::endl;
+	format_log(buf, level, now(), actor, event, attrs);
+	outs.write(buf.data(), buf.size());
+	outs.flush();
 	return outs;
 }
 
@@ -86,14 +404,11 @@ write_log_nt(std::ostream& outs,
 	     std::string event,
 	     std::map<std::string, std::string> attrs)
 {
-	outs << "[" << level_strings[level] << "] ";
-	outs << "[" << "actor:" << actor << " event:" << event << "]";
-
-	for (auto it = attrs.begin(); it != attrs.end(); it++) {
-		outs << " " << it->first << "=" << it->second;
-	}
+	std::string&	buf = thread_buffer();
 
-	outs << std::endl;
+	format_log_nt(buf, level, actor, event, attrs);
+	outs.write(buf.data(), buf.size());
+	outs.flush();
 	return outs;
 }
 
@@ -104,10 +419,10 @@ log_to_string(Level level,
 	      std::string event,
 	      std::map<std::string, std::string> attrs)
 {
-	std::stringstream	ss;
+	std::string	s;
 
-	write_log(ss, level, actor, event, attrs);
-	return ss.str();
+	format_log(s, level, now(), actor, event, attrs);
+	return s;
 }
 
 
@@ -117,10 +432,10 @@ log_to_string_nt(Level level,
 		 std::string event,
 		 std::map<std::string, std::string> attrs)
 {
-	std::stringstream	ss;
+	std::string	s;
 
-	write_log_nt(ss, level, actor, event, attrs);
-	return ss.str();
+	format_log_nt(s, level, actor, event, attrs);
+	return s;
 }
 
 
@@ -141,4 +456,290 @@ log_to_string(std::string actor,
 }
 
 
+void
+BasicLogger::debug(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs)
+{
+	this->log(Level::DEBUG, actor, event, attrs);
+}
+
+
+void
+BasicLogger::debug(const std::string& actor,
+		   const std::string& event)
+{
+	this->log(Level::DEBUG, actor, event, {});
+}
+
+
+void
+BasicLogger::info(const std::string& actor,
+		  const std::string& event,
+		  std::map<std::string, std::string> attrs)
+{
+	this->log(Level::INFO, actor, event, attrs);
+}
+
+
+void
+BasicLogger::info(const std::string& actor,
+		  const std::string& event)
+{
+	this->log(Level::INFO, actor, event, {});
+}
+
+
+void
+BasicLogger::warn(const std::string& actor,
+		  const std::string& event,
+		  std::map<std::string, std::string> attrs)
+{
+	this->log(Level::WARN, actor, event, attrs);
+}
+
+
+void
+BasicLogger::warn(const std::string& actor,
+		  const std::string& event)
+{
+	this->log(Level::WARN, actor, event, {});
+}
+
+
+void
+BasicLogger::error(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs)
+{
+	this->log(Level::ERROR, actor, event, attrs);
+}
+
+
+void
+BasicLogger::error(const std::string& actor,
+		   const std::string& event)
+{
+	this->log(Level::ERROR, actor, event, {});
+}
+
+
+void
+BasicLogger::critical(const std::string& actor,
+		      const std::string& event,
+		      std::map<std::string, std::string> attrs)
+{
+	this->log(Level::CRITICAL, actor, event, attrs);
+}
+
+
+void
+BasicLogger::critical(const std::string& actor,
+		      const std::string& event)
+{
+	this->log(Level::CRITICAL, actor, event, {});
+}
+
+
+void
+BasicLogger::fatal(const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs)
+{
+	this->fatal(EXIT_FAILURE, actor, event, attrs);
+}
+
+
+void
+BasicLogger::fatal(const std::string& actor,
+		   const std::string& event)
+{
+	this->fatal(EXIT_FAILURE, actor, event, {});
+}
+
+
+void
+BasicLogger::fatal(int exitcode,
+		   const std::string& actor,
+		   const std::string& event,
+		   std::map<std::string, std::string> attrs)
+{
+	// The process exits even if FATAL isn't in the enabled set.
+	if (this->enabled(Level::FATAL, actor, event)) {
+		std::uint64_t	started = this->stats->start();
+
+		this->write(Level::FATAL, now(), actor, event, attrs);
+		this->stats->finish(started);
+	}
+	exit(exitcode);
+}
+
+
+void
+BasicLogger::fatal(int exitcode,
+		   const std::string& actor,
+		   const std::string& event)
+{
+	this->fatal(exitcode, actor, event, {});
+}
+
+
+void
+BasicLogger::fatal_noexit(const std::string& actor,
+			  const std::string& event,
+			  std::map<std::string, std::string> attrs)
+{
+	this->log(Level::FATAL, actor, event, attrs);
+}
+
+
+void
+BasicLogger::fatal_noexit(const std::string& actor,
+			  const std::string& event)
+{
+	this->log(Level::FATAL, actor, event, {});
+}
+
+
+void
+BasicLogger::level(Level l)
+{
+	this->ilevel.store(l, std::memory_order_relaxed);
+	this->ilevels.store(at_or_above(l), std::memory_order_relaxed);
+}
+
+
+void
+BasicLogger::levels(LevelSet set)
+{
+	Level	lowest = Level::FATAL;
+
+	set &= LEVELS_ALL;
+	if (set != LEVELS_NONE) {
+		lowest = static_cast<Level>(set & -set);
+	}
+
+	this->ilevel.store(lowest, std::memory_order_relaxed);
+	this->ilevels.store(set, std::memory_order_relaxed);
+}
+
+
+LevelSet
+BasicLogger::levels(void) const
+{
+	return this->ilevels.load(std::memory_order_relaxed);
+}
+
+
+Level
+BasicLogger::level(void) const
+{
+	return this->ilevel.load(std::memory_order_relaxed);
+}
+
+
+bool
+BasicLogger::good()
+{
+	return this->err.load(std::memory_order_relaxed) == LogError::HEALTHY;
+}
+
+
+LogError
+BasicLogger::error()
+{
+	return this->err.load(std::memory_order_relaxed);
+}
+
+
+bool
+BasicLogger::enabled(Level l)
+{
+	return 0 != (this->ilevels.load(std::memory_order_relaxed) &
+	    level_bit(l));
+}
+
+
+void
+BasicLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	std::map<std::string, std::string>	attrs;
+
+	body.attrs(attrs);
+	this->write(l, when, body.actor(), body.event(), attrs);
+}
+
+
+void
+BasicLogger::log(Level l,
+		 const std::string& actor,
+		 const std::string& event,
+		 const std::map<std::string, std::string>& attrs)
+{
+	if (!this->enabled(l, actor, event)) {
+		return;
+	}
+
+	std::uint64_t	started = this->stats->start();
+
+	this->write(l, now(), actor, event, attrs);
+	this->stats->finish(started);
+}
+
+
+std::uint64_t
+BasicLogger::start_call(void)
+{
+	return this->stats->start();
+}
+
+
+void
+BasicLogger::finish_call(std::uint64_t started)
+{
+	this->stats->finish(started);
+}
+
+
+MetricsSnapshot
+BasicLogger::metrics(void)
+{
+	MetricsSnapshot	snap = this->stats->snapshot();
+
+	for (auto& count : this->dropped()) {
+		snap.dropped[count.first] = count.second;
+	}
+	return snap;
+}
+
+
+std::map<Level, std::uint64_t>
+BasicLogger::dropped(void) const
+{
+	return std::map<Level, std::uint64_t>();
+}
+
+
+void
+BasicLogger::count_write(Level l, size_t bytes)
+{
+	this->stats->wrote(l, bytes);
+}
+
+
+void
+BasicLogger::count_flush(void)
+{
+	this->stats->flushed();
+}
+
+
+void
+BasicLogger::fail(LogError e)
+{
+	this->err = e;
+	this->stats->failed(e);
+}
+
+
 } // namespace klog
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <klogger/logger.hh>
+#include <klogger/metrics.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// Snapshots wait until at least this long after the clock anchor, so
+// that the tick rate they compute is reasonably accurate.
+constexpr std::chrono::milliseconds	CALIBRATE_MIN(10);
+
+
+static inline std::uint64_t
+ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return static_cast<std::uint64_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+// A ClockAnchor pairs a tick reading with the steady clock, taken
+// when the first Metrics is created; snapshots compare both against
+// the present to convert ticks to nanoseconds.
+struct ClockAnchor {
+	ClockAnchor() : tick(ticks()), when(std::chrono::steady_clock::now())
+	{
+	}
+
+	std::uint64_t				tick;
+	std::chrono::steady_clock::time_point	when;
+};
+
+
+static const ClockAnchor&
+clock_anchor(void)
+{
+	static const ClockAnchor	anchor;
+
+	return anchor;
+}
+
+
+// ns_per_tick measures the tick rate against the steady clock.
+static double
+ns_per_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	const ClockAnchor&	anchor = clock_anchor();
+	auto			since = std::chrono::steady_clock::now() -
+				    anchor.when;
+
+	if (since < CALIBRATE_MIN) {
+		std::this_thread::sleep_for(CALIBRATE_MIN - since);
+	}
+
+	std::uint64_t	tick = ticks();
+	auto		ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			    std::chrono::steady_clock::now() - anchor.when);
+
+	if (tick <= anchor.tick) {
+		return 1.0;
+	}
+	return static_cast<double>(ns.count()) /
+	    static_cast<double>(tick - anchor.tick);
+#else
+	return 1.0;
+#endif
+}
+
+
+static inline size_t
+latency_bucket(std::uint64_t v)
+{
+	if (v < LATENCY_SUB_BUCKETS) {
+		return static_cast<size_t>(v);
+	}
+
+	size_t	e = 63 - static_cast<size_t>(__builtin_clzll(v));
+	size_t	sub = static_cast<size_t>(v >> (e - LATENCY_SUB_BITS)) &
+		      (LATENCY_SUB_BUCKETS - 1);
+
+	return (e - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+
+// latency_bound returns the exclusive upper bound, in ticks, of a
+// histogram bucket.
+static double
+latency_bound(size_t i)
+{
+	if (i < LATENCY_SUB_BUCKETS) {
+		return static_cast<double>(i + 1);
+	}
+
+	size_t	e = i / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+	size_t	sub = i % LATENCY_SUB_BUCKETS;
+
+	return std::ldexp(static_cast<double>(LATENCY_SUB_BUCKETS + sub + 1),
+	    static_cast<int>(e - LATENCY_SUB_BITS));
+}
+
+
+static inline void
+bump(std::atomic<std::uint64_t>& counter, std::uint64_t n)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n,
+	    std::memory_order_relaxed);
+}
+
+
+static const char *
+error_name(LogError e)
+{
+	switch (e) {
+	case LogError::HEALTHY:
+		return "HEALTHY";
+	case LogError::ERR_CLOSED:
+		return "ERR_CLOSED";
+	case LogError::ERR_OPEN:
+		return "ERR_OPEN";
+	case LogError::ERR_NOPERM:
+		return "ERR_NOPERM";
+	case LogError::ERR_DISK:
+		return "ERR_DISK";
+	case LogError::ERR_UNAVAILABLE:
+		return "ERR_UNAVAILABLE";
+	case LogError::ERR_CLOSEFAIL:
+		return "ERR_CLOSEFAIL";
+	default:
+		return "ERR_UNKNOWN";
+	}
+}
+
+
+// label_value escapes a Prometheus label value.
+static std::string
+label_value(const std::string& s)
+{
+	std::string	out;
+
+	for (auto c : s) {
+		switch (c) {
+		case '\\':
+			out += "\\\\";
+			break;
+		case '"':
+			out += "\\\"";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		default:
+			out += c;
+		}
+	}
+	return out;
+}
+
+
+MetricShard::MetricShard()
+    : records(), bytes(), errors(), flushes(0), latency(), latency_sum(0)
+{
+	for (size_t i = 0; i < LEVEL_COUNT; i++) {
+		this->records[i] = 0;
+		this->bytes[i] = 0;
+	}
+	for (size_t i = 0; i < LOG_ERROR_COUNT; i++) {
+		this->errors[i] = 0;
+	}
+	for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+		this->latency[i] = 0;
+	}
+}
+
+
+MetricsSnapshot::MetricsSnapshot()
+    : records(), bytes(), dropped(), errors(), flushes(0), samples(0),
+      latency_sum(0), latency()
+{
+}
+
+
+std::uint64_t
+MetricsSnapshot::percentile(double p) const
+{
+	if (this->samples == 0) {
+		return 0;
+	}
+
+	double		want = std::ceil(p / 100.0 *
+			    static_cast<double>(this->samples));
+	std::uint64_t	target = want < 1.0 ? 1 :
+			    static_cast<std::uint64_t>(want);
+	std::uint64_t	seen = 0;
+
+	for (auto& bucket : this->latency) {
+		seen += bucket.second;
+		if (seen >= target) {
+			return bucket.first;
+		}
+	}
+	return this->latency.back().first;
+}
+
+
+std::string
+MetricsSnapshot::text(const std::string& name) const
+{
+	std::string	out;
+	std::string	logger = "logger=\"" + label_value(name) + "\"";
+
+	auto	per_level = [&](const char *metric,
+			    const std::map<Level, std::uint64_t>& counts) {
+		out += "# TYPE ";
+		out += metric;
+		out += " counter\n";
+		for (size_t i = 0; i < LEVEL_COUNT; i++) {
+			Level	l = static_cast<Level>(1 << i);
+			auto	it = counts.find(l);
+
+			out += metric;
+			out += "{" + logger + ",level=\"" + level_string(l) +
+			    "\"} ";
+			out += std::to_string(it == counts.end() ? 0 :
+			    it->second);
+			out += "\n";
+		}
+	};
+
+	per_level("klog_records_total", this->records);
+	per_level("klog_bytes_total", this->bytes);
+	per_level("klog_dropped_total", this->dropped);
+
+	out += "# TYPE klog_write_errors_total counter\n";
+	for (size_t i = 1; i < LOG_ERROR_COUNT; i++) {
+		LogError	e = static_cast<LogError>(i);
+		auto		it = this->errors.find(e);
+
+		out += "klog_write_errors_total{" + logger + ",error=\"";
+		out += error_name(e);
+		out += "\"} ";
+		out += std::to_string(it == this->errors.end() ? 0 :
+		    it->second);
+		out += "\n";
+	}
+
+	out += "# TYPE klog_flushes_total counter\n";
+	out += "klog_flushes_total{" + logger + "} " +
+	    std::to_string(this->flushes) + "\n";
+
+	std::uint64_t	seen = 0;
+
+	out += "# TYPE klog_call_latency_ns histogram\n";
+	for (auto& bucket : this->latency) {
+		seen += bucket.second;
+		out += "klog_call_latency_ns_bucket{" + logger + ",le=\"" +
+		    std::to_string(bucket.first) + "\"} " +
+		    std::to_string(seen) + "\n";
+	}
+	out += "klog_call_latency_ns_bucket{" + logger + ",le=\"+Inf\"} " +
+	    std::to_string(this->samples) + "\n";
+	out += "klog_call_latency_ns_sum{" + logger + "} " +
+	    std::to_string(this->latency_sum) + "\n";
+	out += "klog_call_latency_ns_count{" + logger + "} " +
+	    std::to_string(this->samples) + "\n";
+	return out;
+}
+
+
+Metrics::Metrics()
+    : shards()
+{
+	clock_anchor();
+}
+
+
+void
+Metrics::wrote(Level l, size_t bytes)
+{
+	MetricShard&	s = this->shards.get();
+	size_t		i = level_index(l);
+
+	bump(s.records[i], 1);
+	bump(s.bytes[i], bytes);
+}
+
+
+void
+Metrics::failed(LogError e)
+{
+	size_t	i = static_cast<size_t>(e);
+
+	if (i >= LOG_ERROR_COUNT) {
+		i = static_cast<size_t>(LogError::ERR_UNKNOWN);
+	}
+	bump(this->shards.get().errors[i], 1);
+}
+
+
+void
+Metrics::flushed(void)
+{
+	bump(this->shards.get().flushes, 1);
+}
+
+
+std::uint64_t
+Metrics::start(void)
+{
+	static thread_local std::uint32_t	calls = 0;
+
+	if ((++calls & (LATENCY_SAMPLE - 1)) != 0) {
+		return 0;
+	}
+
+	// A zero reading would read as unsampled; it can only be the
+	// very first tick, so nudging it costs nothing.
+	std::uint64_t	t = ticks();
+
+	return t == 0 ? 1 : t;
+}
+
+
+void
+Metrics::finish(std::uint64_t started)
+{
+	if (started == 0) {
+		return;
+	}
+
+	std::uint64_t	t = ticks();
+	std::uint64_t	d = t > started ? t - started : 0;
+	MetricShard&	s = this->shards.get();
+
+	bump(s.latency[latency_bucket(d)], 1);
+	bump(s.latency_sum, d);
+}
+
+
+MetricsSnapshot
+Metrics::snapshot(void)
+{
+	MetricsSnapshot			snap;
+	std::uint64_t			records[LEVEL_COUNT] = {};
+	std::uint64_t			bytes[LEVEL_COUNT] = {};
+	std::uint64_t			errors[LOG_ERROR_COUNT] = {};
+	std::vector<std::uint64_t>	latency(LATENCY_BUCKETS, 0);
+	std::uint64_t			latency_sum = 0;
+	auto				relaxed = std::memory_order_relaxed;
+
+	this->shards.each([&](MetricShard& shard) {
+		for (size_t i = 0; i < LEVEL_COUNT; i++) {
+			records[i] += shard.records[i].load(relaxed);
+			bytes[i] += shard.bytes[i].load(relaxed);
+		}
+		for (size_t i = 0; i < LOG_ERROR_COUNT; i++) {
+			errors[i] += shard.errors[i].load(relaxed);
+		}
+		for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+			latency[i] += shard.latency[i].load(relaxed);
+		}
+		snap.flushes += shard.flushes.load(relaxed);
+		latency_sum += shard.latency_sum.load(relaxed);
+	});
+
+	for (size_t i = 0; i < LEVEL_COUNT; i++) {
+		Level	l = static_cast<Level>(1 << i);
+
+		snap.records[l] = records[i];
+		snap.bytes[l] = bytes[i];
+	}
+	for (size_t i = 1; i < LOG_ERROR_COUNT; i++) {
+		snap.errors[static_cast<LogError>(i)] = errors[i];
+	}
+
+	// Buckets that round to the same number of nanoseconds are
+	// merged.
+	double	scale = ns_per_tick();
+
+	for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+		if (latency[i] == 0) {
+			continue;
+		}
+
+		double		ns = std::ceil(latency_bound(i) * scale);
+		std::uint64_t	bound = UINT64_MAX;
+
+		if (ns < 18446744073709551615.0) {
+			bound = static_cast<std::uint64_t>(ns);
+		}
+
+		snap.samples += latency[i];
+		if (!snap.latency.empty() &&
+		    snap.latency.back().first >= bound) {
+			snap.latency.back().second += latency[i];
+		} else {
+			snap.latency.emplace_back(bound, latency[i]);
+		}
+	}
+	snap.latency_sum = static_cast<std::uint64_t>(
+	    static_cast<double>(latency_sum) * scale);
+	return snap;
+}
+
+
+} // namespace klog
@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/fastlog.hh>
+#include <klogger/filelog.hh>
+#include <klogger/metrics.hh>
+#include <klogger/schema.hh>
+#include <klogger/shmlog.hh>
+#include <klogger/slots.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOG = "metrics_test.log";
+
+
+static uint64_t
+file_size(const string& path)
+{
+	struct stat	st;
+
+	if (-1 == ::stat(path.c_str(), &st)) {
+		return 0;
+	}
+	return static_cast<uint64_t>(st.st_size);
+}
+
+
+static int
+test_counts(void)
+{
+	klog::FileLogger	flog(LOG, true);
+
+	for (int i = 0; i < 10; i++) {
+		flog.info("test", "info", {{"seq", to_string(i)}});
+	}
+	for (int i = 0; i < 5; i++) {
+		flog.warn("test", "warn");
+	}
+	flog.debug("test", "debug");
+
+	klog::MetricsSnapshot	m = flog.metrics();
+	uint64_t		bytes = 0;
+
+	for (auto& count : m.bytes) {
+		bytes += count.second;
+	}
+	flog.close();
+
+	if (m.records[klog::Level::INFO] != 10 ||
+	    m.records[klog::Level::WARN] != 5 ||
+	    m.records[klog::Level::DEBUG] != 0) {
+		console.error("test_counts", "bad record counts");
+		return 0;
+	}
+
+	if (bytes != file_size(LOG) || m.bytes[klog::Level::WARN] == 0) {
+		console.error("test_counts", "bad byte counts",
+		    {{"bytes", to_string(bytes)}});
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+// Each thread times one call in LATENCY_SAMPLE, so fresh threads
+// sample an exact number of calls.
+static int
+test_threads(void)
+{
+	klog::FileLogger	flog(LOG, true);
+	vector<thread>		threads;
+	const int		per_thread = 1000;
+
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&flog]() {
+			for (int i = 0; i < per_thread; i++) {
+				flog.info("test", "threads");
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	klog::MetricsSnapshot	m = flog.metrics();
+	uint64_t		bucketed = 0;
+
+	flog.close();
+	::unlink(LOG.c_str());
+
+	if (m.records[klog::Level::INFO] != 4 * per_thread) {
+		console.error("test_threads", "records lost");
+		return 0;
+	}
+
+	for (auto& bucket : m.latency) {
+		bucketed += bucket.second;
+	}
+	if (m.samples != 4 * per_thread / klog::LATENCY_SAMPLE ||
+	    bucketed != m.samples || m.latency_sum == 0) {
+		console.error("test_threads", "bad samples",
+		    {{"samples", to_string(m.samples)}});
+		return 0;
+	}
+
+	uint64_t	p50 = m.percentile(50);
+	uint64_t	p99 = m.percentile(99);
+
+	if (p50 == 0 || p50 > p99 || p99 > m.latency.back().first ||
+	    m.percentile(0) != m.latency.front().first) {
+		console.error("test_threads", "bad percentiles",
+		    {{"p50", to_string(p50)}, {"p99", to_string(p99)}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// More threads than a logger has slots for fall back to the locked
+// shards, and are still counted.
+static int
+test_many_threads(void)
+{
+	klog::FileLogger	flog(LOG, true);
+	vector<thread>		threads;
+	const size_t		count = klog::THREAD_SLOTS + 16;
+
+	for (size_t t = 0; t < count; t++) {
+		threads.emplace_back([&flog]() {
+			for (int i = 0; i < 10; i++) {
+				flog.info("test", "many threads");
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	klog::MetricsSnapshot	m = flog.metrics();
+
+	flog.close();
+	::unlink(LOG.c_str());
+
+	if (m.records[klog::Level::INFO] != count * 10) {
+		console.error("test_many_threads", "records lost",
+		    {{"records", to_string(m.records[klog::Level::INFO])}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// Threads that come and go one after another take over each other's
+// keys, so they never run out of slots, and their counts are kept.
+static int
+test_churn(void)
+{
+	klog::FileLogger	flog(LOG, true);
+	const size_t		count = 4 * klog::THREAD_SLOTS;
+	uint64_t		highest = 0;
+
+	for (size_t t = 0; t < count; t++) {
+		thread	th([&flog, &highest]() {
+			highest = max(highest, klog::thread_key());
+			flog.info("test", "churn");
+		});
+
+		th.join();
+	}
+
+	klog::MetricsSnapshot	m = flog.metrics();
+
+	flog.close();
+	::unlink(LOG.c_str());
+
+	if (highest >= klog::THREAD_SLOTS ||
+	    m.records[klog::Level::INFO] != count) {
+		console.error("test_churn", "keys not reused",
+		    {{"highest", to_string(highest)},
+		     {"records", to_string(m.records[klog::Level::INFO])}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// Schemas and FastLogger sites are timed like the level methods, and
+// records at levels without a route aren't counted.
+static int
+test_entry_points(void)
+{
+	static const klog::Schema<1>	schema("test", "schema", {"seq"});
+	const int			calls = 8 * klog::LATENCY_SAMPLE;
+	klog::MetricsSnapshot		fm, sm, rm;
+
+	{
+		klog::FastLogger	flog(LOG, true);
+		klog::Site<int>		site(flog, klog::Level::INFO, "test",
+					    "site", {"seq"});
+
+		thread([&site, calls]() {
+			for (int i = 0; i < calls; i++) {
+				site.log(i);
+			}
+		}).join();
+		fm = flog.metrics();
+	}
+
+	{
+		klog::FileLogger	flog(LOG, true);
+
+		thread([&flog, calls]() {
+			for (int i = 0; i < calls; i++) {
+				schema.info(flog, to_string(i));
+			}
+		}).join();
+		sm = flog.metrics();
+	}
+
+	{
+		klog::FileLogger	flog({{
+					    klog::at_or_above(klog::Level::ERROR),
+					    LOG}}, true);
+
+		flog.info("test", "unrouted");
+		flog.error("test", "routed");
+		rm = flog.metrics();
+	}
+	::unlink(LOG.c_str());
+
+	if (fm.samples != 8 || sm.samples != 8) {
+		console.error("test_entry_points", "calls not timed",
+		    {{"site", to_string(fm.samples)},
+		     {"schema", to_string(sm.samples)}});
+		return 0;
+	}
+
+	if (rm.records[klog::Level::INFO] != 0 ||
+	    rm.records[klog::Level::ERROR] != 1) {
+		console.error("test_entry_points", "unrouted record counted");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_errors(void)
+{
+	klog::FileLogger	flog("/dev/full", false);
+
+	for (int i = 0; i < 3; i++) {
+		flog.error("test", "disk full");
+	}
+
+	klog::MetricsSnapshot	m = flog.metrics();
+
+	if (flog.error() != klog::LogError::ERR_DISK ||
+	    m.errors[klog::LogError::ERR_DISK] != 3 ||
+	    m.records[klog::Level::ERROR] != 0) {
+		console.error("test_errors", "errors not counted");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_drops(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::ShmLogger		slog("metrics_test_drops", 4096);
+	klog::ShmCollector	collector("metrics_test_drops", LOG, false);
+
+	for (int i = 0; i < 200; i++) {
+		slog.info("test", "drops", {{"seq", to_string(i)}});
+	}
+
+	klog::MetricsSnapshot	m = slog.metrics();
+
+	collector.drain();
+	slog.close();
+	::unlink(LOG.c_str());
+
+	if (m.dropped[klog::Level::INFO] == 0 ||
+	    m.records[klog::Level::INFO] + m.dropped[klog::Level::INFO] !=
+	    200) {
+		console.error("test_drops", "drops not counted");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_flushes(void)
+{
+	klog::FastLogger	flog(LOG, true);
+
+	flog.info("test", "one");
+	flog.info("test", "two");
+	flog.flush();
+	flog.flush();
+
+	klog::MetricsSnapshot	m = flog.metrics();
+
+	flog.close();
+	::unlink(LOG.c_str());
+
+	if (m.flushes != 1 || m.records[klog::Level::INFO] != 2) {
+		console.error("test_flushes", "bad flush count",
+		    {{"flushes", to_string(m.flushes)}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_text(void)
+{
+	klog::FileLogger	flog(LOG, true);
+
+	for (int i = 0; i < 16; i++) {
+		flog.info("test", "text");
+	}
+
+	klog::MetricsSnapshot	m = flog.metrics();
+	string			text = m.text("app \"one\"");
+
+	flog.close();
+	::unlink(LOG.c_str());
+
+	string	label = "{logger=\"app \\\"one\\\"\"";
+	vector<string>	want = {
+		"# TYPE klog_records_total counter\n",
+		"klog_records_total" + label + ",level=\"INFO\"} 16\n",
+		"klog_records_total" + label + ",level=\"DEBUG\"} 0\n",
+		"klog_bytes_total" + label + ",level=\"INFO\"} " +
+		    to_string(m.bytes[klog::Level::INFO]) + "\n",
+		"klog_dropped_total" + label + ",level=\"FATAL\"} 0\n",
+		"klog_write_errors_total" + label + ",error=\"ERR_DISK\"} 0\n",
+		"klog_flushes_total" + label + "} 0\n",
+		"# TYPE klog_call_latency_ns histogram\n",
+		"klog_call_latency_ns_bucket" + label + ",le=\"+Inf\"} " +
+		    to_string(m.samples) + "\n",
+		"klog_call_latency_ns_count" + label + "} " +
+		    to_string(m.samples) + "\n",
+	};
+
+	for (auto& line : want) {
+		if (text.find(line) == string::npos) {
+			console.error("test_text", "missing line",
+			    {{"line", line}});
+			return 0;
+		}
+	}
+
+	if (m.samples == 0 || text.find("klog_write_errors_total" + label +
+	    ",error=\"HEALTHY\"") != string::npos) {
+		console.error("test_text", "bad series");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"counts", test_counts},
+	{"threads", test_threads},
+	{"many_threads", test_many_threads},
+	{"churn", test_churn},
+	{"entry_points", test_entry_points},
+	{"errors", test_errors},
+	{"drops", test_drops},
+	{"flushes", test_flushes},
+	{"text", test_text},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("metrics_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("metrics_test", "ok");
+}
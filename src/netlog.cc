@@ -0,0 +1,869 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/netlog.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The worker wakes at least this often to retry a connection or notice
+// a close; while batches are unacknowledged, it waits on the socket
+// for ACK_WAIT at a time instead.
+constexpr std::chrono::milliseconds	WORKER_WAIT(100);
+constexpr int				ACK_WAIT_MS = 10;
+
+// Reconnection attempts back off exponentially between these.
+constexpr std::chrono::milliseconds	MIN_BACKOFF(100);
+constexpr std::chrono::milliseconds	MAX_BACKOFF(30000);
+
+// A collector that acknowledges nothing for ACK_TIMEOUT is dropped; a
+// send that makes no progress for SEND_TIMEOUT_S drops the connection.
+constexpr std::chrono::milliseconds	ACK_TIMEOUT(10000);
+constexpr int				SEND_TIMEOUT_S = 5;
+
+// close waits up to CLOSE_WAIT for outstanding acknowledgements.
+constexpr std::chrono::milliseconds	CLOSE_WAIT(2000);
+
+// The header of a spilled batch is never longer than this: a tag, a
+// length of up to nine bytes and the sequence number.
+constexpr size_t			SPILL_HEADER = 18;
+
+
+// count_drops counts each entry in a batch as dropped at its level.
+static void
+count_drops(DropCounter& drops, const std::string& entries)
+{
+	size_t	off = 0;
+
+	while (off < entries.size()) {
+		std::uint8_t	tag;
+		std::uint64_t	length;
+		std::uint64_t	t;
+		std::uint8_t	lvl;
+		size_t		pos;
+
+		if (!tlv::read_header(entries, off, tag, length)) {
+			return;
+		}
+
+		pos = off;
+		off += length;
+		if (tlv::TLogEntry == tag && tlv::read_timestamp(entries, pos, t)
+		    && tlv::read_loglevel(entries, pos, lvl)) {
+			drops.add(static_cast<Level>(lvl));
+		}
+	}
+}
+
+
+// frame appends entries to buf as a batch in the spill file's format.
+static void
+frame(std::string& buf, const std::string& entries)
+{
+	tlv::append_batch_header(buf, 0, entries.size());
+	buf.append(entries);
+}
+
+
+// next_batch appends records from backlog, starting at next, to
+// entries until the batch is full, and advances next past them.
+static void
+next_batch(const std::vector<NetRecord>& backlog, size_t& next,
+	   std::string& entries)
+{
+	while (next < backlog.size()) {
+		const std::string&	data = backlog[next].data;
+
+		if (!entries.empty() && entries.size() + data.size() > NET_BATCH) {
+			break;
+		}
+		entries += data;
+		next++;
+	}
+}
+
+
+NetLogger::NetLogger(std::string address, std::uint16_t tcp_port,
+		     std::string spillfile, OverflowPolicy policy)
+    : BasicLogger(), host(address), port(tcp_port), path(),
+      spill_path(spillfile), drops(), queue(policy, &this->drops),
+      limit(policy.capacity), fd(-1), spill_fd(-1), spill_read(0),
+      spill_size(0), next_seq(1), backlog(), unacked(), acks(),
+      backoff(MIN_BACKOFF), next_attempt(), last_ack(), sending(),
+      collect(), stopping(false), worker()
+{
+	this->open_spill();
+	this->worker = std::thread(&NetLogger::run, this);
+}
+
+
+NetLogger::NetLogger(std::string address, std::uint16_t tcp_port,
+		     std::string spillfile)
+    : NetLogger(address, tcp_port, spillfile, DEFAULT_OVERFLOW)
+{
+}
+
+
+NetLogger::NetLogger(std::string socket_path, std::string spillfile,
+		     OverflowPolicy policy)
+    : BasicLogger(), host(), port(0), path(socket_path),
+      spill_path(spillfile), drops(), queue(policy, &this->drops),
+      limit(policy.capacity), fd(-1), spill_fd(-1), spill_read(0),
+      spill_size(0), next_seq(1), backlog(), unacked(), acks(),
+      backoff(MIN_BACKOFF), next_attempt(), last_ack(), sending(),
+      collect(), stopping(false), worker()
+{
+	this->open_spill();
+	this->worker = std::thread(&NetLogger::run, this);
+}
+
+
+NetLogger::NetLogger(std::string socket_path, std::string spillfile)
+    : NetLogger(socket_path, spillfile, DEFAULT_OVERFLOW)
+{
+}
+
+
+NetLogger::~NetLogger()
+{
+	this->close();
+}
+
+
+void
+NetLogger::enqueue(Level l, std::string& buf)
+{
+	NetRecord	r{l, std::string()};
+
+	r.data.swap(buf);
+	this->queue.push(std::move(r));
+
+	if (Level::FATAL == l) {
+		this->flush();
+	}
+}
+
+
+void
+NetLogger::write(Level l, std::uint64_t when, const std::string& actor,
+		 const std::string& event,
+		 const std::map<std::string, std::string>& attrs)
+{
+	std::string&	buf = thread_buffer();
+
+	tlv::append_entry(buf, l, when, actor, event, attrs);
+	this->enqueue(l, buf);
+}
+
+
+void
+NetLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	std::string&	buf = thread_buffer();
+
+	tlv::append_entry(buf, l, when, body);
+	this->enqueue(l, buf);
+}
+
+
+// open_spill opens the spill file, keeping anything a previous logger
+// left in it.
+void
+NetLogger::open_spill(void)
+{
+	struct stat	st;
+
+	if (this->spill_path.empty()) {
+		return;
+	}
+
+	this->spill_fd = ::open(this->spill_path.c_str(),
+	    O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (-1 == this->spill_fd || -1 == ::fstat(this->spill_fd, &st)) {
+		this->err = errno_error(errno);
+		return;
+	}
+
+	this->spill_size = static_cast<std::uint64_t>(st.st_size);
+}
+
+
+// connect opens a new connection, if there is none and an attempt is
+// due or this is the last attempt, and sends the unacknowledged
+// batches again; it schedules the next attempt if it fails. Only the
+// worker, or close once the worker has stopped, connects, and it
+// doesn't hold either lock while it does.
+bool
+NetLogger::connect(bool last)
+{
+	struct timeval	timeout = {SEND_TIMEOUT_S, 0};
+	int		sock;
+
+	{
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		if (-1 != this->fd) {
+			return true;
+		}
+
+		if (!last &&
+		    std::chrono::steady_clock::now() < this->next_attempt) {
+			return false;
+		}
+	}
+
+	if (this->path.empty()) {
+		sock = connect_tcp(this->host, this->port);
+	}
+	else {
+		sock = connect_unix(this->path);
+	}
+
+	if (-1 == sock) {
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		this->fail(LogError::ERR_UNAVAILABLE);
+		this->next_attempt = std::chrono::steady_clock::now() +
+		    this->backoff;
+		this->backoff = std::min(this->backoff * 2, MAX_BACKOFF);
+		return false;
+	}
+
+	::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+	    sizeof(timeout));
+
+	std::lock_guard<std::mutex>	sender(this->sending);
+	{
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		this->fd = sock;
+		this->backoff = MIN_BACKOFF;
+		this->err = LogError::HEALTHY;
+	}
+	this->next_seq = 1;
+	this->acks.clear();
+	this->last_ack = std::chrono::steady_clock::now();
+
+	for (auto& batch : this->unacked) {
+		if (!this->send(batch)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// disconnect drops a failed connection; the next attempt is made
+// straight away. The caller must hold sending.
+void
+NetLogger::disconnect(void)
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+
+	::close(this->fd);
+	this->fd = -1;
+	this->fail(LogError::ERR_UNAVAILABLE);
+	this->next_attempt = std::chrono::steady_clock::now();
+}
+
+
+// send numbers batch and writes it out, dropping the connection on
+// failure. The caller must hold sending.
+bool
+NetLogger::send(Batch& batch)
+{
+	std::string	header;
+	struct iovec	iov[2];
+	size_t		sent = 0;
+	size_t		total;
+
+	batch.seq = this->next_seq++;
+	tlv::append_batch_header(header, batch.seq, batch.entries.size());
+	total = header.size() + batch.entries.size();
+
+	while (sent < total) {
+		struct msghdr	msg;
+		int		n = 0;
+		ssize_t		written;
+
+		if (sent < header.size()) {
+			iov[n].iov_base = const_cast<char *>(header.data() + sent);
+			iov[n++].iov_len = header.size() - sent;
+		}
+
+		size_t	skip = sent > header.size() ? sent - header.size() : 0;
+		iov[n].iov_base = const_cast<char *>(batch.entries.data() + skip);
+		iov[n++].iov_len = batch.entries.size() - skip;
+
+		::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = static_cast<size_t>(n);
+
+		written = ::sendmsg(this->fd, &msg, MSG_NOSIGNAL);
+		if (written < 0 && EINTR == errno) {
+			continue;
+		}
+
+		if (written <= 0) {
+			this->disconnect();
+			return false;
+		}
+
+		sent += static_cast<size_t>(written);
+	}
+
+	return true;
+}
+
+
+// submit adds a batch to the window and sends it. A batch that fails
+// to send stays in the window, to be sent again on the next
+// connection. The caller must hold sending.
+bool
+NetLogger::submit(std::string& entries, bool spilled)
+{
+	if (this->unacked.empty()) {
+		this->last_ack = std::chrono::steady_clock::now();
+	}
+
+	this->unacked.push_back(Batch{0, std::string(), spilled});
+	this->unacked.back().entries.swap(entries);
+	if (!this->send(this->unacked.back())) {
+		return false;
+	}
+	this->count_flush();
+	return true;
+}
+
+
+// read_acks reads whatever acknowledgements the collector has sent,
+// retiring the batches they cover. The caller must hold sending.
+void
+NetLogger::read_acks(void)
+{
+	char		buf[4096];
+	size_t		off = 0;
+	std::uint64_t	seq;
+
+	while (true) {
+		ssize_t	n = ::recv(this->fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+		if (n > 0) {
+			this->acks.append(buf, static_cast<size_t>(n));
+			continue;
+		}
+
+		if (n < 0 && EINTR == errno) {
+			continue;
+		}
+
+		if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+			break;
+		}
+
+		this->disconnect();
+		return;
+	}
+
+	while (tlv::read_ack(this->acks, off, seq)) {
+		while (!this->unacked.empty() &&
+		    this->unacked.front().seq <= seq) {
+			this->unacked.pop_front();
+		}
+		this->last_ack = std::chrono::steady_clock::now();
+	}
+
+	if (off < this->acks.size() &&
+	    tlv::TAck != static_cast<std::uint8_t>(this->acks[off])) {
+		this->disconnect();
+		return;
+	}
+	this->acks.erase(0, off);
+
+	if (!this->unacked.empty() &&
+	    std::chrono::steady_clock::now() - this->last_ack > ACK_TIMEOUT) {
+		this->disconnect();
+	}
+}
+
+
+// replay sends batches from the spill file while the window allows,
+// and empties the file once all of it has been acknowledged. The
+// caller must hold sending.
+void
+NetLogger::replay(void)
+{
+	while (-1 != this->fd && this->spill_read < this->spill_size &&
+	    this->unacked.size() < NET_WINDOW) {
+		std::string	header(SPILL_HEADER, '\0');
+		std::string	entries;
+		std::uint64_t	length;
+		size_t		off = 1;
+		ssize_t		n;
+
+		n = ::pread(this->spill_fd, &header[0], header.size(),
+		    static_cast<off_t>(this->spill_read));
+		if (n <= 0) {
+			this->fail(LogError::ERR_DISK);
+			this->spill_read = this->spill_size;
+			break;
+		}
+		header.resize(static_cast<size_t>(n));
+
+		if (tlv::TBatch != static_cast<std::uint8_t>(header[0]) ||
+		    !tlv::read_length(header, off, length) ||
+		    length < tlv::SEQUENCE_LENGTH ||
+		    length > this->spill_size - this->spill_read - off) {
+			// The rest of the file can't be trusted.
+			this->fail(LogError::ERR_DISK);
+			this->spill_read = this->spill_size;
+			break;
+		}
+
+		entries.resize(static_cast<size_t>(length) -
+		    tlv::SEQUENCE_LENGTH);
+		n = ::pread(this->spill_fd, &entries[0], entries.size(),
+		    static_cast<off_t>(this->spill_read + off +
+		    tlv::SEQUENCE_LENGTH));
+		if (n != static_cast<ssize_t>(entries.size())) {
+			this->fail(LogError::ERR_DISK);
+			this->spill_read = this->spill_size;
+			break;
+		}
+
+		this->spill_read += off + length;
+		this->submit(entries, true);
+	}
+
+	if (this->spill_size == 0 || this->spill_read < this->spill_size) {
+		return;
+	}
+
+	for (auto& batch : this->unacked) {
+		if (batch.spilled) {
+			return;
+		}
+	}
+
+	if (0 == ::ftruncate(this->spill_fd, 0)) {
+		this->spill_read = 0;
+		this->spill_size = 0;
+	}
+}
+
+
+// count_sent counts the backlog's records from start up to end as
+// written, once they have been sent or spilled; a batch sent again
+// later isn't counted again.
+void
+NetLogger::count_sent(size_t start, size_t end)
+{
+	for (size_t i = start; i < end; i++) {
+		this->count_write(this->backlog[i].level,
+		    this->backlog[i].data.size());
+	}
+}
+
+
+// send_backlog sends batches from the backlog while the window allows.
+// The caller must hold sending.
+void
+NetLogger::send_backlog(void)
+{
+	size_t	next = 0;
+
+	while (-1 != this->fd && next < this->backlog.size() &&
+	    this->unacked.size() < NET_WINDOW) {
+		std::string	entries;
+		size_t		start = next;
+
+		next_batch(this->backlog, next, entries);
+
+		this->submit(entries, false);
+		this->count_sent(start, next);
+	}
+
+	this->backlog.erase(this->backlog.begin(),
+	    this->backlog.begin() + static_cast<std::ptrdiff_t>(next));
+}
+
+
+// spill_entries appends a batch to the spill file, returning false if
+// it couldn't. The caller must hold sending.
+bool
+NetLogger::spill_entries(const std::string& entries)
+{
+	std::string	buf;
+	LogError	result;
+
+	if (-1 == this->spill_fd) {
+		return false;
+	}
+
+	frame(buf, entries);
+	result = write_fd(this->spill_fd, buf.data(), buf.size());
+	if (LogError::HEALTHY != result) {
+		// Cut off any partial batch.
+		(void)::ftruncate(this->spill_fd,
+		    static_cast<off_t>(this->spill_size));
+		this->fail(result);
+		return false;
+	}
+
+	this->spill_size += buf.size();
+	return true;
+}
+
+
+// spill_backlog moves the backlog to the spill file. Without one, it
+// keeps the newest records up to the queue's capacity. The caller must
+// hold sending.
+void
+NetLogger::spill_backlog(void)
+{
+	if (-1 == this->spill_fd) {
+		if (this->backlog.size() > this->limit) {
+			auto	excess = this->backlog.begin() +
+				    static_cast<std::ptrdiff_t>(
+				    this->backlog.size() - this->limit);
+
+			for (auto it = this->backlog.begin(); it != excess;
+			    it++) {
+				this->drops.add(it->level);
+			}
+			this->backlog.erase(this->backlog.begin(), excess);
+		}
+		return;
+	}
+
+	size_t	next = 0;
+
+	while (next < this->backlog.size()) {
+		std::string	entries;
+		size_t		start = next;
+
+		next_batch(this->backlog, next, entries);
+
+		if (!this->spill_entries(entries)) {
+			for (size_t i = start; i < next; i++) {
+				this->drops.add(this->backlog[i].level);
+			}
+		}
+		else {
+			this->count_sent(start, next);
+		}
+	}
+
+	this->backlog.clear();
+}
+
+
+// persist leaves everything undelivered in the spill file, in order:
+// the unacknowledged batches, the rest of the spill file, then the
+// backlog. Whatever can't be kept is dropped. The caller must hold
+// sending.
+void
+NetLogger::persist(void)
+{
+	if (this->unacked.empty() && 0 == this->spill_read) {
+		this->spill_backlog();
+	}
+	else if (-1 != this->spill_fd) {
+		std::string	tmp_path = this->spill_path + ".tmp";
+		std::string	buf;
+		std::uint64_t	left = this->spill_size - this->spill_read;
+		size_t		at;
+		size_t		next = 0;
+		LogError	result = LogError::HEALTHY;
+
+		for (auto& batch : this->unacked) {
+			frame(buf, batch.entries);
+		}
+
+		at = buf.size();
+		buf.resize(at + static_cast<size_t>(left));
+		if (left > 0 && ::pread(this->spill_fd, &buf[at],
+		    static_cast<size_t>(left),
+		    static_cast<off_t>(this->spill_read)) !=
+		    static_cast<ssize_t>(left)) {
+			result = LogError::ERR_DISK;
+		}
+
+		while (next < this->backlog.size()) {
+			std::string	entries;
+
+			next_batch(this->backlog, next, entries);
+			frame(buf, entries);
+		}
+
+		int	tmp = open_logfd(tmp_path, true);
+
+		if (-1 == tmp) {
+			result = errno_error(errno);
+		}
+		else {
+			if (LogError::HEALTHY == result) {
+				result = write_fd(tmp, buf.data(), buf.size());
+			}
+			::close(tmp);
+			if (LogError::HEALTHY == result &&
+			    -1 == ::rename(tmp_path.c_str(),
+			    this->spill_path.c_str())) {
+				result = errno_error(errno);
+			}
+			if (LogError::HEALTHY != result) {
+				::unlink(tmp_path.c_str());
+			}
+		}
+
+		if (LogError::HEALTHY == result) {
+			this->count_sent(0, this->backlog.size());
+			this->unacked.clear();
+			this->backlog.clear();
+		}
+		else {
+			this->fail(result);
+		}
+	}
+
+	for (auto& batch : this->unacked) {
+		count_drops(this->drops, batch.entries);
+	}
+	for (auto& r : this->backlog) {
+		this->drops.add(r.level);
+	}
+	this->unacked.clear();
+	this->backlog.clear();
+}
+
+
+// pump moves the queue onto the backlog and sends what the window
+// allows, spilling the backlog if the collector is unreachable or the
+// spill file is being replayed. Unless the backlog is going to the
+// spill file, it takes no more than the queue's capacity, so records
+// the collector hasn't made room for stay in the queue, where the
+// overflow policy decides what happens to them; it returns true if it
+// left any there. It never connects itself.
+bool
+NetLogger::pump(void)
+{
+	std::lock_guard<std::mutex>	sender(this->sending);
+
+	if (-1 != this->spill_fd &&
+	    (-1 == this->fd || this->spill_size > 0)) {
+		this->queue.drain(this->backlog);
+	}
+	else if (this->backlog.size() < this->limit) {
+		this->queue.drain(this->backlog,
+		    this->limit - this->backlog.size());
+	}
+
+	if (-1 != this->fd) {
+		this->read_acks();
+	}
+
+	if (-1 != this->fd) {
+		this->replay();
+	}
+
+	if (-1 != this->fd && 0 == this->spill_size) {
+		this->send_backlog();
+	}
+
+	if (-1 == this->fd || this->spill_size > 0) {
+		this->spill_backlog();
+	}
+
+	return this->backlog.size() >= this->limit && this->queue.size() > 0;
+}
+
+
+// idle returns true if everything has been delivered. The caller must
+// hold sending.
+bool
+NetLogger::idle(void)
+{
+	return this->backlog.empty() && this->unacked.empty() &&
+	    0 == this->spill_size && 0 == this->queue.size();
+}
+
+
+void
+NetLogger::flush(void)
+{
+	(void)this->pump();
+}
+
+
+bool
+NetLogger::connected(void)
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+
+	return -1 != this->fd;
+}
+
+
+std::uint64_t
+NetLogger::spilled(void)
+{
+	std::lock_guard<std::mutex>	sender(this->sending);
+
+	return this->spill_size;
+}
+
+
+std::map<Level, std::uint64_t>
+NetLogger::dropped(void) const
+{
+	return this->drops.totals();
+}
+
+
+// wait_acks waits up to timeout for the collector to send something,
+// if any batches are unacknowledged; it returns false if there are
+// none.
+bool
+NetLogger::wait_acks(int timeout)
+{
+	struct pollfd	pfd = {-1, POLLIN, 0};
+
+	{
+		std::lock_guard<std::mutex>	sender(this->sending);
+
+		if (-1 == this->fd || this->unacked.empty()) {
+			return false;
+		}
+		pfd.fd = this->fd;
+	}
+
+	// A flush on another thread may close the socket meanwhile;
+	// that only cuts the wait short.
+	(void)::poll(&pfd, 1, timeout);
+	return true;
+}
+
+
+void
+NetLogger::run(void)
+{
+	while (!this->stopping.load()) {
+		this->connect(false);
+		bool	waiting = this->pump();
+
+		if (this->wait_acks(ACK_WAIT_MS)) {
+			continue;
+		}
+
+		// Records left in the queue will still be there; wait
+		// for the backlog to clear instead.
+		if (waiting) {
+			std::this_thread::sleep_for(WORKER_WAIT);
+		}
+		else {
+			this->queue.wait(WORKER_WAIT);
+		}
+	}
+}
+
+
+int
+NetLogger::close(void)
+{
+	if (this->stopping.exchange(true)) {
+		return 0;
+	}
+	this->queue.close();
+
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+
+	auto	deadline = std::chrono::steady_clock::now() + CLOSE_WAIT;
+
+	this->connect(true);
+	(void)this->pump();
+	while (std::chrono::steady_clock::now() < deadline) {
+		{
+			std::lock_guard<std::mutex>	sender(this->sending);
+
+			if (-1 == this->fd || this->idle()) {
+				break;
+			}
+		}
+
+		if (!this->wait_acks(ACK_WAIT_MS)) {
+			// Only the spill file or the backlog is left.
+			std::this_thread::sleep_for(
+			    std::chrono::milliseconds(ACK_WAIT_MS));
+		}
+		this->connect(false);
+		(void)this->pump();
+	}
+
+	std::lock_guard<std::mutex>	sender(this->sending);
+
+	this->queue.drain(this->backlog);
+	this->persist();
+	if (-1 != this->fd) {
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		::close(this->fd);
+		this->fd = -1;
+	}
+	if (-1 != this->spill_fd) {
+		::close(this->spill_fd);
+		this->spill_fd = -1;
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
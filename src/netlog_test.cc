@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/netlog.hh>
+#include <klogger/tlv.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	STREAM = "netlog_test.sock";
+static const string	SPILL = "netlog_test.spill";
+
+
+// Collector stands in for a NetLogger collector: on TCP at an
+// ephemeral port on localhost, or at a unix socket path. It decodes
+// every batch it reads, and acknowledges them while acking is set.
+class Collector {
+public:
+	explicit Collector(const string& unix_path)
+	    : listener(-1), port(0), acking(true), lock(), records(),
+	      batches(0), reader(), done(false)
+	{
+		struct sockaddr_un	addr;
+
+		::unlink(unix_path.c_str());
+		::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		::strncpy(addr.sun_path, unix_path.c_str(),
+		    sizeof(addr.sun_path) - 1);
+		this->listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		::bind(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+		this->start();
+	}
+
+	Collector()
+	    : listener(-1), port(0), acking(true), lock(), records(),
+	      batches(0), reader(), done(false)
+	{
+		struct sockaddr_in	addr;
+		socklen_t		len = sizeof(addr);
+
+		::memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		this->listener = ::socket(AF_INET, SOCK_STREAM, 0);
+		::bind(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+		::getsockname(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), &len);
+		this->port = ntohs(addr.sin_port);
+		this->start();
+	}
+
+	~Collector()
+	{
+		this->done.store(true);
+		if (this->reader.joinable()) {
+			this->reader.join();
+		}
+		::close(this->listener);
+	}
+
+	// wait waits up to two seconds for count records.
+	size_t
+	wait(size_t count)
+	{
+		for (int i = 0; i < 200 && this->received() < count; i++) {
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+		return this->received();
+	}
+
+	size_t
+	received(void)
+	{
+		lock_guard<mutex>	guard(this->lock);
+
+		return this->records.size();
+	}
+
+	// in_order checks that the records carry the sequence numbers 0
+	// to count - 1 in order.
+	bool
+	in_order(size_t count)
+	{
+		lock_guard<mutex>	guard(this->lock);
+
+		if (this->records.size() != count) {
+			return false;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if (this->records[i].attrs["seq"] != to_string(i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int			listener;
+	uint16_t		port;
+	atomic<bool>		acking;
+	mutex			lock;
+	vector<klog::Record>	records;
+	atomic<size_t>		batches;
+	thread			reader;
+	atomic<bool>		done;
+
+private:
+	struct Conn {
+		string		buf;
+		uint64_t	seq;
+		uint64_t	acked;
+	};
+
+	void
+	start(void)
+	{
+		::listen(this->listener, 8);
+		this->reader = thread([this]() { this->run(); });
+	}
+
+	void
+	run(void)
+	{
+		vector<struct pollfd>	fds;
+		vector<Conn>		conns;
+
+		fds.push_back({this->listener, POLLIN, 0});
+		conns.push_back(Conn{"", 0, 0});
+		while (!this->done.load()) {
+			int	ready = ::poll(fds.data(), fds.size(), 10);
+
+			if (ready > 0 && (fds[0].revents & POLLIN)) {
+				int	c = ::accept(this->listener, nullptr,
+					    nullptr);
+
+				fds.push_back({c, POLLIN, 0});
+				conns.push_back(Conn{"", 0, 0});
+			}
+
+			for (size_t i = 1; i < fds.size(); i++) {
+				if (fds[i].fd < 0) {
+					continue;
+				}
+				if (ready > 0 && fds[i].revents &&
+				    !this->read(fds[i].fd, conns[i])) {
+					::close(fds[i].fd);
+					fds[i].fd = -1;
+					continue;
+				}
+				this->ack(fds[i].fd, conns[i]);
+			}
+		}
+
+		for (size_t i = 1; i < fds.size(); i++) {
+			if (fds[i].fd >= 0) {
+				::close(fds[i].fd);
+			}
+		}
+	}
+
+	// read reads from fd and decodes any whole batches in the
+	// connection's buffer; it returns false when the connection
+	// closes.
+	bool
+	read(int fd, Conn& conn)
+	{
+		char	chunk[65536];
+		ssize_t	n = ::recv(fd, chunk, sizeof(chunk), 0);
+		size_t	off = 0;
+		size_t	length;
+
+		if (n <= 0) {
+			return false;
+		}
+		conn.buf.append(chunk, static_cast<size_t>(n));
+
+		while (klog::tlv::read_batch(conn.buf, off, conn.seq, length)) {
+			klog::tlv::Decoder	decoder;
+			lock_guard<mutex>	guard(this->lock);
+
+			decoder.decode(conn.buf.substr(off, length),
+			    this->records);
+			this->batches++;
+			off += length;
+		}
+		conn.buf.erase(0, off);
+		return true;
+	}
+
+	void
+	ack(int fd, Conn& conn)
+	{
+		string	buf;
+
+		if (!this->acking.load() || conn.acked == conn.seq) {
+			return;
+		}
+
+		klog::tlv::append_ack(buf, conn.seq);
+		(void)::send(fd, buf.data(), buf.size(), MSG_NOSIGNAL);
+		conn.acked = conn.seq;
+	}
+
+	Collector(const Collector&) = delete;
+	Collector&	operator=(const Collector&) = delete;
+};
+
+
+static off_t
+file_size(const string& path)
+{
+	struct stat	st;
+
+	if (-1 == ::stat(path.c_str(), &st)) {
+		return -1;
+	}
+	return st.st_size;
+}
+
+
+static int
+test_tcp(void)
+{
+	Collector		collector;
+	klog::NetLogger		nlog("127.0.0.1", collector.port, "");
+
+	if (!eventually([&nlog]() { return nlog.connected(); })) {
+		console.error("test_tcp", "not connected");
+		return 0;
+	}
+
+	for (int i = 0; i < 5000; i++) {
+		nlog.info("test", "stream", {{"seq", to_string(i)}});
+	}
+	nlog.close();
+
+	if (collector.wait(5000) != 5000 || !collector.in_order(5000)) {
+		console.error("test_tcp", "records lost or out of order",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	if (collector.records[0].actor != "test" ||
+	    collector.records[0].event != "stream" ||
+	    collector.records[0].level != klog::Level::INFO) {
+		console.error("test_tcp", "bad record");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_spill(void)
+{
+	::unlink(STREAM.c_str());
+	::unlink(SPILL.c_str());
+
+	klog::NetLogger	nlog(STREAM, SPILL);
+
+	for (int i = 0; i < 100; i++) {
+		nlog.info("test", "spill", {{"seq", to_string(i)}});
+	}
+	nlog.flush();
+
+	if (nlog.connected() || nlog.spilled() == 0 ||
+	    static_cast<off_t>(nlog.spilled()) != file_size(SPILL)) {
+		console.error("test_spill", "records not spilled");
+		return 0;
+	}
+
+	// The worker reconnects once the collector is back, and replays
+	// the spill file.
+	Collector	collector(STREAM);
+
+	if (collector.wait(100) != 100 || !collector.in_order(100)) {
+		console.error("test_spill", "spill not replayed",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 100 && nlog.spilled() > 0; i++) {
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	if (nlog.spilled() != 0 || file_size(SPILL) != 0) {
+		console.error("test_spill", "spill file not emptied");
+		return 0;
+	}
+
+	nlog.close();
+	::unlink(STREAM.c_str());
+	::unlink(SPILL.c_str());
+	return 1;
+}
+
+
+static int
+test_window(void)
+{
+	Collector	collector;
+	string		padding(200, 'x');
+
+	collector.acking.store(false);
+
+	klog::NetLogger	nlog("127.0.0.1", collector.port, "");
+
+	for (int i = 0; i < 4000; i++) {
+		nlog.info("test", "window", {{"seq", to_string(i)},
+		    {"padding", padding}});
+	}
+	nlog.flush();
+	this_thread::sleep_for(chrono::milliseconds(200));
+
+	// Without acknowledgements, the logger stops at a full window.
+	if (collector.batches.load() != klog::NET_WINDOW ||
+	    collector.received() >= 4000) {
+		console.error("test_window", "window not enforced",
+		    {{"batches", to_string(collector.batches.load())}});
+		return 0;
+	}
+
+	collector.acking.store(true);
+	if (collector.wait(4000) != 4000 || !collector.in_order(4000)) {
+		console.error("test_window", "records lost or out of order",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	nlog.close();
+	return 1;
+}
+
+
+static uint64_t
+total_dropped(const klog::NetLogger& nlog)
+{
+	uint64_t	total = 0;
+
+	for (auto& kv : nlog.dropped()) {
+		total += kv.second;
+	}
+	return total;
+}
+
+
+// A collector that stops acknowledging leaves records in the queue,
+// where a blocking policy holds up the producer instead of losing
+// them.
+static int
+test_slow(void)
+{
+	Collector		collector;
+	string			padding(200, 'x');
+	klog::OverflowPolicy	policy = {
+		klog::Overflow::Block, 100, chrono::milliseconds(10000)
+	};
+	atomic<bool>		done(false);
+
+	collector.acking.store(false);
+
+	klog::NetLogger	nlog("127.0.0.1", collector.port, "", policy);
+	thread		producer([&nlog, &padding, &done]() {
+		for (int i = 0; i < 4000; i++) {
+			nlog.info("test", "slow", {{"seq", to_string(i)},
+			    {"padding", padding}});
+		}
+		done.store(true);
+	});
+
+	this_thread::sleep_for(chrono::milliseconds(500));
+	if (done.load() || total_dropped(nlog) != 0) {
+		console.error("test_slow", "producer not held up",
+		    {{"dropped", to_string(total_dropped(nlog))}});
+		collector.acking.store(true);
+		producer.join();
+		return 0;
+	}
+
+	collector.acking.store(true);
+	producer.join();
+	if (collector.wait(4000) != 4000 || !collector.in_order(4000) ||
+	    total_dropped(nlog) != 0) {
+		console.error("test_slow", "records lost or out of order",
+		    {{"received", to_string(collector.received())},
+		     {"dropped", to_string(total_dropped(nlog))}});
+		return 0;
+	}
+
+	nlog.close();
+	return 1;
+}
+
+
+static int
+test_persist(void)
+{
+	::unlink(STREAM.c_str());
+	::unlink(SPILL.c_str());
+
+	{
+		klog::NetLogger	nlog(STREAM, SPILL);
+
+		for (int i = 0; i < 300; i++) {
+			nlog.info("test", "persist", {{"seq", to_string(i)}});
+		}
+		nlog.close();
+	}
+
+	if (file_size(SPILL) <= 0) {
+		console.error("test_persist", "records not left in spill file");
+		return 0;
+	}
+
+	// A new logger picks up where the last one left off.
+	Collector	collector(STREAM);
+	klog::NetLogger	nlog(STREAM, SPILL);
+
+	if (collector.wait(300) != 300 || !collector.in_order(300)) {
+		console.error("test_persist", "spill not replayed",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	nlog.close();
+	if (file_size(SPILL) != 0) {
+		console.error("test_persist", "spill file not emptied");
+		return 0;
+	}
+
+	::unlink(STREAM.c_str());
+	::unlink(SPILL.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"tcp", test_tcp},
+	{"spill", test_spill},
+	{"window", test_window},
+	{"slow", test_slow},
+	{"persist", test_persist},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("netlog_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("netlog_test", "ok");
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+
+#include <klogger/logger.hh>
+#include <klogger/percpu.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+constexpr std::chrono::milliseconds	DEFAULT_INTERVAL(10);
+
+
+static std::atomic<std::uint64_t>	next_thread(1);
+
+
+// Each thread gets a small identifier and a sequence counter, which
+// break ties between records with the same timestamp.
+struct thread_state {
+	std::uint64_t	id;
+	std::uint64_t	seq;
+	std::uint64_t	last;
+
+	thread_state() :
+	    id(next_thread.fetch_add(1, std::memory_order_relaxed)),
+	    seq(0), last(0) {};
+};
+
+
+static thread_state&
+this_thread_state(void)
+{
+	static thread_local thread_state	state;
+
+	return state;
+}
+
+
+static size_t
+cpu_count(void)
+{
+	long	n = ::sysconf(_SC_NPROCESSORS_CONF);
+
+	if (n < 1) {
+		return 1;
+	}
+	return static_cast<size_t>(n);
+}
+
+
+PerCPULogger::PerCPULogger(BasicLogger *out,
+			   std::chrono::milliseconds period,
+			   OverflowPolicy policy)
+    : BasicLogger(), sink(out), interval(period), drops(), shards(),
+      collect(), wait(), wake(), stopping(false), collector()
+{
+	size_t	n = cpu_count();
+
+	for (size_t i = 0; i < n; i++) {
+		this->shards.emplace_back(new Shard(policy, &this->drops));
+		this->shards[i]->on_pressure([this]() {
+			this->wake.notify_one();
+		});
+	}
+
+	this->collector = std::thread(&PerCPULogger::run, this);
+}
+
+
+PerCPULogger::PerCPULogger(BasicLogger *out,
+			   std::chrono::milliseconds period)
+    : PerCPULogger(out, period, DEFAULT_OVERFLOW)
+{
+}
+
+
+PerCPULogger::PerCPULogger(BasicLogger *out)
+    : PerCPULogger(out, DEFAULT_INTERVAL)
+{
+}
+
+
+PerCPULogger::~PerCPULogger()
+{
+	this->close();
+}
+
+
+void
+PerCPULogger::write(Level l, std::uint64_t when,
+		    const std::string& actor,
+		    const std::string& event,
+		    const std::map<std::string, std::string>& attrs)
+{
+	thread_state&	ts = this_thread_state();
+	int		cpu = ::sched_getcpu();
+	size_t		idx;
+
+	// The clock may step backwards; a thread's records must not.
+	if (when < ts.last) {
+		when = ts.last;
+	}
+	ts.last = when;
+
+	if (cpu < 0) {
+		idx = ts.id % this->shards.size();
+	}
+	else {
+		idx = static_cast<size_t>(cpu) % this->shards.size();
+	}
+
+	this->shards[idx]->push(Entry{Record{l, when, actor, event, attrs},
+	    ts.id, ts.seq++});
+
+	if (Level::FATAL == l) {
+		this->flush();
+	}
+}
+
+
+void
+PerCPULogger::drain()
+{
+	std::vector<Entry>	batch;
+	Record			report{Level::WARN, 0, "", "", {}};
+
+	// The shards are drained together, under all of their locks: a
+	// thread that migrated between CPUs may have records in more than
+	// one shard, and draining them one at a time could take a later
+	// record from one while an earlier one waits in another. Ordering
+	// on the timestamp, then the thread's sequence number, restores
+	// the order it wrote them in.
+	Shard::drain_all(this->shards, batch);
+
+	std::sort(batch.begin(), batch.end(),
+	    [](const Entry& a, const Entry& b) {
+		if (a.record.when != b.record.when) {
+			return a.record.when < b.record.when;
+		}
+		if (a.thread != b.thread) {
+			return a.thread < b.thread;
+		}
+		return a.seq < b.seq;
+	});
+
+	for (auto& e : batch) {
+		const Record&	r = e.record;
+
+		if (this->sink->enabled(r.level, r.actor, r.event)) {
+			this->sink->write(r.level, r.when, r.actor, r.event,
+			    r.attrs);
+		}
+	}
+
+	// The buffers have been emptied, so any pressure has cleared.
+	if (this->drops.report(report)) {
+		this->sink->write(report.level, report.when, report.actor,
+		    report.event, report.attrs);
+	}
+
+	if (!this->sink->good()) {
+		this->err = this->sink->error();
+	}
+}
+
+
+std::map<Level, std::uint64_t>
+PerCPULogger::dropped() const
+{
+	return this->drops.totals();
+}
+
+
+void
+PerCPULogger::flush()
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+
+	this->drain();
+}
+
+
+void
+PerCPULogger::run()
+{
+	std::unique_lock<std::mutex>	lock(this->wait);
+
+	while (!this->stopping) {
+		this->wake.wait_for(lock, this->interval);
+		lock.unlock();
+		this->flush();
+		lock.lock();
+	}
+}
+
+
+int
+PerCPULogger::close()
+{
+	for (auto& shard : this->shards) {
+		shard->close();
+	}
+
+	{
+		std::lock_guard<std::mutex>	lock(this->wait);
+
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+
+	if (this->collector.joinable()) {
+		this->collector.join();
+	}
+
+	this->flush();
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
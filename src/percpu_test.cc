@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/percpu.hh>
+#include <klogger/record.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+constexpr int	THREADS = 8;
+constexpr int	RECORDS = 10000;
+
+
+int
+main(void)
+{
+	CaptureLogger		sink;
+	klog::PerCPULogger	percpu(&sink);
+	vector<thread>		workers;
+	int			fails = 0;
+
+	sink.level(klog::Level::DEBUG);
+	percpu.level(klog::Level::DEBUG);
+
+	for (int t = 0; t < THREADS; t++) {
+		workers.push_back(thread([&percpu, t]() {
+			for (int i = 0; i < RECORDS; i++) {
+				percpu.debug(to_string(t), "record",
+				    {{"seq", to_string(i)}});
+			}
+		}));
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+	percpu.close();
+
+	if (sink.records.size() != THREADS * RECORDS) {
+		console.error("percpu_test", "records lost",
+		    {{"expected", to_string(THREADS * RECORDS)},
+		     {"actual", to_string(sink.records.size())}});
+		fails++;
+	}
+
+	// Every thread's records must arrive in the order it wrote them,
+	// with their timestamps in order.
+	map<string, int>		next;
+	map<string, std::uint64_t>	last;
+
+	for (auto& r : sink.records) {
+		int	seq = stoi(r.attrs["seq"]);
+
+		if (seq != next[r.actor]) {
+			console.error("percpu_test", "record out of order",
+			    {{"thread", r.actor},
+			     {"expected", to_string(next[r.actor])},
+			     {"actual", to_string(seq)}});
+			fails++;
+			break;
+		}
+		next[r.actor]++;
+
+		if (r.when < last[r.actor]) {
+			console.error("percpu_test", "timestamps out of order",
+			    {{"thread", r.actor}});
+			fails++;
+			break;
+		}
+		last[r.actor] = r.when;
+	}
+
+	if (fails > 0) {
+		console.fatal("percpu_test", "test fail");
+	}
+	console.info("percpu_test", "ok",
+	    {{"records", to_string(sink.records.size())}});
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+DropCounter::DropCounter() : total(), pending()
+{
+	for (size_t i = 0; i < LEVEL_COUNT; i++) {
+		this->total[i] = 0;
+		this->pending[i] = 0;
+	}
+}
+
+
+void
+DropCounter::add(Level l)
+{
+	size_t	i = level_index(l);
+
+	this->total[i].fetch_add(1, std::memory_order_relaxed);
+	this->pending[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+std::map<Level, std::uint64_t>
+DropCounter::totals() const
+{
+	std::map<Level, std::uint64_t>	counts;
+
+	for (size_t i = 0; i < LEVEL_COUNT; i++) {
+		counts[static_cast<Level>(1 << i)] =
+		    this->total[i].load(std::memory_order_relaxed);
+	}
+	return counts;
+}
+
+
+bool
+DropCounter::report(Record& r)
+{
+	std::uint64_t	count = 0;
+
+	r.attrs.clear();
+	for (size_t i = 0; i < LEVEL_COUNT; i++) {
+		std::uint64_t	n = this->pending[i].exchange(0,
+		    std::memory_order_relaxed);
+
+		if (n > 0) {
+			r.attrs[level_string(static_cast<Level>(1 << i))] =
+			    std::to_string(n);
+			count += n;
+		}
+	}
+
+	if (0 == count) {
+		return false;
+	}
+
+	r.level = Level::WARN;
+	r.when = now();
+	r.actor = "klog";
+	r.event = "dropped records";
+	r.attrs["dropped"] = std::to_string(count);
+	return true;
+}
+
+
+} // namespace klog
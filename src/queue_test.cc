@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/queue.hh>
+#include <klogger/record.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static klog::Record
+record(klog::Level l, int n)
+{
+	return klog::Record{l, 0, "queue_test", to_string(n), {}};
+}
+
+
+// fill pushes one record per level in levels, in order, into a queue
+// with the given policy and a capacity of cap, and returns the events
+// of the records left in the queue.
+static string
+fill(klog::Overflow mode, size_t cap, vector<klog::Level> levels,
+     klog::DropCounter& drops)
+{
+	klog::OverflowPolicy			policy = {mode, cap,
+						    chrono::milliseconds(10)};
+	klog::BoundedQueue<klog::Record>	queue(policy, &drops);
+	vector<klog::Record>			out;
+	string					events;
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		queue.push(record(levels[i], static_cast<int>(i)));
+	}
+
+	queue.drain(out);
+	for (auto& r : out) {
+		events += r.event;
+	}
+	return events;
+}
+
+
+struct policy_test {
+	klog::Overflow		mode;
+	vector<klog::Level>	levels;
+	string			expect;
+	uint64_t		dropped_debug;
+};
+
+
+static vector<policy_test> policy_tests = {
+	{klog::Overflow::Block,
+	 {klog::Level::INFO, klog::Level::INFO, klog::Level::ERROR},
+	 "01", 0},
+	{klog::Overflow::DropNewest,
+	 {klog::Level::DEBUG, klog::Level::INFO, klog::Level::DEBUG},
+	 "01", 1},
+	{klog::Overflow::DropOldest,
+	 {klog::Level::DEBUG, klog::Level::INFO, klog::Level::ERROR},
+	 "12", 1},
+	{klog::Overflow::DropLowest,
+	 {klog::Level::ERROR, klog::Level::DEBUG, klog::Level::FATAL},
+	 "02", 1},
+	{klog::Overflow::DropLowest,
+	 {klog::Level::ERROR, klog::Level::ERROR, klog::Level::DEBUG},
+	 "01", 1},
+};
+
+
+static int
+test_policies(void)
+{
+	int	fails = 0;
+
+	for (size_t i = 0; i < policy_tests.size(); i++) {
+		auto&			t = policy_tests[i];
+		klog::DropCounter	drops;
+		string			got = fill(t.mode, 2, t.levels, drops);
+		uint64_t		debug = drops.totals()[klog::Level::DEBUG];
+
+		if (got != t.expect || debug != t.dropped_debug) {
+			console.error("test_policies", "test fail",
+			    {{"case", to_string(i)},
+			     {"expected", t.expect},
+			     {"actual", got},
+			     {"dropped DEBUG", to_string(debug)}});
+			fails++;
+		}
+	}
+
+	return fails == 0;
+}
+
+
+static int
+test_report(void)
+{
+	klog::DropCounter	drops;
+	klog::Record		r = record(klog::Level::DEBUG, 0);
+	int			fails = 0;
+
+	if (drops.report(r)) {
+		console.error("test_report", "report with no drops");
+		fails++;
+	}
+
+	drops.add(klog::Level::DEBUG);
+	drops.add(klog::Level::DEBUG);
+	drops.add(klog::Level::ERROR);
+	if (!drops.report(r)) {
+		console.error("test_report", "no report after drops");
+		return 0;
+	}
+
+	if (r.attrs["dropped"] != "3" || r.attrs["DEBUG"] != "2" ||
+	    r.attrs["ERROR"] != "1" || r.level != klog::Level::WARN) {
+		console.error("test_report", "bad report", r.attrs);
+		fails++;
+	}
+
+	// The drops have been reported, but still count in the totals.
+	if (drops.report(r) || drops.totals()[klog::Level::DEBUG] != 2) {
+		console.error("test_report", "drops reported twice");
+		fails++;
+	}
+
+	return fails == 0;
+}
+
+
+// test_drain_all drains two queues while a producer alternates
+// between them; each drain must take a prefix of what was pushed, or a
+// later record could be taken ahead of an earlier one.
+static int
+test_drain_all(void)
+{
+	typedef klog::BoundedQueue<klog::Record>	Queue;
+
+	klog::DropCounter		drops;
+	vector<unique_ptr<Queue>>	queues;
+	const int			count = 20000;
+	int				next = 0;
+	int				fails = 0;
+
+	for (int i = 0; i < 2; i++) {
+		queues.emplace_back(new Queue(klog::OverflowPolicy{
+		    klog::Overflow::Block, static_cast<size_t>(count),
+		    chrono::milliseconds(1000)}, &drops));
+	}
+
+	thread	producer([&queues]() {
+		for (int i = 0; i < count; i++) {
+			queues[static_cast<size_t>(i % 2)]->push(
+			    record(klog::Level::INFO, i));
+		}
+	});
+
+	while (next < count) {
+		vector<klog::Record>	out;
+		int			highest = -1;
+
+		Queue::drain_all(queues, out);
+		for (auto& r : out) {
+			highest = max(highest, stoi(r.event));
+		}
+		if (highest >= 0 &&
+		    highest - next + 1 != static_cast<int>(out.size())) {
+			fails++;
+		}
+		next += static_cast<int>(out.size());
+	}
+	producer.join();
+
+	if (fails > 0) {
+		console.error("test_drain_all", "drain took records out of order",
+		    {{"fails", to_string(fails)}});
+	}
+	return fails == 0;
+}
+
+
+static map<string, std::function<int(void)>> tests = {
+	{"drain_all", test_drain_all},
+	{"policies", test_policies},
+	{"report", test_report},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		console.info("queue_test", "test run", {{"test", it->first}});
+		if (!tests[it->first]()) {
+			console.fatal("queue_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+}
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/queue.hh>
+#include <klogger/ratelimit.hh>
+#include <klogger/record.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+constexpr std::chrono::milliseconds	SUMMARY_INTERVAL(1000);
+
+// The timer never wakes more often than this.
+constexpr std::chrono::milliseconds	MIN_TICK(1);
+
+// A sampling threshold of KEEP_ALL keeps every record; see random32.
+constexpr std::uint64_t			KEEP_ALL = 1ULL << 32;
+
+
+// random32 returns a pseudo-random 32-bit value from a per-thread
+// xorshift64* generator, which is plenty for sampling.
+static std::uint32_t
+random32(void)
+{
+	static thread_local std::uint64_t	state = 0;
+
+	if (0 == state) {
+		state = fnv1a(std::to_string(now())) ^
+		    std::hash<std::thread::id>()(std::this_thread::get_id());
+		state |= 1;
+	}
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return static_cast<std::uint32_t>((state * 2685821657736338717ULL) >> 32);
+}
+
+
+RateLimitLogger::RateLimitLogger(BasicLogger *out, RateLimit rl,
+				 std::chrono::milliseconds period)
+    : BasicLogger(), sink(out), limit(rl),
+      interval(std::chrono::duration_cast<std::chrono::nanoseconds>(
+	  period).count()),
+      idle(interval),
+      shards(), sampling(), sampled(), total(0), pending(false),
+      last_summary(now()), summary(), tick(), wake(), stopping(false),
+      timer()
+{
+	for (auto& s : this->sampling) {
+		s.store(KEEP_ALL);
+	}
+
+	// A bucket idle for long enough to refill is no different from
+	// a new one.
+	if (this->limit.rate > 0) {
+		this->idle = std::max(this->idle, static_cast<std::uint64_t>(
+		    this->limit.burst / this->limit.rate * 1e9));
+	}
+
+	this->timer = std::thread(&RateLimitLogger::run, this);
+}
+
+
+RateLimitLogger::RateLimitLogger(BasicLogger *out, RateLimit rl)
+    : RateLimitLogger(out, rl, SUMMARY_INTERVAL)
+{
+}
+
+
+RateLimitLogger::~RateLimitLogger()
+{
+	this->close();
+}
+
+
+void
+RateLimitLogger::sample(Level l, double probability)
+{
+	probability = std::max(0.0, std::min(1.0, probability));
+	this->sampling[level_index(l)].store(
+	    static_cast<std::uint64_t>(probability * KEEP_ALL));
+}
+
+
+bool
+RateLimitLogger::allow(Level l, std::uint64_t when,
+		       const std::string& actor,
+		       const std::string& event)
+{
+	if (Level::FATAL == l) {
+		return true;
+	}
+
+	std::uint64_t	threshold = this->sampling[level_index(l)].load(
+			    std::memory_order_relaxed);
+
+	if (threshold < KEEP_ALL && random32() >= threshold) {
+		this->sampled.add(l);
+		this->total++;
+		this->pending.store(true, std::memory_order_relaxed);
+		return false;
+	}
+
+	if (this->limit.rate <= 0) {
+		return true;
+	}
+
+	std::uint64_t			h = fnv1a_pair(fnv1a(actor), event);
+	Shard&				shard = this->shards[h % SHARDS];
+	std::lock_guard<std::mutex>	guard(shard.lock);
+
+	if (when > shard.last_sweep &&
+	    when - shard.last_sweep >= this->interval) {
+		this->sweep(shard, when);
+	}
+
+	Bucket&	b = this->bucket(shard, h, when, actor, event);
+
+	if (when > b.last) {
+		b.tokens += this->limit.rate * (when - b.last) / 1e9;
+		b.tokens = std::min(b.tokens, this->limit.burst);
+		b.last = when;
+	}
+
+	if (b.tokens >= 1.0) {
+		b.tokens -= 1.0;
+		return true;
+	}
+
+	b.suppressed++;
+	this->total++;
+	this->pending.store(true, std::memory_order_relaxed);
+	return false;
+}
+
+
+// bucket returns the bucket for actor and event, creating a full one if
+// there is none. The caller holds the shard's lock.
+RateLimitLogger::Bucket&
+RateLimitLogger::bucket(Shard& shard, std::uint64_t h, std::uint64_t when,
+			const std::string& actor, const std::string& event)
+{
+	auto	range = shard.buckets.equal_range(h);
+
+	for (auto it = range.first; it != range.second; it++) {
+		if (it->second.actor == actor && it->second.event == event) {
+			return it->second;
+		}
+	}
+
+	Bucket	b{actor, event, this->limit.burst, when, 0};
+
+	return shard.buckets.insert({h, b})->second;
+}
+
+
+// sweep removes the shard's buckets that have been idle long enough to
+// refill and have no suppressed records left to report. The caller
+// holds the shard's lock.
+void
+RateLimitLogger::sweep(Shard& shard, std::uint64_t when)
+{
+	shard.last_sweep = when;
+	for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+		const Bucket&	b = it->second;
+
+		if (0 == b.suppressed && when > b.last &&
+		    when - b.last >= this->idle) {
+			it = shard.buckets.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+
+void
+RateLimitLogger::write(Level l, std::uint64_t when,
+		       const std::string& actor,
+		       const std::string& event,
+		       const std::map<std::string, std::string>& attrs)
+{
+	if (this->sink->enabled(l, actor, event) &&
+	    this->allow(l, when, actor, event)) {
+		this->sink->write(l, when, actor, event, attrs);
+	}
+
+	if (this->due(when)) {
+		this->summarise(when);
+	}
+}
+
+
+void
+RateLimitLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	if (this->sink->enabled(l, body.actor(), body.event()) &&
+	    this->allow(l, when, body.actor(), body.event())) {
+		this->sink->write_body(l, when, body);
+	}
+
+	if (this->due(when)) {
+		this->summarise(when);
+	}
+}
+
+
+// due returns true if there is something to summarise and the last
+// summary was at least an interval before when.
+bool
+RateLimitLogger::due(std::uint64_t when) const
+{
+	std::uint64_t	last = this->last_summary.load();
+
+	return this->pending.load(std::memory_order_relaxed) &&
+	    when > last && when - last >= this->interval;
+}
+
+
+// summarise writes the summary records, unless another thread is
+// already doing so.
+void
+RateLimitLogger::summarise(std::uint64_t when)
+{
+	std::unique_lock<std::mutex>	lock(this->summary, std::try_to_lock);
+	std::vector<Record>		records;
+	Record				r{Level::WARN, 0, "", "", {}};
+
+	if (!lock.owns_lock()) {
+		return;
+	}
+
+	this->last_summary.store(when);
+	this->pending.store(false);
+
+	for (auto& shard : this->shards) {
+		std::lock_guard<std::mutex>	guard(shard.lock);
+
+		for (auto& kv : shard.buckets) {
+			Bucket&	b = kv.second;
+
+			if (0 == b.suppressed) {
+				continue;
+			}
+
+			records.push_back(Record{Level::WARN, when, "klog",
+			    "suppressed records",
+			    {{"actor", b.actor}, {"event", b.event},
+			     {"suppressed", std::to_string(b.suppressed)}}});
+			b.suppressed = 0;
+		}
+		this->sweep(shard, when);
+	}
+
+	if (this->sampled.report(r)) {
+		r.event = "sampled records";
+		records.push_back(r);
+	}
+
+	for (auto& rec : records) {
+		this->sink->write(rec.level, rec.when, rec.actor, rec.event,
+		    rec.attrs);
+	}
+}
+
+
+// run writes the summary once it is due, so that a pair that has gone
+// quiet still reports what was held back.
+void
+RateLimitLogger::run(void)
+{
+	std::unique_lock<std::mutex>	guard(this->tick);
+	std::chrono::nanoseconds	period = std::max(
+					    std::chrono::nanoseconds(
+					    this->interval),
+					    std::chrono::nanoseconds(MIN_TICK));
+
+	while (!this->stopping) {
+		this->wake.wait_for(guard, period);
+
+		std::uint64_t	t = now();
+
+		if (!this->stopping && this->due(t)) {
+			guard.unlock();
+			this->summarise(t);
+			guard.lock();
+		}
+	}
+}
+
+
+size_t
+RateLimitLogger::buckets(void)
+{
+	size_t	n = 0;
+
+	for (auto& shard : this->shards) {
+		std::lock_guard<std::mutex>	guard(shard.lock);
+
+		n += shard.buckets.size();
+	}
+	return n;
+}
+
+
+std::uint64_t
+RateLimitLogger::suppressed(void) const
+{
+	return this->total.load();
+}
+
+
+void
+RateLimitLogger::flush(void)
+{
+	this->summarise(now());
+}
+
+
+int
+RateLimitLogger::close(void)
+{
+	{
+		std::lock_guard<std::mutex>	guard(this->tick);
+
+		this->stopping = true;
+	}
+	this->wake.notify_all();
+	if (this->timer.joinable()) {
+		this->timer.join();
+	}
+
+	this->flush();
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
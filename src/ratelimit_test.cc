@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/ratelimit.hh>
+#include <klogger/record.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static int
+test_burst(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{1, 5},
+				    chrono::hours(1));
+	std::uint64_t		start = klog::now();
+
+	for (int i = 0; i < 20; i++) {
+		limited.write(klog::Level::INFO, start, "test", "burst", {});
+	}
+	limited.write(klog::Level::INFO, start, "test", "other", {});
+
+	if (sink.count("burst") != 5 || sink.count("other") != 1) {
+		console.error("test_burst", "burst not honoured",
+		    {{"burst", to_string(sink.count("burst"))}});
+		return 0;
+	}
+
+	// Two seconds later, two more tokens are available.
+	start += 2000000000ULL;
+	for (int i = 0; i < 20; i++) {
+		limited.write(klog::Level::INFO, start, "test", "burst", {});
+	}
+
+	if (sink.count("burst") != 7 || limited.suppressed() != 33) {
+		console.error("test_burst", "bucket not refilled",
+		    {{"burst", to_string(sink.count("burst"))},
+		     {"suppressed", to_string(limited.suppressed())}});
+		return 0;
+	}
+
+	limited.write(klog::Level::FATAL, start, "test", "burst", {});
+	if (sink.count("burst") != 8) {
+		console.error("test_burst", "FATAL record limited");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_summary(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{1, 1});
+	std::uint64_t		start = klog::now();
+
+	for (int i = 0; i < 10; i++) {
+		limited.write(klog::Level::INFO, start, "test", "noisy", {});
+	}
+
+	if (sink.count("suppressed records") != 0) {
+		console.error("test_summary", "summary written early");
+		return 0;
+	}
+
+	// The next record past the interval writes the summary.
+	limited.write(klog::Level::INFO, start + 1500000000ULL, "test",
+	    "noisy", {});
+	if (sink.count("suppressed records") != 1) {
+		console.error("test_summary", "no summary written");
+		return 0;
+	}
+
+	for (auto& r : sink.records) {
+		if (r.event != "suppressed records") {
+			continue;
+		}
+
+		if (r.level != klog::Level::WARN || r.actor != "klog" ||
+		    r.attrs["actor"] != "test" || r.attrs["event"] != "noisy" ||
+		    r.attrs["suppressed"] != "9") {
+			console.error("test_summary", "bad summary record",
+			    {{"suppressed", r.attrs["suppressed"]}});
+			return 0;
+		}
+	}
+
+	// Nothing new was suppressed, so close writes no summary.
+	limited.close();
+	if (sink.count("suppressed records") != 1) {
+		console.error("test_summary", "empty summary written");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// test_quiet checks that the timer reports a pair that has stopped
+// logging.
+static int
+test_quiet(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{1, 1},
+				    chrono::milliseconds(50));
+
+	for (int i = 0; i < 10; i++) {
+		limited.info("test", "noisy");
+	}
+
+	if (!eventually([&sink]() {
+	    return sink.count("suppressed records") == 1; })) {
+		console.error("test_quiet", "no summary written");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_sampling(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::NO_RATE_LIMIT);
+
+	sink.level(klog::Level::DEBUG);
+	limited.level(klog::Level::DEBUG);
+	limited.sample(klog::Level::DEBUG, 0);
+	limited.sample(klog::Level::INFO, 0.5);
+
+	for (int i = 0; i < 10000; i++) {
+		limited.debug("test", "debug");
+		limited.info("test", "info");
+		limited.warn("test", "warn");
+	}
+
+	size_t	info = sink.count("info");
+
+	if (sink.count("debug") != 0 || sink.count("warn") != 10000) {
+		console.error("test_sampling", "sampling at 0 or 1 wrong");
+		return 0;
+	}
+
+	if (info < 4000 || info > 6000) {
+		console.error("test_sampling", "sampling rate wrong",
+		    {{"info", to_string(info)}});
+		return 0;
+	}
+
+	limited.flush();
+	if (sink.count("sampled records") != 1) {
+		console.error("test_sampling", "no sampling summary");
+		return 0;
+	}
+
+	auto&	r = sink.records.back();
+	if (r.attrs["DEBUG"] != "10000" ||
+	    r.attrs["dropped"] != to_string(20000 - info)) {
+		console.error("test_sampling", "bad sampling summary",
+		    {{"dropped", r.attrs["dropped"]}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_threads(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{1, 10},
+				    chrono::hours(1));
+	vector<thread>		threads;
+	std::uint64_t		start = klog::now();
+
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(thread([&limited, start]() {
+			for (int i = 0; i < 1000; i++) {
+				limited.write(klog::Level::INFO, start,
+				    "thread", "event" + to_string(i % 8), {});
+			}
+		}));
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+	limited.close();
+
+	if (sink.records.size() != 88 || limited.suppressed() != 3920) {
+		console.error("test_threads", "bad counts",
+		    {{"records", to_string(sink.records.size())},
+		     {"suppressed", to_string(limited.suppressed())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// test_evict checks that idle buckets are dropped, so that a stream of
+// new pairs doesn't grow the map without limit.
+static int
+test_evict(void)
+{
+	CaptureLogger		sink;
+	klog::RateLimitLogger	limited(&sink, klog::RateLimit{10, 10});
+	std::uint64_t		old = klog::now() - 5000000000ULL;
+
+	for (int i = 0; i < 1000; i++) {
+		limited.write(klog::Level::INFO, old, "test",
+		    "event" + to_string(i), {});
+	}
+	limited.write(klog::Level::INFO, klog::now(), "test", "live", {});
+	limited.write(klog::Level::INFO, klog::now(), "test", "live", {});
+
+	size_t	before = limited.buckets();
+
+	// The summary sweeps every shard; the live bucket is too recent
+	// to go.
+	limited.flush();
+	if (before < 900 ||
+	    limited.buckets() != 1 || sink.records.size() != 1002) {
+		console.error("test_evict", "idle buckets kept",
+		    {{"before", to_string(before)},
+		     {"after", to_string(limited.buckets())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"evict", test_evict},
+	{"burst", test_burst},
+	{"summary", test_summary},
+	{"quiet", test_quiet},
+	{"sampling", test_sampling},
+	{"threads", test_threads},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("ratelimit_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("ratelimit_test", "ok");
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/record.hh>
+
+
+namespace klog {
+
+
+static inline void
+pack_u32(char *p, std::uint32_t v)
+{
+	::memcpy(p, &v, sizeof(v));
+}
+
+
+static inline char *
+pack_string(char *p, const std::string& s)
+{
+	pack_u32(p, static_cast<std::uint32_t>(s.size()));
+	p += sizeof(std::uint32_t);
+	::memcpy(p, s.data(), s.size());
+	return p + s.size();
+}
+
+
+void
+pack_record(PackedRecord& p, Level l, std::uint64_t when,
+	    const std::string& actor, const std::string& event,
+	    const std::map<std::string, std::string>& attrs)
+{
+	constexpr size_t	prefix = sizeof(std::uint32_t);
+	size_t			length = sizeof(when) + prefix * 3;
+
+	length += actor.size() + event.size();
+	for (auto it = attrs.begin(); it != attrs.end(); it++) {
+		length += prefix * 2 + it->first.size() + it->second.size();
+	}
+
+	p.level = l;
+	p.data.resize(length);
+
+	char	*out = &p.data[0];
+
+	::memcpy(out, &when, sizeof(when));
+	out += sizeof(when);
+	out = pack_string(out, actor);
+	out = pack_string(out, event);
+	pack_u32(out, static_cast<std::uint32_t>(attrs.size()));
+	out += prefix;
+
+	for (auto it = attrs.begin(); it != attrs.end(); it++) {
+		out = pack_string(out, it->first);
+		out = pack_string(out, it->second);
+	}
+}
+
+
+// unpack_u32 and unpack_string read from the front of [p, end), and
+// return false if the data runs out.
+static bool
+unpack_u32(const char *& p, const char *end, std::uint32_t& v)
+{
+	if (static_cast<size_t>(end - p) < sizeof(v)) {
+		return false;
+	}
+
+	::memcpy(&v, p, sizeof(v));
+	p += sizeof(v);
+	return true;
+}
+
+
+static bool
+unpack_string(const char *& p, const char *end, std::string& s)
+{
+	std::uint32_t	length;
+
+	if (!unpack_u32(p, end, length)) {
+		return false;
+	}
+	else if (static_cast<size_t>(end - p) < length) {
+		return false;
+	}
+
+	s.assign(p, length);
+	p += length;
+	return true;
+}
+
+
+bool
+unpack_record(const PackedRecord& p, Record& r)
+{
+	const char	*in = p.data.data();
+	const char	*end = in + p.data.size();
+	std::uint32_t	count;
+
+	if (p.data.size() < sizeof(r.when)) {
+		return false;
+	}
+
+	r.level = p.level;
+	::memcpy(&r.when, in, sizeof(r.when));
+	in += sizeof(r.when);
+
+	if (!unpack_string(in, end, r.actor)) {
+		return false;
+	}
+	else if (!unpack_string(in, end, r.event)) {
+		return false;
+	}
+	else if (!unpack_u32(in, end, count)) {
+		return false;
+	}
+
+	r.attrs.clear();
+	for (std::uint32_t i = 0; i < count; i++) {
+		std::string	k, v;
+
+		if (!unpack_string(in, end, k)) {
+			return false;
+		}
+		else if (!unpack_string(in, end, v)) {
+			return false;
+		}
+		r.attrs.emplace_hint(r.attrs.end(), std::move(k), std::move(v));
+	}
+
+	return in == end;
+}
+
+
+} // namespace klog
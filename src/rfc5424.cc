@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/rfc5424.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The worker wakes at least this often to notice a close.
+constexpr std::chrono::milliseconds	WORKER_WAIT(100);
+
+// A blocked socket is waited on for at most SEND_WAIT_MS before the rest
+// of the batch is dropped.
+constexpr int				SEND_WAIT_MS = 100;
+
+// sendmmsg(2) is given at most SEND_BATCH messages at a time.
+constexpr size_t			SEND_BATCH = 64;
+
+// The SD-ID of the element holding a record's fields; 32473 is the
+// private enterprise number RFC 5612 sets aside for documentation.
+static const char			SD_ID[] = "klog@32473";
+
+// RFC 5424 limits on header fields and parameter names.
+constexpr size_t			MAX_HOSTNAME = 255;
+constexpr size_t			MAX_APP_NAME = 48;
+constexpr size_t			MAX_PARAM_NAME = 32;
+
+
+// append_rfc3339 appends when as an RFC 3339 UTC timestamp with
+// microseconds. The part up to the seconds is cached per thread.
+static void
+append_rfc3339(std::string& buf, std::uint64_t when)
+{
+	static thread_local std::time_t	cached_t = -1;
+	static thread_local char	cached[32];
+	std::time_t			t = static_cast<std::time_t>(
+					    when / 1000000000);
+	char				frac[16];
+
+	if (t != cached_t) {
+		std::tm	tm;
+
+		::gmtime_r(&t, &tm);
+		std::strftime(cached, sizeof(cached), "%Y-%m-%dT%H:%M:%S",
+		    &tm);
+		cached_t = t;
+	}
+
+	std::snprintf(frac, sizeof(frac), ".%06uZ",
+	    static_cast<unsigned>(when % 1000000000 / 1000));
+	buf += cached;
+	buf += frac;
+}
+
+
+// append_field appends a header field, which must be printable ASCII
+// without spaces; anything else becomes '_', and an empty field is
+// the NILVALUE.
+static void
+append_field(std::string& buf, const std::string& s, size_t max)
+{
+	if (s.empty()) {
+		buf += '-';
+		return;
+	}
+
+	for (size_t i = 0; i < s.size() && i < max; i++) {
+		char	c = s[i];
+
+		buf += (c > 32 && c < 127) ? c : '_';
+	}
+}
+
+
+static void
+append_param(std::string& buf, const std::string& name,
+	     const std::string& value)
+{
+	buf += ' ';
+	if (name.empty()) {
+		buf += '_';
+	}
+
+	for (size_t i = 0; i < name.size() && i < MAX_PARAM_NAME; i++) {
+		char	c = name[i];
+
+		if (c <= 32 || c >= 127 || '=' == c || ']' == c || '"' == c) {
+			c = '_';
+		}
+		buf += c;
+	}
+
+	buf += "=\"";
+	for (auto c : value) {
+		if ('"' == c || '\\' == c || ']' == c) {
+			buf += '\\';
+		}
+		buf += c;
+	}
+	buf += '"';
+}
+
+
+void
+format_rfc5424(std::string& buf, int facility, Level l, std::uint64_t when,
+	       const std::string& host, const std::string& app,
+	       const std::string& procid, const std::string& actor,
+	       const std::string& event,
+	       const std::map<std::string, std::string>& attrs,
+	       const std::string& text)
+{
+	buf += '<';
+	buf += std::to_string(facility | syslog_priority(l));
+	buf += ">1 ";
+	append_rfc3339(buf, when);
+	buf += ' ';
+	append_field(buf, host, MAX_HOSTNAME);
+	buf += ' ';
+	append_field(buf, app, MAX_APP_NAME);
+	buf += ' ';
+	buf += procid;
+	buf += " - [";
+	buf += SD_ID;
+	append_param(buf, "actor", actor);
+	append_param(buf, "event", event);
+	for (auto& kv : attrs) {
+		append_param(buf, kv.first, kv.second);
+	}
+	buf += "] ";
+	buf += text;
+}
+
+
+static std::string
+hostname(void)
+{
+	char	buf[MAX_HOSTNAME + 1];
+
+	if (-1 == ::gethostname(buf, sizeof(buf))) {
+		return "";
+	}
+	buf[MAX_HOSTNAME] = '\0';
+	return buf;
+}
+
+
+RFC5424Logger::RFC5424Logger(std::string name, syslog::Facility f,
+			     OverflowPolicy policy)
+    : BasicLogger(), drops(), queue(policy, &this->drops), ident(name),
+      facility(static_cast<int>(f)), host(hostname()),
+      procid(std::to_string(::getpid()))
+{
+}
+
+
+void
+RFC5424Logger::format(SyslogMessage& m, Level l, std::uint64_t when,
+		      const std::string& actor, const std::string& event,
+		      const std::map<std::string, std::string>& attrs,
+		      const std::string& text)
+{
+	m.level = l;
+	format_rfc5424(m.data, this->facility, l, when, this->host,
+	    this->ident, this->procid, actor, event, attrs, text);
+}
+
+
+void
+RFC5424Logger::report(std::vector<SyslogMessage>& batch)
+{
+	Record	r{Level::DEBUG, 0, "", "", {}};
+
+	if (this->drops.report(r)) {
+		SyslogMessage	m{r.level, std::string()};
+		std::string	text;
+
+		format_body(text, r.actor, r.event, r.attrs);
+		this->format(m, r.level, r.when, r.actor, r.event, r.attrs,
+		    text);
+		batch.push_back(std::move(m));
+	}
+}
+
+
+void
+RFC5424Logger::enqueue(Level l, std::uint64_t when, const std::string& actor,
+		       const std::string& event,
+		       const std::map<std::string, std::string>& attrs,
+		       const std::string& text)
+{
+	SyslogMessage	m{l, std::string()};
+
+	this->format(m, l, when, actor, event, attrs, text);
+	this->queue.push(std::move(m));
+
+	if (Level::FATAL == l) {
+		this->flush();
+	}
+}
+
+
+void
+RFC5424Logger::write(Level l, std::uint64_t when, const std::string& actor,
+		     const std::string& event,
+		     const std::map<std::string, std::string>& attrs)
+{
+	std::string&	text = thread_buffer();
+
+	format_body(text, actor, event, attrs);
+	this->enqueue(l, when, actor, event, attrs, text);
+}
+
+
+void
+RFC5424Logger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	std::string&				text = thread_buffer();
+	std::map<std::string, std::string>	attrs;
+
+	body.text(text);
+	body.attrs(attrs);
+	this->enqueue(l, when, body.actor(), body.event(), attrs, text);
+}
+
+
+std::map<Level, std::uint64_t>
+RFC5424Logger::dropped(void) const
+{
+	return this->drops.totals();
+}
+
+
+DatagramSyslogger::DatagramSyslogger(std::string name, syslog::Facility f,
+				     std::string socket_path,
+				     OverflowPolicy policy)
+    : RFC5424Logger(name, f, policy), path(socket_path), sock_lock(),
+      fd(-1), collect(), stopping(false), worker()
+{
+	if (!this->connect()) {
+		this->err = LogError::ERR_OPEN;
+	}
+
+	this->worker = std::thread(&DatagramSyslogger::run, this);
+}
+
+
+DatagramSyslogger::DatagramSyslogger(std::string name, syslog::Facility f,
+				     std::string socket_path)
+    : DatagramSyslogger(name, f, socket_path, SYSLOG_OVERFLOW)
+{
+}
+
+
+DatagramSyslogger::DatagramSyslogger(std::string name, syslog::Facility f)
+    : DatagramSyslogger(name, f, "/dev/log", SYSLOG_OVERFLOW)
+{
+}
+
+
+DatagramSyslogger::~DatagramSyslogger()
+{
+	this->close();
+}
+
+
+// connect (re)connects the socket; the caller must hold sock_lock,
+// or be the constructor.
+bool
+DatagramSyslogger::connect(void)
+{
+	struct sockaddr_un	addr;
+
+	if (this->fd != -1) {
+		::close(this->fd);
+		this->fd = -1;
+	}
+
+	if (this->path.size() >= sizeof(addr.sun_path)) {
+		return false;
+	}
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::memcpy(addr.sun_path, this->path.data(), this->path.size());
+
+	this->fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	    0);
+	if (-1 == this->fd) {
+		return false;
+	}
+
+	if (-1 == ::connect(this->fd,
+	    reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+		::close(this->fd);
+		this->fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+
+// send writes batch to the socket with as few sendmmsg calls as it
+// can. The caller must hold sock_lock.
+void
+DatagramSyslogger::send(std::vector<SyslogMessage>& batch)
+{
+	struct mmsghdr	msgs[SEND_BATCH];
+	struct iovec	iovs[SEND_BATCH];
+	size_t		next = 0;
+	bool		retried = false;
+
+	while (next < batch.size()) {
+		size_t	n = std::min(SEND_BATCH, batch.size() - next);
+
+		::memset(msgs, 0, sizeof(msgs));
+		for (size_t i = 0; i < n; i++) {
+			std::string&	data = batch[next + i].data;
+
+			iovs[i].iov_base = &data[0];
+			iovs[i].iov_len = data.size();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int	sent = -1;
+
+		if (this->fd != -1) {
+			sent = ::sendmmsg(this->fd, msgs,
+			    static_cast<unsigned>(n), MSG_DONTWAIT);
+		}
+
+		if (sent > 0) {
+			LogError	failed = LogError::ERR_UNAVAILABLE;
+
+			for (int i = 0; i < sent; i++, next++) {
+				this->count_write(batch[next].level,
+				    batch[next].data.size());
+			}
+			this->count_flush();
+
+			// The daemon is back; clear an earlier failure.
+			(void)this->err.compare_exchange_strong(failed,
+			    LogError::HEALTHY);
+			continue;
+		}
+
+		if (this->fd != -1 && sent == -1) {
+			if (EINTR == errno) {
+				continue;
+			}
+
+			if (EAGAIN == errno || EWOULDBLOCK == errno) {
+				struct pollfd	pfd = {this->fd, POLLOUT, 0};
+
+				if (::poll(&pfd, 1, SEND_WAIT_MS) > 0) {
+					continue;
+				}
+			}
+			else if (EMSGSIZE == errno) {
+				this->drops.add(batch[next].level);
+				next++;
+				continue;
+			}
+		}
+
+		// The daemon may have restarted, so try a fresh socket
+		// once before giving up on the batch.
+		if (!retried) {
+			retried = true;
+			if (this->connect()) {
+				continue;
+			}
+		}
+
+		this->fail(LogError::ERR_UNAVAILABLE);
+		for (; next < batch.size(); next++) {
+			this->drops.add(batch[next].level);
+		}
+	}
+}
+
+
+void
+DatagramSyslogger::flush(void)
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+	std::vector<SyslogMessage>	batch;
+
+	this->queue.drain(batch);
+	this->report(batch);
+
+	if (batch.empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex>	guard(this->sock_lock);
+	this->send(batch);
+}
+
+
+void
+DatagramSyslogger::run(void)
+{
+	while (!this->stopping.load()) {
+		if (this->queue.wait(WORKER_WAIT)) {
+			this->flush();
+		}
+	}
+}
+
+
+int
+DatagramSyslogger::close(void)
+{
+	this->stopping.store(true);
+	this->queue.close();
+
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+
+	this->flush();
+
+	std::lock_guard<std::mutex>	guard(this->sock_lock);
+	if (this->fd != -1) {
+		::close(this->fd);
+		this->fd = -1;
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/rfc5424.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	SOCKET = "rfc5424_test.sock";
+static const string	STREAM = "rfc5424_test.stream";
+
+
+// Daemon stands in for syslogd: it binds a datagram socket at SOCKET
+// and collects every message sent to it.
+class Daemon {
+public:
+	Daemon() : fd(-1), messages(), reader(), done(false)
+	{
+		struct sockaddr_un	addr;
+
+		::unlink(SOCKET.c_str());
+		::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		::strncpy(addr.sun_path, SOCKET.c_str(),
+		    sizeof(addr.sun_path) - 1);
+
+		this->fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+		::bind(this->fd, reinterpret_cast<struct sockaddr *>(&addr),
+		    sizeof(addr));
+	}
+
+	~Daemon()
+	{
+		this->stop();
+		::close(this->fd);
+		::unlink(SOCKET.c_str());
+	}
+
+	// start reads messages on a thread until stop is called.
+	void
+	start(void)
+	{
+		this->reader = thread([this]() {
+			while (!this->done.load()) {
+				this->read(50);
+			}
+			while (this->read(0)) ;
+		});
+	}
+
+	void
+	stop(void)
+	{
+		this->done.store(true);
+		if (this->reader.joinable()) {
+			this->reader.join();
+		}
+	}
+
+	// read waits up to ms for a message, returning false if none
+	// came.
+	bool
+	read(int ms)
+	{
+		struct pollfd	pfd = {this->fd, POLLIN, 0};
+		char		buf[8192];
+
+		if (::poll(&pfd, 1, ms) <= 0) {
+			return false;
+		}
+
+		ssize_t	n = ::recv(this->fd, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			return false;
+		}
+
+		this->messages.push_back(string(buf, static_cast<size_t>(n)));
+		return true;
+	}
+
+	int		fd;
+	vector<string>	messages;
+	thread		reader;
+	atomic<bool>	done;
+
+private:
+	Daemon(const Daemon&) = delete;
+	Daemon&	operator=(const Daemon&) = delete;
+};
+
+
+static int
+test_format(void)
+{
+	Daemon			daemon;
+	klog::DatagramSyslogger	slog("rfc5424 test",
+				    klog::syslog::Facility::Daemon, SOCKET);
+
+	slog.warn("test", "hello", {{"quote", "a\"b]c\\d"},
+	    {"bad key=", "v"}});
+	slog.flush();
+
+	if (!daemon.read(1000)) {
+		console.error("test_format", "no message received");
+		return 0;
+	}
+
+	string&	m = daemon.messages[0];
+	string	pid = to_string(::getpid());
+
+	// LOG_DAEMON is facility 3, and WARN is severity 4.
+	if (m.compare(0, 7, "<28>1 2") != 0 ||
+	    m.find("Z ") != 32 ||
+	    m.find(" rfc5424_test " + pid + " - ") == string::npos) {
+		console.error("test_format", "bad header", {{"message", m}});
+		return 0;
+	}
+
+	string	sd = "[klog@32473 actor=\"test\" event=\"hello\" "
+		     "bad_key_=\"v\" quote=\"a\\\"b\\]c\\\\d\"] "
+		     "[actor:test event:hello]";
+
+	if (m.find(sd) == string::npos) {
+		console.error("test_format", "bad structured data",
+		    {{"message", m}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_batch(void)
+{
+	Daemon			daemon;
+	klog::DatagramSyslogger	slog("rfc5424_test",
+				    klog::syslog::Facility::Local0, SOCKET);
+
+	daemon.start();
+	for (int i = 0; i < 2000; i++) {
+		slog.info("test", "batch", {{"seq", to_string(i)}});
+	}
+	slog.close();
+	daemon.stop();
+
+	if (daemon.messages.size() != 2000) {
+		console.error("test_batch", "messages lost",
+		    {{"received", to_string(daemon.messages.size())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 2000; i++) {
+		string	seq = "seq=\"" + to_string(i) + "\"]";
+
+		if (daemon.messages[i].find(seq) == string::npos) {
+			console.error("test_batch", "messages out of order");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_no_daemon(void)
+{
+	::unlink(SOCKET.c_str());
+
+	klog::DatagramSyslogger	slog("rfc5424_test",
+				    klog::syslog::Facility::User, SOCKET);
+
+	if (slog.good()) {
+		console.error("test_no_daemon", "missing socket not reported");
+		return 0;
+	}
+
+	slog.info("test", "lost");
+	slog.flush();
+	if (slog.dropped()[klog::Level::INFO] != 1) {
+		console.error("test_no_daemon", "drop not counted");
+		return 0;
+	}
+
+	Daemon	daemon;
+
+	slog.info("test", "delivered");
+	slog.flush();
+	if (!daemon.read(1000) || !slog.good()) {
+		console.error("test_no_daemon", "didn't recover");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// Collector stands in for a syslog collector on a stream socket: on
+// TCP at an ephemeral port on localhost, or at a unix socket path. It
+// accepts any number of connections and splits what it reads into
+// octet-counted messages.
+class Collector {
+public:
+	explicit Collector(const string& unix_path)
+	    : listener(-1), port(0), lock(), messages(), reader(), done(false)
+	{
+		struct sockaddr_un	addr;
+
+		::unlink(unix_path.c_str());
+		::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		::strncpy(addr.sun_path, unix_path.c_str(),
+		    sizeof(addr.sun_path) - 1);
+		this->listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		::bind(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+		this->start();
+	}
+
+	Collector()
+	    : listener(-1), port(0), lock(), messages(), reader(), done(false)
+	{
+		struct sockaddr_in	addr;
+		socklen_t		len = sizeof(addr);
+
+		::memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		this->listener = ::socket(AF_INET, SOCK_STREAM, 0);
+		::bind(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+		::getsockname(this->listener,
+		    reinterpret_cast<struct sockaddr *>(&addr), &len);
+		this->port = ntohs(addr.sin_port);
+		this->start();
+	}
+
+	~Collector()
+	{
+		this->stop();
+	}
+
+	void
+	stop(void)
+	{
+		this->done.store(true);
+		if (this->reader.joinable()) {
+			this->reader.join();
+		}
+		if (-1 != this->listener) {
+			::close(this->listener);
+			this->listener = -1;
+		}
+	}
+
+	// wait waits up to two seconds for count messages.
+	size_t
+	wait(size_t count)
+	{
+		for (int i = 0; i < 200 && this->received() < count; i++) {
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+		return this->received();
+	}
+
+	size_t
+	received(void)
+	{
+		lock_guard<mutex>	guard(this->lock);
+
+		return this->messages.size();
+	}
+
+	int		listener;
+	uint16_t	port;
+	mutex		lock;
+	vector<string>	messages;
+	thread		reader;
+	atomic<bool>	done;
+
+private:
+	void
+	start(void)
+	{
+		::listen(this->listener, 8);
+		this->reader = thread([this]() { this->run(); });
+	}
+
+	void
+	run(void)
+	{
+		vector<struct pollfd>	fds;
+		vector<string>		pending;
+
+		fds.push_back({this->listener, POLLIN, 0});
+		pending.push_back("");
+		while (!this->done.load()) {
+			if (::poll(fds.data(), fds.size(), 20) <= 0) {
+				continue;
+			}
+
+			if (fds[0].revents & POLLIN) {
+				int	c = ::accept(this->listener, nullptr,
+					    nullptr);
+
+				fds.push_back({c, POLLIN, 0});
+				pending.push_back("");
+			}
+
+			for (size_t i = 1; i < fds.size(); i++) {
+				if (fds[i].fd < 0 || !fds[i].revents) {
+					continue;
+				}
+				if (!this->read(fds[i].fd, pending[i])) {
+					::close(fds[i].fd);
+					fds[i].fd = -1;
+				}
+			}
+		}
+
+		for (size_t i = 1; i < fds.size(); i++) {
+			if (fds[i].fd >= 0) {
+				::close(fds[i].fd);
+			}
+		}
+	}
+
+	// read reads from fd and moves any whole messages in buf to
+	// messages; it returns false when the connection closes.
+	bool
+	read(int fd, string& buf)
+	{
+		char	chunk[65536];
+		ssize_t	n = ::recv(fd, chunk, sizeof(chunk), 0);
+
+		if (n <= 0) {
+			return false;
+		}
+		buf.append(chunk, static_cast<size_t>(n));
+
+		while (true) {
+			size_t	sp = buf.find(' ');
+
+			if (sp == string::npos) {
+				break;
+			}
+
+			size_t	length = stoul(buf.substr(0, sp));
+
+			if (buf.size() < sp + 1 + length) {
+				break;
+			}
+
+			lock_guard<mutex>	guard(this->lock);
+			this->messages.push_back(buf.substr(sp + 1, length));
+			buf.erase(0, sp + 1 + length);
+		}
+
+		return true;
+	}
+
+	Collector(const Collector&) = delete;
+	Collector&	operator=(const Collector&) = delete;
+};
+
+
+static int
+test_stream_tcp(void)
+{
+	Collector		collector;
+	klog::StreamSyslogger	slog("rfc5424_test",
+				    klog::syslog::Facility::Local1,
+				    "127.0.0.1", collector.port);
+
+	if (!eventually([&slog]() { return slog.connected(); })) {
+		console.error("test_stream_tcp", "not connected");
+		return 0;
+	}
+
+	for (int i = 0; i < 5000; i++) {
+		slog.info("test", "stream", {{"seq", to_string(i)}});
+	}
+	slog.close();
+
+	if (collector.wait(5000) != 5000) {
+		console.error("test_stream_tcp", "messages lost",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 5000; i++) {
+		string&	m = collector.messages[i];
+
+		// LOG_LOCAL1 is facility 17, and INFO is severity 6.
+		if (m.compare(0, 6, "<142>1") != 0 ||
+		    m.find("seq=\"" + to_string(i) + "\"]") == string::npos) {
+			console.error("test_stream_tcp", "bad message",
+			    {{"message", m}});
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int
+test_stream_outage(void)
+{
+	::unlink(STREAM.c_str());
+
+	klog::StreamSyslogger	slog("rfc5424_test",
+				    klog::syslog::Facility::User, STREAM);
+
+	for (int i = 0; i < 100; i++) {
+		slog.info("test", "outage", {{"seq", to_string(i)}});
+	}
+	slog.flush();
+
+	if (!eventually([&slog]() { return !slog.good(); }) ||
+	    slog.connected()) {
+		console.error("test_stream_outage", "outage not reported");
+		return 0;
+	}
+
+	// The worker reconnects once the collector is back, and sends
+	// what was buffered.
+	Collector	collector(STREAM);
+
+	if (collector.wait(100) != 100 || !slog.connected()) {
+		console.error("test_stream_outage", "backlog not delivered",
+		    {{"received", to_string(collector.received())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 100; i++) {
+		string	seq = "seq=\"" + to_string(i) + "\"]";
+
+		if (collector.messages[i].find(seq) == string::npos) {
+			console.error("test_stream_outage", "out of order");
+			return 0;
+		}
+	}
+
+	slog.close();
+	::unlink(STREAM.c_str());
+	return 1;
+}
+
+
+static int
+test_stream_many(void)
+{
+	Collector		a, b;
+	klog::StreamSyslogger	alog("alpha", klog::syslog::Facility::User,
+				    "localhost", a.port);
+	klog::StreamSyslogger	blog("beta", klog::syslog::Facility::User,
+				    "localhost", b.port);
+
+	for (int i = 0; i < 100; i++) {
+		alog.info("test", "a");
+		blog.info("test", "b");
+	}
+	alog.close();
+	blog.close();
+
+	if (a.wait(100) != 100 || b.wait(100) != 100) {
+		console.error("test_stream_many", "messages lost");
+		return 0;
+	}
+
+	for (int i = 0; i < 100; i++) {
+		if (a.messages[i].find(" alpha ") == string::npos ||
+		    b.messages[i].find(" beta ") == string::npos) {
+			console.error("test_stream_many", "loggers mixed up");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"format", test_format},
+	{"batch", test_batch},
+	{"no_daemon", test_no_daemon},
+	{"stream_tcp", test_stream_tcp},
+	{"stream_outage", test_stream_outage},
+	{"stream_many", test_stream_many},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("rfc5424_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("rfc5424_test", "ok");
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/rfc5424.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The worker wakes at least this often to retry a connection or notice
+// a close.
+constexpr std::chrono::milliseconds	WORKER_WAIT(100);
+
+// Reconnection attempts back off exponentially between these.
+constexpr std::chrono::milliseconds	MIN_BACKOFF(100);
+constexpr std::chrono::milliseconds	MAX_BACKOFF(30000);
+
+// Messages are written in chunks of up to WRITE_CHUNK bytes; a write
+// that makes no progress for SEND_TIMEOUT_S drops the connection.
+constexpr size_t			WRITE_CHUNK = 65536;
+constexpr int				SEND_TIMEOUT_S = 5;
+
+// A connection attempt that hasn't completed in CONNECT_TIMEOUT_MS is
+// abandoned.
+constexpr int				CONNECT_TIMEOUT_MS = 5000;
+
+
+StreamSyslogger::StreamSyslogger(std::string name, syslog::Facility f,
+				 std::string address, std::uint16_t tcp_port,
+				 OverflowPolicy policy)
+    : RFC5424Logger(name, f, policy), host(address), port(tcp_port),
+      path(), fd(-1), backlog(), limit(policy.capacity),
+      backoff(MIN_BACKOFF), next_attempt(), sending(), collect(),
+      stopping(false), worker()
+{
+	this->worker = std::thread(&StreamSyslogger::run, this);
+}
+
+
+StreamSyslogger::StreamSyslogger(std::string name, syslog::Facility f,
+				 std::string address, std::uint16_t tcp_port)
+    : StreamSyslogger(name, f, address, tcp_port, SYSLOG_OVERFLOW)
+{
+}
+
+
+StreamSyslogger::StreamSyslogger(std::string name, syslog::Facility f,
+				 std::string socket_path,
+				 OverflowPolicy policy)
+    : RFC5424Logger(name, f, policy), host(), port(0), path(socket_path),
+      fd(-1), backlog(), limit(policy.capacity), backoff(MIN_BACKOFF),
+      next_attempt(), sending(), collect(), stopping(false), worker()
+{
+	this->worker = std::thread(&StreamSyslogger::run, this);
+}
+
+
+StreamSyslogger::StreamSyslogger(std::string name, syslog::Facility f,
+				 std::string socket_path)
+    : StreamSyslogger(name, f, socket_path, SYSLOG_OVERFLOW)
+{
+}
+
+
+StreamSyslogger::~StreamSyslogger()
+{
+	this->close();
+}
+
+
+// connect_within connects sock to addr, giving up after
+// CONNECT_TIMEOUT_MS; the socket is left blocking.
+static bool
+connect_within(int sock, const struct sockaddr *addr, socklen_t length)
+{
+	struct pollfd	pfd;
+	int		flags = ::fcntl(sock, F_GETFL);
+	int		error = 0;
+	socklen_t	size = sizeof(error);
+	int		n;
+
+	if (-1 == flags || -1 == ::fcntl(sock, F_SETFL, flags | O_NONBLOCK)) {
+		return false;
+	}
+
+	if (-1 == ::connect(sock, addr, length)) {
+		if (EINPROGRESS != errno) {
+			return false;
+		}
+
+		pfd.fd = sock;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		do {
+			n = ::poll(&pfd, 1, CONNECT_TIMEOUT_MS);
+		} while (n < 0 && EINTR == errno);
+
+		if (1 != n || -1 == ::getsockopt(sock, SOL_SOCKET, SO_ERROR,
+		    &error, &size) || 0 != error) {
+			return false;
+		}
+	}
+
+	return -1 != ::fcntl(sock, F_SETFL, flags);
+}
+
+
+int
+connect_unix(const std::string& path)
+{
+	struct sockaddr_un	addr;
+	int			sock;
+
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	::memcpy(addr.sun_path, path.data(), path.size());
+
+	sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (-1 == sock) {
+		return -1;
+	}
+
+	if (!connect_within(sock, reinterpret_cast<struct sockaddr *>(&addr),
+	    sizeof(addr))) {
+		::close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+
+int
+connect_tcp(const std::string& host, std::uint16_t port)
+{
+	struct addrinfo	 hints;
+	struct addrinfo	*res = nullptr;
+	int		 sock = -1;
+
+	::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (0 != ::getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+	    &hints, &res)) {
+		return -1;
+	}
+
+	for (auto ai = res; ai != nullptr; ai = ai->ai_next) {
+		sock = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+		    ai->ai_protocol);
+		if (-1 == sock) {
+			continue;
+		}
+
+		if (connect_within(sock, ai->ai_addr, ai->ai_addrlen)) {
+			break;
+		}
+
+		::close(sock);
+		sock = -1;
+	}
+
+	::freeaddrinfo(res);
+	return sock;
+}
+
+
+// connect opens a new connection if there is none and an attempt is
+// due, or regardless on the last attempt, and schedules the next
+// attempt if it fails. Only the worker, or close once the worker has
+// stopped, connects, and it doesn't hold collect while it does.
+bool
+StreamSyslogger::connect(bool last)
+{
+	struct timeval	timeout = {SEND_TIMEOUT_S, 0};
+	int		sock;
+
+	{
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		if (-1 != this->fd) {
+			return true;
+		}
+
+		if (!last &&
+		    std::chrono::steady_clock::now() < this->next_attempt) {
+			return false;
+		}
+	}
+
+	if (this->path.empty()) {
+		sock = connect_tcp(this->host, this->port);
+	}
+	else {
+		sock = connect_unix(this->path);
+	}
+
+	std::lock_guard<std::mutex>	lock(this->collect);
+
+	if (-1 == sock) {
+		this->fail(LogError::ERR_UNAVAILABLE);
+		this->next_attempt = std::chrono::steady_clock::now() +
+		    this->backoff;
+		this->backoff = std::min(this->backoff * 2, MAX_BACKOFF);
+		return false;
+	}
+
+	::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+	    sizeof(timeout));
+	this->fd = sock;
+	this->backoff = MIN_BACKOFF;
+	this->err = LogError::HEALTHY;
+	return true;
+}
+
+
+// disconnect drops a failed connection; the next attempt is made
+// straight away. The caller must hold collect.
+void
+StreamSyslogger::disconnect(void)
+{
+	::close(this->fd);
+	this->fd = -1;
+	this->fail(LogError::ERR_UNAVAILABLE);
+	this->next_attempt = std::chrono::steady_clock::now();
+}
+
+
+// write_out writes the backlog to the collector on sock, framing each
+// message with its length. On failure, the messages not yet wholly
+// written are kept. The caller must hold sending but not collect, so
+// that a slow collector doesn't hold up anything but other senders.
+void
+StreamSyslogger::write_out(int sock)
+{
+	std::string	buf;
+	size_t		next = 0;
+
+	while (next < this->backlog.size()) {
+		size_t	end = next;
+
+		buf.clear();
+		while (end < this->backlog.size()) {
+			const std::string&	m = this->backlog[end].data;
+			std::string		length = std::to_string(m.size());
+
+			if (!buf.empty() &&
+			    buf.size() + length.size() + 1 + m.size() >
+			    WRITE_CHUNK) {
+				break;
+			}
+
+			buf += length;
+			buf += ' ';
+			buf += m;
+			end++;
+		}
+
+		const char	*p = buf.data();
+		size_t		 left = buf.size();
+
+		while (left > 0) {
+			ssize_t	n = ::send(sock, p, left, MSG_NOSIGNAL);
+
+			if (n < 0 && EINTR == errno) {
+				continue;
+			}
+
+			if (n <= 0) {
+				std::lock_guard<std::mutex>	lock(
+				    this->collect);
+
+				this->disconnect();
+				this->backlog.erase(this->backlog.begin(),
+				    this->backlog.begin() +
+				    static_cast<std::ptrdiff_t>(next));
+				return;
+			}
+
+			p += n;
+			left -= static_cast<size_t>(n);
+		}
+
+		for (; next < end; next++) {
+			this->count_write(this->backlog[next].level,
+			    this->backlog[next].data.size());
+		}
+		this->count_flush();
+	}
+
+	this->backlog.clear();
+}
+
+
+// pump moves the queue onto the backlog and writes it out if the
+// collector is connected; on the last pump, anything undelivered is
+// dropped. Only one thread pumps at a time, and collect is held only
+// to look at the connection.
+void
+StreamSyslogger::pump(bool last)
+{
+	std::lock_guard<std::mutex>	sender(this->sending);
+	int				sock;
+
+	this->queue.drain(this->backlog);
+	if (this->backlog.size() > this->limit) {
+		auto	excess = this->backlog.begin() +
+			    static_cast<std::ptrdiff_t>(
+			    this->backlog.size() - this->limit);
+
+		for (auto it = this->backlog.begin(); it != excess; it++) {
+			this->drops.add(it->level);
+		}
+		this->backlog.erase(this->backlog.begin(), excess);
+	}
+
+	{
+		std::lock_guard<std::mutex>	lock(this->collect);
+
+		sock = this->fd;
+	}
+
+	if (-1 != sock) {
+		this->report(this->backlog);
+		if (!this->backlog.empty()) {
+			this->write_out(sock);
+		}
+	}
+
+	if (last) {
+		for (auto& m : this->backlog) {
+			this->drops.add(m.level);
+		}
+		this->backlog.clear();
+	}
+}
+
+
+void
+StreamSyslogger::flush(void)
+{
+	this->pump(false);
+}
+
+
+bool
+StreamSyslogger::connected(void)
+{
+	std::lock_guard<std::mutex>	lock(this->collect);
+
+	return -1 != this->fd;
+}
+
+
+void
+StreamSyslogger::run(void)
+{
+	while (!this->stopping.load()) {
+		this->connect(false);
+		this->pump(false);
+		this->queue.wait(WORKER_WAIT);
+	}
+}
+
+
+int
+StreamSyslogger::close(void)
+{
+	if (this->stopping.exchange(true)) {
+		return 0;
+	}
+	this->queue.close();
+
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+
+	this->connect(true);
+	this->pump(true);
+
+	std::lock_guard<std::mutex>	sender(this->sending);
+	std::lock_guard<std::mutex>	lock(this->collect);
+	if (-1 != this->fd) {
+		::close(this->fd);
+		this->fd = -1;
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
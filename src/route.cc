@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include <klogger/logger.hh>
+#include <klogger/route.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The states of a file that isn't open.
+constexpr int	FD_UNOPENED = -1;
+constexpr int	FD_FAILED = -2;
+constexpr int	FD_CLOSED = -3;
+
+
+// write_state writes buf to fd, or returns the error for a file that
+// isn't open.
+static LogError
+write_state(int fd, const char *buf, size_t length)
+{
+	switch (fd) {
+	case FD_FAILED:
+		return LogError::ERR_OPEN;
+	case FD_CLOSED:
+		return LogError::ERR_CLOSED;
+	default:
+		return write_fd(fd, buf, length);
+	}
+}
+
+
+LevelFiles::LevelFiles(const std::vector<Route>& routes, bool trunc)
+    : files(), table(), truncate(trunc), open_lock(), writers(0)
+{
+	for (auto& r : routes) {
+		File	*f = nullptr;
+
+		for (auto& existing : this->files) {
+			if (existing->path == r.path) {
+				f = existing.get();
+				break;
+			}
+		}
+
+		if (nullptr == f) {
+			this->files.emplace_back(new File{r.path, {FD_UNOPENED}});
+			f = this->files.back().get();
+		}
+
+		for (size_t i = 0; i < LEVEL_COUNT; i++) {
+			if (r.levels & (1 << i)) {
+				this->table[i] = f;
+			}
+		}
+	}
+}
+
+
+LevelFiles::~LevelFiles()
+{
+	this->close();
+}
+
+
+int
+LevelFiles::open(File& f)
+{
+	std::lock_guard<std::mutex>	guard(this->open_lock);
+	int				fd = f.fd.load();
+
+	if (FD_UNOPENED == fd) {
+		fd = this->install(f);
+	}
+
+	return fd;
+}
+
+
+// install opens f and publishes its descriptor, unless another caller
+// got there first, and returns the descriptor now in use. It doesn't
+// lock, so the emergency path can use it.
+int
+LevelFiles::install(File& f)
+{
+	int	expected = FD_UNOPENED;
+	int	fd = open_logfd(f.path, this->truncate);
+
+	if (-1 == fd) {
+		fd = FD_FAILED;
+	}
+
+	if (!f.fd.compare_exchange_strong(expected, fd,
+	    std::memory_order_acq_rel)) {
+		if (fd >= 0) {
+			::close(fd);
+		}
+		fd = expected;
+	}
+
+	return fd;
+}
+
+
+bool
+LevelFiles::open_all(void)
+{
+	bool	ok = true;
+
+	for (auto& f : this->files) {
+		if (this->open(*f) < 0) {
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+
+bool
+LevelFiles::routed(Level l) const
+{
+	return nullptr != this->table[level_index(l)];
+}
+
+
+// write_file writes buf to f, opening it if needed. It counts itself
+// in writers before it looks at the descriptor, so that close, which
+// takes the descriptors away first, can wait for it; the count is
+// lock-free, so the emergency path can use it too.
+LogError
+LevelFiles::write_file(File& f, const char *buf, size_t length,
+		       bool emergency)
+{
+	this->writers.fetch_add(1);
+
+	int		fd = f.fd.load(std::memory_order_acquire);
+	LogError	result;
+
+	if (FD_UNOPENED == fd) {
+		fd = emergency ? this->install(f) : this->open(f);
+	}
+
+	result = write_state(fd, buf, length);
+	this->writers.fetch_sub(1, std::memory_order_release);
+	return result;
+}
+
+
+LogError
+LevelFiles::write(Level l, const char *buf, size_t length)
+{
+	File	*f = this->table[level_index(l)];
+
+	if (nullptr == f) {
+		return LogError::HEALTHY;
+	}
+
+	return this->write_file(*f, buf, length, false);
+}
+
+
+LogError
+LevelFiles::write_emergency(Level l, const char *buf, size_t length)
+{
+	File	*f = this->table[level_index(l)];
+
+	if (nullptr == f) {
+		return LogError::HEALTHY;
+	}
+
+	return this->write_file(*f, buf, length, true);
+}
+
+
+// close takes every descriptor away from new writers, then waits for
+// those already writing before closing them, so that a descriptor
+// number is never reused under a write. A writer may be waiting to
+// open a file, so the lock isn't held while close waits.
+int
+LevelFiles::close(void)
+{
+	std::vector<int>	held;
+	int			status = 0;
+
+	{
+		std::lock_guard<std::mutex>	guard(this->open_lock);
+
+		for (auto& f : this->files) {
+			int	fd = f->fd.exchange(FD_CLOSED);
+
+			if (fd >= 0) {
+				held.push_back(fd);
+			}
+		}
+	}
+
+	while (this->writers.load(std::memory_order_acquire) != 0) {
+		std::this_thread::yield();
+	}
+
+	for (auto fd : held) {
+		if (-1 == ::close(fd)) {
+			status = -1;
+		}
+	}
+
+	return status;
+}
+
+
+} // namespace klog
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <klogger/console.hh>
+#include <klogger/filelog.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static bool
+exists(const string& path)
+{
+	struct stat	st;
+
+	return 0 == ::stat(path.c_str(), &st);
+}
+
+
+static size_t
+count_lines(const string& path)
+{
+	ifstream	in(path);
+	string		line;
+	size_t		n = 0;
+
+	while (getline(in, line)) {
+		n++;
+	}
+	return n;
+}
+
+
+static int
+test_level_sets(void)
+{
+	klog::ConsoleLogger	logger;
+
+	logger.levels(klog::Level::DEBUG | klog::Level::ERROR);
+	if (!logger.enabled(klog::Level::DEBUG) ||
+	    logger.enabled(klog::Level::INFO) ||
+	    logger.enabled(klog::Level::WARN) ||
+	    !logger.enabled(klog::Level::ERROR) ||
+	    logger.enabled(klog::Level::FATAL)) {
+		console.error("test_level_sets", "wrong levels enabled");
+		return 0;
+	}
+
+	if (logger.level() != klog::Level::DEBUG) {
+		console.error("test_level_sets", "wrong lowest level");
+		return 0;
+	}
+
+	logger.level(klog::Level::WARN);
+	if (logger.levels() != klog::at_or_above(klog::Level::WARN)) {
+		console.error("test_level_sets", "threshold not a set");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_routes(void)
+{
+	const string	debug = "route_test.debug";
+	const string	errors = "route_test.errors";
+	const string	unused = "route_test.unused";
+	int		ok = 1;
+
+	{
+		klog::FileLogger	flog({{klog::Level::DEBUG |
+					       klog::Level::INFO, debug},
+					      {klog::Level::ERROR |
+					       klog::Level::CRITICAL, errors},
+					      {klog::level_bit(klog::Level::FATAL),
+					       unused}}, true);
+
+		flog.levels(klog::LEVELS_ALL);
+		if (exists(debug) || exists(errors) || exists(unused)) {
+			console.error("test_routes", "file opened eagerly");
+			ok = 0;
+		}
+
+		flog.debug("test", "debug");
+		flog.info("test", "info");
+		flog.warn("test", "unrouted");
+		flog.error("test", "error");
+		if (!flog.good()) {
+			console.error("test_routes", "logger failed");
+			ok = 0;
+		}
+	}
+
+	if (count_lines(debug) != 2 || count_lines(errors) != 1) {
+		console.error("test_routes", "records misrouted",
+		    {{"debug", to_string(count_lines(debug))},
+		     {"errors", to_string(count_lines(errors))}});
+		ok = 0;
+	}
+	else if (exists(unused)) {
+		console.error("test_routes", "unused file created");
+		ok = 0;
+	}
+
+	::unlink(debug.c_str());
+	::unlink(errors.c_str());
+	::unlink(unused.c_str());
+	return ok;
+}
+
+
+// test_close checks that closing a logger while other threads write
+// to it doesn't let their records into a file that reuses its
+// descriptor.
+static int
+test_close(void)
+{
+	const string		path = "route_test.log";
+	const string		other = "route_test.other";
+	klog::FileLogger	flog(path, true);
+	atomic<bool>		stop(false);
+	vector<thread>		threads;
+	int			fd;
+
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(thread([&flog, &stop]() {
+			while (!stop.load()) {
+				flog.info("test", "close");
+			}
+		}));
+	}
+
+	this_thread::sleep_for(chrono::milliseconds(10));
+	flog.close();
+	fd = ::open(other.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	this_thread::sleep_for(chrono::milliseconds(10));
+	stop.store(true);
+	for (auto& th : threads) {
+		th.join();
+	}
+	::close(fd);
+
+	size_t	stray = count_lines(other);
+
+	::unlink(path.c_str());
+	::unlink(other.c_str());
+	if (stray != 0) {
+		console.error("test_close", "records written after close",
+		    {{"records", to_string(stray)}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"close", test_close},
+	{"level_sets", test_level_sets},
+	{"routes", test_routes},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("route_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("route_test", "ok");
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef __KLOGGER_SCAN_HH__
+#define __KLOGGER_SCAN_HH__
+
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#define KLOG_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KLOG_SCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+
+namespace klog {
+
+
+// The scanners find the first byte of a class in a string: a byte no
+// greater than C::last, compared unsigned, or either of C::first and
+// C::second. The JSON and logfmt encoders each define a class, such as
+//
+//	struct Escaped {
+//		static constexpr char		first = '"';
+//		static constexpr char		second = '\\';
+//		static constexpr unsigned char	last = 0x1f;
+//	};
+//
+// and share the scalar, SSE2 and AVX2 scanners below.
+template<typename C>
+inline bool
+in_class(unsigned char c)
+{
+	return c <= C::last || c == static_cast<unsigned char>(C::first) ||
+	    c == static_cast<unsigned char>(C::second);
+}
+
+
+template<typename C>
+size_t
+scan_bytes(const char *s, size_t length)
+{
+	size_t	i = 0;
+
+	for (; i < length; i++) {
+		if (in_class<C>(static_cast<unsigned char>(s[i]))) {
+			break;
+		}
+	}
+	return i;
+}
+
+
+#if defined(KLOG_SCAN_SSE2)
+// sse2_mask returns a bit for each of the 16 bytes at s in the class.
+// A byte c is at most last where max(c, last) is last.
+template<typename C>
+inline unsigned
+sse2_mask(const char *s)
+{
+	const __m128i	last = _mm_set1_epi8(static_cast<char>(C::last));
+	__m128i		v = _mm_loadu_si128(
+			    reinterpret_cast<const __m128i *>(s));
+	__m128i		hit = _mm_or_si128(
+			    _mm_or_si128(
+			    _mm_cmpeq_epi8(v, _mm_set1_epi8(C::first)),
+			    _mm_cmpeq_epi8(v, _mm_set1_epi8(C::second))),
+			    _mm_cmpeq_epi8(_mm_max_epu8(v, last), last));
+
+	return static_cast<unsigned>(_mm_movemask_epi8(hit));
+}
+
+
+template<typename C>
+size_t
+scan_sse2(const char *s, size_t length)
+{
+	size_t	i = 0;
+
+	for (; i + 16 <= length; i += 16) {
+		unsigned	mask = sse2_mask<C>(s + i);
+
+		if (0 != mask) {
+			return i + static_cast<size_t>(__builtin_ctz(mask));
+		}
+	}
+
+	return i + scan_bytes<C>(s + i, length - i);
+}
+#endif
+
+
+#if defined(KLOG_SCAN_AVX2)
+// scan_avx2 finishes with a 16-byte block and then single bytes itself,
+// rather than calling scan_sse2: switching from AVX to legacy SSE code
+// costs more than the rest of a short scan.
+template<typename C>
+__attribute__((target("avx2"))) size_t
+scan_avx2(const char *s, size_t length)
+{
+	const __m256i	first = _mm256_set1_epi8(C::first);
+	const __m256i	second = _mm256_set1_epi8(C::second);
+	const __m256i	last = _mm256_set1_epi8(static_cast<char>(C::last));
+	size_t		i = 0;
+
+	for (; i + 32 <= length; i += 32) {
+		__m256i	v = _mm256_loadu_si256(
+			    reinterpret_cast<const __m256i *>(s + i));
+		__m256i	hit = _mm256_or_si256(
+			    _mm256_or_si256(_mm256_cmpeq_epi8(v, first),
+			    _mm256_cmpeq_epi8(v, second)),
+			    _mm256_cmpeq_epi8(_mm256_max_epu8(v, last), last));
+		unsigned	mask = static_cast<unsigned>(
+				    _mm256_movemask_epi8(hit));
+
+		if (0 != mask) {
+			return i + static_cast<size_t>(__builtin_ctz(mask));
+		}
+	}
+
+	if (i + 16 <= length) {
+		unsigned	mask = sse2_mask<C>(s + i);
+
+		if (0 != mask) {
+			return i + static_cast<size_t>(__builtin_ctz(mask));
+		}
+		i += 16;
+	}
+
+	for (; i < length; i++) {
+		if (in_class<C>(static_cast<unsigned char>(s[i]))) {
+			break;
+		}
+	}
+	return i;
+}
+#endif
+
+
+typedef size_t	(*scan_func)(const char *, size_t);
+
+struct Scanner {
+	scan_func	scan;
+	const char	*name;
+};
+
+
+// pick_scanner picks the fastest scanner for class C that the CPU
+// runs, once, on first use.
+template<typename C>
+const Scanner&
+pick_scanner(void)
+{
+	static const Scanner	picked = []() {
+#if defined(KLOG_SCAN_AVX2)
+		if (__builtin_cpu_supports("avx2")) {
+			return Scanner{scan_avx2<C>, "avx2"};
+		}
+#endif
+#if defined(KLOG_SCAN_SSE2)
+		return Scanner{scan_sse2<C>, "sse2"};
+#else
+		return Scanner{scan_bytes<C>, "scalar"};
+#endif
+	}();
+
+	return picked;
+}
+
+
+} // namespace klog
+
+
+#endif // #ifndef __KLOGGER_SCAN_HH__
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/schema.hh>
+#include <klogger/tlv.hh>
+
+
+namespace klog {
+
+
+// SchemaBody is the Body of a single schema event, pairing the
+// schema's precomputed encodings with the values for one call.
+class SchemaBody : public Body {
+public:
+	SchemaBody(const SchemaBase& s, const std::string *const *v) :
+	    schema(s), values(v) {};
+
+	const std::string&
+	actor() const
+	{
+		return this->schema.sactor;
+	}
+
+	const std::string&
+	event() const
+	{
+		return this->schema.sevent;
+	}
+
+	void
+	text(std::string& buf) const
+	{
+		buf += this->schema.text_prefix;
+		for (size_t i = 0; i < this->schema.keys.size(); i++) {
+			buf += this->schema.text_keys[i];
+			buf += *this->values[i];
+		}
+	}
+
+	void
+	tlv(std::string& buf) const
+	{
+		buf += this->schema.tlv_prefix;
+		for (size_t i = 0; i < this->schema.keys.size(); i++) {
+			buf += this->schema.tlv_keys[i];
+			tlv::append_string(buf, *this->values[i]);
+		}
+	}
+
+	size_t
+	tlv_length() const
+	{
+		size_t	length = this->schema.tlv_fixed;
+
+		for (size_t i = 0; i < this->schema.keys.size(); i++) {
+			length += tlv::string_length(*this->values[i]);
+		}
+		return length;
+	}
+
+	void
+	attrs(std::map<std::string, std::string>& out) const
+	{
+		for (size_t i = 0; i < this->schema.keys.size(); i++) {
+			out[this->schema.keys[i]] = *this->values[i];
+		}
+	}
+
+private:
+	const SchemaBase&		 schema;
+	const std::string *const	*values;
+
+	SchemaBody(const SchemaBody&) = delete;
+	SchemaBody&	operator=(const SchemaBody&) = delete;
+};
+
+
+SchemaBase::SchemaBase(const std::string& actor, const std::string& event,
+		       const std::string *names, size_t count)
+    : sactor(actor), sevent(event), keys(names, names + count),
+      text_prefix(), text_keys(), tlv_prefix(), tlv_keys(), tlv_fixed(0)
+{
+	this->text_prefix = "[actor:" + actor + " event:" + event + "]";
+	tlv::append_string(this->tlv_prefix, actor);
+	tlv::append_string(this->tlv_prefix, event);
+	this->tlv_fixed = this->tlv_prefix.size();
+
+	for (auto& k : this->keys) {
+		std::string	encoded;
+
+		this->text_keys.push_back(" " + k + "=");
+		tlv::append_string(encoded, k);
+		this->tlv_fixed += encoded.size();
+		this->tlv_keys.push_back(encoded);
+	}
+}
+
+
+void
+SchemaBase::log(BasicLogger& logger, Level l,
+		const std::string *const *values) const
+{
+	if (!logger.enabled(l, this->sactor, this->sevent)) {
+		return;
+	}
+
+	SchemaBody	body(*this, values);
+	std::uint64_t	started = logger.start_call();
+
+	logger.write_body(l, now(), body);
+	logger.finish_call(started);
+}
+
+
+} // namespace klog
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/record.hh>
+#include <klogger/schema.hh>
+#include <klogger/tlv.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+// BodyLogger keeps the text and TLV renderings of each body written
+// to it.
+class BodyLogger : public CaptureLogger {
+public:
+	BodyLogger() : CaptureLogger(), texts(), tlvs(), lengths() {};
+
+	void
+	write_body(klog::Level, std::uint64_t, const klog::Body& body)
+	{
+		string	text, tlv;
+
+		body.text(text);
+		body.tlv(tlv);
+		this->texts.push_back(text);
+		this->tlvs.push_back(tlv);
+		this->lengths.push_back(body.tlv_length());
+	}
+
+	vector<string>	texts;
+	vector<string>	tlvs;
+	vector<size_t>	lengths;
+};
+
+
+static const klog::Schema<2>	request("server", "request",
+				    {"client", "size"});
+
+
+static int
+test_render(void)
+{
+	BodyLogger	logger;
+	string		client = "127.0.0.1";
+	string		size = "";
+	string		expected;
+
+	request.info(logger, client, size);
+	if (logger.texts.size() != 1) {
+		console.error("test_render", "record not written");
+		return 0;
+	}
+
+	if (logger.texts[0] != "[actor:server event:request] "
+			       "client=127.0.0.1 size=") {
+		console.error("test_render", "bad text rendering",
+		    {{"text", logger.texts[0]}});
+		return 0;
+	}
+
+	klog::tlv::append_string(expected, "server");
+	klog::tlv::append_string(expected, "request");
+	klog::tlv::append_string(expected, "client");
+	klog::tlv::append_string(expected, client);
+	klog::tlv::append_string(expected, "size");
+	klog::tlv::append_string(expected, size);
+	if (logger.tlvs[0] != expected) {
+		console.error("test_render", "bad TLV rendering");
+		return 0;
+	}
+
+	if (logger.lengths[0] != expected.size()) {
+		console.error("test_render", "bad TLV length",
+		    {{"expected", to_string(expected.size())},
+		     {"actual", to_string(logger.lengths[0])}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+// A logger that doesn't know about bodies receives the same record it
+// would from the generic call.
+static int
+test_generic(void)
+{
+	CaptureLogger	logger;
+	string		client = "10.0.0.1";
+	string		size = "512";
+
+	logger.level(klog::Level::DEBUG);
+	request.debug(logger, client, size);
+	logger.debug("server", "request",
+	    {{"client", client}, {"size", size}});
+
+	if (logger.records.size() != 2) {
+		console.error("test_generic", "records lost");
+		return 0;
+	}
+
+	auto&	a = logger.records[0];
+	auto&	b = logger.records[1];
+
+	if (a.level != b.level || a.actor != b.actor || a.event != b.event ||
+	    a.attrs != b.attrs) {
+		console.error("test_generic", "schema record differs");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_level(void)
+{
+	CaptureLogger	logger;
+	string		client = "10.0.0.1";
+	string		size = "512";
+
+	logger.level(klog::Level::WARN);
+	request.info(logger, client, size);
+	request.error(logger, client, size);
+
+	if (logger.records.size() != 1 ||
+	    logger.records[0].level != klog::Level::ERROR) {
+		console.error("test_level", "level not honoured");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"render", test_render},
+	{"generic", test_generic},
+	{"level", test_level},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("schema_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("schema_test", "ok");
+}
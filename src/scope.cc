@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <klogger/logger.hh>
+#include <klogger/record.hh>
+#include <klogger/scope.hh>
+
+
+namespace klog {
+
+
+// spare_arena holds an arena given back by a finished scope on this
+// thread, so that the next scope can reuse its allocation.
+static std::string&
+spare_arena(void)
+{
+	static thread_local std::string	spare;
+
+	return spare;
+}
+
+
+// Each arena entry is a header followed by the packed record; sent
+// marks a WARN record that has already been passed on.
+struct ArenaHeader {
+	Level		level;
+	bool		sent;
+	std::uint32_t	length;
+};
+
+
+RequestScope::RequestScope(BasicLogger *out, Level at)
+    : BasicLogger(), sink(out), trigger(at), lock(), failed(false),
+      arena(), packed{Level::DEBUG, std::string()}, drops()
+{
+	this->arena.swap(spare_arena());
+	this->arena.clear();
+	this->level(Level::DEBUG);
+}
+
+
+RequestScope::RequestScope(BasicLogger *out)
+    : RequestScope(out, Level::ERROR)
+{
+}
+
+
+RequestScope::~RequestScope()
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	if (!this->failed) {
+		this->release();
+	}
+	this->arena.clear();
+	this->arena.swap(spare_arena());
+}
+
+
+void
+RequestScope::write(Level l, std::uint64_t when, const std::string& actor,
+		    const std::string& event,
+		    const std::map<std::string, std::string>& attrs)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	if (l >= this->trigger && !this->failed) {
+		this->write_out();
+	}
+
+	if (this->failed) {
+		if (this->sink->enabled(l, actor, event)) {
+			this->sink->write(l, when, actor, event, attrs);
+		}
+		return;
+	}
+
+	// WARN records are buffered too, so that they reach the sink in
+	// the order they were logged; a WARN that doesn't fit releases
+	// the ones before it and goes straight through.
+	pack_record(this->packed, l, when, actor, event, attrs);
+	if (this->arena.size() + sizeof(ArenaHeader) +
+	    this->packed.data.size() > ARENA_LIMIT) {
+		if (l >= Level::WARN && this->sink->enabled(l, actor, event)) {
+			this->release();
+			this->sink->write(l, when, actor, event, attrs);
+			return;
+		}
+		this->drops.add(l);
+		return;
+	}
+
+	ArenaHeader	h{l, false, static_cast<std::uint32_t>(
+			    this->packed.data.size())};
+
+	this->arena.append(reinterpret_cast<const char *>(&h), sizeof(h));
+	this->arena += this->packed.data;
+}
+
+
+// write_out writes the arena to the sink and marks the scope failed.
+// The caller must hold the lock.
+void
+RequestScope::write_out(void)
+{
+	Record		r{Level::DEBUG, 0, "", "", {}};
+	size_t		off = 0;
+
+	this->failed = true;
+	while (off + sizeof(ArenaHeader) <= this->arena.size()) {
+		ArenaHeader	h;
+
+		::memcpy(&h, this->arena.data() + off, sizeof(h));
+		off += sizeof(h);
+		this->packed.level = h.level;
+		this->packed.data.assign(this->arena, off, h.length);
+		off += h.length;
+
+		if (!h.sent && unpack_record(this->packed, r)) {
+			this->sink->write(r.level, r.when, r.actor, r.event,
+			    r.attrs);
+		}
+	}
+	this->arena.clear();
+
+	if (this->drops.report(r)) {
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+	}
+}
+
+
+// release passes the buffered WARN records the sink's level allows on
+// to it, in order, and marks them sent. The caller must hold the lock.
+void
+RequestScope::release(void)
+{
+	Record		r{Level::DEBUG, 0, "", "", {}};
+	size_t		off = 0;
+
+	while (off + sizeof(ArenaHeader) <= this->arena.size()) {
+		ArenaHeader	h;
+		char		*at = &this->arena[off];
+
+		::memcpy(&h, at, sizeof(h));
+		off += sizeof(h) + h.length;
+		if (h.sent || h.level < Level::WARN) {
+			continue;
+		}
+
+		this->packed.level = h.level;
+		this->packed.data.assign(this->arena, off - h.length,
+		    h.length);
+		if (!unpack_record(this->packed, r) ||
+		    !this->sink->enabled(r.level, r.actor, r.event)) {
+			continue;
+		}
+
+		this->sink->write(r.level, r.when, r.actor, r.event, r.attrs);
+		h.sent = true;
+		::memcpy(at, &h, sizeof(h));
+	}
+}
+
+
+bool
+RequestScope::triggered(void)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	return this->failed;
+}
+
+
+void
+RequestScope::flush(void)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	if (!this->failed) {
+		this->write_out();
+	}
+}
+
+
+int
+RequestScope::close(void)
+{
+	std::lock_guard<std::mutex>	guard(this->lock);
+
+	if (!this->failed) {
+		this->release();
+	}
+	this->arena.clear();
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/record.hh>
+#include <klogger/scope.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+static int
+test_success(void)
+{
+	CaptureLogger	sink;
+
+	sink.level(klog::Level::INFO);
+	{
+		klog::RequestScope	scope(&sink);
+
+		scope.debug("request", "parsed");
+		scope.info("request", "handled");
+		scope.warn("request", "slow");
+
+		if (scope.triggered()) {
+			console.error("test_success", "scope triggered");
+			return 0;
+		}
+	}
+
+	if (sink.records.size() != 1 || sink.records[0].event != "slow") {
+		console.error("test_success", "buffered records written",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_failure(void)
+{
+	CaptureLogger	sink;
+
+	sink.level(klog::Level::INFO);
+	{
+		klog::RequestScope	scope(&sink);
+
+		for (int i = 0; i < 5; i++) {
+			scope.debug("request", "step",
+			    {{"seq", to_string(i)}});
+		}
+		scope.error("request", "failed");
+		scope.info("request", "cleanup");
+		scope.debug("request", "filtered");
+	}
+
+	// Once the scope has failed, the sink's level applies again.
+	if (sink.records.size() != 7) {
+		console.error("test_failure", "records not written",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 5; i++) {
+		if (sink.records[i].level != klog::Level::DEBUG ||
+		    sink.records[i].attrs["seq"] != to_string(i)) {
+			console.error("test_failure", "records out of order");
+			return 0;
+		}
+	}
+
+	if (sink.records[5].event != "failed" ||
+	    sink.records[6].event != "cleanup" ||
+	    sink.records[0].when > sink.records[5].when) {
+		console.error("test_failure", "trigger out of order");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_overflow(void)
+{
+	CaptureLogger	sink;
+	string		big(1024, 'x');
+
+	{
+		klog::RequestScope	scope(&sink, klog::Level::WARN);
+
+		for (int i = 0; i < 100; i++) {
+			scope.info("request", "big", {{"big", big}});
+		}
+		scope.warn("request", "failed");
+	}
+
+	size_t	n = sink.records.size();
+
+	if (n < 50 || n > 70 || sink.records[n - 1].event != "failed") {
+		console.error("test_overflow", "arena limit not honoured",
+		    {{"records", to_string(n)}});
+		return 0;
+	}
+
+	auto&	dropped = sink.records[n - 2];
+	if (dropped.event != "dropped records" ||
+	    dropped.attrs["dropped"] != to_string(100 - (n - 2))) {
+		console.error("test_overflow", "drops not reported");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_order(void)
+{
+	CaptureLogger		sink;
+	vector<string>		events = {"parsed", "slow", "handled",
+					  "failed"};
+
+	sink.level(klog::Level::INFO);
+	{
+		klog::RequestScope	scope(&sink);
+
+		scope.info("request", "parsed");
+		scope.warn("request", "slow");
+		scope.info("request", "handled");
+		scope.error("request", "failed");
+	}
+
+	if (sink.records.size() != events.size()) {
+		console.error("test_order", "records not written",
+		    {{"records", to_string(sink.records.size())}});
+		return 0;
+	}
+
+	for (size_t i = 0; i < events.size(); i++) {
+		if (sink.records[i].event != events[i]) {
+			console.error("test_order", "records out of order");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"success", test_success},
+	{"failure", test_failure},
+	{"overflow", test_overflow},
+	{"order", test_order},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("scope_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("scope_test", "ok");
+}
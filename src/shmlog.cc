@@ -0,0 +1,587 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/shmlog.hh>
+#include <klogger/tlv.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// The collector looks for new rings at most this often.
+constexpr std::uint64_t	SCAN_INTERVAL_NS = 1000000000;
+
+// Rings appear under this directory on Linux.
+constexpr auto		SHM_DIR = "/dev/shm";
+
+
+static inline shm::Slot *
+slot_at(char *ring, size_t off)
+{
+	return reinterpret_cast<shm::Slot *>(ring + off);
+}
+
+
+static inline bool
+power_of_two(size_t n)
+{
+	return n >= 4096 && 0 == (n & (n - 1));
+}
+
+
+// Each ShmLogger in a process gets its own segment, numbered from this.
+static std::atomic<std::uint64_t>	next_segment(0);
+
+
+// ring_suffix returns true if s is the "PID.N" that follows a ring's
+// name in its segment name.
+static bool
+ring_suffix(const std::string& s)
+{
+	size_t	dot = s.find('.');
+
+	return dot != std::string::npos && dot > 0 && dot + 1 < s.size() &&
+	    s.find_first_not_of("0123456789") == dot &&
+	    s.find_first_not_of("0123456789", dot + 1) == std::string::npos;
+}
+
+
+ShmLogger::ShmLogger(std::string name, size_t ring_size)
+    : BasicLogger(), path("/" + name + "." + std::to_string(::getpid()) +
+      "." + std::to_string(next_segment++)),
+      size(ring_size), header(nullptr), ring(nullptr), writers(0), drops()
+{
+	size_t	length = sizeof(shm::RingHeader) + this->size;
+	void	*mem;
+	int	 fd;
+
+	if (!power_of_two(this->size)) {
+		this->err = LogError::ERR_OPEN;
+		return;
+	}
+
+	// A segment left by an earlier process with the same pid is of
+	// no use to anyone; no live logger shares its name.
+	::shm_unlink(this->path.c_str());
+	fd = ::shm_open(this->path.c_str(), O_RDWR | O_CREAT | O_EXCL |
+	    O_CLOEXEC, 0600);
+	if (-1 == fd) {
+		this->err = errno_error(errno);
+		return;
+	}
+
+	if (-1 == ::ftruncate(fd, static_cast<off_t>(length))) {
+		this->err = errno_error(errno);
+		::close(fd);
+		::shm_unlink(this->path.c_str());
+		return;
+	}
+
+	mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    0);
+	::close(fd);
+	if (MAP_FAILED == mem) {
+		this->err = errno_error(errno);
+		::shm_unlink(this->path.c_str());
+		return;
+	}
+
+	shm::RingHeader	*h = new (mem) shm::RingHeader();
+
+	this->ring = static_cast<char *>(mem) + sizeof(shm::RingHeader);
+	h->size = this->size;
+	h->pid = ::getpid();
+	h->magic.store(shm::MAGIC, std::memory_order_release);
+	this->header.store(h);
+}
+
+
+ShmLogger::ShmLogger(std::string name)
+    : ShmLogger(name, shm::RING_SIZE)
+{
+}
+
+
+ShmLogger::~ShmLogger()
+{
+	this->close();
+}
+
+
+void
+ShmLogger::write(Level l, std::uint64_t when, const std::string& actor,
+		 const std::string& event,
+		 const std::map<std::string, std::string>& attrs)
+{
+	std::string&	buf = thread_buffer();
+
+	tlv::append_entry(buf, l, when, actor, event, attrs);
+	this->push(l, buf);
+}
+
+
+void
+ShmLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	std::string&	buf = thread_buffer();
+
+	tlv::append_entry(buf, l, when, body);
+	this->push(l, buf);
+}
+
+
+// push counts itself in writers before it looks at the header, so
+// that close, which takes the header away first, can wait for it.
+void
+ShmLogger::push(Level l, const std::string& entry)
+{
+	this->writers.fetch_add(1);
+
+	shm::RingHeader	*h = this->header.load();
+
+	if (nullptr == h) {
+		this->drops.add(l);
+	}
+	else {
+		this->push(h, l, entry);
+	}
+
+	this->writers.fetch_sub(1, std::memory_order_release);
+}
+
+
+// push reserves a slot for entry, padding out the end of the ring if
+// the slot wouldn't fit before it, and copies the entry in.
+void
+ShmLogger::push(shm::RingHeader *h, Level l, const std::string& entry)
+{
+	size_t		need = shm::slot_length(entry.size());
+	size_t		mask = this->size - 1;
+	size_t		pad;
+	std::uint64_t	head;
+
+	if (need > this->size / 2) {
+		this->drops.add(l);
+		return;
+	}
+
+	head = h->head.load(std::memory_order_relaxed);
+	while (true) {
+		std::uint64_t	tail;
+		size_t		off = static_cast<size_t>(head & mask);
+
+		tail = h->tail.load(std::memory_order_acquire);
+		pad = this->size - off < need ? this->size - off : 0;
+		if (head + pad + need - tail > this->size) {
+			this->drops.add(l);
+			h->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (h->head.compare_exchange_weak(head, head + pad + need,
+		    std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	if (pad > 0) {
+		shm::Slot	*p = slot_at(this->ring,
+				    static_cast<size_t>(head & mask));
+
+		p->length = static_cast<std::uint32_t>(pad - sizeof(shm::Slot));
+		p->state.store(shm::SLOT_PADDING, std::memory_order_release);
+	}
+
+	shm::Slot	*s = slot_at(this->ring,
+			    static_cast<size_t>((head + pad) & mask));
+
+	s->length = static_cast<std::uint32_t>(entry.size());
+	s->state.store(shm::SLOT_RESERVED, std::memory_order_release);
+	::memcpy(reinterpret_cast<char *>(s + 1), entry.data(), entry.size());
+	s->state.store(shm::SLOT_COMMITTED, std::memory_order_release);
+	this->count_write(l, entry.size());
+}
+
+
+// close takes the header away from new writers, then waits for those
+// already in push to finish before unmapping the ring.
+int
+ShmLogger::close(void)
+{
+	shm::RingHeader	*h = this->header.exchange(nullptr);
+	bool		 drained;
+
+	if (nullptr == h) {
+		return 0;
+	}
+
+	while (this->writers.load(std::memory_order_acquire) != 0) {
+		std::this_thread::yield();
+	}
+
+	h->closed.store(1, std::memory_order_release);
+	drained = h->head.load() == h->tail.load();
+	::munmap(h, sizeof(shm::RingHeader) + this->size);
+	this->ring = nullptr;
+
+	if (drained) {
+		::shm_unlink(this->path.c_str());
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+const std::string&
+ShmLogger::segment(void) const
+{
+	return this->path;
+}
+
+
+std::map<Level, std::uint64_t>
+ShmLogger::dropped(void) const
+{
+	return this->drops.totals();
+}
+
+
+// A Ring is the collector's mapping of one producer's ring.
+struct ShmCollector::Ring {
+	Ring(const std::string& segment, void *mem, size_t length)
+	    : path(segment),
+	      header(static_cast<shm::RingHeader *>(mem)),
+	      data(static_cast<char *>(mem) + sizeof(shm::RingHeader)),
+	      mapped(length), reported(0) {};
+
+	~Ring()
+	{
+		::munmap(this->header, this->mapped);
+	}
+
+	// gone returns true if the producer closed the ring or exited.
+	bool
+	gone(void) const
+	{
+		pid_t	pid = static_cast<pid_t>(this->header->pid);
+
+		if (this->header->closed.load(std::memory_order_acquire)) {
+			return true;
+		}
+		return -1 == ::kill(pid, 0) && ESRCH == errno;
+	}
+
+	// zero clears n bytes of the ring from position pos, so that
+	// stale data is never taken for a slot.
+	void
+	zero(std::uint64_t pos, std::uint64_t n)
+	{
+		size_t	off = static_cast<size_t>(pos & (this->header->size - 1));
+		size_t	first = static_cast<size_t>(
+			    std::min<std::uint64_t>(n, this->header->size - off));
+
+		::memset(this->data + off, 0, first);
+		if (n > first) {
+			::memset(this->data, 0, static_cast<size_t>(n) - first);
+		}
+	}
+
+	std::string		 path;
+	shm::RingHeader		*header;
+	char			*data;
+	size_t			 mapped;
+	std::uint64_t		 reported;
+
+private:
+	Ring(const Ring&) = delete;
+	Ring&	operator=(const Ring&) = delete;
+};
+
+
+ShmCollector::ShmCollector(std::string ring_name, std::string logfile,
+			   bool as_text)
+    : name(ring_name), text(as_text), fd(open_logfd(logfile, false)),
+      err(LogError::HEALTHY), open_rings(), last_scan(0), torn_records(0),
+      batch(), entries(), decoder(), records()
+{
+	if (-1 == this->fd) {
+		this->err = errno_error(errno);
+	}
+}
+
+
+ShmCollector::~ShmCollector()
+{
+	this->open_rings.clear();
+	if (-1 != this->fd) {
+		::close(this->fd);
+	}
+}
+
+
+static std::uint64_t
+steady_ns(void)
+{
+	return static_cast<std::uint64_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(
+	    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+// scan maps any rings that have appeared since the last scan.
+void
+ShmCollector::scan(void)
+{
+	std::string	prefix = this->name + ".";
+	std::uint64_t	now = steady_ns();
+	DIR		*dir;
+	struct dirent	*ent;
+
+	if (0 != this->last_scan && now - this->last_scan < SCAN_INTERVAL_NS) {
+		return;
+	}
+	this->last_scan = now;
+
+	dir = ::opendir(SHM_DIR);
+	if (nullptr == dir) {
+		return;
+	}
+
+	while (nullptr != (ent = ::readdir(dir))) {
+		std::string	entry(ent->d_name);
+		std::string	segment = "/" + entry;
+		struct stat	st;
+		void		*mem;
+		int		 sfd;
+
+		if (entry.compare(0, prefix.size(), prefix) != 0 ||
+		    !ring_suffix(entry.substr(prefix.size())) ||
+		    this->open_rings.count(segment) > 0) {
+			continue;
+		}
+
+		sfd = ::shm_open(segment.c_str(), O_RDWR | O_CLOEXEC, 0);
+		if (-1 == sfd) {
+			continue;
+		}
+
+		if (-1 == ::fstat(sfd, &st) ||
+		    st.st_size <= static_cast<off_t>(sizeof(shm::RingHeader))) {
+			::close(sfd);
+			continue;
+		}
+
+		size_t	length = static_cast<size_t>(st.st_size);
+
+		mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, sfd, 0);
+		::close(sfd);
+		if (MAP_FAILED == mem) {
+			continue;
+		}
+
+		std::unique_ptr<Ring>	r(new Ring(segment, mem, length));
+
+		// A ring whose producer is still setting it up is picked up
+		// on a later scan.
+		if (shm::MAGIC != r->header->magic.load(
+		    std::memory_order_acquire) ||
+		    shm::RING_VERSION != r->header->version ||
+		    !power_of_two(r->header->size) ||
+		    r->header->size + sizeof(shm::RingHeader) != length) {
+			continue;
+		}
+
+		this->open_rings.insert(std::make_pair(segment,
+		    std::move(r)));
+	}
+
+	::closedir(dir);
+}
+
+
+// collect appends the committed records in r to the entries, and
+// returns how many there were.
+size_t
+ShmCollector::collect(Ring& r)
+{
+	std::uint64_t	size = r.header->size;
+	std::uint64_t	head = r.header->head.load(std::memory_order_acquire);
+	std::uint64_t	tail = r.header->tail.load(std::memory_order_relaxed);
+	std::uint64_t	dropped;
+	size_t		count = 0;
+
+	while (tail < head) {
+		size_t		off = static_cast<size_t>(tail & (size - 1));
+		size_t		avail = static_cast<size_t>(size) - off;
+		shm::Slot	*s = slot_at(r.data, off);
+		std::uint32_t	state = s->state.load(
+				    std::memory_order_acquire);
+		std::uint64_t	advance = head - tail;
+
+		if (shm::SLOT_COMMITTED == state &&
+		    shm::slot_length(s->length) <= avail) {
+			this->entries.append(reinterpret_cast<char *>(s + 1),
+			    s->length);
+			advance = shm::slot_length(s->length);
+			count++;
+		}
+		else if (shm::SLOT_PADDING == state) {
+			advance = avail;
+		}
+		else if (shm::SLOT_COMMITTED == state) {
+			// A bad length; nothing after it can be trusted.
+			this->torn_records++;
+		}
+		else if (!r.gone()) {
+			// The record is still being written.
+			break;
+		}
+		else {
+			// The producer died writing this record. If the
+			// length made it out, the records after it may be
+			// whole.
+			this->torn_records++;
+			if (shm::SLOT_RESERVED == state &&
+			    shm::slot_length(s->length) <= avail) {
+				advance = shm::slot_length(s->length);
+			}
+		}
+
+		r.zero(tail, advance);
+		tail += advance;
+	}
+
+	r.header->tail.store(tail, std::memory_order_release);
+
+	dropped = r.header->dropped.load(std::memory_order_relaxed);
+	if (dropped > r.reported) {
+		tlv::append_entry(this->entries, Level::WARN, now(), "klog",
+		    "dropped records",
+		    {{"segment", r.path},
+		     {"dropped", std::to_string(dropped - r.reported)}});
+		r.reported = dropped;
+	}
+
+	return count;
+}
+
+
+// emit writes data to the log file.
+void
+ShmCollector::emit(const std::string& data)
+{
+	if (-1 == this->fd || data.empty()) {
+		return;
+	}
+
+	this->err = write_fd(this->fd, data.data(), data.size());
+}
+
+
+size_t
+ShmCollector::drain(void)
+{
+	size_t	count = 0;
+
+	this->scan();
+	this->entries.clear();
+
+	for (auto it = this->open_rings.begin();
+	    it != this->open_rings.end();) {
+		Ring&	r = *it->second;
+
+		count += this->collect(r);
+		if (r.header->tail.load() == r.header->head.load() &&
+		    r.gone()) {
+			::shm_unlink(r.path.c_str());
+			it = this->open_rings.erase(it);
+			continue;
+		}
+		it++;
+	}
+
+	if (!this->text) {
+		this->emit(this->entries);
+		return count;
+	}
+
+	this->records.clear();
+	this->batch.clear();
+	this->decoder.decode(this->entries, this->records);
+	for (auto& rec : this->records) {
+		format_log(this->batch, rec.level, rec.when, rec.actor,
+		    rec.event, rec.attrs);
+	}
+	this->emit(this->batch);
+	return count;
+}
+
+
+size_t
+ShmCollector::rings(void) const
+{
+	return this->open_rings.size();
+}
+
+
+std::uint64_t
+ShmCollector::torn(void) const
+{
+	return this->torn_records;
+}
+
+
+bool
+ShmCollector::good(void) const
+{
+	return LogError::HEALTHY == this->err;
+}
+
+
+} // namespace klog
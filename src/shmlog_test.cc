@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/shmlog.hh>
+#include <klogger/tlv.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+static const string	LOG = "shmlog_test.log";
+
+
+static string
+read_file(const string& path)
+{
+	ifstream	in(path, ios::binary);
+
+	return string(istreambuf_iterator<char>(in),
+	    istreambuf_iterator<char>());
+}
+
+
+static vector<klog::Record>
+read_log(void)
+{
+	klog::tlv::Decoder	decoder;
+	vector<klog::Record>	records;
+
+	decoder.decode(read_file(LOG), records);
+	return records;
+}
+
+
+static bool
+segment_exists(const string& segment)
+{
+	int	fd = ::shm_open(segment.c_str(), O_RDONLY, 0);
+
+	if (-1 == fd) {
+		return false;
+	}
+	::close(fd);
+	return true;
+}
+
+
+static int
+test_single(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::ShmLogger		slog("shmlog_test_single");
+	klog::ShmCollector	collector("shmlog_test_single", LOG, false);
+	string			segment = slog.segment();
+
+	for (int i = 0; i < 1000; i++) {
+		slog.info("test", "single", {{"seq", to_string(i)}});
+	}
+
+	if (collector.drain() != 1000 || collector.rings() != 1) {
+		console.error("test_single", "records not collected");
+		return 0;
+	}
+
+	auto	records = read_log();
+
+	if (records.size() != 1000) {
+		console.error("test_single", "records lost");
+		return 0;
+	}
+
+	for (int i = 0; i < 1000; i++) {
+		if (records[i].attrs["seq"] != to_string(i) ||
+		    records[i].event != "single") {
+			console.error("test_single", "bad record");
+			return 0;
+		}
+	}
+
+	// Once the producer closes, the drained ring is removed.
+	slog.close();
+	collector.drain();
+	if (collector.rings() != 0 || segment_exists(segment)) {
+		console.error("test_single", "ring not removed");
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+// Two loggers with the same name get their own rings.
+static int
+test_same_name(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::ShmLogger		first("shmlog_test_same");
+	klog::ShmLogger		second("shmlog_test_same");
+	klog::ShmCollector	collector("shmlog_test_same", LOG, false);
+
+	if (!first.good() || !second.good() ||
+	    first.segment() == second.segment()) {
+		console.error("test_same_name", "rings not separate");
+		return 0;
+	}
+
+	for (int i = 0; i < 100; i++) {
+		first.info("test", "first", {{"seq", to_string(i)}});
+		second.info("test", "second", {{"seq", to_string(i)}});
+	}
+
+	if (collector.drain() != 200 || collector.rings() != 2 ||
+	    read_log().size() != 200) {
+		console.error("test_same_name", "records lost",
+		    {{"rings", to_string(collector.rings())}});
+		return 0;
+	}
+
+	first.close();
+	second.close();
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_threads(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::ShmLogger		slog("shmlog_test_threads");
+	klog::ShmCollector	collector("shmlog_test_threads", LOG, false);
+	vector<thread>		workers;
+	size_t			total = 0;
+
+	for (int t = 0; t < 4; t++) {
+		workers.push_back(thread([&slog, t]() {
+			for (int i = 0; i < 2000; i++) {
+				slog.info("test", "threads",
+				    {{"thread", to_string(t)},
+				     {"seq", to_string(i)}});
+			}
+		}));
+	}
+
+	// Drain while the producers write.
+	while (total < 8000) {
+		total += collector.drain();
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	auto		records = read_log();
+	map<string, int>	next;
+
+	if (records.size() != 8000) {
+		console.error("test_threads", "records lost");
+		return 0;
+	}
+
+	for (auto& r : records) {
+		if (r.attrs["seq"] != to_string(next[r.attrs["thread"]]++)) {
+			console.error("test_threads", "records out of order");
+			return 0;
+		}
+	}
+
+	slog.close();
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_processes(void)
+{
+	vector<pid_t>	children;
+
+	::unlink(LOG.c_str());
+	for (int c = 0; c < 3; c++) {
+		pid_t	pid = ::fork();
+
+		if (0 == pid) {
+			klog::ShmLogger	slog("shmlog_test_procs");
+
+			for (int i = 0; i < 500; i++) {
+				slog.info("test", "processes",
+				    {{"child", to_string(c)}});
+			}
+			::_exit(0);
+		}
+		children.push_back(pid);
+	}
+
+	for (auto pid : children) {
+		::waitpid(pid, nullptr, 0);
+	}
+
+	// The children have exited without closing their rings; their
+	// records are collected all the same, into a text log.
+	klog::ShmCollector	collector("shmlog_test_procs", LOG, true);
+
+	if (collector.drain() != 1500 || collector.rings() != 0) {
+		console.error("test_processes", "records not collected");
+		return 0;
+	}
+
+	string	log = read_file(LOG);
+	size_t	lines = 0;
+
+	for (size_t at = log.find("[INFO] [actor:test event:processes] child=");
+	    at != string::npos;
+	    at = log.find("[INFO] [actor:test event:processes] child=",
+	    at + 1)) {
+		lines++;
+	}
+
+	if (lines != 1500) {
+		console.error("test_processes", "bad text log",
+		    {{"lines", to_string(lines)}});
+		return 0;
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+// reserve moves the ring's head past a slot the way a producer does,
+// and writes the slot's length if mark is set, without committing it.
+static void
+reserve(const string& segment, bool mark)
+{
+	int	fd = ::shm_open(segment.c_str(), O_RDWR, 0);
+	size_t	length = sizeof(klog::shm::RingHeader) + klog::shm::RING_SIZE;
+	void	*mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fd, 0);
+	auto	header = static_cast<klog::shm::RingHeader *>(mem);
+	char	*ring = static_cast<char *>(mem) + sizeof(*header);
+	auto	head = header->head.load();
+	auto	s = reinterpret_cast<klog::shm::Slot *>(ring +
+		    (head & (klog::shm::RING_SIZE - 1)));
+
+	header->head.store(head + klog::shm::slot_length(100));
+	if (mark) {
+		s->length = 100;
+		s->state.store(klog::shm::SLOT_RESERVED);
+	}
+
+	::munmap(mem, length);
+	::close(fd);
+}
+
+
+static int
+test_torn(void)
+{
+	string	segment;
+	pid_t	pid;
+
+	::unlink(LOG.c_str());
+	pid = ::fork();
+	if (0 == pid) {
+		klog::ShmLogger	slog("shmlog_test_torn");
+
+		// The producer dies with two records half written: one
+		// with its length, and one without.
+		for (int i = 0; i < 10; i++) {
+			slog.info("test", "torn", {{"seq", to_string(i)}});
+		}
+		reserve(slog.segment(), true);
+		for (int i = 10; i < 15; i++) {
+			slog.info("test", "torn", {{"seq", to_string(i)}});
+		}
+		reserve(slog.segment(), false);
+		::_exit(0);
+	}
+	::waitpid(pid, nullptr, 0);
+
+	klog::ShmCollector	collector("shmlog_test_torn", LOG, false);
+
+	segment = "/shmlog_test_torn." + to_string(pid);
+	if (collector.drain() != 15 || collector.torn() != 2 ||
+	    collector.rings() != 0 || segment_exists(segment)) {
+		console.error("test_torn", "torn records mishandled",
+		    {{"torn", to_string(collector.torn())}});
+		return 0;
+	}
+
+	auto	records = read_log();
+
+	for (int i = 0; i < 15; i++) {
+		if (records[i].attrs["seq"] != to_string(i)) {
+			console.error("test_torn", "bad record");
+			return 0;
+		}
+	}
+
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static int
+test_full(void)
+{
+	::unlink(LOG.c_str());
+
+	klog::ShmLogger		slog("shmlog_test_full", 4096);
+	klog::ShmCollector	collector("shmlog_test_full", LOG, false);
+
+	for (int i = 0; i < 200; i++) {
+		slog.info("test", "full", {{"seq", to_string(i)}});
+	}
+
+	uint64_t	dropped = slog.dropped()[klog::Level::INFO];
+	size_t		kept = collector.drain();
+
+	if (dropped == 0 || kept + dropped != 200) {
+		console.error("test_full", "drops not counted");
+		return 0;
+	}
+
+	// The collector reports the drops in the log.
+	auto	records = read_log();
+
+	if (records.size() != kept + 1 ||
+	    records.back().event != "dropped records" ||
+	    records.back().level != klog::Level::WARN ||
+	    records.back().attrs["dropped"] != to_string(dropped)) {
+		console.error("test_full", "drops not reported");
+		return 0;
+	}
+
+	// Once drained, the ring takes records again.
+	slog.info("test", "full", {{"seq", "200"}});
+	if (collector.drain() != 1) {
+		console.error("test_full", "ring not reused");
+		return 0;
+	}
+
+	slog.close();
+	::unlink(LOG.c_str());
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"single", test_single},
+	{"same name", test_same_name},
+	{"threads", test_threads},
+	{"processes", test_processes},
+	{"torn", test_torn},
+	{"full", test_full},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("shmlog_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("shmlog_test", "ok");
+}
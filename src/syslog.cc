@@ -21,6 +21,7 @@
  */
 
 
+
 #include <iostream>
 #include <syslog.h>
 #include <unistd.h>
@@ -33,9 +34,29 @@
 namespace klog {
 
 
+int
+syslog_priority(Level l)
+{
+	switch (l) {
+	case Level::DEBUG:
+		return LOG_DEBUG;
+	case Level::INFO:
+		return LOG_INFO;
+	case Level::WARN:
+		return LOG_WARNING;
+	case Level::ERROR:
+		return LOG_ERR;
+	case Level::CRITICAL:
+		return LOG_CRIT;
+	default:
+		return LOG_EMERG;
+	}
+}
+
+
 Syslogger::Syslogger(std::string name, syslog::Facility f,
 		     std::initializer_list<syslog::Option> opts)
-    : ident(name), err(LogError::HEALTHY), ilevel(DEFAULT_LEVEL)
+    : BasicLogger(), ident(name)
 {
 	int	options = 0;
 
@@ -43,218 +64,36 @@ Syslogger::Syslogger(std::string name, syslog::Facility f,
 		options |= static_cast<int>(opt);
 	}
 
-	::openlog(name.c_str(), options, static_cast<int>(f));
-}
-
-
-void
-Syslogger::debug(const std::string& actor,
-		     const std::string& event,
-		     std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-
-	std::string	out = log_to_string_nt(Level::DEBUG, actor, event, attrs);
-	::syslog(LOG_DEBUG, "%s", out.c_str());
-}
-
-
-void
-Syslogger::debug(const std::string& actor,
-		 const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::DEBUG);
-
-	std::string	out = log_to_string_nt(Level::DEBUG, actor, event, {});
-	::syslog(LOG_DEBUG, "%s", out.c_str());
-}
-
-
-void
-Syslogger::info(const std::string& actor,
-		const std::string& event,
-		std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-
-	std::string	out = log_to_string_nt(Level::INFO, actor, event, attrs);
-	::syslog(LOG_INFO, "%s", out.c_str());
-}
-
-
-void
-Syslogger::info(const std::string& actor,
-		const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::INFO);
-
-	std::string	out = log_to_string_nt(Level::INFO, actor, event, {});
-	::syslog(LOG_INFO, "%s", out.c_str());
-}
-
-
-void
-Syslogger::warn(const std::string& actor,
-		const std::string& event,
-		std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-
-	std::string	out = log_to_string_nt(Level::WARN, actor, event, attrs);
-	::syslog(LOG_WARNING, "%s", out.c_str());
-}
-
-
-void
-Syslogger::warn(const std::string& actor,
-		const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::WARN);
-
-	std::string	out = log_to_string_nt(Level::WARN, actor, event, {});
-	::syslog(LOG_WARNING, "%s", out.c_str());
-}
-
-
-void
-Syslogger::error(const std::string& actor,
-		 const std::string& event,
-		 std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-
-	std::string	out = log_to_string_nt(Level::ERROR, actor, event, attrs);
-	::syslog(LOG_ERR, "%s", out.c_str());
-}
-
-
-void
-Syslogger::error(const std::string& actor,
-		 const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::ERROR);
-
-	std::string	out = log_to_string_nt(Level::ERROR, actor, event, {});
-	::syslog(LOG_ERR, "%s", out.c_str());
-}
-
-
-void
-Syslogger::critical(const std::string& actor,
-		    const std::string& event,
-		    std::map<std::string, std::string> attrs) 
-{
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-
-	std::string	out = log_to_string_nt(Level::CRITICAL, actor, event, attrs);
-	::syslog(LOG_CRIT, "%s", out.c_str());
-}
-
-
-void
-Syslogger::critical(const std::string& actor,
-		    const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::CRITICAL);
-
-	std::string	out = log_to_string_nt(Level::CRITICAL, actor, event, {});
-	::syslog(LOG_CRIT, "%s", out.c_str());
-}
-
-
-void
-Syslogger::fatal(const std::string& actor,
-		 const std::string& event,
-		 std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, attrs);
-	::syslog(LOG_EMERG, "%s", out.c_str());
-	exit(EXIT_FAILURE);
-}
-
-
-void
-Syslogger::fatal(const std::string& actor,
-		 const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, {});
-	::syslog(LOG_EMERG, "%s", out.c_str());
-	exit(EXIT_FAILURE);
+	// openlog(3) keeps the pointer it is given, so it must point at
+	// storage that lives as long as the logger does.
+	::openlog(this->ident.c_str(), options, static_cast<int>(f));
 }
 
 
 void
-Syslogger::fatal(int exitcode,
+Syslogger::write(Level l, std::uint64_t,
 		 const std::string& actor,
 		 const std::string& event,
-		 std::map<std::string, std::string> attrs)
+		 const std::map<std::string, std::string>& attrs)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
+	std::string&	buf = thread_buffer();
 
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, attrs);
-	::syslog(LOG_EMERG, "%s", out.c_str());
-	exit(exitcode);
+	format_log_nt(buf, l, actor, event, attrs);
+	::syslog(syslog_priority(l), "%s", buf.c_str());
+	this->count_write(l, buf.size());
 }
 
 
 void
-Syslogger::fatal(int exitcode,
-		 const std::string& actor,
-		 const std::string& event)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, {});
-	::syslog(LOG_EMERG, "%s", out.c_str());
-	exit(exitcode);
-}
-
-
-void
-Syslogger::fatal_noexit(const std::string& actor,
-			const std::string& event,
-			std::map<std::string, std::string> attrs)
-{
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
-
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, attrs);
-	::syslog(LOG_EMERG, "%s", out.c_str());
-}
-
-
-void
-Syslogger::fatal_noexit(const std::string& actor,
-			const std::string& event)
+Syslogger::write_body(Level l, std::uint64_t, const Body& body)
 {
-	LEVEL_CHECK(this->ilevel, Level::FATAL);
+	std::string&	buf = thread_buffer();
 
-	std::string	out = log_to_string_nt(Level::FATAL, actor, event, {});
-	::syslog(LOG_EMERG, "%s", out.c_str());
-}
-
-
-void
-Syslogger::level(Level l)
-{
-	this->ilevel = l;
-}
-
-
-bool
-Syslogger::good()
-{
-	return this->err == LogError::HEALTHY;
-}
-
-
-LogError
-Syslogger::error()
-{
-	return this->err;
+	format_header_nt(buf, l);
+	body.text(buf);
+	buf += "\n";
+	::syslog(syslog_priority(l), "%s", buf.c_str());
+	this->count_write(l, buf.size());
 }
 
 
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <klogger/deferred.hh>
+#include <klogger/logger.hh>
+#include <klogger/tee.hh>
+#include <internal.hh>
+
+
+namespace klog {
+
+
+// CachedBody renders each encoding of the body it wraps the first time
+// it is asked for, and copies the rendering for every later sink.
+class CachedBody : public Body {
+public:
+	explicit CachedBody(const Body& b) :
+	    inner(b), text_cache(), tlv_cache(), have_text(false),
+	    have_tlv(false) {};
+
+	const std::string&
+	actor() const
+	{
+		return this->inner.actor();
+	}
+
+	const std::string&
+	event() const
+	{
+		return this->inner.event();
+	}
+
+	void
+	text(std::string& buf) const
+	{
+		if (!this->have_text) {
+			this->inner.text(this->text_cache);
+			this->have_text = true;
+		}
+		buf += this->text_cache;
+	}
+
+	void
+	tlv(std::string& buf) const
+	{
+		if (!this->have_tlv) {
+			this->inner.tlv(this->tlv_cache);
+			this->have_tlv = true;
+		}
+		buf += this->tlv_cache;
+	}
+
+	size_t
+	tlv_length() const
+	{
+		if (this->have_tlv) {
+			return this->tlv_cache.size();
+		}
+		return this->inner.tlv_length();
+	}
+
+	void
+	attrs(std::map<std::string, std::string>& out) const
+	{
+		this->inner.attrs(out);
+	}
+
+private:
+	const Body&		inner;
+	mutable std::string	text_cache;
+	mutable std::string	tlv_cache;
+	mutable bool		have_text;
+	mutable bool		have_tlv;
+
+	CachedBody(const CachedBody&) = delete;
+	CachedBody&	operator=(const CachedBody&) = delete;
+};
+
+
+TeeLogger::TeeLogger() : BasicLogger(), sinks()
+{
+}
+
+
+TeeLogger::~TeeLogger()
+{
+	this->close();
+}
+
+
+void
+TeeLogger::add(BasicLogger *sink, Level min)
+{
+	this->sinks.push_back(Sink{sink, sink, min, nullptr});
+}
+
+
+void
+TeeLogger::add_queued(BasicLogger *sink, Level min, OverflowPolicy policy)
+{
+	std::unique_ptr<DeferredLogger>	queue(new DeferredLogger(sink, policy));
+
+	this->sinks.push_back(Sink{queue.get(), sink, min, std::move(queue)});
+}
+
+
+void
+TeeLogger::add_queued(BasicLogger *sink, Level min)
+{
+	this->add_queued(sink, min, DEFAULT_OVERFLOW);
+}
+
+
+void
+TeeLogger::write(Level l, std::uint64_t when,
+		 const std::string& actor,
+		 const std::string& event,
+		 const std::map<std::string, std::string>& attrs)
+{
+	MapBody	body(actor, event, attrs);
+
+	this->write_body(l, when, body);
+}
+
+
+void
+TeeLogger::write_body(Level l, std::uint64_t when, const Body& body)
+{
+	CachedBody	cached(body);
+
+	for (auto& s : this->sinks) {
+		if (s.min > l ||
+		    !s.target->enabled(l, body.actor(), body.event())) {
+			continue;
+		}
+		s.logger->write_body(l, when, cached);
+	}
+}
+
+
+bool
+TeeLogger::good(void)
+{
+	return LogError::HEALTHY == this->error();
+}
+
+
+LogError
+TeeLogger::error(void)
+{
+	LogError	own = this->err.load();
+
+	if (LogError::HEALTHY != own) {
+		return own;
+	}
+
+	for (auto& s : this->sinks) {
+		LogError	e = s.logger->error();
+
+		if (LogError::HEALTHY != e) {
+			return e;
+		}
+	}
+
+	return LogError::HEALTHY;
+}
+
+
+void
+TeeLogger::flush(void)
+{
+	for (auto& s : this->sinks) {
+		if (s.queue) {
+			s.queue->flush();
+		}
+	}
+}
+
+
+int
+TeeLogger::close(void)
+{
+	for (auto& s : this->sinks) {
+		if (s.queue) {
+			s.queue->close();
+		}
+	}
+
+	this->err = LogError::ERR_CLOSED;
+	return 0;
+}
+
+
+} // namespace klog
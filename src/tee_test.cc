@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <klogger/console.hh>
+#include <klogger/record.hh>
+#include <klogger/tee.hh>
+#include <test_util.hh>
+
+using namespace std;
+
+
+klog::ConsoleLogger	console;
+
+
+// TextLogger keeps the text rendering of each body written to it.
+class TextLogger : public CaptureLogger {
+public:
+	TextLogger() : CaptureLogger(), texts() {};
+
+	void
+	write_body(klog::Level, std::uint64_t, const klog::Body& body)
+	{
+		string	text;
+
+		body.text(text);
+		this->texts.push_back(text);
+	}
+
+	vector<string>	texts;
+};
+
+
+// CountingBody counts how often its text is rendered.
+class CountingBody : public klog::Body {
+public:
+	CountingBody() : name("counted"), renders(0) {};
+
+	const string&	actor() const { return this->name; };
+	const string&	event() const { return this->name; };
+
+	void
+	text(string& buf) const
+	{
+		this->renders++;
+		buf += "[actor:counted event:counted]";
+	}
+
+	void	tlv(string&) const {};
+	size_t	tlv_length() const { return 0; };
+	void	attrs(map<string, string>&) const {};
+
+	string		name;
+	mutable int	renders;
+};
+
+
+static int
+test_levels(void)
+{
+	CaptureLogger	all, errors;
+	klog::TeeLogger	tee;
+
+	tee.add(&all, klog::Level::DEBUG);
+	tee.add(&errors, klog::Level::ERROR);
+	tee.level(klog::Level::DEBUG);
+	all.level(klog::Level::DEBUG);
+
+	// A sink's own overrides apply too.
+	all.level("noisy", klog::Level::CRITICAL);
+	errors.level("noisy", klog::Level::FATAL);
+
+	tee.debug("test", "debug");
+	tee.warn("test", "warn", {{"k", "v"}});
+	tee.error("test", "error");
+	tee.warn("noisy", "suppressed");
+	tee.error("noisy", "suppressed");
+
+	if (all.records.size() != 3 || errors.records.size() != 1) {
+		console.error("test_levels", "sink levels not honoured",
+		    {{"all", to_string(all.records.size())},
+		     {"errors", to_string(errors.records.size())}});
+		return 0;
+	}
+
+	if (all.records[1].attrs.at("k") != "v" ||
+	    errors.records[0].event != "error") {
+		console.error("test_levels", "record changed");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_render_once(void)
+{
+	TextLogger	a, b, c;
+	klog::TeeLogger	tee;
+	CountingBody	body;
+
+	tee.add(&a, klog::Level::DEBUG);
+	tee.add(&b, klog::Level::DEBUG);
+	tee.add(&c, klog::Level::DEBUG);
+	tee.write_body(klog::Level::INFO, klog::now(), body);
+
+	if (body.renders != 1) {
+		console.error("test_render_once", "body rendered per sink",
+		    {{"renders", to_string(body.renders)}});
+		return 0;
+	}
+
+	if (a.texts != b.texts || b.texts != c.texts || a.texts.size() != 1) {
+		console.error("test_render_once", "sinks saw different text");
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static int
+test_queued(void)
+{
+	CaptureLogger	direct, slow;
+	klog::TeeLogger	tee;
+
+	tee.add(&direct, klog::Level::DEBUG);
+	tee.add_queued(&slow, klog::Level::INFO);
+	tee.level(klog::Level::DEBUG);
+	direct.level(klog::Level::DEBUG);
+
+	for (int i = 0; i < 100; i++) {
+		tee.info("test", "queued", {{"seq", to_string(i)}});
+	}
+	tee.debug("test", "filtered");
+	tee.close();
+	tee.info("test", "late");
+
+	if (direct.records.size() != 102 || slow.records.size() != 101) {
+		console.error("test_queued", "records lost",
+		    {{"direct", to_string(direct.records.size())},
+		     {"slow", to_string(slow.records.size())}});
+		return 0;
+	}
+
+	for (int i = 0; i < 100; i++) {
+		if (slow.records[i].attrs["seq"] != to_string(i)) {
+			console.error("test_queued", "record out of order");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static map<string, function<int(void)>> tests = {
+	{"levels", test_levels},
+	{"render_once", test_render_once},
+	{"queued", test_queued},
+};
+
+
+int
+main(void)
+{
+	for (auto it = tests.begin(); it != tests.end(); it++) {
+		if (!it->second()) {
+			console.fatal("tee_test", "test fail",
+			    {{"test", it->first}});
+		}
+	}
+
+	console.info("tee_test", "ok");
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016 K. Isom <coder@kyleisom.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * copy of this  software and associated documentation  files (the "Software"),
+ * to deal  in the Software  without restriction, including  without limitation
+ * the rights  to use,  copy, modify,  merge, publish,  distribute, sublicense,
+ * and/or  sell copies  of the  Software,  and to  permit persons  to whom  the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS  PROVIDED "AS IS", WITHOUT WARRANTY OF  ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING  BUT NOT  LIMITED TO  THE WARRANTIES  OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS  OR COPYRIGHT  HOLDERS BE  LIABLE FOR  ANY CLAIM,  DAMAGES OR  OTHER
+ * LIABILITY,  WHETHER IN  AN ACTION  OF CONTRACT,  TORT OR  OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef __KLOGGER_TEST_UTIL_HH__
+#define __KLOGGER_TEST_UTIL_HH__
+
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <klogger/logger.hh>
+#include <klogger/record.hh>
+
+
+// CaptureLogger keeps every record written to it through the generic
+// path; tests may subclass it to capture bodies too. Records are
+// only safe to read once writers have stopped.
+class CaptureLogger : public klog::BasicLogger {
+public:
+	CaptureLogger() : klog::BasicLogger(), lock(), records() {};
+
+	void
+	write(klog::Level l, std::uint64_t when, const std::string& actor,
+	      const std::string& event,
+	      const std::map<std::string, std::string>& attrs)
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+
+		this->records.push_back(klog::Record{l, when, actor, event,
+		    attrs});
+	}
+
+	int	close(void) { return 0; };
+
+	// count returns the number of records with the given event.
+	size_t
+	count(const std::string& event)
+	{
+		std::lock_guard<std::mutex>	guard(this->lock);
+		size_t				n = 0;
+
+		for (auto& r : this->records) {
+			if (r.event == event) {
+				n++;
+			}
+		}
+		return n;
+	}
+
+	std::mutex			lock;
+	std::vector<klog::Record>	records;
+};
+
+
+// eventually waits up to two seconds for cond to hold, for loggers
+// that do their work on a background thread.
+static inline bool
+eventually(std::function<bool(void)> cond)
+{
+	for (int i = 0; i < 200 && !cond(); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return cond();
+}
+
+
+#endif // #ifndef __KLOGGER_TEST_UTIL_HH__
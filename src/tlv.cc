@@ -28,7 +28,10 @@
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <vector>
 
+#include <klogger/record.hh>
 #include <klogger/tlv.hh>
 
 
@@ -232,26 +235,34 @@ write_header(std::ostream& outs, std::uint8_t tag, std::uint64_t length)
 
 
 static inline size_t
-string_record_length(std::string s)
+string_record_length(const std::string& s)
 {
 	size_t	slen = s.size();
 	size_t	length;
 
+	// Long lengths are a count byte followed by the length octets.
 	length = sizeof(TString);
 	length += length_octets(slen);
+	if (slen > 0x7F) {
+		length++;
+	}
 	length += slen;
 	return length;
 }
 
 
+size_t
+string_length(const std::string& s)
+{
+	return string_record_length(s);
+}
+
+
 static inline size_t
-log_length(std::string actor, std::string event,
-	   std::map<std::string, std::string> attrs)
+log_length(const std::string& actor, const std::string& event,
+	   const std::map<std::string, std::string>& attrs)
 {
-	// Timestamp record is 1 byte tag + 1 byte length + 8 byte
-	// value (10 bytes total); level record is 1 byte tag +
-	// 1 byte length + 1 byte value (3 bytes).
-	size_t	length = 13;
+	size_t	length = TIMESTAMP_LENGTH + LEVEL_LENGTH;
 
 	length += string_record_length(actor);
 	length += string_record_length(event);
@@ -303,5 +314,542 @@ write_tlv_log(std::ostream& outs, std::uint8_t lvl,
 }
 
 
+void
+append_length(std::string& buf, size_t length)
+{
+	if (length <= 0x7F) {
+		buf.push_back(static_cast<char>(length));
+		return;
+	}
+
+	size_t	loct = length_octets(length);
+
+	buf.push_back(static_cast<char>(0x80 + loct));
+	for (size_t i = loct; i > 0; i--) {
+		buf.push_back(static_cast<char>((length >> ((i - 1) * 8)) & 0xFF));
+	}
+}
+
+
+void
+append_header(std::string& buf, std::uint8_t tag, std::uint64_t length)
+{
+	buf.push_back(static_cast<char>(tag));
+	append_length(buf, length);
+}
+
+
+void
+append_timestamp(std::string& buf, std::uint64_t t)
+{
+	append_header(buf, TTimestamp, sizeof(t));
+	for (size_t i = sizeof(t); i > 0; i--) {
+		buf.push_back(static_cast<char>((t >> ((i - 1) * 8)) & 0xFF));
+	}
+}
+
+
+void
+append_loglevel(std::string& buf, std::uint8_t lvl)
+{
+	append_header(buf, TLevel, sizeof(lvl));
+	buf.push_back(static_cast<char>(lvl));
+}
+
+
+void
+append_string(std::string& buf, const std::string& s)
+{
+	append_header(buf, TString, s.size());
+	buf.append(s);
+}
+
+
+void
+append_tlv_log(std::string& buf, std::uint8_t lvl, std::uint64_t t,
+	       const std::string& actor, const std::string& event,
+	       const std::map<std::string, std::string>& attrs)
+{
+	append_header(buf, TLogEntry, log_length(actor, event, attrs));
+	append_timestamp(buf, t);
+	append_loglevel(buf, lvl);
+	append_string(buf, actor);
+	append_string(buf, event);
+
+	for (auto it = attrs.begin(); it != attrs.end(); it++) {
+		append_string(buf, it->first);
+		append_string(buf, it->second);
+	}
+}
+
+
+std::uint8_t
+level_value(Level l)
+{
+	return static_cast<std::uint8_t>(
+	    static_cast<std::underlying_type<Level>::type>(l));
+}
+
+
+// The binary format records the timestamp in seconds.
+std::uint64_t
+seconds(std::uint64_t when)
+{
+	return when / 1000000000;
+}
+
+
+void
+append_entry(std::string& buf, Level l, std::uint64_t when,
+	     const std::string& actor, const std::string& event,
+	     const std::map<std::string, std::string>& attrs)
+{
+	append_tlv_log(buf, level_value(l), seconds(when), actor, event,
+	    attrs);
+}
+
+
+void
+append_entry(std::string& buf, Level l, std::uint64_t when, const Body& body)
+{
+	// The body follows the timestamp and level records.
+	append_header(buf, TLogEntry,
+	    TIMESTAMP_LENGTH + LEVEL_LENGTH + body.tlv_length());
+	append_timestamp(buf, seconds(when));
+	append_loglevel(buf, level_value(l));
+	body.tlv(buf);
+}
+
+
+// append_sequence appends a bare 8-byte big-endian sequence number.
+static void
+append_sequence(std::string& buf, std::uint64_t seq)
+{
+	for (size_t i = SEQUENCE_LENGTH; i > 0; i--) {
+		buf.push_back(static_cast<char>((seq >> ((i - 1) * 8)) & 0xFF));
+	}
+}
+
+
+void
+append_batch_header(std::string& buf, std::uint64_t seq, size_t length)
+{
+	append_header(buf, TBatch, SEQUENCE_LENGTH + length);
+	append_sequence(buf, seq);
+}
+
+
+void
+append_ack(std::string& buf, std::uint64_t seq)
+{
+	append_header(buf, TAck, SEQUENCE_LENGTH);
+	append_sequence(buf, seq);
+}
+
+
+bool
+read_length(const std::string& buf, size_t& off, std::uint64_t& length)
+{
+	if (off >= buf.size()) {
+		return false;
+	}
+
+	std::uint8_t	b = static_cast<std::uint8_t>(buf[off]);
+
+	if (b <= 0x7F) {
+		length = b;
+		off++;
+		return true;
+	}
+
+	size_t	loct = b & 0x7F;
+
+	if (loct == 0 || loct > sizeof(length) || buf.size() - off - 1 < loct) {
+		return false;
+	}
+
+	length = 0;
+	for (size_t i = 1; i <= loct; i++) {
+		length = (length << 8) +
+		    static_cast<std::uint8_t>(buf[off + i]);
+	}
+	off += 1 + loct;
+	return true;
+}
+
+
+bool
+read_header(const std::string& buf, size_t& off, std::uint8_t& tag,
+	    std::uint64_t& length)
+{
+	size_t	pos = off;
+
+	if (pos >= buf.size()) {
+		return false;
+	}
+
+	tag = static_cast<std::uint8_t>(buf[pos++]);
+	if (!read_length(buf, pos, length)) {
+		return false;
+	}
+
+	if (length > buf.size() - pos) {
+		return false;
+	}
+
+	off = pos;
+	return true;
+}
+
+
+// read_value reads the header of a record that must have the given tag
+// and length.
+static bool
+read_value(const std::string& buf, size_t& off, std::uint8_t want,
+	   std::uint64_t want_length)
+{
+	std::uint8_t	tag;
+	std::uint64_t	length;
+
+	if (!read_header(buf, off, tag, length)) {
+		return false;
+	}
+	return tag == want && length == want_length;
+}
+
+
+bool
+read_timestamp(const std::string& buf, size_t& off, std::uint64_t& t)
+{
+	size_t	pos = off;
+
+	if (!read_value(buf, pos, TTimestamp, sizeof(t))) {
+		return false;
+	}
+
+	t = 0;
+	for (size_t i = 0; i < sizeof(t); i++) {
+		t = (t << 8) + static_cast<std::uint8_t>(buf[pos + i]);
+	}
+	off = pos + sizeof(t);
+	return true;
+}
+
+
+bool
+read_loglevel(const std::string& buf, size_t& off, std::uint8_t& lvl)
+{
+	size_t	pos = off;
+
+	if (!read_value(buf, pos, TLevel, sizeof(lvl))) {
+		return false;
+	}
+
+	lvl = static_cast<std::uint8_t>(buf[pos]);
+	off = pos + sizeof(lvl);
+	return true;
+}
+
+
+bool
+read_string(const std::string& buf, size_t& off, std::string& s)
+{
+	size_t		pos = off;
+	std::uint8_t	tag;
+	std::uint64_t	length;
+
+	if (!read_header(buf, pos, tag, length) || tag != TString) {
+		return false;
+	}
+
+	s.assign(buf, pos, length);
+	off = pos + length;
+	return true;
+}
+
+
+static std::uint64_t
+read_sequence(const std::string& buf, size_t off)
+{
+	std::uint64_t	seq = 0;
+
+	for (size_t i = 0; i < SEQUENCE_LENGTH; i++) {
+		seq = (seq << 8) + static_cast<std::uint8_t>(buf[off + i]);
+	}
+	return seq;
+}
+
+
+bool
+read_batch(const std::string& buf, size_t& off, std::uint64_t& seq,
+	   size_t& length)
+{
+	size_t		pos = off;
+	std::uint8_t	tag;
+	std::uint64_t	value_length;
+
+	if (!read_header(buf, pos, tag, value_length) || tag != TBatch ||
+	    value_length < SEQUENCE_LENGTH) {
+		return false;
+	}
+
+	seq = read_sequence(buf, pos);
+	length = static_cast<size_t>(value_length - SEQUENCE_LENGTH);
+	off = pos + SEQUENCE_LENGTH;
+	return true;
+}
+
+
+bool
+read_ack(const std::string& buf, size_t& off, std::uint64_t& seq)
+{
+	size_t	pos = off;
+
+	if (!read_value(buf, pos, TAck, SEQUENCE_LENGTH)) {
+		return false;
+	}
+
+	seq = read_sequence(buf, pos);
+	off = pos + SEQUENCE_LENGTH;
+	return true;
+}
+
+
+// read_raw copies n bytes in native byte order from buf at off, which
+// must leave them before end.
+static bool
+read_raw(const std::string& buf, size_t& off, size_t end, void *p, size_t n)
+{
+	if (end - off < n) {
+		return false;
+	}
+
+	::memcpy(p, buf.data() + off, n);
+	off += n;
+	return true;
+}
+
+
+bool
+Decoder::decode_entry(const std::string& buf, size_t& off, size_t end,
+		      Record& r)
+{
+	std::uint64_t	t;
+	std::uint8_t	lvl;
+
+	if (!read_timestamp(buf, off, t) || !read_loglevel(buf, off, lvl)) {
+		return false;
+	}
+
+	r.when = t * 1000000000;
+	r.level = static_cast<Level>(lvl);
+	if (!read_string(buf, off, r.actor) ||
+	    !read_string(buf, off, r.event)) {
+		return false;
+	}
+
+	while (off < end) {
+		std::string	k, v;
+
+		if (!read_string(buf, off, k) || !read_string(buf, off, v)) {
+			return false;
+		}
+		r.attrs[k] = v;
+	}
+
+	return true;
+}
+
+
+bool
+Decoder::decode_site(const std::string& buf, size_t& off, size_t end)
+{
+	std::uint32_t	id;
+	std::uint8_t	lvl;
+	Site		site{Level::DEBUG, "", "", "", {}};
+
+	if (!read_raw(buf, off, end, &id, sizeof(id)) ||
+	    !read_loglevel(buf, off, lvl)) {
+		return false;
+	}
+
+	site.level = static_cast<Level>(lvl);
+	if (!read_string(buf, off, site.actor) ||
+	    !read_string(buf, off, site.event) ||
+	    !read_string(buf, off, site.types)) {
+		return false;
+	}
+
+	while (off < end) {
+		std::string	k;
+
+		if (!read_string(buf, off, k)) {
+			return false;
+		}
+		site.keys.push_back(k);
+	}
+
+	if (site.keys.size() != site.types.size()) {
+		return false;
+	}
+
+	this->sites.erase(id);
+	this->sites.insert({id, site});
+	return true;
+}
+
+
+bool
+Decoder::decode_site_entry(const std::string& buf, size_t& off, size_t end,
+			   Record& r, std::uint64_t& counter)
+{
+	std::uint32_t	id;
+
+	if (!read_raw(buf, off, end, &id, sizeof(id)) ||
+	    !read_raw(buf, off, end, &counter, sizeof(counter))) {
+		return false;
+	}
+
+	auto	it = this->sites.find(id);
+
+	if (it == this->sites.end()) {
+		return false;
+	}
+
+	const Site&	site = it->second;
+
+	r.level = site.level;
+	r.actor = site.actor;
+	r.event = site.event;
+	for (size_t i = 0; i < site.types.size(); i++) {
+		std::int64_t	iv;
+		std::uint64_t	uv;
+		double		fv;
+		std::uint32_t	n;
+		std::string	value;
+
+		switch (site.types[i]) {
+		case 'i':
+			if (!read_raw(buf, off, end, &iv, sizeof(iv))) {
+				return false;
+			}
+			value = std::to_string(iv);
+			break;
+		case 'u':
+			if (!read_raw(buf, off, end, &uv, sizeof(uv))) {
+				return false;
+			}
+			value = std::to_string(uv);
+			break;
+		case 'f':
+			if (!read_raw(buf, off, end, &fv, sizeof(fv))) {
+				return false;
+			}
+			value = std::to_string(fv);
+			break;
+		case 's':
+			if (!read_raw(buf, off, end, &n, sizeof(n)) ||
+			    end - off < n) {
+				return false;
+			}
+			value.assign(buf, off, n);
+			off += n;
+			break;
+		default:
+			return false;
+		}
+		r.attrs[site.keys[i]] = value;
+	}
+
+	return true;
+}
+
+
+// wall_time converts a cycle counter to nanoseconds since the epoch by
+// interpolating between the first and last clock anchors. With only one
+// anchor, the counter is taken to count nanoseconds.
+std::uint64_t
+Decoder::wall_time(std::uint64_t counter) const
+{
+	if (this->anchors.empty()) {
+		return counter;
+	}
+
+	auto&	first = this->anchors.front();
+	auto&	last = this->anchors.back();
+	double	delta = static_cast<double>(
+			    static_cast<std::int64_t>(counter - first.first));
+
+	if (last.first != first.first) {
+		delta *= static_cast<double>(last.second - first.second) /
+		    static_cast<double>(last.first - first.first);
+	}
+
+	return first.second + static_cast<std::int64_t>(delta);
+}
+
+
+bool
+Decoder::decode(const std::string& buf, std::vector<Record>& out)
+{
+	std::vector<std::pair<size_t, std::uint64_t>>	pending;
+	size_t						off = 0;
+	bool						ok = true;
+
+	while (ok && off < buf.size()) {
+		std::uint8_t	tag;
+		std::uint64_t	length;
+		std::uint64_t	counter = 0;
+		std::uint64_t	ns = 0;
+		Record		r{Level::DEBUG, 0, "", "", {}};
+
+		if (!read_header(buf, off, tag, length)) {
+			ok = false;
+			break;
+		}
+
+		size_t	end = off + length;
+
+		switch (tag) {
+		case TLogEntry:
+			ok = this->decode_entry(buf, off, end, r);
+			if (ok) {
+				out.push_back(r);
+			}
+			break;
+		case TSite:
+			ok = this->decode_site(buf, off, end);
+			break;
+		case TSiteEntry:
+			ok = this->decode_site_entry(buf, off, end, r, counter);
+			if (ok) {
+				pending.push_back({out.size(), counter});
+				out.push_back(r);
+			}
+			break;
+		case TClock:
+			ok = read_raw(buf, off, end, &counter, sizeof(counter)) &&
+			     read_raw(buf, off, end, &ns, sizeof(ns));
+			if (ok) {
+				this->anchors.push_back({counter, ns});
+			}
+			break;
+		default:
+			off = end;
+		}
+
+		ok = ok && off == end;
+	}
+
+	// Site entries precede the anchor written when their buffer is
+	// flushed, so they're timestamped once the whole buffer is read.
+	for (auto& p : pending) {
+		out[p.first].when = this->wall_time(p.second);
+	}
+
+	return ok;
+}
+
+
 } // namespace tlv
 } // namespace klog
@@ -283,7 +283,105 @@ test_write_string(void)
 	return fails == 0;
 }
 
+// The buffer encoders must produce the same bytes as the stream
+// encoders.
+static int
+test_append(void)
+{
+	int	fails = 0;
+
+	for (auto t : length_tests) {
+		string	buf;
+
+		klog::tlv::append_length(buf, t.length);
+		if (!compare_strings(t.expect, buf)) {
+			console.error("test_append", "length output failure",
+			    {{"length", to_string(t.length)},
+			     {"expected", klog::tlv::hex_encode(t.expect)},
+			     {"actual", klog::tlv::hex_encode(buf)}});
+			fails++;
+		}
+	}
+
+	for (auto t : string_tests) {
+		string	buf;
+
+		klog::tlv::append_string(buf, t.s);
+		if (klog::tlv::hex_encode(buf) != t.e) {
+			console.error("test_append", "string output failure",
+			    {{"string", t.s},
+			     {"expected", t.e},
+			     {"actual", klog::tlv::hex_encode(buf)}});
+			fails++;
+		}
+	}
+
+	string	buf;
+
+	klog::tlv::append_timestamp(buf, 1458304571);
+	klog::tlv::append_loglevel(buf, 0x1);
+	if (klog::tlv::hex_encode(buf) != "02080000000056EBF63B040101") {
+		console.error("test_append", "timestamp/level output failure",
+		    {{"actual", klog::tlv::hex_encode(buf)}});
+		fails++;
+	}
+
+	return fails == 0;
+}
+
+
+// test_read checks that a log entry reads back as it was appended,
+// including attributes long enough to need multi-octet lengths.
+static int
+test_read(void)
+{
+	map<string, string>	attrs = {{"short", "v"},
+					 {"long", string(300, 'a')}};
+	vector<klog::Record>	records;
+	klog::tlv::Decoder	decoder;
+	string			buf;
+
+	for (auto t : length_tests) {
+		string		encoded(t.expect);
+		size_t		off = 0;
+		uint64_t	length;
+
+		if (!klog::tlv::read_length(encoded, off, length) ||
+		    length != t.length || off != encoded.size()) {
+			console.error("test_read", "length read failure",
+			    {{"length", to_string(t.length)}});
+			return 0;
+		}
+	}
+
+	klog::tlv::append_tlv_log(buf, 0x4, 1458304571, "actor", "event",
+	    attrs);
+	if (!decoder.decode(buf, records) || records.size() != 1) {
+		console.error("test_read", "entry failed to decode");
+		return 0;
+	}
+
+	auto&	r = records[0];
+
+	if (r.level != klog::Level::WARN || r.when != 1458304571000000000 ||
+	    r.actor != "actor" || r.event != "event" || r.attrs != attrs) {
+		console.error("test_read", "entry changed in decoding");
+		return 0;
+	}
+
+	buf.resize(buf.size() - 1);
+	if (decoder.decode(buf, records)) {
+		console.error("test_read", "truncated entry decoded");
+		return 0;
+	}
+
+	return 1;
+}
+
+
 static map<string, std::function<int(void)>> tests = {
+	{"append", test_append},
+	{"read", test_read},
 	{"hex_encode", test_hex_encode},
 	{"write_length", test_write_length},
 	{"write_timestamp", test_write_timestamp},
@@ -298,7 +396,7 @@ main(void)
 	// console.level(klog::Level::DEBUG);
 	for (auto it = tests.begin(); it != tests.end(); it++) {
 		console.info("tlv_test", "test run", {{"test", 	it->first}});
-		if (-1 == tests[it->first]()) {
+		if (!tests[it->first]()) {
 			console.fatal("tlv_test", "test fail",
 			    {{"test", it->first}});
 		}